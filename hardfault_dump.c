@@ -4,90 +4,57 @@
 #include <inttypes.h>
 #include <stddef.h>
 
-#include "stm32g4xx.h"   /* Pulls in CMSIS core headers on STM32G4 */
+/* CMSIS device header of your part; it also selects the core layer. */
+#ifndef HF_DEVICE_HEADER
+#define HF_DEVICE_HEADER "stm32g4xx.h"
+#endif
+#include HF_DEVICE_HEADER
+
+#include "hf_arch.h"
+
+/* Which mailbox slot this image writes its own dumps into. */
+#ifndef HF_IMAGE_ID
+#define HF_IMAGE_ID HF_IMAGE_APPLICATION
+#endif
 
 /*
- * Optional FreeRTOS support.
- *
- * Define HF_ENABLE_FREERTOS_SUPPORT in your build if this image uses FreeRTOS.
- * At runtime we still detect whether the scheduler is running before trying
- * to query task info, so this code is safe to use in early-boot faults too.
+ * Optional RTOS support, selected at compile time with HF_RTOS (see
+ * hf_rtos.h). The adapter still checks that the scheduler is running before
+ * touching thread data, so early-boot faults are safe too.
  */
-#ifdef HF_ENABLE_FREERTOS_SUPPORT
-  #include "FreeRTOS.h"
-  #include "task.h"
+#include "hf_rtos.h"
 
-  /* Weak refs: if FreeRTOS isn't linked in this image, these will be NULL. */
-  extern BaseType_t xTaskGetSchedulerState(void) __attribute__((weak));
-  extern void vTaskGetInfo(TaskHandle_t, TaskStatus_t *, BaseType_t, eTaskState)
-      __attribute__((weak));
+/* Upper bound on stacked bytes copied into the dump (slot size permitting). */
+#ifndef HF_MAX_STACK_COPY
+#define HF_MAX_STACK_COPY 2048u
 #endif
 
 #ifndef MIN
 #define MIN(a,b) (( (a) < (b) ) ? (a) : (b))
 #endif
 
-/* ========= Persistent buffer in .noinit (NOT cleared on reset) ========= */
-/* Add .noinit section in linker script (see README).                      */
-__attribute__((section(".noinit")))
-static uint8_t s_hf_dump_area[8 * 1024];   /* tune size as needed */
+/* ============ Persistent dump mailbox (NOT cleared on reset) ============ */
+/*
+ * The area lives at a fixed address shared by bootloader and application
+ * (see hf_abi.h). Base and size both come from hardfault_dump.ld, which
+ * also checks them at link time; slot size and payload cap follow.
+ */
+extern uint8_t __hf_dump_start[];
+extern uint8_t __hf_dump_end[];
 
-/* ------------ FreeRTOS task name length abstraction ------------ */
-#ifdef HF_ENABLE_FREERTOS_SUPPORT
-  #ifndef configMAX_TASK_NAME_LEN
-    #error "configMAX_TASK_NAME_LEN must be defined when HF_ENABLE_FREERTOS_SUPPORT is enabled"
-  #endif
-  #define HF_MAX_TASK_NAME_LEN (configMAX_TASK_NAME_LEN)
-#else
-  #define HF_MAX_TASK_NAME_LEN (16U)
-#endif
-
-#define HF_MAGIC   0x48464450u   /* 'HFDP' */
-#define HF_VERSION 0x0003u
-
-/* Dump header (everything about the fault context + optional FreeRTOS task) */
-typedef struct __attribute__((__packed__)) {
-    uint32_t magic;
-    uint16_t version;
-    uint16_t header_len;
-
-    uint32_t exc_return;
-    uint32_t msp;
-    uint32_t psp;
-    uint32_t active_sp;   /* pointer to the stacked frame */
-    uint32_t used_sp;     /* 0 = MSP, 1 = PSP */
-    uint32_t has_fp;      /* 0/1 whether FP context was stacked */
-
-    /* SCB fault info */
-    uint32_t scb_cfsr;
-    uint32_t scb_hfsr;
-    uint32_t scb_dfsr;
-    uint32_t scb_mmfar;
-    uint32_t scb_bfar;
-    uint32_t scb_afsr;
-    uint32_t shcsr;
-
-    /* Core regs from stacked frame */
-    uint32_t r0;
-    uint32_t r1;
-    uint32_t r2;
-    uint32_t r3;
-    uint32_t r12;
-    uint32_t lr;
-    uint32_t pc;
-    uint32_t psr;
-
-    /* FreeRTOS info about the faulted task (if scheduler started) */
-    uint32_t rtos_present;                /* 0/1 */
-    uint32_t rtos_task_priority;          /* uxCurrentPriority */
-    uint32_t rtos_stack_high_water_bytes; /* minimum free stack during life */
-    uint32_t rtos_stack_base;             /* pxStackBase */
-    char     rtos_task_name[HF_MAX_TASK_NAME_LEN + 1];
-
-    /* Payload (stack dump) */
-    uint32_t stack_bytes;  /* number of bytes after this header */
-    uint32_t checksum;     /* XOR of header(with checksum=0) + payload */
-} hf_dump_hdr_t;
+#define HF_DUMP_AREA_SIZE ((uint32_t)(__hf_dump_end - __hf_dump_start))
+
+#define HF_SLOT_SIZE HF_MBOX_SLOT_SIZE(HF_DUMP_AREA_SIZE)
+
+static hf_mbox_hdr_t *hf_mbox(void)
+{
+    return (hf_mbox_hdr_t *)__hf_dump_start;
+}
+
+static uint8_t *hf_slot(uint8_t id)
+{
+    return &__hf_dump_start[sizeof(hf_mbox_hdr_t) + (uint32_t)id * HF_SLOT_SIZE];
+}
 
 /* ================== Local helpers for dump memory ================== */
 
@@ -97,25 +64,27 @@ static void hf_memclear(void *p, uint32_t len)
     memset(p, 0xFF, len);
 }
 
-static void hf_memwrite(uint32_t off, const void *data, uint32_t len)
+static void hf_memwrite(uint8_t id, uint32_t off, const void *data, uint32_t len)
 {
-    if (off >= sizeof(s_hf_dump_area)) return;
-    if (off + len > sizeof(s_hf_dump_area)) {
-        len = (uint32_t)sizeof(s_hf_dump_area) - off;
+    if (off >= HF_SLOT_SIZE) return;
+    if (off + len > HF_SLOT_SIZE) {
+        len = HF_SLOT_SIZE - off;
     }
-    memcpy(&s_hf_dump_area[off], data, len);
+    memcpy(&hf_slot(id)[off], data, len);
 }
 
-static void hf_memread(uint32_t off, void *data, uint32_t len)
+static void hf_memread(uint8_t id, uint32_t off, void *data, uint32_t len)
 {
-    if (off >= sizeof(s_hf_dump_area)) {
+    if (off >= HF_SLOT_SIZE) {
         memset(data, 0xFF, len);
         return;
     }
-    if (off + len > sizeof(s_hf_dump_area)) {
-        len = (uint32_t)sizeof(s_hf_dump_area) - off;
+    if (off + len > HF_SLOT_SIZE) {
+        memset((uint8_t *)data + (HF_SLOT_SIZE - off), 0xFF,
+               len - (HF_SLOT_SIZE - off));
+        len = HF_SLOT_SIZE - off;
     }
-    memcpy(data, &s_hf_dump_area[off], len);
+    memcpy(data, &hf_slot(id)[off], len);
 }
 
 static uint32_t hf_xor(const void *p, uint32_t len)
@@ -128,56 +97,425 @@ static uint32_t hf_xor(const void *p, uint32_t len)
     return x;
 }
 
+static bool hf_mbox_valid(void)
+{
+    const hf_mbox_hdr_t *m = hf_mbox();
+
+    return m->magic       == HF_MBOX_MAGIC &&
+           m->abi_version == HF_MBOX_ABI_VERSION &&
+           m->hdr_len     == sizeof(hf_mbox_hdr_t) &&
+           m->area_size   == HF_DUMP_AREA_SIZE &&
+           m->slot_size   == HF_SLOT_SIZE &&
+           m->slot_count  == HF_MBOX_SLOTS;
+}
+
+/* Wipe all slots and write a fresh mailbox header. */
+static void hf_mbox_format(void)
+{
+    hf_mbox_hdr_t *m = hf_mbox();
+
+    hf_memclear(__hf_dump_start, HF_DUMP_AREA_SIZE);
+    memset(m, 0, sizeof(*m));
+    m->magic       = HF_MBOX_MAGIC;
+    m->abi_version = HF_MBOX_ABI_VERSION;
+    m->hdr_len     = sizeof(hf_mbox_hdr_t);
+    m->area_size   = HF_DUMP_AREA_SIZE;
+    m->slot_size   = HF_SLOT_SIZE;
+    m->slot_count  = HF_MBOX_SLOTS;
+}
+
+/*
+ * Read a dump header written by any library version >= HF_VERSION_MIN.
+ * Fields this build doesn't know are dropped, fields the writer didn't know
+ * read as zero. Returns false unless the header and payload check out.
+ */
+static bool hf_read_header(uint8_t id, hf_dump_hdr_t *h)
+{
+    if (id >= HF_MBOX_SLOTS || !hf_mbox_valid()) return false;
+
+    memset(h, 0, sizeof(*h));
+    hf_memread(id, 0, h, HF_DUMP_HDR_MIN_LEN);
+
+    if (h->magic != HF_MAGIC)                            return false;
+    if (h->version < HF_VERSION_MIN)                     return false;
+    if (h->header_len < HF_DUMP_HDR_MIN_LEN)             return false;
+    if (h->header_len > HF_SLOT_SIZE)                    return false;
+    if (h->stack_bytes > HF_SLOT_SIZE - h->header_len)   return false;
+
+    const uint8_t *raw = hf_slot(id);
+    const uint32_t saved = h->checksum;
+
+    /* XOR over the raw header with the checksum field taken out again. */
+    uint32_t computed = hf_xor(raw, h->header_len)
+                      ^ hf_xor(&raw[offsetof(hf_dump_hdr_t, checksum)],
+                               sizeof(h->checksum))
+                      ^ hf_xor(&raw[h->header_len], h->stack_bytes);
+    if (saved != computed)                               return false;
+
+    hf_memread(id, 0, h, MIN((uint32_t)h->header_len,
+                             (uint32_t)sizeof(hf_dump_hdr_t)));
+
+    /* Extension records (v6+) are checked on their own: if they are bad,
+     * only they are dropped. Older headers read ext_bytes as 0. */
+    const uint32_t ext_at = (uint32_t)h->header_len + h->stack_bytes;
+    if (h->ext_bytes > HF_SLOT_SIZE - ext_at ||
+        hf_xor(&raw[ext_at], h->ext_bytes) != h->ext_checksum) {
+        h->ext_bytes = 0;
+    }
+    return true;
+}
+
 /* ====================== Public dump helpers ====================== */
 
-bool HardFault_DumpAvailable(void)
+bool HardFault_DumpAvailableId(uint8_t id)
 {
     hf_dump_hdr_t h;
-    hf_memread(0, &h, sizeof(h));
+    return hf_read_header(id, &h);
+}
 
-    if (h.magic != HF_MAGIC)                             return false;
-    if (h.version != HF_VERSION)                         return false;
-    if (h.header_len != sizeof(hf_dump_hdr_t))           return false;
-    if (h.stack_bytes > sizeof(s_hf_dump_area) - sizeof(hf_dump_hdr_t))
-        return false;
+bool HardFault_DumpAvailable(void)
+{
+    return HardFault_DumpAvailableId(HF_IMAGE_ID);
+}
+
+void HardFault_ClearDumpId(uint8_t id)
+{
+    if (id >= HF_MBOX_SLOTS) return;
 
-    uint32_t saved = h.checksum;
-    h.checksum = 0;
-    uint32_t computed = hf_xor(&h, sizeof(h))
-                      ^ hf_xor(&s_hf_dump_area[sizeof(h)],
-                               h.stack_bytes);
-    return (saved == computed);
+    if (!hf_mbox_valid()) {
+        hf_mbox_format();
+        return;
+    }
+    hf_memclear(hf_slot(id), HF_SLOT_SIZE);
 }
 
 void HardFault_ClearDump(void)
 {
-    hf_memclear(s_hf_dump_area, (uint32_t)sizeof(s_hf_dump_area));
+    HardFault_ClearDumpId(HF_IMAGE_ID);
+}
+
+uint32_t HardFault_DumpSize(uint8_t id)
+{
+    hf_dump_hdr_t h;
+
+    if (!hf_read_header(id, &h)) {
+        return 0;
+    }
+    return (uint32_t)h.header_len + h.stack_bytes + h.ext_bytes;
+}
+
+uint32_t HardFault_ReadDump(uint8_t id, uint32_t off, void *buf, uint32_t len)
+{
+    const uint32_t size = HardFault_DumpSize(id);
+
+    if (off >= size) {
+        return 0;
+    }
+    len = MIN(len, size - off);
+    hf_memread(id, off, buf, len);
+    return len;
+}
+
+const uint8_t *HardFault_DumpData(uint8_t id, uint32_t *size)
+{
+    *size = HardFault_DumpSize(id);
+    return (*size != 0u) ? hf_slot(id) : NULL;
+}
+
+uint32_t HardFault_DumpCount(uint8_t id)
+{
+    if (id >= HF_MBOX_SLOTS || !hf_mbox_valid()) {
+        return 0;
+    }
+    return hf_mbox()->fault_count[id];
+}
+
+/* ===================== Dump extension records ===================== */
+
+/* Data offset of the first record of a type in a checked dump, 0 if none. */
+static uint32_t hf_ext_find(uint8_t id, const hf_dump_hdr_t *h, uint16_t type,
+                            hf_ext_hdr_t *e)
+{
+    uint32_t off = (uint32_t)h->header_len + h->stack_bytes;
+    const uint32_t end = off + h->ext_bytes;
+
+    while (off + sizeof(*e) <= end) {
+        hf_memread(id, off, e, sizeof(*e));
+        const uint32_t next = off + sizeof(*e) + ((e->len + 3u) & ~3u);
+        if (next > end) {
+            break;
+        }
+        if (e->type == type) {
+            return off + sizeof(*e);
+        }
+        off = next;
+    }
+    return 0;
+}
+
+/* Appends records to this image's slot, from the fault handler. */
+typedef struct {
+    uint32_t off;   /* next byte to write */
+    uint32_t end;
+    uint32_t xor;   /* becomes ext_checksum */
+} hf_ext_w_t;
+
+static inline void hf_ext_write(hf_ext_w_t *w, const void *p, uint32_t len)
+{
+    hf_memwrite(HF_IMAGE_ID, w->off, p, len);
+    w->xor ^= hf_xor(p, len);
+    w->off += len;
+}
+
+/* Opens a record of len data bytes; false if it does not fit. The caller
+ * then writes exactly len bytes and closes it with hf_ext_end(). */
+static inline bool hf_ext_begin(hf_ext_w_t *w, uint16_t type, uint16_t len)
+{
+    const hf_ext_hdr_t e = { type, len };
+
+    if (sizeof(e) + ((len + 3u) & ~3u) > w->end - w->off) {
+        return false;
+    }
+    hf_ext_write(w, &e, sizeof(e));
+    return true;
+}
+
+static inline void hf_ext_end(hf_ext_w_t *w, uint16_t len)
+{
+    static const uint8_t pad[3] = { 0 };
+    hf_ext_write(w, pad, (4u - (len & 3u)) & 3u);
 }
 
 /* ===================== Fault enable helper ===================== */
 
+/* UDF #HF_FPU_TRAP_IMM ('F'): the fault HardFault_FpuCheck() raises. */
+#define HF_FPU_TRAP_IMM 0x46u
+
+static uint32_t s_hf_fault_profile = HF_FAULT_PROFILE;
+
 static inline void Fault_EnableAll(void)
 {
-    /* Enable MemManage, BusFault, UsageFault so HardFault is more specific. */
-    SCB->SHCSR |= (SCB_SHCSR_MEMFAULTENA_Msk |
-                   SCB_SHCSR_BUSFAULTENA_Msk |
-                   SCB_SHCSR_USGFAULTENA_Msk);
+    hf_arch_fault_enable(s_hf_fault_profile);
+}
+
+bool HardFault_SetFaultProfile(uint32_t profile)
+{
+    if (profile > HF_FAULT_DIAGNOSTIC) {
+        return false;
+    }
+    s_hf_fault_profile = profile;
+    Fault_EnableAll();
+    return true;
+}
+
+uint32_t HardFault_FaultProfile(void)
+{
+    return s_hf_fault_profile;
+}
+
+uint32_t HardFault_FpuCheck(void)
+{
+    const uint32_t flags = hf_arch_fpu_take(HF_FPU_TRAP_FLAGS);
+
+    if (flags != 0u && s_hf_fault_profile == HF_FAULT_DIAGNOSTIC) {
+        /* The flags go into the dump as r0; hf_dump_write() spots the UDF. */
+        __ASM volatile ("mov r0, %0 \n"
+                        "udf %1     \n"
+                        : : "r" (flags), "i" (HF_FPU_TRAP_IMM) : "r0", "memory");
+    }
+    return flags;
 }
 
 /* ========================= Decode & print ========================= */
 
-void HardFault_DecodeAndPrint(void)
+static const char *hf_rtos_label(uint32_t id)
+{
+    switch (id) {
+    case HF_RTOS_FREERTOS: return "FreeRTOS";
+    case HF_RTOS_ZEPHYR:   return "Zephyr";
+    case HF_RTOS_THREADX:  return "ThreadX";
+    case HF_RTOS_RTX5:     return "RTX5";
+    default:               return "RTOS";
+    }
+}
+
+/* Task stack table of a dump (HF_EXT_TASK_STACKS), lowest free first. */
+static void hf_print_task_stacks(uint8_t id, const hf_dump_hdr_t *h)
+{
+    hf_ext_hdr_t     e;
+    hf_stack_table_t tab;
+    const uint32_t   at = hf_ext_find(id, h, HF_EXT_TASK_STACKS, &e);
+
+    if (at == 0u || e.len < sizeof(tab)) {
+        return;
+    }
+    hf_memread(id, at, &tab, sizeof(tab));
+    if (tab.entry_size < sizeof(hf_task_stack_t) ||
+        sizeof(tab) + (uint32_t)tab.count * tab.entry_size > e.len) {
+        return;
+    }
+
+    HF_LOGF("Task stacks (free bytes):\r\n");
+    for (uint32_t i = 0; i < tab.count; i++) {
+        hf_task_stack_t t;
+        hf_memread(id, at + sizeof(tab) + i * tab.entry_size, &t, sizeof(t));
+
+        if (!(t.flags & HF_STACK_F_SAMPLED)) {
+            HF_LOGF(" '%.*s' min: not sampled yet\r\n", (int)HF_STACK_NAME_LEN, t.name);
+            continue;
+        }
+        HF_LOGF(" '%.*s' min: %" PRIu32 " of %" PRIu32 "  last: %" PRIu32 "%s  lows:",
+                (int)HF_STACK_NAME_LEN, t.name, t.min_free, t.stack_size,
+                t.last_free, (t.flags & HF_STACK_F_LIVE) ? "" : "  gone");
+        for (uint32_t m = 0; m < t.mark_count && m < HF_STACK_MARKS; m++) {
+            HF_LOGF(" %" PRIu16 " (b%" PRIu16 " t%" PRIu32 ")",
+                    t.mark[m].free, t.mark[m].boot, t.mark[m].tick);
+        }
+        HF_LOGF("\r\n");
+    }
+}
+
+/* Shadow call stack of a dump (HF_EXT_SHADOW_STACK), innermost call first. */
+static void hf_print_shadow_stack(uint8_t id, const hf_dump_hdr_t *h)
+{
+    hf_ext_hdr_t    e;
+    hf_shadow_rec_t rec;
+    const uint32_t  at = hf_ext_find(id, h, HF_EXT_SHADOW_STACK, &e);
+
+    if (at == 0u || e.len < sizeof(rec)) {
+        return;
+    }
+    hf_memread(id, at, &rec, sizeof(rec));
+    if (sizeof(rec) + 4u * (uint32_t)rec.count > e.len) {
+        return;
+    }
+
+    HF_LOGF("Shadow stack: depth %" PRIu32 "  thread 0x%08" PRIX32 "%s%s%s\r\n",
+            rec.depth, rec.thread,
+            (rec.flags & HF_SHADOW_F_HANDLER)  ? "  handler"  : "",
+            (rec.flags & HF_SHADOW_F_WRAPPED)  ? "  wrapped"  : "",
+            (rec.flags & HF_SHADOW_F_UNSYNCED) ? "  unsynced" : "");
+    for (uint32_t i = 0; i < rec.count; i++) {
+        uint32_t site;
+        hf_memread(id, at + sizeof(rec) + 4u * i, &site, sizeof(site));
+        HF_LOGF(" Called from: 0x%08" PRIX32 "\r\n", site);
+    }
+}
+
+/* Newest entries of a dump's heap history (HF_EXT_HEAP_OPS). */
+static void hf_print_heap_ops(uint8_t id, const hf_dump_hdr_t *h)
+{
+    hf_ext_hdr_t   e;
+    hf_heap_hist_t hist;
+    const uint32_t at = hf_ext_find(id, h, HF_EXT_HEAP_OPS, &e);
+
+    if (at == 0u || e.len < sizeof(hist)) {
+        return;
+    }
+    hf_memread(id, at, &hist, sizeof(hist));
+    if (hist.entry_size < sizeof(hf_heap_op_t) ||
+        sizeof(hist) + (uint32_t)hist.count * hist.entry_size > e.len) {
+        return;
+    }
+
+    HF_LOGF("Heap ops: %" PRIu32 " logged, newest first\r\n", hist.total);
+    for (uint32_t i = 0; i < hist.count && i < HF_HEAP_PRINT_OPS; i++) {
+        hf_heap_op_t op;
+        hf_memread(id, at + sizeof(hist) + i * hist.entry_size, &op, sizeof(op));
+
+        switch (HF_HEAP_INFO_OP(op.info)) {
+        case HF_HEAP_OP_ALLOC:
+            if (op.ptr != 0u) {
+                HF_LOGF(" Heap alloc: 0x%08" PRIX32, op.ptr);
+            } else {
+                HF_LOGF(" Heap alloc: failed");
+            }
+            HF_LOGF(" size %" PRIu32 " from 0x%08" PRIX32 " ctx 0x%08" PRIX32 "\r\n",
+                    HF_HEAP_INFO_SIZE(op.info), op.caller, op.ctx);
+            break;
+        case HF_HEAP_OP_FREE:
+            HF_LOGF(" Heap free: 0x%08" PRIX32 " from 0x%08" PRIX32 " ctx 0x%08" PRIX32 "\r\n",
+                    op.ptr, op.caller, op.ctx);
+            break;
+        case HF_HEAP_OP_BOOT:
+            HF_LOGF(" Heap boot: %" PRIu32 "\r\n", HF_HEAP_INFO_SIZE(op.info));
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+static const char *hf_scan_label(uint8_t kind)
+{
+    switch (kind) {
+    case HF_SCAN_TASK_STACK: return "task stack";
+    case HF_SCAN_MAIN_STACK: return "main stack";
+    case HF_SCAN_HEAP_SIZE:  return "heap size";
+    case HF_SCAN_HEAP_LINK:  return "heap link";
+    default:                 return "?";
+    }
+}
+
+/* What the integrity scanner found (HF_EXT_SCAN). */
+static void hf_print_scan(uint8_t id, const hf_dump_hdr_t *h)
 {
-    if (!HardFault_DumpAvailable()) {
+    hf_ext_hdr_t   e;
+    hf_scan_rec_t  rec;
+    const uint32_t at = hf_ext_find(id, h, HF_EXT_SCAN, &e);
+
+    if (at == 0u || e.len < sizeof(rec)) {
         return;
     }
+    hf_memread(id, at, &rec, sizeof(rec));
+
+    HF_LOGF("Integrity: %s at 0x%08" PRIX32 " found 0x%08" PRIX32,
+            hf_scan_label(rec.kind), rec.addr, rec.found);
+    if (rec.kind == HF_SCAN_TASK_STACK || rec.kind == HF_SCAN_MAIN_STACK) {
+        HF_LOGF(" expected 0x%08" PRIX32, rec.expected);
+    }
+    HF_LOGF(" region 0x%08" PRIX32, rec.region);
+    if (rec.name[0] != '\0') {
+        HF_LOGF(" task '%.*s'", (int)HF_STACK_NAME_LEN, rec.name);
+    }
+    HF_LOGF("\r\n");
+}
+
+/* "FPU trap: FPSCR flags 0x06 DZC OFC" */
+static void hf_print_fpu_trap(uint32_t flags)
+{
+    static const char *const name[8] = { "IOC", "DZC", "OFC", "UFC", "IXC", NULL, NULL, "IDC" };
+
+    HF_LOGF("FPU trap: FPSCR flags 0x%02" PRIX32, flags);
+    for (uint32_t b = 0; b < 8u; b++) {
+        if ((flags & (1u << b)) && name[b] != NULL) {
+            HF_LOGF(" %s", name[b]);
+        }
+    }
+    HF_LOGF("\r\n");
+}
 
+void HardFault_DecodeAndPrintId(uint8_t id)
+{
     hf_dump_hdr_t h;
-    hf_memread(0, &h, sizeof(h));
+
+    if (!hf_read_header(id, &h)) {
+        return;
+    }
 
     HF_LOGF("\r\n===== HARD FAULT DUMP =====\r\n");
     HF_LOGF("Magic: 0x%08" PRIX32 ", Ver: %" PRIu16 "\r\n",
             h.magic, h.version);
+    HF_LOGF("Image: %s  Faults recorded: %" PRIu32 "\r\n",
+            (id == HF_IMAGE_BOOTLOADER) ? "bootloader" : "application",
+            HardFault_DumpCount(id));
+    if (h.flags & HF_DUMP_F_SOFT) {
+        HF_LOGF("Soft capture: no fault, the system kept running\r\n");
+    }
+    if (h.flags & HF_DUMP_F_FPU_TRAP) {
+        hf_print_fpu_trap(h.r0);
+    }
+    hf_print_scan(id, &h);
     HF_LOGF("EXC_RETURN: 0x%08" PRIX32 "  MSP: 0x%08" PRIX32
             "  PSP: 0x%08" PRIX32 "\r\n",
             h.exc_return, h.msp, h.psp);
@@ -194,6 +532,7 @@ void HardFault_DecodeAndPrint(void)
     HF_LOGF(" PC : 0x%08" PRIX32 "  PSR: 0x%08" PRIX32 "\r\n",
             h.pc, h.psr);
 
+#if HF_ARCH_HAS_CFSR
     /* Fault registers */
     uint8_t  mmfsr = (uint8_t)(h.scb_cfsr & 0xFFu);
     uint8_t  bfsr  = (uint8_t)((h.scb_cfsr >> 8) & 0xFFu);
@@ -208,19 +547,49 @@ void HardFault_DecodeAndPrint(void)
             h.scb_mmfar, h.scb_bfar);
     HF_LOGF("AFSR: 0x%08" PRIX32 "  SHCSR: 0x%08" PRIX32 "\r\n",
             h.scb_afsr, h.shcsr);
+#endif
+
+#if (HF_ARCH_ID == HF_ARCH_CM33)
+    if (h.flags & HF_DUMP_F_SPLIM) {
+        HF_LOGF("SP limit: 0x%08" PRIX32 "%s  State: %s\r\n",
+                h.sp_limit,
+                (h.flags & HF_DUMP_F_STKOVF) ? "  STACK OVERFLOW" : "",
+                (h.flags & HF_DUMP_F_SECURE) ? "Secure" : "Non-secure");
+    }
+#endif
+
+    if (h.version >= 5u && h.msp_limit != 0u) {
+        const char *near = (h.flags & HF_DUMP_F_MSP_NEAR) ? "  NEAR LIMIT" : "";
+        if (h.msp_max_used != 0u) {
+            HF_LOGF("MSP bottom: 0x%08" PRIX32 "  Max used: %" PRIu32 " bytes%s\r\n",
+                    h.msp_limit, h.msp_max_used, near);
+        } else {
+            HF_LOGF("MSP bottom: 0x%08" PRIX32 "%s\r\n", h.msp_limit, near);
+        }
+    }
+#if HF_MSP_PAINT
+    if (id == HF_IMAGE_ID && HardFault_BootRecord()->msp_worst_used != 0u) {
+        HF_LOGF("MSP worst ever: %" PRIu32 " of %" PRIu32 " bytes\r\n",
+                HardFault_BootRecord()->msp_worst_used, HardFault_BootRecord()->msp_size);
+    }
+#endif
 
+    /* Driven by the dump, not this build: it may come from another image. */
     if (h.rtos_present) {
-        HF_LOGF("FreeRTOS:\r\n");
+        HF_LOGF("%s:\r\n", hf_rtos_label(h.rtos_present));
         HF_LOGF(" Task : '%s'\r\n", h.rtos_task_name);
         HF_LOGF(" Prio : %" PRIu32 "\r\n", h.rtos_task_priority);
         HF_LOGF(" Stack base : 0x%08" PRIX32 "\r\n", h.rtos_stack_base);
         HF_LOGF(" Min free   : %" PRIu32 " bytes\r\n",
                 h.rtos_stack_high_water_bytes);
     } else {
-        HF_LOGF("FreeRTOS info: not available (no RTOS or scheduler not started)\r\n");
+        HF_LOGF("RTOS info: not available (no RTOS or scheduler not started)\r\n");
     }
+    hf_print_task_stacks(id, &h);
 
     HF_LOGF("Stack dump bytes: %" PRIu32 "\r\n", h.stack_bytes);
+    hf_print_shadow_stack(id, &h);
+    hf_print_heap_ops(id, &h);
 
     /* Machine-friendly line for PC-side addr2line script */
     HF_LOGF("HF_ADDR PC=0x%08" PRIX32 " LR=0x%08" PRIX32 "\r\n", h.pc, h.lr);
@@ -228,7 +597,12 @@ void HardFault_DecodeAndPrint(void)
     HF_LOGF("===== END HARD FAULT DUMP =====\r\n");
 }
 
-/* ===================== HardFault handler core ===================== */
+void HardFault_DecodeAndPrint(void)
+{
+    HardFault_DecodeAndPrintId(HF_IMAGE_ID);
+}
+
+/* ========================= Stack helpers ========================= */
 
 static inline uint32_t get_main_stack_top(void)
 {
@@ -236,136 +610,1972 @@ static inline uint32_t get_main_stack_top(void)
     return (uint32_t)_estack;
 }
 
-/* forward declaration of C helper called by the naked handler */
-static void prvGetRegistersFromStack(uint32_t *fault_sp, uint32_t exc_return);
-
-/* This is the vector-table entry. Do NOT call directly. */
-__attribute__((naked)) void HardFault_Handler(void)
+#if (HF_RTOS != HF_RTOS_NONE) || HF_MSP_PAINT
+/* Bytes never touched at the bottom of a painted stack (its high-water mark). */
+static uint32_t hf_stack_unused(uint32_t lo, uint32_t hi, uint32_t fill)
 {
-    __asm volatile
-    (
-        "tst lr, #4                   \n" /* Check EXC_RETURN bit[2] SP used */
-        "ite eq                       \n"
-        "mrseq r0, msp                \n" /* r0 = active SP (MSP)  */
-        "mrsne r0, psp                \n" /* r0 = active SP (PSP)  */
-        "mov   r1, lr                 \n" /* r1 = EXC_RETURN       */
-        "b     prvGetRegistersFromStack \n"
-    );
+    if (lo == 0u || (lo & 3u) != 0u || hi <= lo) {
+        return 0;
+    }
+
+    const uint32_t *p   = (const uint32_t *)lo;
+    const uint32_t *end = (const uint32_t *)hi;
+    while (p < end && *p == fill) {
+        p++;
+    }
+    return (uint32_t)p - lo;
 }
+#endif
 
-static void prvGetRegistersFromStack(uint32_t *fault_sp, uint32_t exc_return)
-{
-    const uint32_t used_psp = (exc_return & (1U << 2)) ? 1U : 0U; /* bit2 */
-    const uint32_t msp = __get_MSP();
-    const uint32_t psp = __get_PSP();
-    const uint32_t has_fp = ((exc_return & (1U << 4)) == 0U) ? 1U : 0U;
+/* ========================== Boot record ========================== */
 
-    /* core regs from stacked frame (basic frame, ignoring FP extension) */
-    uint32_t r0  = fault_sp[0];
-    uint32_t r1  = fault_sp[1];
-    uint32_t r2  = fault_sp[2];
-    uint32_t r3  = fault_sp[3];
-    uint32_t r12 = fault_sp[4];
-    uint32_t lr  = fault_sp[5];
-    uint32_t pc  = fault_sp[6];
-    uint32_t psr = fault_sp[7];
+#ifndef HF_NOINIT
+#define HF_NOINIT __attribute__((section(".noinit")))
+#endif
 
-    hf_dump_hdr_t hdr;
-    memset(&hdr, 0, sizeof(hdr));
+#define HF_BOOT_MAGIC 0x54424648u   /* 'HFBT' */
 
-    hdr.magic      = HF_MAGIC;
-    hdr.version    = HF_VERSION;
-    hdr.header_len = sizeof(hf_dump_hdr_t);
+HF_NOINIT static hf_boot_record_t s_hf_boot;
 
-    hdr.exc_return = exc_return;
-    hdr.msp        = msp;
-    hdr.psp        = psp;
-    hdr.active_sp  = (uint32_t)fault_sp;
-    hdr.used_sp    = used_psp;
-    hdr.has_fp     = has_fp;
+/* A dump of this image was written since the last boot: its count moved. */
+static void hf_boot_begin(void)
+{
+    const uint32_t faults = hf_mbox()->fault_count[HF_IMAGE_ID];
 
-    hdr.scb_cfsr   = SCB->CFSR;
-    hdr.scb_hfsr   = SCB->HFSR;
-    hdr.scb_dfsr   = SCB->DFSR;
-    hdr.scb_mmfar  = SCB->MMFAR;
-    hdr.scb_bfar   = SCB->BFAR;
-    hdr.scb_afsr   = SCB->AFSR;
-    hdr.shcsr      = SCB->SHCSR;
+    if (s_hf_boot.magic != HF_BOOT_MAGIC) {
+        memset(&s_hf_boot, 0, sizeof(s_hf_boot));
+        s_hf_boot.magic = HF_BOOT_MAGIC;
+        s_hf_boot.last_fault_count = faults;   /* power-on: nothing new */
+    }
+    s_hf_boot.boot_count++;
+    s_hf_boot.flags = 0;
+    s_hf_boot.flash_check = HF_FLASH_CHECK_OFF;
+    if (faults != s_hf_boot.last_fault_count && faults != 0u) {
+        s_hf_boot.flags |= HF_BOOT_F_FAULT_RESET;
+    }
+    s_hf_boot.last_fault_count = faults;
+}
 
-    hdr.r0 = r0; hdr.r1 = r1; hdr.r2 = r2; hdr.r3 = r3;
-    hdr.r12 = r12; hdr.lr = lr; hdr.pc = pc; hdr.psr = psr;
+const hf_boot_record_t *HardFault_BootRecord(void)
+{
+    return &s_hf_boot;
+}
 
-    /* Try to capture FreeRTOS info about the current task (if compiled in) */
-    hdr.rtos_present = 0;
+/* ========================= Boot timeline ========================= */
 
-#ifdef HF_ENABLE_FREERTOS_SUPPORT
-    if (xTaskGetSchedulerState != NULL &&
-        vTaskGetInfo           != NULL &&
-        xTaskGetSchedulerState() != taskSCHEDULER_NOT_STARTED)
-    {
-        TaskStatus_t ts;
-        vTaskGetInfo(NULL, &ts, pdTRUE, eInvalid);
+#if HF_BOOT_TIMELINE
+#ifndef HF_BOOT_CLOCK
+#if !HF_ARCH_HAS_CYCCNT
+#error "HF_BOOT_TIMELINE: no CYCCNT on this core, define HF_BOOT_CLOCK() and HF_BOOT_CLOCK_HZ"
+#endif
+#define HF_BOOT_CLOCK() hf_arch_cycles()
+#endif
+#ifndef HF_BOOT_CLOCK_HZ
+#define HF_BOOT_CLOCK_HZ SystemCoreClock
+#endif
+/* Clock up to the first mark after HF_MARK_RESET, which may run before
+ * SystemCoreClock is initialised; 0 takes the clock at that mark. */
+#ifndef HF_BOOT_CLOCK_RESET_HZ
+#ifdef HSI_VALUE
+#define HF_BOOT_CLOCK_RESET_HZ HSI_VALUE
+#else
+#define HF_BOOT_CLOCK_RESET_HZ 0u
+#endif
+#endif
 
-        hdr.rtos_present = 1;
-        hdr.rtos_task_priority = ts.uxCurrentPriority;
-        hdr.rtos_stack_high_water_bytes =
-            (uint32_t)ts.usStackHighWaterMark * sizeof(StackType_t);
-        hdr.rtos_stack_base = (uint32_t)ts.pxStackBase;
+#define HF_TIMES_MAGIC 0x4D544648u   /* 'HFTM' */
 
-        strncpy(hdr.rtos_task_name, ts.pcTaskName, HF_MAX_TASK_NAME_LEN);
-        hdr.rtos_task_name[HF_MAX_TASK_NAME_LEN] = '\0';
-    }
-#endif
+/* All in .noinit: HF_MARK_RESET may run before .data and .bss are set up. */
+typedef struct {
+    uint32_t           magic;
+    hf_boot_times_t    pub;
+    hf_boot_timeline_t cur;      /* being recorded */
+    uint32_t           active;   /* cur takes marks */
+    uint32_t           armed;    /* HF_MARK_RESET seen, init not yet */
+    uint32_t           clk;      /* HF_BOOT_CLOCK() at the last mark */
+    uint32_t           hz;       /* HF_BOOT_CLOCK_HZ then, 0 = not known yet */
+    uint32_t           rem;      /* remainder below 1 us, in 1/hz us */
+    uint32_t           us;       /* time of the last mark */
+} hf_times_t;
 
-    /* Now, copy some of the faulted stack */
-    hf_memclear(s_hf_dump_area, (uint32_t)sizeof(s_hf_dump_area));
+HF_NOINIT static hf_times_t s_hf_times;
 
-    const uint32_t max_payload =
-        (uint32_t)sizeof(s_hf_dump_area) - (uint32_t)sizeof(hf_dump_hdr_t);
+/* .bss: init ran on this boot. Without it (or armed), cur is a previous
+ * boot's timeline and takes no more marks. */
+static bool s_hf_times_live;
 
-    /* Without precise RTOS stack bounds, we just limit to some sane cap (e.g. 2KB) */
-    uint32_t max_stack_copy = MIN(max_payload, 2048U);
+static void hf_times_check(void)
+{
+    if (s_hf_times.magic != HF_TIMES_MAGIC) {
+        memset(&s_hf_times, 0, sizeof(s_hf_times));
+        s_hf_times.magic = HF_TIMES_MAGIC;
+    }
+}
 
-    hdr.stack_bytes = 0;
-    hdr.checksum    = 0;
+/*
+ * Ends the current timeline. Boot number and cause come from the boot
+ * record, which still describes the boot that recorded the timeline: a
+ * timeline that never got ready is only closed by the next reset, before
+ * init updates the record.
+ */
+static void hf_times_close(void)
+{
+    hf_boot_timeline_t *t = &s_hf_times.cur;
 
-    /* Write header first (checksum to be updated later) */
-    hf_memwrite(0, &hdr, sizeof(hdr));
+    if (!s_hf_times.active) {
+        return;
+    }
+    t->boot = s_hf_boot.boot_count;
+    if (s_hf_boot.flags & HF_BOOT_F_FAULT_RESET) {
+        t->flags |= HF_TIMELINE_F_FAULT;
+    }
+    s_hf_times.pub.timeline[s_hf_times.pub.next] = *t;
+    s_hf_times.pub.next = (s_hf_times.pub.next + 1u) % HF_BOOT_TIMELINES;
+    s_hf_times.active = 0;
+}
 
-    /* Basic sanity: fault_sp must be below main stack top */
-    if ((uint32_t)fault_sp < get_main_stack_top()) {
-        hf_memwrite(sizeof(hdr), fault_sp, max_stack_copy);
-        hdr.stack_bytes = max_stack_copy;
+static void hf_times_start(uint8_t flags, uint32_t hz)
+{
+    hf_times_close();
+    memset(&s_hf_times.cur, 0, sizeof(s_hf_times.cur));
+    s_hf_times.cur.flags = flags;
+    s_hf_times.active = 1;
+
+    hf_arch_cycles_enable();
+    s_hf_times.clk = HF_BOOT_CLOCK();
+    s_hf_times.hz  = hz;
+    s_hf_times.rem = 0;
+    s_hf_times.us  = 0;
+}
 
-        /* Compute checksum over header(with checksum=0) + payload */
-        hdr.checksum = 0;
-        hdr.checksum = hf_xor(&hdr, sizeof(hdr))
-                     ^ hf_xor(&s_hf_dump_area[sizeof(hdr)],
-                              hdr.stack_bytes);
+/* From init: start here if HF_MARK_RESET did not. */
+static void hf_times_begin(void)
+{
+    hf_times_check();
+    if (!s_hf_times.armed) {
+        hf_times_start(HF_TIMELINE_F_LATE, HF_BOOT_CLOCK_HZ);
+    }
+    s_hf_times.armed = 0;
+    s_hf_times_live  = true;
+}
 
-        hf_memwrite(0, &hdr, sizeof(hdr));
+/* HF_MARK_READY: count the reset-to-ready time, then file the timeline. */
+static void hf_times_ready(void)
+{
+    const uint32_t us = s_hf_times.us;
+
+    s_hf_times.cur.flags |= HF_TIMELINE_F_READY;
+    if (!(s_hf_times.cur.flags & HF_TIMELINE_F_LATE)) {
+        hf_boot_latency_t *l = (s_hf_boot.flags & HF_BOOT_F_FAULT_RESET)
+                             ? &s_hf_times.pub.fault : &s_hf_times.pub.cold;
+        if (l->count == 0u || us < l->min_us) {
+            l->min_us = us;
+        }
+        if (us > l->max_us) {
+            l->max_us = us;
+        }
+        l->last_us   = us;
+        l->total_us += us;
+        l->count++;
     }
+    hf_times_close();
 
-#ifdef DEBUG
-    __ASM volatile ("BKPT #01");
+#if HF_BOOT_PRINT
+    HF_LOGF("Boot ready: %" PRIu32 " us%s\r\n", us,
+            (s_hf_boot.flags & HF_BOOT_F_FAULT_RESET) ? " (after fault)" : "");
 #endif
+}
 
-    __DSB();
-    __ISB();
-    NVIC_SystemReset();
+static const char *hf_mark_name(uint16_t id)
+{
+    switch (id) {
+    case HF_MARK_RESET:        return "reset";
+    case HF_MARK_INIT:         return "init";
+    case HF_MARK_INIT_PRINTED: return "printed";
+    case HF_MARK_INIT_DONE:    return "done";
+    case HF_MARK_READY:        return "ready";
+    default:                   return NULL;
+    }
 }
 
-/* ========================= Public init API ========================= */
+static void hf_print_latency(const char *what, const hf_boot_latency_t *l)
+{
+    if (l->count == 0u) {
+        HF_LOGF(" Reset to ready, %s: none\r\n", what);
+        return;
+    }
+    HF_LOGF(" Reset to ready, %s: n=%" PRIu32 " last %" PRIu32 " min %" PRIu32
+            " max %" PRIu32 " mean %" PRIu32 "\r\n",
+            what, l->count, l->last_us, l->min_us, l->max_us,
+            (uint32_t)(l->total_us / l->count));
+}
+#endif
 
-void HardFaultDumps_Init(void)
+void HardFault_BootMark(uint16_t id)
 {
-    /* Enable detailed faults */
-    Fault_EnableAll();
+#if HF_BOOT_TIMELINE
+    if (id == HF_MARK_RESET) {
+        hf_times_check();
+        hf_times_start(0u, HF_BOOT_CLOCK_RESET_HZ);
+        s_hf_times.armed = 1;
+    } else {
+        if (s_hf_times.magic != HF_TIMES_MAGIC || !s_hf_times.active ||
+            !(s_hf_times.armed || s_hf_times_live)) {
+            return;
+        }
+        const uint32_t now = HF_BOOT_CLOCK();
+        uint32_t hz = (s_hf_times.hz != 0u) ? s_hf_times.hz : HF_BOOT_CLOCK_HZ;
+        if (hz == 0u) {
+            hz = 1u;
+        }
+        const uint64_t num = (uint64_t)(now - s_hf_times.clk) * 1000000u + s_hf_times.rem;
+        s_hf_times.us += (uint32_t)(num / hz);
+        s_hf_times.rem = (uint32_t)(num % hz);
+        s_hf_times.clk = now;
+        s_hf_times.hz  = HF_BOOT_CLOCK_HZ;
+    }
+
+    hf_boot_timeline_t *t = &s_hf_times.cur;
+    uint32_t i = t->count;
+    if (i >= HF_BOOT_MARKS) {
+        t->flags |= HF_TIMELINE_F_FULL;
+        if (id != HF_MARK_READY) {
+            return;
+        }
+        i = HF_BOOT_MARKS - 1u;   /* the end matters more than the middle */
+    } else {
+        t->count++;
+    }
+    t->mark[i].id = id;
+    t->mark[i].us = s_hf_times.us;
+
+    if (id == HF_MARK_READY) {
+        hf_times_ready();
+    }
+#else
+    (void)id;
+#endif
+}
+
+const hf_boot_times_t *HardFault_BootTimes(void)
+{
+#if HF_BOOT_TIMELINE
+    hf_times_check();
+    return &s_hf_times.pub;
+#else
+    return NULL;
+#endif
+}
+
+void HardFault_PrintBootTimes(void)
+{
+#if HF_BOOT_TIMELINE
+    const hf_boot_times_t *p = HardFault_BootTimes();
+
+    HF_LOGF("Boot times (us since reset):\r\n");
+    for (uint32_t n = 0; n < HF_BOOT_TIMELINES; n++) {
+        const hf_boot_timeline_t *t = &p->timeline[(p->next + n) % HF_BOOT_TIMELINES];
+        if (t->count == 0u) {
+            continue;
+        }
+        HF_LOGF(" boot %" PRIu32 "%s%s%s:", t->boot,
+                (t->flags & HF_TIMELINE_F_FAULT) ? " after fault" : "",
+                (t->flags & HF_TIMELINE_F_LATE)  ? " from init" : "",
+                (t->flags & HF_TIMELINE_F_READY) ? "" : " not ready");
+        for (uint32_t m = 0; m < t->count && m < HF_BOOT_MARKS; m++) {
+            const char *name = hf_mark_name(t->mark[m].id);
+            if (name != NULL) {
+                HF_LOGF(" %s %" PRIu32, name, t->mark[m].us);
+            } else {
+                HF_LOGF(" #%" PRIu16 " %" PRIu32, t->mark[m].id, t->mark[m].us);
+            }
+        }
+        HF_LOGF("\r\n");
+    }
+    hf_print_latency("cold", &p->cold);
+    hf_print_latency("after fault", &p->fault);
+#endif
+}
+
+/* ========================== Main stack ========================== */
+
+#ifndef HF_MSP_FILL
+#define HF_MSP_FILL 0xA5A5A5A5u
+#endif
+
+#ifdef HF_MSP_LIMIT_SYMBOL
+extern uint32_t HF_MSP_LIMIT_SYMBOL[];
+#else
+/* Weak, so linker scripts without it still link (limit unknown). */
+extern uint32_t _Min_Stack_Size[] __attribute__((weak));
+#endif
+
+#if HF_MSP_PAINT
+static bool s_hf_msp_painted;   /* .bss: faults before the painting report 0 */
+#endif
+
+/* Bottom of the main stack, 0 if the linker script does not tell. */
+static uint32_t hf_msp_limit(void)
+{
+#ifdef HF_MSP_LIMIT_SYMBOL
+    return (uint32_t)HF_MSP_LIMIT_SYMBOL;
+#else
+    const uint32_t size = (uint32_t)_Min_Stack_Size;
+    return (size != 0u && size < get_main_stack_top()) ? get_main_stack_top() - size : 0u;
+#endif
+}
+
+/* High-water mark of the painted main stack; updates the worst-ever value. */
+static uint32_t hf_msp_used(void)
+{
+#if HF_MSP_PAINT
+    const uint32_t lo  = hf_msp_limit();
+    const uint32_t top = get_main_stack_top();
+
+    if (!s_hf_msp_painted || lo == 0u) {
+        return 0;
+    }
+    const uint32_t used = (top - lo) - hf_stack_unused(lo, top, HF_MSP_FILL);
+    if (s_hf_boot.magic == HF_BOOT_MAGIC && used > s_hf_boot.msp_worst_used) {
+        s_hf_boot.msp_worst_used = used;
+    }
+    return used;
+#else
+    return 0;
+#endif
+}
+
+#if HF_MSP_PAINT
+/*
+ * Called from init, after hf_boot_begin(). RAM keeps the previous boot's
+ * paint across a reset, so its depth is read back first; then everything
+ * below the current SP is painted. Interrupts may stay enabled: an ISR
+ * that preempts us has returned before we write on.
+ */
+static void hf_msp_paint(void)
+{
+    const uint32_t lo  = hf_msp_limit();
+    const uint32_t top = get_main_stack_top();
+
+    if (lo == 0u || (lo & 3u) != 0u) {
+        return;
+    }
+
+    s_hf_boot.msp_size = top - lo;
+    if (s_hf_boot.msp_painted != 0u &&
+        s_hf_boot.msp_painted + 1u == s_hf_boot.boot_count) {
+        s_hf_boot.msp_last_used = (top - lo) - hf_stack_unused(lo, top, HF_MSP_FILL);
+        if (s_hf_boot.msp_last_used > s_hf_boot.msp_worst_used) {
+            s_hf_boot.msp_worst_used = s_hf_boot.msp_last_used;
+        }
+    }
+
+    uint32_t *p = (uint32_t *)lo;
+    uint32_t *end = (uint32_t *)(__get_MSP() & ~3u);
+    while (p < end) {
+        *p++ = HF_MSP_FILL;
+    }
+    s_hf_boot.msp_painted = s_hf_boot.boot_count;
+    s_hf_msp_painted = true;
+}
+#endif
+
+uint32_t HardFault_MainStackUsed(void)
+{
+    return hf_msp_used();
+}
+
+/* ======================= Task stack sampler ======================= */
+
+#if HF_STACK_SAMPLER
+#if (HF_RTOS == HF_RTOS_NONE)
+#error "HF_STACK_SAMPLER needs an RTOS adapter (HF_RTOS)"
+#endif
+#if (HF_STACK_TASKS == 0u) || (HF_STACK_TASKS > 32u)
+#error "HF_STACK_TASKS must be 1..32"
+#endif
+
+#define HF_STACK_MAGIC 0x4B545348u   /* 'HSTK' */
+
+/* Kept across resets like the boot record; an empty name is a free entry. */
+typedef struct {
+    uint32_t        magic;
+    hf_task_stack_t task[HF_STACK_TASKS];
+} hf_stack_tab_t;
+
+HF_NOINIT static hf_stack_tab_t s_hf_stk;
+
+/* This boot only (.bss): thread handles and where the sampler is. */
+static const void *s_hf_stk_thread[HF_STACK_TASKS];
+static uint32_t    s_hf_stk_cur;   /* entry being scanned */
+static uint32_t    s_hf_stk_pos;   /* next word to check, 0 = start a pass */
+
+static uint16_t hf_boot16(void)
+{
+    return (uint16_t)s_hf_boot.boot_count;
+}
+
+static void hf_stack_tab_check(void)
+{
+    if (s_hf_stk.magic != HF_STACK_MAGIC) {
+        memset(&s_hf_stk, 0, sizeof(s_hf_stk));
+        s_hf_stk.magic = HF_STACK_MAGIC;
+    }
+}
+
+/* From init: no task is tracked yet on this boot. */
+static void hf_stack_begin(void)
+{
+    hf_stack_tab_check();
+    for (uint32_t i = 0; i < HF_STACK_TASKS; i++) {
+        s_hf_stk.task[i].flags &= (uint8_t)~HF_STACK_F_LIVE;
+    }
+}
+
+/* Table key: the task name, or "@<stack address>" for unnamed tasks. */
+static void hf_stack_key(char key[HF_STACK_NAME_LEN], const char *name, uint32_t lo)
+{
+    memset(key, 0, HF_STACK_NAME_LEN);
+    if (name != NULL && name[0] != '\0') {
+        strncpy(key, name, HF_STACK_NAME_LEN);
+        return;
+    }
+    key[0] = '@';
+    for (uint32_t i = 0; i < 8u; i++) {
+        key[1u + i] = "0123456789ABCDEF"[(lo >> (28u - 4u * i)) & 0xFu];
+    }
+}
+
+/* A pass over one stack is done: free bytes below the first used word. */
+static void hf_stack_pass_done(hf_task_stack_t *t, uint32_t free)
+{
+    t->last_free = free;
+    t->flags |= HF_STACK_F_SAMPLED;
+    if (free >= t->min_free) {
+        return;
+    }
+
+    t->min_free = free;
+    if (t->mark_count >= HF_STACK_MARKS) {
+        memmove(&t->mark[0], &t->mark[1], sizeof(t->mark[0]) * (HF_STACK_MARKS - 1u));
+        t->mark_count = HF_STACK_MARKS - 1u;
+    }
+    hf_stack_mark_t *m = &t->mark[t->mark_count++];
+    m->tick = hf_rtos_tick();
+    m->free = (uint16_t)MIN(free, 0xFFFFu);
+    m->boot = hf_boot16();
+}
+
+/* Bytes the table takes in a dump, 0 if it has no entries. */
+static uint32_t hf_stack_ext_size(void)
+{
+    uint32_t n = 0;
+
+    if (s_hf_stk.magic != HF_STACK_MAGIC) {
+        return 0;
+    }
+    for (uint32_t i = 0; i < HF_STACK_TASKS; i++) {
+        n += (s_hf_stk.task[i].name[0] != '\0') ? 1u : 0u;
+    }
+    return (n != 0u) ? (uint32_t)(sizeof(hf_ext_hdr_t) + sizeof(hf_stack_table_t))
+                       + n * (uint32_t)sizeof(hf_task_stack_t) : 0u;
+}
+
+/* Into the dump, lowest free first, so a short slot keeps the tasks at risk. */
+static void hf_stack_ext(hf_ext_w_t *w)
+{
+    const uint32_t size = hf_stack_ext_size();
+    const uint32_t head = sizeof(hf_ext_hdr_t) + sizeof(hf_stack_table_t);
+
+    if (size == 0u || w->end - w->off < head + sizeof(hf_task_stack_t)) {
+        return;
+    }
+    const uint32_t n = MIN(size, w->end - w->off) - head;
+    const hf_stack_table_t tab = {
+        (uint8_t)(n / sizeof(hf_task_stack_t)), HF_STACK_MARKS, sizeof(hf_task_stack_t)
+    };
+    const uint16_t len = (uint16_t)(sizeof(tab) + tab.count * sizeof(hf_task_stack_t));
+
+    if (!hf_ext_begin(w, HF_EXT_TASK_STACKS, len)) {
+        return;
+    }
+    hf_ext_write(w, &tab, sizeof(tab));
+
+    uint32_t done = 0;
+    for (uint32_t k = 0; k < tab.count; k++) {
+        uint32_t best = HF_STACK_TASKS;
+        for (uint32_t i = 0; i < HF_STACK_TASKS; i++) {
+            if (s_hf_stk.task[i].name[0] == '\0' || (done & (1u << i))) {
+                continue;
+            }
+            if (best == HF_STACK_TASKS ||
+                s_hf_stk.task[i].min_free < s_hf_stk.task[best].min_free) {
+                best = i;
+            }
+        }
+        done |= 1u << best;
+        hf_ext_write(w, &s_hf_stk.task[best], sizeof(hf_task_stack_t));
+    }
+    hf_ext_end(w, len);
+}
+#endif
+
+bool HardFaultStack_Track(const void *thread)
+{
+#if HF_STACK_SAMPLER
+    uint32_t lo, hi;
+    char     key[HF_STACK_NAME_LEN];
+
+    hf_rtos_stack_of(thread, &lo, &hi);
+    if (lo == 0u || (lo & 3u) != 0u) {
+        return false;
+    }
+    /* hi = 0: size unknown. A pass still ends inside the stack, at the
+     * initial frame the kernel put at its top. */
+    const uint32_t size = (hi > lo) ? hi - lo : 0u;
+    hf_stack_key(key, hf_rtos_name_of(thread), lo);
+
+    const uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    hf_stack_tab_check();
+
+    /* Its own entry from an earlier boot, else a free one, else one
+     * whose task has not shown up on this boot. */
+    uint32_t slot = HF_STACK_TASKS, spare = HF_STACK_TASKS;
+    for (uint32_t i = 0; i < HF_STACK_TASKS; i++) {
+        const hf_task_stack_t *t = &s_hf_stk.task[i];
+        if (s_hf_stk_thread[i] != NULL) {
+            continue;
+        }
+        if (t->name[0] == '\0') {
+            if (spare == HF_STACK_TASKS || s_hf_stk.task[spare].name[0] != '\0') {
+                spare = i;
+            }
+        } else if (memcmp(t->name, key, sizeof(key)) == 0) {
+            slot = i;
+            break;
+        } else if (t->boot != hf_boot16() && spare == HF_STACK_TASKS) {
+            spare = i;
+        }
+    }
+    if (slot == HF_STACK_TASKS) {
+        slot = spare;
+    }
+
+    if (slot != HF_STACK_TASKS) {
+        hf_task_stack_t *t = &s_hf_stk.task[slot];
+
+        /* New task, or resized since: its history no longer applies. */
+        if (memcmp(t->name, key, sizeof(key)) != 0 || t->stack_size != size) {
+            memset(t, 0, sizeof(*t));
+            memcpy(t->name, key, sizeof(key));
+            t->min_free  = 0xFFFFFFFFu;
+            t->last_free = 0xFFFFFFFFu;
+        }
+        t->stack_lo   = lo;
+        t->stack_size = size;
+        t->boot       = hf_boot16();
+        t->flags     |= HF_STACK_F_LIVE;
+        s_hf_stk_thread[slot] = thread;
+    }
+    __set_PRIMASK(primask);
+    return slot != HF_STACK_TASKS;
+#else
+    (void)thread;
+    return false;
+#endif
+}
+
+void HardFaultStack_Untrack(const void *thread)
+{
+#if HF_STACK_SAMPLER
+    const uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    for (uint32_t i = 0; i < HF_STACK_TASKS; i++) {
+        if (s_hf_stk_thread[i] == thread) {
+            s_hf_stk_thread[i] = NULL;
+            s_hf_stk.task[i].flags &= (uint8_t)~HF_STACK_F_LIVE;
+            if (i == s_hf_stk_cur) {
+                s_hf_stk_pos = 0;   /* its stack may be freed now */
+            }
+        }
+    }
+    __set_PRIMASK(primask);
+#else
+    (void)thread;
+#endif
+}
+
+/*
+ * A pass spans several calls, so a task that goes deeper meanwhile below
+ * the scan position shows up on its next pass only. The fill value is
+ * checked word by word: HF_STACK_SAMPLE_WORDS loads and compares with
+ * interrupts masked, plus a little bookkeeping when a pass ends.
+ */
+void HardFaultStack_Sample(void)
+{
+#if HF_STACK_SAMPLER
+    const uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    for (uint32_t n = 0; n < HF_STACK_TASKS; n++) {
+        if (s_hf_stk_thread[s_hf_stk_cur] != NULL) {
+            break;
+        }
+        s_hf_stk_cur = (s_hf_stk_cur + 1u) % HF_STACK_TASKS;
+        s_hf_stk_pos = 0;
+    }
+
+    if (s_hf_stk_thread[s_hf_stk_cur] != NULL) {
+        hf_task_stack_t *t   = &s_hf_stk.task[s_hf_stk_cur];
+        const uint32_t   end = (t->stack_size != 0u) ? t->stack_lo + t->stack_size
+                                                    : 0xFFFFFFFCu;
+        uint32_t p = (s_hf_stk_pos != 0u) ? s_hf_stk_pos : t->stack_lo;
+
+        for (uint32_t budget = HF_STACK_SAMPLE_WORDS;
+             budget != 0u && p < end && *(const uint32_t *)p == HF_RTOS_STACK_FILL;
+             budget--) {
+            p += 4u;
+        }
+
+        if (p < end && *(const uint32_t *)p == HF_RTOS_STACK_FILL) {
+            s_hf_stk_pos = p;   /* budget used up, still in the painted part */
+        } else {
+            hf_stack_pass_done(t, p - t->stack_lo);
+            s_hf_stk_cur = (s_hf_stk_cur + 1u) % HF_STACK_TASKS;
+            s_hf_stk_pos = 0;
+        }
+    }
+    __set_PRIMASK(primask);
+#endif
+}
+
+const hf_task_stack_t *HardFaultStack_Table(uint32_t *count)
+{
+#if HF_STACK_SAMPLER
+    if (s_hf_stk.magic == HF_STACK_MAGIC) {
+        *count = HF_STACK_TASKS;
+        return s_hf_stk.task;
+    }
+#endif
+    *count = 0;
+    return NULL;
+}
+
+/* ======================== Shadow call stack ======================== */
+
+#if HF_SHADOW_STACK
+#if (HF_SHADOW_DEPTH == 0u) || ((HF_SHADOW_DEPTH & (HF_SHADOW_DEPTH - 1u)) != 0u)
+#error "HF_SHADOW_DEPTH must be a power of two"
+#endif
+
+/*
+ * One ring per context: [0] Handler mode, shared by all ISRs as they nest
+ * strictly; [1] Thread mode outside any kernel thread (bare metal, or main()
+ * before the kernel has a current thread); the rest belong to kernel
+ * threads, a free one has no owner.
+ *
+ * The hooks run before and after every instrumented function, so this file
+ * must not be instrumented itself, nor anything that runs before .data and
+ * .bss are set up (startup code, SystemInit()).
+ */
+typedef struct {
+    const void *thread;
+    uint32_t    depth;                   /* calls entered, not yet left */
+    uint32_t    flags;                   /* HF_SHADOW_F_UNSYNCED */
+    uint32_t    site[HF_SHADOW_DEPTH];   /* call site of call n at n % HF_SHADOW_DEPTH */
+} hf_shadow_t;
+
+#if (HF_RTOS != HF_RTOS_NONE)
+#define HF_SHADOW_SLOTS (2u + HF_SHADOW_CONTEXTS)
+#else
+#define HF_SHADOW_SLOTS 2u
+#endif
+
+static hf_shadow_t s_hf_shadow[HF_SHADOW_SLOTS];
+
+#if (HF_RTOS != HF_RTOS_NONE)
+static hf_shadow_t *s_hf_shadow_cur = &s_hf_shadow[1];   /* thread of the last hook */
+static uint32_t     s_hf_shadow_evict;                    /* next slot taken when full */
+
+/*
+ * The running thread's ring, on its first hook after a switch. With all
+ * slots taken, one is taken over round robin; its owner then starts over
+ * when it runs again, and its ring ends up UNSYNCED.
+ */
+HF_NO_INSTRUMENT __attribute__((noinline))
+static hf_shadow_t *hf_shadow_attach(const void *thread)
+{
+    hf_shadow_t *s = &s_hf_shadow[1];
+
+    if (thread != NULL) {
+        const uint32_t primask = __get_PRIMASK();
+        __disable_irq();
+
+        hf_shadow_t *spare = NULL;
+        s = NULL;
+        for (uint32_t i = 2u; i < HF_SHADOW_SLOTS; i++) {
+            if (s_hf_shadow[i].thread == thread) {
+                s = &s_hf_shadow[i];
+                break;
+            }
+            if (s_hf_shadow[i].thread == NULL && spare == NULL) {
+                spare = &s_hf_shadow[i];
+            }
+        }
+        if (s == NULL) {
+            if (spare == NULL) {
+                spare = &s_hf_shadow[2u + s_hf_shadow_evict];
+                s_hf_shadow_evict = (s_hf_shadow_evict + 1u) % HF_SHADOW_CONTEXTS;
+            }
+            s = spare;
+            s->thread = thread;
+            s->depth  = 0u;
+            s->flags  = 0u;
+        }
+        __set_PRIMASK(primask);
+    }
+    s_hf_shadow_cur = s;
+    return s;
+}
+#endif
+
+/* Ring of the code running now: IPSR, then one compare with the last thread. */
+HF_NO_INSTRUMENT
+static inline hf_shadow_t *hf_shadow_ctx(void)
+{
+    if (__get_IPSR() != 0u) {
+        return &s_hf_shadow[0];
+    }
+#if (HF_RTOS != HF_RTOS_NONE)
+    hf_shadow_t *s      = s_hf_shadow_cur;
+    const void  *thread = hf_rtos_thread();
+    return (s->thread == thread) ? s : hf_shadow_attach(thread);
+#else
+    return &s_hf_shadow[1];
+#endif
+}
+
+/*
+ * GCC calls these right after the prologue and right before the epilogue
+ * of every instrumented function. A context only ever changes its own
+ * ring, and whatever preempts it leaves its depth as it found it, so no
+ * locking is needed.
+ */
+HF_NO_INSTRUMENT
+void __cyg_profile_func_enter(void *this_fn, void *call_site)
+{
+    hf_shadow_t *s = hf_shadow_ctx();
+
+    (void)this_fn;
+    s->site[s->depth & (HF_SHADOW_DEPTH - 1u)] = (uint32_t)call_site;
+    s->depth++;
+}
+
+HF_NO_INSTRUMENT
+void __cyg_profile_func_exit(void *this_fn, void *call_site)
+{
+    hf_shadow_t *s = hf_shadow_ctx();
+
+    (void)this_fn;
+    (void)call_site;
+    if (s->depth != 0u) {
+        s->depth--;
+    } else {
+        s->flags |= HF_SHADOW_F_UNSYNCED;   /* e.g. a longjmp() or a lost slot */
+    }
+}
+
+/* Ring of the context that faulted, NULL if it never had one. */
+static const hf_shadow_t *hf_shadow_faulted(const hf_dump_hdr_t *h)
+{
+    if ((h->exc_return & HF_EXC_RETURN_MODE) == 0u) {
+        return &s_hf_shadow[0];
+    }
+#if (HF_RTOS != HF_RTOS_NONE)
+    const void *thread = hf_rtos_thread();
+    if (thread != NULL) {
+        for (uint32_t i = 2u; i < HF_SHADOW_SLOTS; i++) {
+            if (s_hf_shadow[i].thread == thread) {
+                return &s_hf_shadow[i];
+            }
+        }
+        return NULL;
+    }
+#endif
+    return &s_hf_shadow[1];
+}
+
+/* Bytes its record takes in a dump, 0 if no instrumented call is active. */
+static uint32_t hf_shadow_ext_size(const hf_dump_hdr_t *h)
+{
+    const hf_shadow_t *s = hf_shadow_faulted(h);
+
+    if (s == NULL || (s->depth == 0u && s->flags == 0u)) {
+        return 0;
+    }
+    return (uint32_t)(sizeof(hf_ext_hdr_t) + sizeof(hf_shadow_rec_t))
+           + 4u * MIN(s->depth, HF_SHADOW_DEPTH);
+}
+
+/* Into the dump, innermost call first, so a short slot keeps those. */
+static void hf_shadow_ext(hf_ext_w_t *w, const hf_dump_hdr_t *h)
+{
+    const hf_shadow_t *s    = hf_shadow_faulted(h);
+    const uint32_t     head = sizeof(hf_ext_hdr_t) + sizeof(hf_shadow_rec_t);
+
+    if (hf_shadow_ext_size(h) == 0u || w->end - w->off < head) {
+        return;
+    }
+    hf_shadow_rec_t rec;
+    rec.thread   = (uint32_t)s->thread;
+    rec.depth    = s->depth;
+    rec.count    = (uint16_t)MIN(MIN(s->depth, HF_SHADOW_DEPTH), (w->end - w->off - head) / 4u);
+    rec.flags    = (uint8_t)(s->flags
+                 | ((s == &s_hf_shadow[0]) ? HF_SHADOW_F_HANDLER : 0u)
+                 | ((rec.count < s->depth) ? HF_SHADOW_F_WRAPPED : 0u));
+    rec.reserved = 0u;
+
+    const uint16_t len = (uint16_t)(sizeof(rec) + 4u * rec.count);
+    if (!hf_ext_begin(w, HF_EXT_SHADOW_STACK, len)) {
+        return;
+    }
+    hf_ext_write(w, &rec, sizeof(rec));
+    for (uint32_t i = 0; i < rec.count; i++) {
+        hf_ext_write(w, &s->site[(s->depth - 1u - i) & (HF_SHADOW_DEPTH - 1u)], 4u);
+    }
+    hf_ext_end(w, len);
+}
+#endif
+
+void HardFaultShadow_Release(const void *thread)
+{
+#if HF_SHADOW_STACK && (HF_RTOS != HF_RTOS_NONE)
+    const uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    for (uint32_t i = 2u; i < HF_SHADOW_SLOTS; i++) {
+        if (thread != NULL && s_hf_shadow[i].thread == thread) {
+            s_hf_shadow[i].thread = NULL;
+            if (s_hf_shadow_cur == &s_hf_shadow[i]) {
+                s_hf_shadow_cur = &s_hf_shadow[1];
+            }
+        }
+    }
+    __set_PRIMASK(primask);
+#else
+    (void)thread;
+#endif
+}
+
+/* ========================== Heap history ========================== */
+
+#if HF_HEAP_HISTORY
+#if (HF_HEAP_OPS == 0u) || ((HF_HEAP_OPS & (HF_HEAP_OPS - 1u)) != 0u) || (HF_HEAP_OPS > 2048u)
+#error "HF_HEAP_OPS must be a power of two up to 2048"
+#endif
+
+#define HF_HEAP_MAGIC 0x50484648u   /* 'HFHP' */
+
+/*
+ * Kept across resets like the boot record. Calls made before
+ * HardFaultDumps_Init() are logged too, but a ring found without its magic
+ * is cleared there; total is masked on every use, so a garbage value is
+ * harmless.
+ */
+typedef struct {
+    uint32_t     magic;
+    uint32_t     total;                 /* ops logged, the next one goes to total % HF_HEAP_OPS */
+    hf_heap_op_t op[HF_HEAP_OPS];
+} hf_heap_log_t;
+
+HF_NOINIT static hf_heap_log_t s_hf_heap;
+
+/* HardFaultHeap_Log() writes entries as words. */
+_Static_assert(offsetof(hf_heap_log_t, op) % 4u == 0u &&
+               offsetof(hf_heap_op_t, info) == 4u && offsetof(hf_heap_op_t, caller) == 8u &&
+               offsetof(hf_heap_op_t, ctx) == 12u, "heap ring entries must be word aligned");
+
+/* From init: keep the history of earlier boots, mark where this one starts. */
+static void hf_heap_begin(void)
+{
+    if (s_hf_heap.magic != HF_HEAP_MAGIC) {
+        memset(&s_hf_heap, 0, sizeof(s_hf_heap));
+        s_hf_heap.magic = HF_HEAP_MAGIC;
+    }
+    HardFaultHeap_Log(HF_HEAP_OP_BOOT, NULL, s_hf_boot.boot_count, NULL);
+}
+
+/* Bytes the ring takes in a dump, 0 if nothing was logged. */
+static uint32_t hf_heap_ext_size(void)
+{
+    if (s_hf_heap.magic != HF_HEAP_MAGIC || s_hf_heap.total == 0u) {
+        return 0;
+    }
+    return (uint32_t)(sizeof(hf_ext_hdr_t) + sizeof(hf_heap_hist_t))
+           + MIN(s_hf_heap.total, HF_HEAP_OPS) * (uint32_t)sizeof(hf_heap_op_t);
+}
+
+/* Into the dump, newest first, so a short slot keeps the latest calls. */
+static void hf_heap_ext(hf_ext_w_t *w)
+{
+    const uint32_t head = sizeof(hf_ext_hdr_t) + sizeof(hf_heap_hist_t);
+
+    if (hf_heap_ext_size() == 0u || w->end - w->off < head + sizeof(hf_heap_op_t)) {
+        return;
+    }
+    const uint32_t total = s_hf_heap.total;
+    const hf_heap_hist_t hist = {
+        total,
+        (uint16_t)MIN(MIN(total, HF_HEAP_OPS), (w->end - w->off - head) / sizeof(hf_heap_op_t)),
+        sizeof(hf_heap_op_t)
+    };
+    const uint16_t len = (uint16_t)(sizeof(hist) + hist.count * sizeof(hf_heap_op_t));
+
+    if (!hf_ext_begin(w, HF_EXT_HEAP_OPS, len)) {
+        return;
+    }
+    hf_ext_write(w, &hist, sizeof(hist));
+    for (uint32_t i = 0; i < hist.count; i++) {
+        hf_ext_write(w, &s_hf_heap.op[(total - 1u - i) & (HF_HEAP_OPS - 1u)],
+                     sizeof(hf_heap_op_t));
+    }
+    hf_ext_end(w, len);
+}
+
+/*
+ * The wrappers log a free before the block goes back to the allocator, so
+ * the entry is there even if freeing it faults (double free, trampled
+ * header), and an allocation once its block is known.
+ */
+#if (HF_HEAP_HISTORY & HF_HEAP_FREERTOS)
+void *__real_pvPortMalloc(size_t size);
+void  __real_vPortFree(void *ptr);
+
+void *__wrap_pvPortMalloc(size_t size)
+{
+    void *ptr = __real_pvPortMalloc(size);
+    HardFaultHeap_Log(HF_HEAP_OP_ALLOC, ptr, (uint32_t)size, __builtin_return_address(0));
+    return ptr;
+}
+
+void __wrap_vPortFree(void *ptr)
+{
+    if (ptr != NULL) {
+        HardFaultHeap_Log(HF_HEAP_OP_FREE, ptr, 0u, __builtin_return_address(0));
+    }
+    __real_vPortFree(ptr);
+}
+#endif
+
+#if (HF_HEAP_HISTORY & HF_HEAP_LIBC)
+void *__real_malloc(size_t size);
+void  __real_free(void *ptr);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+void *__wrap_malloc(size_t size)
+{
+    void *ptr = __real_malloc(size);
+    HardFaultHeap_Log(HF_HEAP_OP_ALLOC, ptr, (uint32_t)size, __builtin_return_address(0));
+    return ptr;
+}
+
+void __wrap_free(void *ptr)
+{
+    if (ptr != NULL) {
+        HardFaultHeap_Log(HF_HEAP_OP_FREE, ptr, 0u, __builtin_return_address(0));
+    }
+    __real_free(ptr);
+}
+
+void *__wrap_calloc(size_t n, size_t size)
+{
+    void *ptr = __real_calloc(n, size);
+    HardFaultHeap_Log(HF_HEAP_OP_ALLOC, ptr, (uint32_t)(n * size), __builtin_return_address(0));
+    return ptr;
+}
+
+/* Logged afterwards: a free of the old block if it moved or went away,
+ * then the new one (or a failed allocation, the old block stays). */
+void *__wrap_realloc(void *old, size_t size)
+{
+    void *const caller = __builtin_return_address(0);
+    void *ptr = __real_realloc(old, size);
+
+    if (old != NULL && ptr != old && (ptr != NULL || size == 0u)) {
+        HardFaultHeap_Log(HF_HEAP_OP_FREE, old, 0u, caller);
+    }
+    if (size != 0u) {
+        HardFaultHeap_Log(HF_HEAP_OP_ALLOC, ptr, (uint32_t)size, caller);
+    }
+    return ptr;
+}
+#endif
+#endif
+
+/*
+ * About 20 instructions: the context, then four stores with interrupts
+ * masked. An entry is never torn, whoever preempts the allocator.
+ */
+void HardFaultHeap_Log(uint32_t op, const void *ptr, uint32_t size, const void *caller)
+{
+#if HF_HEAP_HISTORY
+    uint32_t ctx = __get_IPSR();
+#if (HF_RTOS != HF_RTOS_NONE)
+    if (ctx == 0u) {
+        ctx = (uint32_t)hf_rtos_thread();
+    }
+#endif
+    const uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    /* Word stores into the packed record: still four STRs when built with
+     * -mno-unaligned-access, as strict fault profiles need. */
+    uint32_t *e = (uint32_t *)&s_hf_heap.op[s_hf_heap.total & (HF_HEAP_OPS - 1u)];
+    e[0] = (uint32_t)ptr;
+    e[1] = HF_HEAP_INFO(op, size);
+    e[2] = (uint32_t)caller;
+    e[3] = ctx;
+    s_hf_heap.total++;
+    __set_PRIMASK(primask);
+#else
+    (void)op;
+    (void)ptr;
+    (void)size;
+    (void)caller;
+#endif
+}
+
+/* ======================= Integrity scanner ======================= */
+
+#if HF_SCAN
+#if (HF_SCAN_HEAPS == 0u) || (HF_SCAN_CANARY_WORDS == 0u)
+#error "HF_SCAN_HEAPS and HF_SCAN_CANARY_WORDS must be at least 1"
+#endif
+
+/* What one check costs where there is no cycle counter to measure it. */
+#define HF_SCAN_CHECK_CYCLES 40u
+
+/* heap_4/heap_5 block header on 32-bit ports: BlockLink_t {next, size},
+ * 8-byte aligned, top bit of the size set while the block is in use. */
+#define HF_SCAN_HEAP_ALIGN   8u
+#define HF_SCAN_HEAP_HDR     8u
+#define HF_SCAN_HEAP_USED    0x80000000u
+
+/* Checks of a pass, in order: sampler tasks, main stack, heap regions. */
+#if HF_STACK_SAMPLER
+#define HF_SCAN_ITEM_MSP     HF_STACK_TASKS
+#else
+#define HF_SCAN_ITEM_MSP     0u
+#endif
+#define HF_SCAN_ITEM_HEAP    (HF_SCAN_ITEM_MSP + 1u)
+
+typedef struct {
+    uint32_t lo;   /* first block header */
+    uint32_t hi;
+} hf_scan_heap_t;
+
+/* This boot only (.bss). */
+static hf_scan_heap_t    s_hf_scan_heap[HF_SCAN_HEAPS];
+static uint32_t          s_hf_scan_heaps;
+static volatile uint32_t s_hf_scan_gen;    /* bumped by HardFaultScan_HeapChanged() */
+static uint32_t          s_hf_scan_seen;   /* s_hf_scan_gen the heap walk is valid for */
+static uint32_t          s_hf_scan_item;   /* check in progress */
+static uint32_t          s_hf_scan_pos;    /* next block header, 0 = start the region */
+static hf_scan_rec_t     s_hf_scan_found;  /* kind 0 = nothing found */
+
+static bool hf_dump_soft(void);
+
+/* From init: the budget is measured in DWT cycles where there are some. */
+static void hf_scan_begin(void)
+{
+    hf_arch_cycles_enable();
+}
+
+/* The lowest words of a stack must still hold its fill. */
+static void hf_scan_fill(uint32_t lo, uint32_t fill, uint8_t kind)
+{
+    const uint32_t *w = (const uint32_t *)lo;
+
+    for (uint32_t k = 0; k < HF_SCAN_CANARY_WORDS; k++) {
+        if (w[k] != fill) {
+            s_hf_scan_found.kind     = kind;
+            s_hf_scan_found.addr     = lo + 4u * k;
+            s_hf_scan_found.found    = w[k];
+            s_hf_scan_found.expected = fill;
+            s_hf_scan_found.region   = lo;
+            return;
+        }
+    }
+}
+
+#if HF_STACK_SAMPLER
+/* Under the lock: once untracked, a task's stack may be freed. */
+static void hf_scan_task(uint32_t i)
+{
+    const uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    if (s_hf_stk_thread[i] != NULL) {
+        hf_scan_fill(s_hf_stk.task[i].stack_lo, HF_RTOS_STACK_FILL, HF_SCAN_TASK_STACK);
+        if (s_hf_scan_found.kind != 0u) {
+            memcpy(s_hf_scan_found.name, s_hf_stk.task[i].name, HF_STACK_NAME_LEN);
+        }
+    }
+    __set_PRIMASK(primask);
+}
+#endif
+
+static void hf_scan_msp(void)
+{
+#if HF_MSP_PAINT
+    if (s_hf_msp_painted && hf_msp_limit() != 0u) {
+        hf_scan_fill(hf_msp_limit(), HF_MSP_FILL, HF_SCAN_MAIN_STACK);
+    }
+#endif
+}
+
+/*
+ * One block header of a heap region; true at the end marker. The walk
+ * spans many calls, so it starts over whenever the allocator changed the
+ * heap in between: the next header may lie inside a merged block by then.
+ * A changed heap is never reported as corrupt, only a stable one.
+ */
+static bool hf_scan_heap_block(const hf_scan_heap_t *r)
+{
+    const uint32_t gen = s_hf_scan_gen;
+
+    if (gen != s_hf_scan_seen || s_hf_scan_pos == 0u) {
+        s_hf_scan_seen = gen;
+        s_hf_scan_pos  = r->lo;
+    }
+
+    const uint32_t p    = s_hf_scan_pos;
+    const uint32_t next = ((const uint32_t *)p)[0];
+    const uint32_t raw  = ((const uint32_t *)p)[1];
+    const uint32_t size = raw & ~HF_SCAN_HEAP_USED;
+
+    if (s_hf_scan_gen != gen) {
+        return false;   /* changed while reading: start over next time */
+    }
+    if (size == 0u) {
+        return true;    /* end marker (heap_4 before the first allocation: zeros) */
+    }
+
+    /* The size must leave room for the end marker behind the block. */
+    if ((size & (HF_SCAN_HEAP_ALIGN - 1u)) != 0u || size < HF_SCAN_HEAP_HDR ||
+        size > r->hi - p - HF_SCAN_HEAP_HDR) {
+        s_hf_scan_found.kind  = HF_SCAN_HEAP_SIZE;
+        s_hf_scan_found.addr  = p + 4u;
+        s_hf_scan_found.found = raw;
+    } else if ((raw & HF_SCAN_HEAP_USED) ? (next != 0u)
+                                         : (next == 0u || (next & (HF_SCAN_HEAP_ALIGN - 1u)) != 0u)) {
+        s_hf_scan_found.kind  = HF_SCAN_HEAP_LINK;
+        s_hf_scan_found.addr  = p;
+        s_hf_scan_found.found = next;
+    } else {
+        s_hf_scan_pos = p + size;
+        return false;
+    }
+    s_hf_scan_found.region = r->lo;
+    return false;
+}
+
+/* One check of the current item; true when the item is done. */
+static bool hf_scan_check(void)
+{
+    const uint32_t i = s_hf_scan_item;
+
+#if HF_STACK_SAMPLER
+    if (i < HF_SCAN_ITEM_MSP) {
+        hf_scan_task(i);
+        return true;
+    }
+#endif
+    if (i == HF_SCAN_ITEM_MSP) {
+        hf_scan_msp();
+        return true;
+    }
+    return hf_scan_heap_block(&s_hf_scan_heap[i - HF_SCAN_ITEM_HEAP]);
+}
+
+static uint32_t hf_scan_ext_size(void)
+{
+    return (s_hf_scan_found.kind != 0u)
+         ? (uint32_t)(sizeof(hf_ext_hdr_t) + sizeof(hf_scan_rec_t)) : 0u;
+}
+
+static void hf_scan_ext(hf_ext_w_t *w)
+{
+    if (s_hf_scan_found.kind != 0u &&
+        hf_ext_begin(w, HF_EXT_SCAN, sizeof(hf_scan_rec_t))) {
+        hf_ext_write(w, &s_hf_scan_found, sizeof(hf_scan_rec_t));
+        hf_ext_end(w, sizeof(hf_scan_rec_t));
+    }
+}
+#endif
+
+/*
+ * Checks until the budget is spent, at least one. A check is one stack
+ * end or one heap block header: a few loads and compares, so the budget
+ * is overrun by well under 100 cycles.
+ */
+hf_scan_t HardFaultScan_Step(void)
+{
+#if HF_SCAN
+    const uint32_t t0 = hf_arch_cycles();
+    uint32_t spent = 0;
+
+    if (s_hf_scan_found.kind != 0u) {
+        return HF_SCAN_FOUND;
+    }
+    do {
+        if (s_hf_scan_item >= HF_SCAN_ITEM_HEAP + s_hf_scan_heaps) {
+            s_hf_scan_item = 0;
+            s_hf_scan_pos  = 0;
+            return HF_SCAN_PASS_DONE;
+        }
+        if (hf_scan_check()) {
+            s_hf_scan_item++;
+            s_hf_scan_pos = 0;
+        }
+        if (s_hf_scan_found.kind != 0u) {
+            (void)hf_dump_soft();
+            return HF_SCAN_FOUND;
+        }
+#if HF_ARCH_HAS_CYCCNT
+        spent = hf_arch_cycles() - t0;
+#else
+        spent += HF_SCAN_CHECK_CYCLES;
+#endif
+    } while (spent < HF_SCAN_BUDGET_CYCLES);
+    (void)t0;
+    return HF_SCAN_RUNNING;
+#else
+    return HF_SCAN_OFF;
+#endif
+}
+
+bool HardFaultScan_AddHeap(const void *start, uint32_t len)
+{
+#if HF_SCAN
+    /* Where heap_4/heap_5 put the first block: start aligned up. */
+    const uint32_t lo = ((uint32_t)start + HF_SCAN_HEAP_ALIGN - 1u) & ~(HF_SCAN_HEAP_ALIGN - 1u);
+    const uint32_t hi = (uint32_t)start + len;
+    bool added = false;
+
+    const uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    if (s_hf_scan_heaps < HF_SCAN_HEAPS && hi >= lo + 2u * HF_SCAN_HEAP_HDR) {
+        s_hf_scan_heap[s_hf_scan_heaps].lo = lo;
+        s_hf_scan_heap[s_hf_scan_heaps].hi = hi;
+        s_hf_scan_heaps++;
+        added = true;
+    }
+    __set_PRIMASK(primask);
+    return added;
+#else
+    (void)start;
+    (void)len;
+    return false;
+#endif
+}
+
+void HardFaultScan_HeapChanged(void)
+{
+#if HF_SCAN
+    s_hf_scan_gen++;
+#endif
+}
+
+const hf_scan_rec_t *HardFaultScan_Found(void)
+{
+#if HF_SCAN
+    if (s_hf_scan_found.kind != 0u) {
+        return &s_hf_scan_found;
+    }
+#endif
+    return NULL;
+}
+
+/* ===================== HardFault handler core ===================== */
+
+/* Bytes the extension records of this dump would take (h: header so far). */
+static uint32_t hf_ext_size(const hf_dump_hdr_t *h)
+{
+    uint32_t n = 0;
+#if HF_SCAN
+    n += hf_scan_ext_size();
+#endif
+#if HF_SHADOW_STACK
+    n += hf_shadow_ext_size(h);
+#endif
+#if HF_HEAP_HISTORY
+    n += hf_heap_ext_size();
+#endif
+#if HF_STACK_SAMPLER
+    n += hf_stack_ext_size();
+#endif
+    (void)h;
+    return n;
+}
+
+/* Writes them after the stack payload, each as far as the slot allows. */
+static void hf_ext_fill(hf_ext_w_t *w, const hf_dump_hdr_t *h)
+{
+#if HF_SCAN
+    hf_scan_ext(w);
+#endif
+#if HF_SHADOW_STACK
+    hf_shadow_ext(w, h);
+#endif
+#if HF_HEAP_HISTORY
+    hf_heap_ext(w);
+#endif
+#if HF_STACK_SAMPLER
+    hf_stack_ext(w);
+#endif
+    (void)w;
+    (void)h;
+}
+
+/* forward declaration of C helper called by the naked handler */
+static void prvGetRegistersFromStack(uint32_t *fault_sp, uint32_t exc_return);
+
+/* This is the vector-table entry. Do NOT call directly. */
+__attribute__((naked)) void HardFault_Handler(void)
+{
+    __asm volatile
+    (
+        HF_ARCH_HANDLER_ASM
+    );
+}
+
+#if HF_ARCH_HAS_CFSR
+/* hf_arch_fault_enable() turns these on, so they take the same path;
+ * CFSR tells them apart. The startup file's weak ones just loop. */
+void MemManage_Handler(void)  __attribute__((alias("HardFault_Handler")));
+void BusFault_Handler(void)   __attribute__((alias("HardFault_Handler")));
+void UsageFault_Handler(void) __attribute__((alias("HardFault_Handler")));
+#endif
+
+/*
+ * Writes this image's slot from an exception frame. flags go into the
+ * header as given; a soft dump (HF_DUMP_F_SOFT) leaves the fault count
+ * alone, so the next boot does not count as one after a fault.
+ */
+static void hf_dump_write(uint32_t *fault_sp, uint32_t exc_return, uint16_t flags)
+{
+    const uint32_t used_psp = (exc_return & HF_EXC_RETURN_SPSEL) ? 1U : 0U;
+    const uint32_t msp = __get_MSP();
+    const uint32_t psp = __get_PSP();
+
+    /* Secure/Non-secure and extended frames are resolved per core. */
+    fault_sp = hf_arch_frame(fault_sp, exc_return);
+
+    /* core regs from stacked frame (basic frame, ignoring FP extension) */
+    uint32_t r0  = fault_sp[0];
+    uint32_t r1  = fault_sp[1];
+    uint32_t r2  = fault_sp[2];
+    uint32_t r3  = fault_sp[3];
+    uint32_t r12 = fault_sp[4];
+    uint32_t lr  = fault_sp[5];
+    uint32_t pc  = fault_sp[6];
+    uint32_t psr = fault_sp[7];
+
+    hf_dump_hdr_t hdr;
+    memset(&hdr, 0, sizeof(hdr));
+
+    hdr.magic      = HF_MAGIC;
+    hdr.version    = HF_VERSION;
+    hdr.header_len = sizeof(hf_dump_hdr_t);
+
+    hdr.exc_return = exc_return;
+    hdr.msp        = msp;
+    hdr.psp        = psp;
+    hdr.active_sp  = (uint32_t)fault_sp;
+    hdr.used_sp    = used_psp;
+
+    /* SCB fault info, FP context, stack limit: whatever this core has */
+    hf_arch_capture(&hdr, exc_return);
+    hdr.flags |= flags;
+#if HF_ARCH_HAS_CFSR
+    /* UNDEFINSTR at HardFault_FpuCheck()'s UDF: r0 holds the FPSCR flags. */
+    if (!(flags & HF_DUMP_F_SOFT) && (hdr.scb_cfsr & (1u << 16)) &&
+        *(const uint16_t *)(pc & ~1u) == (0xDE00u | HF_FPU_TRAP_IMM)) {
+        hdr.flags |= HF_DUMP_F_FPU_TRAP;
+    }
+#endif
+
+    /* Main stack depth, and whether this frame ran out of it. */
+    hdr.msp_limit    = hf_msp_limit();
+    hdr.msp_max_used = hf_msp_used();
+    if (!used_psp && hdr.msp_limit != 0u &&
+        (uint32_t)fault_sp < hdr.msp_limit + HF_MSP_NEAR_BYTES) {
+        hdr.flags |= HF_DUMP_F_MSP_NEAR;
+    }
+
+    hdr.r0 = r0; hdr.r1 = r1; hdr.r2 = r2; hdr.r3 = r3;
+    hdr.r12 = r12; hdr.lr = lr; hdr.pc = pc; hdr.psr = psr;
+
+    /* Try to capture RTOS info about the current thread (if compiled in) */
+    hdr.rtos_present = HF_RTOS_NONE;
+
+#if (HF_RTOS != HF_RTOS_NONE)
+    uint32_t task_lo = 0;
+    uint32_t task_hi = 0;
+
+    if (hf_rtos_running()) {
+        const char *name = hf_rtos_thread_name();
+
+        hf_rtos_thread_stack(&task_lo, &task_hi);
+
+        hdr.rtos_present = HF_RTOS;
+        hdr.rtos_task_priority = hf_rtos_thread_priority();
+        hdr.rtos_stack_base = task_lo;
+        hdr.rtos_stack_high_water_bytes =
+            hf_stack_unused(task_lo, task_hi ? task_hi : (uint32_t)fault_sp,
+                            HF_RTOS_STACK_FILL);
+
+        if (name != NULL) {
+            strncpy(hdr.rtos_task_name, name, HF_MAX_TASK_NAME_LEN);
+        }
+        hdr.rtos_task_name[HF_MAX_TASK_NAME_LEN] = '\0';
+    }
+#endif
+
+    /* Now, copy some of the faulted stack into this image's slot */
+    if (!hf_mbox_valid()) {
+        hf_mbox_format();
+    }
+    hf_memclear(hf_slot(HF_IMAGE_ID), HF_SLOT_SIZE);
+    if (!(flags & HF_DUMP_F_SOFT)) {
+        hf_mbox()->fault_count[HF_IMAGE_ID]++;
+    }
+
+    const uint32_t max_payload = HF_SLOT_SIZE - (uint32_t)sizeof(hf_dump_hdr_t);
+
+    /* Extension records get the room they need, up to half the payload. */
+    const uint32_t ext_room = MIN(hf_ext_size(&hdr), max_payload / 2u);
+
+    /* Without precise RTOS stack bounds, limit to what the slot holds, the
+     * HF_MAX_STACK_COPY cap, and never read past the top of the main stack. */
+    uint32_t max_stack_copy = MIN(max_payload - ext_room, (uint32_t)HF_MAX_STACK_COPY);
+    if ((uint32_t)fault_sp < get_main_stack_top()) {
+        max_stack_copy = MIN(max_stack_copy,
+                             get_main_stack_top() - (uint32_t)fault_sp);
+    }
+#if (HF_RTOS != HF_RTOS_NONE)
+    /* Exact bound when the frame sits on a thread stack of known size. */
+    if (used_psp && task_hi != 0u &&
+        (uint32_t)fault_sp >= task_lo && (uint32_t)fault_sp < task_hi) {
+        max_stack_copy = MIN(max_stack_copy, task_hi - (uint32_t)fault_sp);
+    }
+#endif
+
+    hdr.stack_bytes = 0;
+    hdr.checksum    = 0;
+
+    /* Write header first (checksum to be updated later) */
+    hf_memwrite(HF_IMAGE_ID, 0, &hdr, sizeof(hdr));
+
+    /* Basic sanity: fault_sp must be below main stack top */
+    if ((uint32_t)fault_sp < get_main_stack_top()) {
+        hf_memwrite(HF_IMAGE_ID, sizeof(hdr), fault_sp, max_stack_copy);
+        hdr.stack_bytes = max_stack_copy;
+
+        /* Extension records behind the payload, with their own checksum */
+        hf_ext_w_t ext = { (uint32_t)sizeof(hdr) + hdr.stack_bytes, HF_SLOT_SIZE, 0u };
+        hf_ext_fill(&ext, &hdr);
+        hdr.ext_bytes    = ext.off - ((uint32_t)sizeof(hdr) + hdr.stack_bytes);
+        hdr.ext_checksum = ext.xor;
+
+        /* Compute checksum over header(with checksum=0) + payload */
+        hdr.checksum = 0;
+        hdr.checksum = hf_xor(&hdr, sizeof(hdr))
+                     ^ hf_xor(&hf_slot(HF_IMAGE_ID)[sizeof(hdr)],
+                              hdr.stack_bytes);
+
+        hf_memwrite(HF_IMAGE_ID, 0, &hdr, sizeof(hdr));
+    }
+}
+
+/* Called from the naked handler, hence `used` despite being static. */
+__attribute__((used))
+static void prvGetRegistersFromStack(uint32_t *fault_sp, uint32_t exc_return)
+{
+    hf_dump_write(fault_sp, exc_return, 0u);
+
+#ifdef DEBUG
+    __ASM volatile ("BKPT #01");
+#endif
+
+    hf_arch_flush(__hf_dump_start, HF_DUMP_AREA_SIZE);
+
+    __DSB();
+    __ISB();
+    NVIC_SystemReset();
+}
+
+#if HF_SCAN
+/*
+ * A dump of the running code, without a fault and without a reset. The
+ * frame is made up: PC is this function, LR its caller, and the stack
+ * payload starts just above it. A dump already in the slot is kept.
+ */
+static bool hf_dump_soft(void)
+{
+    const uint32_t ipsr = __get_IPSR();
+    /* Handler mode, or Thread mode on PSP or MSP; no FP context. */
+    const uint32_t exc_return = (ipsr != 0u) ? 0xFFFFFFF1u
+                              : (__get_CONTROL() & 2u) ? 0xFFFFFFFDu : 0xFFFFFFF9u;
+    uint32_t frame[8] = { 0 };
+    bool     written = false;
+
+    frame[5] = (uint32_t)__builtin_return_address(0);
+    frame[6] = (uint32_t)&hf_dump_soft;
+    frame[7] = (1u << 24) | ipsr;   /* Thumb bit */
+
+    const uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    if (!HardFault_DumpAvailableId(HF_IMAGE_ID)) {
+        hf_dump_write(frame, exc_return, HF_DUMP_F_SOFT);
+        hf_arch_flush(__hf_dump_start, HF_DUMP_AREA_SIZE);
+        written = true;
+    }
+    __set_PRIMASK(primask);
+    return written;
+}
+#endif
+
+/* ===================== Flash integrity check ===================== */
+
+#if HF_FLASH_CHECK
+#include "hf_flashcheck.h"
+
+/* From hf_image_crc.ld: checked range and the CRC word that ends it. */
+extern const uint32_t __hf_image_start[];
+extern const uint32_t __hf_image_crc[];
+
+static uint32_t s_hf_fc_t0;
+
+static void hf_flash_check_start(void)
+{
+    const uint32_t bytes = (uint32_t)__hf_image_crc - (uint32_t)__hf_image_start;
+
+    s_hf_boot.flash_crc_expected = *__hf_image_crc;
+    s_hf_boot.flash_crc_actual   = 0;
+    s_hf_boot.flash_check_bytes  = bytes;
+    s_hf_boot.flash_check_cycles = 0;
+    if (s_hf_boot.flash_crc_expected == 0xFFFFFFFFu) {   /* erased: never patched */
+        s_hf_boot.flash_check = HF_FLASH_CHECK_NO_CRC;
+        return;
+    }
+
+    hf_arch_cycles_enable();
+    s_hf_fc_t0 = hf_arch_cycles();
+
+    s_hf_boot.flash_check = HF_FLASH_CHECK_RUNNING;
+    hf_flashcheck_begin((uint32_t)__hf_image_start, bytes / 4u);
+}
+#endif
+
+hf_flash_check_t HardFault_FlashCheckPoll(bool wait)
+{
+#if HF_FLASH_CHECK
+    if (s_hf_boot.flash_check != HF_FLASH_CHECK_RUNNING) {
+        return (hf_flash_check_t)s_hf_boot.flash_check;
+    }
+
+    int st;
+    do {
+        st = hf_flashcheck_step();
+    } while (wait && st == HF_FLASHCHECK_BUSY);
+    if (st == HF_FLASHCHECK_BUSY) {
+        return HF_FLASH_CHECK_RUNNING;
+    }
+
+    s_hf_boot.flash_check_cycles = hf_arch_cycles() - s_hf_fc_t0;
+    s_hf_boot.flash_crc_actual   = hf_flashcheck_result();
+    hf_flashcheck_release();
+
+    if (st == HF_FLASHCHECK_ERROR) {
+        s_hf_boot.flash_check = HF_FLASH_CHECK_ERROR;
+    } else if (s_hf_boot.flash_crc_actual == s_hf_boot.flash_crc_expected) {
+        s_hf_boot.flash_check = HF_FLASH_CHECK_PASS;
+    } else {
+        s_hf_boot.flash_check = HF_FLASH_CHECK_FAIL;
+    }
+
+#if HF_BOOT_PRINT
+    HF_LOGF("Flash CRC: %s (0x%08" PRIX32 ", expected 0x%08" PRIX32
+            ", %" PRIu32 " bytes in %" PRIu32 " cycles)\r\n",
+            (s_hf_boot.flash_check == HF_FLASH_CHECK_PASS) ? "OK" :
+            (s_hf_boot.flash_check == HF_FLASH_CHECK_FAIL) ? "MISMATCH" : "DMA ERROR",
+            s_hf_boot.flash_crc_actual, s_hf_boot.flash_crc_expected,
+            s_hf_boot.flash_check_bytes, s_hf_boot.flash_check_cycles);
+#endif
+    return (hf_flash_check_t)s_hf_boot.flash_check;
+#else
+    (void)wait;
+    return HF_FLASH_CHECK_OFF;
+#endif
+}
+
+/* ======================== Power-fail save ======================== */
+
+#if HF_PVD_SAVE
+#ifndef HF_PVD_HOLDUP_US
+#error "HF_PVD_SAVE needs HF_PVD_HOLDUP_US, the board's hold-up time (see README.md)"
+#endif
+
+#include "hf_pvd.h"
+
+/* From hf_pvd.ld. */
+extern uint32_t __hf_pvd_start[];
+extern uint32_t __hf_pvd_end[];
+
+/*
+ * Page layout, in double words (DW): per record a header DW
+ * {head = id | len << 16, XOR of the data bytes ^ ~head} and the data
+ * padded to whole DWs, then the commit DW {HF_PVD_COMMIT, records |
+ * skipped << 8 | us << 16}. A save that lost power before its commit is
+ * ignored.
+ */
+#define HF_PVD_COMMIT    0x43504648u   /* 'HFPC' */
+#define HF_PVD_REC_MBOX  1u
+#define HF_PVD_REC_BOOT  2u
+#define HF_PVD_REC_HEAP  3u
+#define HF_PVD_REC_STACK 4u
+#define HF_PVD_REC_SLOT  8u            /* + slot id */
+
+#define HF_PVD_DW(bytes) (((uint32_t)(bytes) + 7u) / 8u)
+#define HF_PVD_BUDGET    ((HF_PVD_HOLDUP_US - HF_PVD_ENTRY_US) / HF_PVD_DW_US)
+
+_Static_assert(HF_PVD_HOLDUP_US > HF_PVD_ENTRY_US &&
+               HF_PVD_BUDGET >= 1u + HF_PVD_DW(sizeof(hf_mbox_hdr_t)) +
+                                1u + HF_PVD_DW(sizeof(hf_boot_record_t)) + 1u,
+               "HF_PVD_HOLDUP_US does not cover the mailbox header and the boot record");
+
+static bool     s_hf_pvd_ready;      /* page erased on this boot, not written yet */
+static uint32_t s_hf_pvd_next;       /* address of the next DW */
+static uint32_t s_hf_pvd_dw;         /* DWs written by this save */
+static uint32_t s_hf_pvd_t0;
+static uint32_t s_hf_pvd_saved;
+static uint32_t s_hf_pvd_skipped;
+static bool     s_hf_pvd_error;      /* flash error: no commit */
+static bool     s_hf_pvd_found;      /* init: a committed save was in the page */
+static uint32_t s_hf_pvd_info;       /* its commit word */
+static bool     s_hf_pvd_restored;
+
+/*
+ * Since the PVD fired: HF_PVD_ENTRY_US for the interrupt entry, which comes
+ * before s_hf_pvd_t0, plus the save so far, measured or estimated from the
+ * DWs written. Both branches count the same way against HF_PVD_HOLDUP_US.
+ */
+static uint32_t hf_pvd_us(void)
+{
+#if HF_ARCH_HAS_CYCCNT
+    return HF_PVD_ENTRY_US +
+           (uint32_t)((uint64_t)(hf_arch_cycles() - s_hf_pvd_t0) * 1000000u / SystemCoreClock);
+#else
+    return HF_PVD_ENTRY_US + s_hf_pvd_dw * HF_PVD_DW_US;
+#endif
+}
+
+static bool hf_pvd_put(uint32_t lo, uint32_t hi)
+{
+    if (!hf_pvd_flash_dw(s_hf_pvd_next, lo, hi)) {
+        s_hf_pvd_error = true;
+        return false;
+    }
+    s_hf_pvd_next += 8u;
+    s_hf_pvd_dw++;
+    return true;
+}
+
+/* One record, whole or not at all: it must leave time and room for the commit. */
+static void hf_pvd_record(uint32_t id, const void *p, uint32_t len)
+{
+    const uint8_t *b = (const uint8_t *)p;
+    const uint32_t dw = 1u + HF_PVD_DW(len) + 1u;
+    const uint32_t room = ((uint32_t)__hf_pvd_end - s_hf_pvd_next) / 8u;
+
+    if (s_hf_pvd_error) {
+        return;
+    }
+    if (dw > room || hf_pvd_us() + dw * HF_PVD_DW_US > HF_PVD_HOLDUP_US) {
+        s_hf_pvd_skipped++;
+        return;
+    }
+    const uint32_t head = id | (len << 16);
+
+    if (!hf_pvd_put(head, hf_xor(b, len) ^ ~head)) {
+        return;
+    }
+    for (uint32_t off = 0; off < len; off += 8u) {
+        uint32_t w[2] = { 0xFFFFFFFFu, 0xFFFFFFFFu };
+
+        memcpy(w, &b[off], MIN(8u, len - off));
+        if (!hf_pvd_put(w[0], w[1])) {
+            return;
+        }
+    }
+    s_hf_pvd_saved++;
+}
+
+/* Once per boot, interrupts off: from the PVD interrupt or a rehearsal. */
+static void hf_pvd_save(void)
+{
+    if (!s_hf_pvd_ready) {
+        return;
+    }
+    s_hf_pvd_ready   = false;
+    s_hf_pvd_t0      = hf_arch_cycles();
+    s_hf_pvd_next    = (uint32_t)__hf_pvd_start;
+    s_hf_pvd_dw      = 0;
+    s_hf_pvd_saved   = 0;
+    s_hf_pvd_skipped = 0;
+    s_hf_pvd_error   = false;
+
+    hf_pvd_flash_unlock();
+    hf_pvd_record(HF_PVD_REC_MBOX, hf_mbox(), sizeof(hf_mbox_hdr_t));
+    /* This image's slot first. */
+    for (uint32_t k = 0; k < HF_MBOX_SLOTS; k++) {
+        const uint8_t id = (uint8_t)((HF_IMAGE_ID + k) % HF_MBOX_SLOTS);
+
+        if (HardFault_DumpAvailableId(id)) {
+            hf_pvd_record(HF_PVD_REC_SLOT + id, hf_slot(id), HardFault_DumpSize(id));
+        }
+    }
+    hf_pvd_record(HF_PVD_REC_BOOT, &s_hf_boot, sizeof(s_hf_boot));
+#if HF_HEAP_HISTORY
+    hf_pvd_record(HF_PVD_REC_HEAP, &s_hf_heap, sizeof(s_hf_heap));
+#endif
+#if HF_STACK_SAMPLER
+    hf_pvd_record(HF_PVD_REC_STACK, &s_hf_stk, sizeof(s_hf_stk));
+#endif
+    if (!s_hf_pvd_error) {
+        const uint32_t us = MIN(hf_pvd_us(), 0xFFFFu);
+
+        (void)hf_pvd_put(HF_PVD_COMMIT, (MIN(s_hf_pvd_saved, 0xFFu)) |
+                                        (MIN(s_hf_pvd_skipped, 0xFFu) << 8) | (us << 16));
+    }
+    hf_pvd_flash_lock();
+}
+
+/* The commit DW of a complete save in the page, NULL if there is none. */
+static const uint32_t *hf_pvd_commit(void)
+{
+    const uint32_t *w = __hf_pvd_start;
+
+    while ((uint32_t)(__hf_pvd_end - w) >= 2u) {
+        if (w[0] == HF_PVD_COMMIT) {
+            return w;
+        }
+        const uint32_t len = w[0] >> 16;
+        const uint32_t dw  = HF_PVD_DW(len);
+
+        /* Header, data and a commit after them must all be in the page. */
+        if (w[0] == 0xFFFFFFFFu || 2u + dw > (uint32_t)(__hf_pvd_end - w) / 2u ||
+            hf_xor(&w[2], len) != (w[1] ^ ~w[0])) {
+            return NULL;
+        }
+        w += 2u + 2u * dw;
+    }
+    return NULL;
+}
+
+/* Lost with RAM: nothing valid, or a blank mailbox formatted by this boot's bootloader. */
+static bool hf_pvd_mbox_lost(void)
+{
+    if (!hf_mbox_valid()) {
+        return true;
+    }
+    for (uint8_t id = 0; id < HF_MBOX_SLOTS; id++) {
+        if (hf_mbox()->fault_count[id] != 0u || HardFault_DumpAvailableId(id)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * From init, before anything looks at the mailbox or the .noinit records:
+ * copy back from a committed save whatever RAM did not keep. After a dip
+ * that never reached the brown-out reset RAM is intact and wins.
+ */
+static void hf_pvd_restore(void)
+{
+    const uint32_t *c = hf_pvd_commit();
+    bool mbox = false;
+
+    if (c == NULL) {
+        return;
+    }
+    s_hf_pvd_found = true;
+    s_hf_pvd_info  = c[1];
+    for (const uint32_t *w = __hf_pvd_start; w < c; w += 2u + 2u * HF_PVD_DW(w[0] >> 16)) {
+        const uint32_t id  = w[0] & 0xFFFFu;
+        const uint32_t len = w[0] >> 16;
+        void *dst = NULL;
+
+        if (id == HF_PVD_REC_MBOX) {
+            if (len == sizeof(hf_mbox_hdr_t) && hf_pvd_mbox_lost()) {
+                dst  = hf_mbox();
+                mbox = true;
+            }
+        } else if (id >= HF_PVD_REC_SLOT && id < HF_PVD_REC_SLOT + HF_MBOX_SLOTS) {
+            if (mbox && len <= HF_SLOT_SIZE) {
+                dst = hf_slot((uint8_t)(id - HF_PVD_REC_SLOT));
+            }
+        } else if (id == HF_PVD_REC_BOOT) {
+            if (len == sizeof(s_hf_boot) && s_hf_boot.magic != HF_BOOT_MAGIC) {
+                dst = &s_hf_boot;
+            }
+#if HF_HEAP_HISTORY
+        } else if (id == HF_PVD_REC_HEAP) {
+            if (len == sizeof(s_hf_heap) && s_hf_heap.magic != HF_HEAP_MAGIC) {
+                dst = &s_hf_heap;
+            }
+#endif
+#if HF_STACK_SAMPLER
+        } else if (id == HF_PVD_REC_STACK) {
+            if (len == sizeof(s_hf_stk) && s_hf_stk.magic != HF_STACK_MAGIC) {
+                dst = &s_hf_stk;
+            }
+#endif
+        }
+        if (dst != NULL) {
+            memcpy(dst, &w[2], len);
+            s_hf_pvd_restored = true;
+        }
+    }
+}
+
+/* From init, after hf_boot_begin(): report, erase the page, arm the PVD. */
+static void hf_pvd_begin(void)
+{
+    const uint32_t info = s_hf_pvd_info;
+
+    s_hf_boot.pvd_records = 0;
+    s_hf_boot.pvd_skipped = 0;
+    s_hf_boot.pvd_save_us = 0;
+    if (s_hf_pvd_found) {
+        s_hf_boot.flags |= HF_BOOT_F_PVD_SAVED;
+        if (s_hf_pvd_restored) {
+            s_hf_boot.flags |= HF_BOOT_F_PVD_RESTORED;
+        }
+        s_hf_boot.pvd_records = info & 0xFFu;
+        s_hf_boot.pvd_skipped = (info >> 8) & 0xFFu;
+        s_hf_boot.pvd_save_us = info >> 16;
+#if HF_BOOT_PRINT
+        HF_LOGF("Power-fail save: %" PRIu32 " records, %" PRIu32 " skipped, %" PRIu32
+                " of %" PRIu32 " us hold-up%s\r\n",
+                s_hf_boot.pvd_records, s_hf_boot.pvd_skipped, s_hf_boot.pvd_save_us,
+                (uint32_t)HF_PVD_HOLDUP_US, s_hf_pvd_restored ? ", restored" : "");
+#endif
+    }
+
+    hf_arch_cycles_enable();
+    for (const uint32_t *w = __hf_pvd_start; w < __hf_pvd_end; w++) {
+        if (*w != 0xFFFFFFFFu) {
+            hf_pvd_flash_unlock();
+            const bool ok = hf_pvd_flash_erase((uint32_t)__hf_pvd_start);
+            hf_pvd_flash_lock();
+            if (!ok) {
+#if HF_BOOT_PRINT
+                HF_LOGF("Power-fail save: page erase failed, not armed\r\n");
+#endif
+                return;
+            }
+            break;
+        }
+    }
+    s_hf_pvd_ready = true;
+    hf_pvd_arm();
+}
+
+/*
+ * VDD crossed the PVD threshold on its way down. Save, then wait for the
+ * brown-out reset; if VDD comes back instead, reset anyway, as the page is
+ * used up until the next boot erases it.
+ */
+void HF_PVD_IRQ_HANDLER(void)
+{
+    hf_pvd_ack();
+    if (!hf_pvd_low()) {
+        return;   /* rising crossing on the shared line, or the dip is over */
+    }
+    __disable_irq();
+    hf_pvd_save();
+    while (hf_pvd_low()) {
+    }
+    NVIC_SystemReset();
+}
+#endif
+
+void HardFaultPvd_Rehearse(void)
+{
+#if HF_PVD_SAVE
+    __disable_irq();
+    hf_pvd_save();
+    NVIC_SystemReset();
+#endif
+}
+
+/* ========================= Public init API ========================= */
+
+void HardFaultDumps_Init(void)
+{
+#if HF_BOOT_TIMELINE
+    hf_times_begin();
+#endif
+    HF_BOOT_MARK(HF_MARK_INIT);
+
+    /* Enable detailed faults */
+    Fault_EnableAll();
+
+#if HF_PVD_SAVE
+    /* Power was lost: put back what the last power-fail save kept. */
+    hf_pvd_restore();
+#endif
+
+    /* First boot, or another image left an incompatible layout behind. */
+    if (!hf_mbox_valid()) {
+        hf_mbox_format();
+    }
+
+    hf_boot_begin();
+#if HF_PVD_SAVE
+    hf_pvd_begin();
+#endif
+#if HF_MSP_PAINT
+    hf_msp_paint();
+#endif
+#if HF_STACK_SAMPLER
+    hf_stack_begin();
+#endif
+#if HF_HEAP_HISTORY
+    hf_heap_begin();
+#endif
+#if HF_SCAN
+    hf_scan_begin();
+#endif
+#if HF_FLASH_CHECK
+    /* Start before printing: the CRC runs while the dump goes out. */
+    if (s_hf_boot.flags & HF_BOOT_F_FAULT_RESET) {
+        hf_flash_check_start();
+    }
+#endif
 
     /* If a dump exists from a previous reset, decode & print it. */
+#if HF_BOOT_PRINT
     if (HardFault_DumpAvailable()) {
         HardFault_DecodeAndPrint();
         /* Optionally clear afterwards so it doesn't spam every boot */
         HardFault_ClearDump();
+        HF_BOOT_MARK(HF_MARK_INIT_PRINTED);
     }
+#endif
+    /* With HF_BOOT_PRINT == 0 the dump stays until the host clears it. */
+    HF_BOOT_MARK(HF_MARK_INIT_DONE);
 }
@@ -4,23 +4,45 @@
 #include <stdbool.h>
 #include <stdio.h>
 
+#include "hf_abi.h"
+
 /*
- * HardFault dump & post-mortem support for Cortex-M4 / STM32G4
+ * HardFault dump & post-mortem support for Cortex-M0+/M3/M4/M7/M33
+ * (STM32G4 by default, see HF_DEVICE_HEADER and hf_arch.h)
  *
  * Features:
  *  - Saves SCB fault registers, core registers, and a slice of the
- *    faulted stack into a persistent .noinit buffer that survives reset.
- *  - Optional FreeRTOS integration: captures task name, priority and stack
- *    high-water mark of the faulted task (if the scheduler is running).
+ *    faulted stack into a persistent, fixed-address mailbox that survives
+ *    reset and is shared with the bootloader (see hf_abi.h).
+ *  - Optional RTOS integration (FreeRTOS, Zephyr, ThreadX, RTX5; hf_rtos.h):
+ *    captures thread name, priority and stack high-water mark of the
+ *    faulted thread (if the scheduler is running).
  *  - On next boot, you call HardFaultDumps_Init() and it will:
  *      * Enable detailed Mem/Bus/Usage faults.
  *      * If a previous HardFault dump exists, decode it and print it via HF_LOGF.
+ *      * Optionally (HF_FLASH_CHECK) start a CRC check of the flash image.
+ *      * Optionally (HF_MSP_PAINT) paint the main stack for high-water marks.
+ *  - Optionally (HF_STACK_SAMPLER) samples every task's stack a few words at
+ *    a time in the background and keeps a high-water trend in every dump.
+ *  - Optionally (HF_BOOT_TIMELINE) timestamps the boot from reset to
+ *    "application ready" and keeps cold and post-fault latencies apart.
+ *  - Optionally (HF_SHADOW_STACK) keeps a shadow call stack per thread from
+ *    -finstrument-functions hooks, for exact backtraces in the dump.
+ *  - Optionally (HF_HEAP_HISTORY) logs the last allocator calls with their
+ *    callers, for use-after-free and double-free forensics.
+ *  - Optionally (HF_SCAN) checks heap block headers and stack-end fill
+ *    words in the background and writes a dump, without a reset, as soon
+ *    as one is corrupted.
+ *  - Optionally (HF_PVD_SAVE, STM32G4) saves the persistent records to a
+ *    flash page on a power-fail warning, and restores them on the next boot.
  *
  *  - PC side: a tiny Python script (hf_addr2line.py) parses the UART log and
  *    resolves PC/LR addresses to function and file:line using addr2line.
  *
  * Usage:
- *  - Add .noinit section in your linker script (see README.md).
+ *  - Add the HF_DUMP region and hardfault_dump.ld to every image's linker
+ *    script (see README.md). Build the bootloader with
+ *    -DHF_IMAGE_ID=HF_IMAGE_BOOTLOADER.
  *  - Add hardfault_dump.c to your build.
  *  - Ensure your UART/printf is ready, then call HardFaultDumps_Init() in main().
  *  - Trigger a HardFault (or wait for a real one), then inspect the next boot log.
@@ -31,6 +53,346 @@
 #define HF_LOGF printf
 #endif
 
+/*
+ * Set HF_BOOT_PRINT to 0 to keep HardFaultDumps_Init() quiet: the dump is
+ * then left in place for on-demand retrieval (hf_proto.h / hf_fetch.py)
+ * until the host clears it.
+ */
+#ifndef HF_BOOT_PRINT
+#define HF_BOOT_PRINT 1
+#endif
+
+/* Number of dump slots addressable by id: one per image (HF_IMAGE_*). */
+#define HF_DUMP_COUNT HF_MBOX_SLOTS
+
+/*
+ * Set HF_FLASH_CHECK to 1 to CRC the application image after every
+ * fault-caused reset (STM32G4 CRC unit + DMA, see hf_flashcheck.h), to rule
+ * out flash bit-rot. HardFaultDumps_Init() starts it; it runs in the
+ * background and HardFault_FlashCheckPoll() collects the result. Needs
+ * hf_image_crc.ld in the linker script and hf_imgcrc.py after linking.
+ */
+#ifndef HF_FLASH_CHECK
+#define HF_FLASH_CHECK 0
+#endif
+
+/*
+ * Fault profile set up by HardFaultDumps_Init(); HardFault_SetFaultProfile()
+ * changes it at run time.
+ *
+ *  - HF_FAULT_PRODUCTION: MemManage, BusFault and UsageFault enabled.
+ *  - HF_FAULT_STRICT: also trap integer division by zero (CCR.DIV_0_TRP,
+ *    else the result is 0) and unaligned word and halfword accesses
+ *    (CCR.UNALIGN_TRP, else an extra bus transfer each).
+ *  - HF_FAULT_DIAGNOSTIC: also precise bus faults on stores (M3/M4, the
+ *    write buffer is off) and HardFault_FpuCheck() traps on the FPSCR
+ *    flags in HF_FPU_TRAP_FLAGS.
+ *
+ * CCR.UNALIGN_TRP needs -mno-unaligned-access, which GCC does not use by
+ * default on v7-M: hf_dump_hdr_t has fields at odd offsets, and with
+ * unaligned access allowed the handler itself would trap. Without the flag
+ * the strict profiles leave that one trap off (with a build warning); the
+ * others still apply. See README.md section 1.17.
+ */
+#define HF_FAULT_PRODUCTION 0u
+#define HF_FAULT_STRICT     1u
+#define HF_FAULT_DIAGNOSTIC 2u
+
+#ifndef HF_FAULT_PROFILE
+#define HF_FAULT_PROFILE HF_FAULT_PRODUCTION
+#endif
+
+#if (HF_FAULT_PROFILE != HF_FAULT_PRODUCTION) && defined(__ARM_FEATURE_UNALIGNED)
+#warning "hardfault_dump: built without -mno-unaligned-access, CCR.UNALIGN_TRP stays off"
+#endif
+
+/* Invalid operation, division by zero, overflow (HF_FPSCR_* in hf_abi.h). */
+#ifndef HF_FPU_TRAP_FLAGS
+#define HF_FPU_TRAP_FLAGS (HF_FPSCR_IOC | HF_FPSCR_DZC | HF_FPSCR_OFC)
+#endif
+
+/*
+ * Main stack (MSP) monitoring. The bottom of the main stack is the linker
+ * symbol named by HF_MSP_LIMIT_SYMBOL if you define it, else
+ * _estack - _Min_Stack_Size as in CubeMX/CubeIDE scripts; with neither, the
+ * checks are off. Every dump records it (msp_limit) and sets
+ * HF_DUMP_F_MSP_NEAR when the faulting frame was on the main stack within
+ * HF_MSP_NEAR_BYTES of it (or below it).
+ *
+ * With HF_MSP_PAINT set to 1, HardFaultDumps_Init() also paints the free
+ * part of the main stack, so HardFault_MainStackUsed(), every dump and
+ * the boot record can report how deep it has been.
+ */
+#ifndef HF_MSP_PAINT
+#define HF_MSP_PAINT 0
+#endif
+
+#ifndef HF_MSP_NEAR_BYTES
+#define HF_MSP_NEAR_BYTES 128u
+#endif
+
+/*
+ * Background task stack sampler (RTOS builds). With HF_STACK_SAMPLER set
+ * to 1, each HardFaultStack_Sample() call checks at most
+ * HF_STACK_SAMPLE_WORDS words of one tracked task's stack, bottom up, and
+ * goes on to the next task once it reaches used stack. A finished pass is
+ * that task's current high-water mark. The table of up to HF_STACK_TASKS
+ * tasks (64 bytes each) sits in .noinit: it keeps each task's lowest free
+ * stack and its last HF_STACK_MARKS new lows across resets, and every dump
+ * carries a copy (HF_EXT_TASK_STACKS).
+ */
+#ifndef HF_STACK_SAMPLER
+#define HF_STACK_SAMPLER 0
+#endif
+
+#ifndef HF_STACK_TASKS
+#define HF_STACK_TASKS 8u
+#endif
+
+#ifndef HF_STACK_SAMPLE_WORDS
+#define HF_STACK_SAMPLE_WORDS 8u
+#endif
+
+/*
+ * Shadow call stack. With HF_SHADOW_STACK set to 1, this file provides the
+ * __cyg_profile_func_enter/exit hooks of GCC's -finstrument-functions: each
+ * instrumented call pushes its call site onto a ring of HF_SHADOW_DEPTH
+ * entries (a power of two) of the running context, one per thread for up
+ * to HF_SHADOW_CONTEXTS threads plus one shared by all handlers. A dump
+ * carries the faulting context's ring (HF_EXT_SHADOW_STACK). Compile your
+ * code with -finstrument-functions, but not this file, the kernel or hot
+ * leaf functions (HF_NO_INSTRUMENT, see README.md).
+ */
+#ifndef HF_SHADOW_STACK
+#define HF_SHADOW_STACK 0
+#endif
+
+#ifndef HF_SHADOW_DEPTH
+#define HF_SHADOW_DEPTH 16u
+#endif
+
+#ifndef HF_SHADOW_CONTEXTS
+#define HF_SHADOW_CONTEXTS 8u
+#endif
+
+/* Keeps one function out of -finstrument-functions, e.g. a hot leaf. */
+#define HF_NO_INSTRUMENT __attribute__((no_instrument_function))
+
+/*
+ * Heap operation history. HF_HEAP_HISTORY selects the allocators to wrap;
+ * link with the matching -Wl,--wrap options:
+ *
+ *   HF_HEAP_FREERTOS  --wrap=pvPortMalloc,--wrap=vPortFree
+ *   HF_HEAP_LIBC      --wrap=malloc,--wrap=free,--wrap=calloc,--wrap=realloc
+ *
+ * Each call is logged (op, block, size, caller, thread) into a ring of
+ * HF_HEAP_OPS entries (a power of two, 16 bytes each) in .noinit, and
+ * every dump carries it newest first (HF_EXT_HEAP_OPS). The boot print
+ * shows the newest HF_HEAP_PRINT_OPS. Other allocators can log through
+ * HardFaultHeap_Log().
+ */
+#define HF_HEAP_FREERTOS 0x1u
+#define HF_HEAP_LIBC     0x2u
+
+#ifndef HF_HEAP_HISTORY
+#define HF_HEAP_HISTORY 0
+#endif
+
+#ifndef HF_HEAP_OPS
+#define HF_HEAP_OPS 32u
+#endif
+
+#ifndef HF_HEAP_PRINT_OPS
+#define HF_HEAP_PRINT_OPS 8u
+#endif
+
+/*
+ * Integrity scanner. With HF_SCAN set to 1, each HardFaultScan_Step() call
+ * spends about HF_SCAN_BUDGET_CYCLES (DWT cycles; a fixed estimate per
+ * check on cores without CYCCNT) on the next checks of a pass, then returns:
+ *
+ *  - the lowest HF_SCAN_CANARY_WORDS words of every task tracked by the
+ *    stack sampler (HF_STACK_SAMPLER) and of the painted main stack
+ *    (HF_MSP_PAINT) must still hold their fill,
+ *  - the block headers of the heap regions given to HardFaultScan_AddHeap()
+ *    must chain up, FreeRTOS heap_4/heap_5 layout, to the end marker.
+ *
+ * The first corruption found is written as a dump flagged HF_DUMP_F_SOFT,
+ * with an HF_EXT_SCAN record, and the system keeps running. A dump already
+ * in the slot is kept. The heap walk restarts whenever the allocator
+ * reports a change through HardFaultScan_HeapChanged().
+ */
+#ifndef HF_SCAN
+#define HF_SCAN 0
+#endif
+
+#ifndef HF_SCAN_BUDGET_CYCLES
+#define HF_SCAN_BUDGET_CYCLES 1000u
+#endif
+
+#ifndef HF_SCAN_CANARY_WORDS
+#define HF_SCAN_CANARY_WORDS 4u
+#endif
+
+#ifndef HF_SCAN_HEAPS
+#define HF_SCAN_HEAPS 2u
+#endif
+
+/*
+ * Power-fail save (STM32G4, hf_pvd.h). With HF_PVD_SAVE set to 1, the PVD
+ * interrupt writes the mailbox header, the slots holding a dump, the boot
+ * record, the heap history and the task stack table, in that order, to the
+ * HF_PVD flash page (hf_pvd.ld) while VDD falls from the PVD threshold to
+ * the brown-out reset. HardFaultDumps_Init() copies back whatever RAM lost
+ * and erases the page again; nothing changes for its callers.
+ *
+ * HF_PVD_HOLDUP_US is that fall time for your board, worst case (see
+ * README.md): t = C * (V_PVD - V_BOR) / I. A record is saved whole or not
+ * at all, and only while it fits what is left of the budget at
+ * HF_PVD_DW_US per double word (G4 datasheet tPROG, 64 bits, max). The
+ * build fails if the budget does not cover the mailbox header and the
+ * boot record. HardFaultPvd_Rehearse() measures the real time.
+ */
+#ifndef HF_PVD_SAVE
+#define HF_PVD_SAVE 0
+#endif
+
+#ifndef HF_PVD_DW_US
+#define HF_PVD_DW_US 91u
+#endif
+
+/* Interrupt entry and the commit check, before the first double word. */
+#ifndef HF_PVD_ENTRY_US
+#define HF_PVD_ENTRY_US 20u
+#endif
+
+#ifndef HF_PVD_IRQ_HANDLER
+#define HF_PVD_IRQ_HANDLER PVD_PVM_IRQHandler
+#endif
+
+/*
+ * Boot timeline. With HF_BOOT_TIMELINE set to 1, HF_BOOT_MARK(id) records
+ * the time since HF_BOOT_MARK(HF_MARK_RESET), which goes as early as you
+ * can (SystemInit() or the top of main()). HardFaultDumps_Init() adds its
+ * own marks around the dump print, and HF_BOOT_MARK(HF_MARK_READY) ends
+ * the timeline and adds its reset-to-ready time to the cold or the
+ * post-fault figures. The last HF_BOOT_TIMELINES timelines of up to
+ * HF_BOOT_MARKS marks, and those figures, are kept in .noinit.
+ *
+ * Time is HF_BOOT_CLOCK() ticks at HF_BOOT_CLOCK_HZ: DWT CYCCNT at
+ * SystemCoreClock by default, converted with the clock of the previous
+ * mark, so a mark right after the PLL switch keeps the figures exact.
+ * M0/M0+ have no CYCCNT: define both, e.g. a free-running timer.
+ */
+#ifndef HF_BOOT_TIMELINE
+#define HF_BOOT_TIMELINE 0
+#endif
+
+#ifndef HF_BOOT_TIMELINES
+#define HF_BOOT_TIMELINES 4u
+#endif
+
+#ifndef HF_BOOT_MARKS
+#define HF_BOOT_MARKS 12u
+#endif
+
+/* HF_BOOT_MARK ids; your own start at HF_MARK_USER. */
+#define HF_MARK_RESET        0u    /* starts the timeline */
+#define HF_MARK_INIT         1u    /* HardFaultDumps_Init() entered */
+#define HF_MARK_INIT_PRINTED 2u    /* previous dump printed (if there was one) */
+#define HF_MARK_INIT_DONE    3u    /* HardFaultDumps_Init() returns */
+#define HF_MARK_READY        15u   /* application ready: ends the timeline */
+#define HF_MARK_USER         16u
+
+#if HF_BOOT_TIMELINE
+#define HF_BOOT_MARK(id) HardFault_BootMark((uint16_t)(id))
+#else
+#define HF_BOOT_MARK(id) ((void)0)
+#endif
+
+/* hf_boot_timeline_t.flags */
+#define HF_TIMELINE_F_FAULT   0x01u   /* boot after a dump of this image */
+#define HF_TIMELINE_F_READY   0x02u   /* reached HF_MARK_READY */
+#define HF_TIMELINE_F_LATE    0x04u   /* no HF_MARK_RESET: starts at init */
+#define HF_TIMELINE_F_FULL    0x08u   /* marks were dropped */
+
+typedef struct {
+    uint16_t id;                   /* HF_MARK_* */
+    uint16_t reserved;
+    uint32_t us;                   /* since HF_MARK_RESET */
+} hf_boot_mark_t;
+
+typedef struct {
+    uint32_t       boot;           /* hf_boot_record_t.boot_count */
+    uint8_t        flags;          /* HF_TIMELINE_F_* */
+    uint8_t        count;          /* valid marks */
+    uint16_t       reserved;
+    hf_boot_mark_t mark[HF_BOOT_MARKS];
+} hf_boot_timeline_t;
+
+/* Reset-to-ready times of one kind of boot. */
+typedef struct {
+    uint32_t count;
+    uint32_t last_us;
+    uint32_t min_us;
+    uint32_t max_us;
+    uint64_t total_us;             /* total_us / count = mean */
+} hf_boot_latency_t;
+
+typedef struct {
+    hf_boot_latency_t  cold;       /* power-on, watchdog, pin, software... */
+    hf_boot_latency_t  fault;      /* after a dump of this image */
+    uint32_t           next;       /* oldest entry of timeline[] */
+    hf_boot_timeline_t timeline[HF_BOOT_TIMELINES];
+} hf_boot_times_t;
+
+/* hf_boot_record_t.flags */
+#define HF_BOOT_F_FAULT_RESET  0x0001u   /* this boot follows a dump of this image */
+#define HF_BOOT_F_PVD_SAVED    0x0002u   /* a power-fail save was committed before it */
+#define HF_BOOT_F_PVD_RESTORED 0x0004u   /* and records were copied back from it */
+
+/* hf_boot_record_t.flash_check, HardFault_FlashCheckPoll() */
+typedef enum {
+    HF_FLASH_CHECK_OFF = 0,    /* not run on this boot */
+    HF_FLASH_CHECK_RUNNING,
+    HF_FLASH_CHECK_PASS,
+    HF_FLASH_CHECK_FAIL,       /* CRC mismatch: flash content changed */
+    HF_FLASH_CHECK_ERROR,      /* DMA transfer error */
+    HF_FLASH_CHECK_NO_CRC,     /* image was not patched by hf_imgcrc.py */
+} hf_flash_check_t;
+
+/* HardFaultScan_Step() */
+typedef enum {
+    HF_SCAN_OFF = 0,           /* built without HF_SCAN */
+    HF_SCAN_RUNNING,           /* pass not finished yet */
+    HF_SCAN_PASS_DONE,         /* this step finished a clean pass */
+    HF_SCAN_FOUND,             /* corruption found and captured; scanning stops */
+} hf_scan_t;
+
+/*
+ * What HardFaultDumps_Init() found and did on this boot. Kept in .noinit
+ * (override HF_NOINIT for another section), so it also survives the next
+ * reset for a debugger or a later boot to look at.
+ */
+typedef struct {
+    uint32_t magic;
+    uint32_t boot_count;           /* boots since the record was created */
+    uint32_t flags;                /* HF_BOOT_F_* */
+    uint32_t last_fault_count;     /* mailbox fault_count seen at the last boot */
+    uint32_t flash_check;          /* hf_flash_check_t */
+    uint32_t flash_crc_expected;
+    uint32_t flash_crc_actual;
+    uint32_t flash_check_bytes;
+    uint32_t flash_check_cycles;   /* DWT cycles from start to completion */
+    uint32_t msp_size;             /* main stack bytes, bottom to _estack */
+    uint32_t msp_painted;          /* boot_count of the last painting (HF_MSP_PAINT) */
+    uint32_t msp_last_used;        /* high-water mark the previous boot reached */
+    uint32_t msp_worst_used;       /* deepest main stack use seen, kept across resets */
+    uint32_t pvd_records;          /* power-fail save before this boot: records written */
+    uint32_t pvd_skipped;          /* records that did not fit the hold-up budget */
+    uint32_t pvd_save_us;          /* PVD interrupt to commit */
+} hf_boot_record_t;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -47,8 +409,140 @@ void HardFault_DecodeAndPrint(void);
 /* Manually clear dump region. */
 void HardFault_ClearDump(void);
 
-/* You don't call this yourself; installed in the vector table. */
+/*
+ * Access by dump id (HF_IMAGE_BOOTLOADER / HF_IMAGE_APPLICATION), e.g. for a
+ * bootloader acting on the application's dump before jumping to it. The
+ * functions above work on this image's own slot (HF_IMAGE_ID).
+ */
+
+bool HardFault_DumpAvailableId(uint8_t id);
+void HardFault_DecodeAndPrintId(uint8_t id);
+
+/* Number of dumps this slot has recorded since the mailbox was formatted. */
+uint32_t HardFault_DumpCount(uint8_t id);
+
+/* Size of the stored dump (header + payload) in bytes, 0 if none is valid. */
+uint32_t HardFault_DumpSize(uint8_t id);
+
+/* Copy up to len raw dump bytes starting at off; returns bytes copied. */
+uint32_t HardFault_ReadDump(uint8_t id, uint32_t off, void *buf, uint32_t len);
+
+/*
+ * The stored dump in place, validated once, with its size in *size; NULL
+ * and 0 if none is valid. For callers that go through a whole dump
+ * (HardFault_ReadDump() validates on every call). Stays valid until the
+ * slot is written or cleared.
+ */
+const uint8_t *HardFault_DumpData(uint8_t id, uint32_t *size);
+
+/* Clear one dump by id. */
+void HardFault_ClearDumpId(uint8_t id);
+
+/*
+ * Switch the fault profile (HF_FAULT_*). False, and no change, if the
+ * profile is unknown. Built with unaligned accesses allowed, the strict
+ * profiles leave CCR.UNALIGN_TRP off.
+ */
+bool     HardFault_SetFaultProfile(uint32_t profile);
+uint32_t HardFault_FaultProfile(void);
+
+/*
+ * FPU exception flags (HF_FPSCR_*) in HF_FPU_TRAP_FLAGS raised since the
+ * last check, cleared on return. Under HF_FAULT_DIAGNOSTIC it does not
+ * return when there are any: it faults, and the dump names the flags. Call
+ * it where the results are computed, as each thread has its own FPSCR.
+ */
+uint32_t HardFault_FpuCheck(void);
+
+/* This boot's record (see hf_boot_record_t). */
+const hf_boot_record_t *HardFault_BootRecord(void);
+
+/*
+ * Progress of the flash check started by HardFaultDumps_Init(). With wait,
+ * blocks until it finishes. The first call that sees it finish records the
+ * result in the boot record, logs one line and releases CRC unit and DMA
+ * channel. Returns HF_FLASH_CHECK_OFF if it was not started on this boot.
+ */
+hf_flash_check_t HardFault_FlashCheckPoll(bool wait);
+
+/*
+ * Main stack high-water mark in bytes since HardFaultDumps_Init() painted it,
+ * 0 without HF_MSP_PAINT. Scans only the untouched part of the stack; also
+ * raises msp_worst_used in the boot record.
+ */
+uint32_t HardFault_MainStackUsed(void);
+
+/*
+ * Task stack sampler (HF_STACK_SAMPLER, no-ops otherwise). Track/Untrack
+ * take the kernel's thread handle (TaskHandle_t, struct k_thread *,
+ * TX_THREAD *, osThreadId_t); with FreeRTOS, hook them in as
+ * traceTASK_CREATE / traceTASK_DELETE. A task gets back its entry from
+ * earlier boots by name. Track returns false when the table is full; call
+ * it after HardFaultDumps_Init().
+ */
+bool HardFaultStack_Track(const void *thread);
+void HardFaultStack_Untrack(const void *thread);
+
+/* One bounded sampling step; from the idle hook or the tick hook. */
+void HardFaultStack_Sample(void);
+
+/* The table, e.g. for a shell command: *count entries, unused ones have
+ * an empty name. NULL and 0 without HF_STACK_SAMPLER. */
+const hf_task_stack_t *HardFaultStack_Table(uint32_t *count);
+
+/*
+ * Shadow call stack (HF_SHADOW_STACK, no-op otherwise): drops the ring of a
+ * thread that ends, so a thread created later with the same handle starts
+ * empty. With FreeRTOS, hook it in as traceTASK_DELETE.
+ */
+void HardFaultShadow_Release(const void *thread);
+
+/*
+ * Log one allocator call (HF_HEAP_OP_*) into the heap history, e.g. from a
+ * wrapper around a kernel byte pool; caller is __builtin_return_address(0)
+ * of the wrapper. ISR safe; a no-op without HF_HEAP_HISTORY.
+ */
+void HardFaultHeap_Log(uint32_t op, const void *ptr, uint32_t size, const void *caller);
+
+/*
+ * Integrity scanner (HF_SCAN, no-ops otherwise). Step from the idle hook.
+ * AddHeap takes a heap_4 ucHeap array or a heap_5 region as given to
+ * vPortDefineHeapRegions(); false when HF_SCAN_HEAPS are taken. Call
+ * HeapChanged from the allocator, with FreeRTOS as traceMALLOC and
+ * traceFREE, or the walk may see a heap changing under it.
+ */
+hf_scan_t HardFaultScan_Step(void);
+bool      HardFaultScan_AddHeap(const void *start, uint32_t len);
+void      HardFaultScan_HeapChanged(void);
+
+/* The first corruption found on this boot, NULL while none. */
+const hf_scan_rec_t *HardFaultScan_Found(void);
+
+/*
+ * Power-fail save (HF_PVD_SAVE, no-op otherwise): run it now as if the PVD
+ * had fired, then reset. The next boot reports the time it took in
+ * pvd_save_us, to check HF_PVD_HOLDUP_US against.
+ */
+void HardFaultPvd_Rehearse(void);
+
+/* Use HF_BOOT_MARK(id), which compiles away without HF_BOOT_TIMELINE. */
+void HardFault_BootMark(uint16_t id);
+
+/* Finished timelines and latencies, NULL without HF_BOOT_TIMELINE. */
+const hf_boot_times_t *HardFault_BootTimes(void);
+
+/* Log them through HF_LOGF, e.g. from a shell command. */
+void HardFault_PrintBootTimes(void);
+
+/* You don't call these yourself; installed in the vector table. The
+ * configurable fault handlers (not on v6-M) are aliases of the first. */
 void HardFault_Handler(void);
+void MemManage_Handler(void);
+void BusFault_Handler(void);
+void UsageFault_Handler(void);
+#if HF_PVD_SAVE
+void HF_PVD_IRQ_HANDLER(void);
+#endif
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,285 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Dump mailbox ABI shared by every image on the part (bootloader and
+ * application).
+ *
+ * The dump area sits at a fixed RAM address given by the linker symbol
+ * __hf_dump_start (see hardfault_dump.ld), identical in all images, so an
+ * image can read the dumps written by another one without its ELF:
+ *
+ *   +--------------------+  __hf_dump_start
+ *   | hf_mbox_hdr_t      |  mailbox header (this file)
+ *   +--------------------+
+ *   | slot 0: bootloader |  hf_dump_hdr_t + payload
+ *   +--------------------+
+ *   | slot 1: application|  hf_dump_hdr_t + payload
+ *   +--------------------+
+ *
+ * Compatibility rules:
+ *  - hf_mbox_hdr_t is frozen for a given HF_MBOX_ABI_VERSION. An image that
+ *    finds another ABI version (or area size) reformats the whole area.
+ *  - hf_dump_hdr_t is append-only: new fields go after `checksum`, and
+ *    HF_VERSION is bumped. Readers locate the payload with header_len and
+ *    accept any version >= HF_VERSION_MIN, so a bootloader built against an
+ *    older library still decodes the base fields of a newer application.
+ *  - From v6 on, typed extension records may follow the stack payload
+ *    (ext_bytes). They have their own checksum, so readers that predate them
+ *    still validate header + payload and simply never look further.
+ *
+ * Do not reorder or resize anything here without bumping the versions.
+ */
+
+#define HF_MBOX_MAGIC        0x424D4648u   /* 'HFMB' */
+#define HF_MBOX_ABI_VERSION  1u
+
+/* Slot ids double as dump ids for HardFault_DumpSize() and friends. */
+#define HF_IMAGE_BOOTLOADER  0u
+#define HF_IMAGE_APPLICATION 1u
+#define HF_MBOX_SLOTS        2u
+
+#define HF_MAGIC       0x48464450u   /* 'HFDP' */
+#define HF_VERSION     0x0006u
+#define HF_VERSION_MIN 0x0004u
+
+/*
+ * v3 sized rtos_task_name by configMAX_TASK_NAME_LEN, so stack_bytes and
+ * checksum moved with each build's FreeRTOSConfig.h. v4 is the first version
+ * with the fixed 16 + NUL name below; v3 dumps are rejected, not guessed at.
+ */
+
+/* hf_dump_hdr_t.arch: core that wrote the dump (v4+). */
+#define HF_ARCH_UNKNOWN      0u
+#define HF_ARCH_CM0          1u   /* v6-M: M0/M0+, no CFSR */
+#define HF_ARCH_CM3          2u
+#define HF_ARCH_CM4          3u
+#define HF_ARCH_CM7          4u
+#define HF_ARCH_CM33         5u   /* v8-M Mainline */
+
+/* hf_dump_hdr_t.flags (v4+). */
+#define HF_DUMP_F_SECURE     0x0001u   /* faulting context was Secure */
+#define HF_DUMP_F_SPLIM      0x0002u   /* sp_limit is valid (v8-M) */
+#define HF_DUMP_F_STKOVF     0x0004u   /* stack limit hit (v8-M) */
+#define HF_DUMP_F_MSP_NEAR   0x0008u   /* frame on MSP within HF_MSP_NEAR_BYTES of msp_limit (v5+) */
+#define HF_DUMP_F_SOFT       0x0010u   /* written while running, no fault and no reset (v6+) */
+#define HF_DUMP_F_FPU_TRAP   0x0020u   /* HardFault_FpuCheck() trapped: r0 = FPSCR flags (v6+) */
+
+/* FPSCR cumulative exception flags, as in r0 of an HF_DUMP_F_FPU_TRAP dump. */
+#define HF_FPSCR_IOC         0x01u     /* invalid operation */
+#define HF_FPSCR_DZC         0x02u     /* division by zero */
+#define HF_FPSCR_OFC         0x04u     /* overflow */
+#define HF_FPSCR_UFC         0x08u     /* underflow */
+#define HF_FPSCR_IXC         0x10u     /* inexact */
+#define HF_FPSCR_IDC         0x80u     /* input denormal */
+
+/* hf_dump_hdr_t.rtos_present: 0 = none, else the adapter (hf_rtos.h). */
+#define HF_RTOS_NONE         0u
+#define HF_RTOS_FREERTOS     1u
+#define HF_RTOS_ZEPHYR       2u
+#define HF_RTOS_THREADX      3u
+#define HF_RTOS_RTX5         4u
+
+/* Fixed in the ABI; longer RTOS task names are truncated. */
+#define HF_MAX_TASK_NAME_LEN (16U)
+
+/* Mailbox header at __hf_dump_start. */
+typedef struct __attribute__((__packed__)) {
+    uint32_t magic;                        /* HF_MBOX_MAGIC */
+    uint16_t abi_version;                  /* HF_MBOX_ABI_VERSION */
+    uint16_t hdr_len;                      /* sizeof(hf_mbox_hdr_t) */
+    uint32_t area_size;                    /* whole area incl. this header */
+    uint32_t slot_size;                    /* bytes per slot, multiple of 4 */
+    uint16_t slot_count;                   /* HF_MBOX_SLOTS */
+    uint16_t reserved0;
+    uint32_t fault_count[HF_MBOX_SLOTS];   /* dumps written since format */
+    uint32_t reserved1;
+} hf_mbox_hdr_t;
+
+/* Dump header at the start of each slot. */
+typedef struct __attribute__((__packed__)) {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t header_len;
+
+    uint32_t exc_return;
+    uint32_t msp;
+    uint32_t psp;
+    uint32_t active_sp;   /* pointer to the stacked frame */
+    uint32_t used_sp;     /* 0 = MSP, 1 = PSP */
+    uint32_t has_fp;      /* 0/1 whether FP context was stacked */
+
+    /* SCB fault info */
+    uint32_t scb_cfsr;
+    uint32_t scb_hfsr;
+    uint32_t scb_dfsr;
+    uint32_t scb_mmfar;
+    uint32_t scb_bfar;
+    uint32_t scb_afsr;
+    uint32_t shcsr;
+
+    /* Core regs from stacked frame */
+    uint32_t r0;
+    uint32_t r1;
+    uint32_t r2;
+    uint32_t r3;
+    uint32_t r12;
+    uint32_t lr;
+    uint32_t pc;
+    uint32_t psr;
+
+    /* RTOS info about the faulted thread (if scheduler started) */
+    uint32_t rtos_present;                /* HF_RTOS_* (v3: 0/1 = FreeRTOS) */
+    uint32_t rtos_task_priority;          /* current priority */
+    uint32_t rtos_stack_high_water_bytes; /* minimum free stack during life */
+    uint32_t rtos_stack_base;             /* lowest stack address */
+    char     rtos_task_name[HF_MAX_TASK_NAME_LEN + 1];
+
+    /* Payload (stack dump) */
+    uint32_t stack_bytes;  /* number of bytes after this header */
+    uint32_t checksum;     /* XOR of header(with checksum=0) + payload */
+
+    /* ---- v4 ---- */
+    uint16_t arch;         /* HF_ARCH_* */
+    uint16_t flags;        /* HF_DUMP_F_* */
+    uint32_t sp_limit;     /* MSPLIM/PSPLIM of the faulting stack, or 0 */
+
+    /* ---- v5 ---- */
+    uint32_t msp_limit;    /* bottom of the main stack, or 0 if unknown */
+    uint32_t msp_max_used; /* main stack high-water mark in bytes, 0 if not painted */
+
+    /* ---- v6 ---- */
+    uint32_t ext_bytes;    /* extension records after the payload, 0 if none */
+    uint32_t ext_checksum; /* XOR of those bytes */
+
+    /* v7+ fields are appended here. */
+} hf_dump_hdr_t;
+
+/* Size of the oldest header layout readers still accept (v4). */
+#define HF_DUMP_HDR_MIN_LEN 141u
+
+/*
+ * Extension records (v6+), packed back to back after the stack payload:
+ * hf_ext_hdr_t, len data bytes, zero padding to a multiple of 4. Readers
+ * skip types they do not know.
+ */
+typedef struct __attribute__((__packed__)) {
+    uint16_t type;                         /* HF_EXT_* */
+    uint16_t len;                          /* data bytes, without the padding */
+} hf_ext_hdr_t;
+
+#define HF_EXT_TASK_STACKS   1u   /* hf_stack_table_t + hf_task_stack_t[count] */
+#define HF_EXT_SHADOW_STACK  2u   /* hf_shadow_rec_t + uint32_t site[count] */
+#define HF_EXT_HEAP_OPS      3u   /* hf_heap_hist_t + hf_heap_op_t[count] */
+#define HF_EXT_SCAN          4u   /* hf_scan_rec_t */
+
+/* ---- HF_EXT_TASK_STACKS: background stack sampler ---- */
+
+#define HF_STACK_NAME_LEN    12u   /* names are truncated, not terminated */
+#define HF_STACK_MARKS       4u    /* new lows kept per task */
+
+/* hf_task_stack_t.flags */
+#define HF_STACK_F_LIVE      0x01u   /* tracked on the boot that wrote the dump */
+#define HF_STACK_F_SAMPLED   0x02u   /* at least one full pass done */
+
+typedef struct __attribute__((__packed__)) {
+    uint8_t  count;                        /* entries that follow */
+    uint8_t  marks;                        /* HF_STACK_MARKS of the writer */
+    uint16_t entry_size;                   /* sizeof(hf_task_stack_t) of the writer */
+} hf_stack_table_t;
+
+/* A new low of one task's free stack. */
+typedef struct __attribute__((__packed__)) {
+    uint32_t tick;                         /* RTOS tick count when seen */
+    uint16_t free;                         /* bytes never touched, saturated */
+    uint16_t boot;                         /* low 16 bits of the boot count */
+} hf_stack_mark_t;
+
+typedef struct __attribute__((__packed__)) {
+    char     name[HF_STACK_NAME_LEN];
+    uint32_t stack_lo;                     /* lowest stack address */
+    uint32_t stack_size;                   /* bytes, 0 if the kernel does not say */
+    uint32_t min_free;                     /* lowest free bytes seen, over all boots */
+    uint32_t last_free;                    /* result of the latest pass */
+    uint16_t boot;                         /* boot the task was last tracked on */
+    uint8_t  flags;                        /* HF_STACK_F_* */
+    uint8_t  mark_count;                   /* valid entries in mark[] */
+    hf_stack_mark_t mark[HF_STACK_MARKS];  /* oldest first */
+} hf_task_stack_t;
+
+/* ---- HF_EXT_SHADOW_STACK: call sites of the faulting context ---- */
+
+/* hf_shadow_rec_t.flags */
+#define HF_SHADOW_F_HANDLER  0x01u   /* fault hit Handler mode (an ISR) */
+#define HF_SHADOW_F_WRAPPED  0x02u   /* deeper than recorded: outer calls lost */
+#define HF_SHADOW_F_UNSYNCED 0x04u   /* more exits than entries were seen */
+
+typedef struct __attribute__((__packed__)) {
+    uint32_t thread;                       /* kernel thread handle, 0 = none */
+    uint32_t depth;                        /* instrumented calls active at the fault */
+    uint16_t count;                        /* call sites that follow, innermost first */
+    uint8_t  flags;                        /* HF_SHADOW_F_* */
+    uint8_t  reserved;
+} hf_shadow_rec_t;
+
+/* ---- HF_EXT_HEAP_OPS: allocator history ---- */
+
+/* hf_heap_op_t.info: operation in the top 4 bits, size below. */
+#define HF_HEAP_OP_ALLOC     1u   /* ptr 0 = the allocation failed */
+#define HF_HEAP_OP_FREE      2u   /* size 0, logged before the block is freed */
+#define HF_HEAP_OP_BOOT      3u   /* HardFaultDumps_Init(): size = boot count */
+
+#define HF_HEAP_INFO(op, size)  (((uint32_t)(op) << 28) | ((uint32_t)(size) & 0x0FFFFFFFu))
+#define HF_HEAP_INFO_OP(info)   ((uint32_t)(info) >> 28)
+#define HF_HEAP_INFO_SIZE(info) ((uint32_t)(info) & 0x0FFFFFFFu)
+
+typedef struct __attribute__((__packed__)) {
+    uint32_t total;                        /* ops logged since the ring was set up */
+    uint16_t count;                        /* entries that follow, newest first */
+    uint16_t entry_size;                   /* sizeof(hf_heap_op_t) of the writer */
+} hf_heap_hist_t;
+
+typedef struct __attribute__((__packed__)) {
+    uint32_t ptr;                          /* block as the caller sees it */
+    uint32_t info;                         /* HF_HEAP_INFO(op, bytes requested) */
+    uint32_t caller;                       /* return address into the caller */
+    uint32_t ctx;                          /* thread handle, or exception number
+                                              (< 512) from an ISR, 0 = none */
+} hf_heap_op_t;
+
+/* ---- HF_EXT_SCAN: first corruption the integrity scanner found ---- */
+
+/* hf_scan_rec_t.kind */
+#define HF_SCAN_TASK_STACK   1u   /* fill word at the end of a task stack overwritten */
+#define HF_SCAN_MAIN_STACK   2u   /* fill word at the end of the main stack overwritten */
+#define HF_SCAN_HEAP_SIZE    3u   /* block size misaligned or past the region */
+#define HF_SCAN_HEAP_LINK    4u   /* used block with a free-list link, free block without one */
+
+typedef struct __attribute__((__packed__)) {
+    uint8_t  kind;                         /* HF_SCAN_* */
+    uint8_t  reserved[3];
+    uint32_t addr;                         /* word found wrong */
+    uint32_t found;                        /* its value */
+    uint32_t expected;                     /* fill word for stacks, 0 for heaps */
+    uint32_t region;                       /* stack bottom or heap region start */
+    char     name[HF_STACK_NAME_LEN];      /* task (HF_SCAN_TASK_STACK), as in the stack table */
+} hf_scan_rec_t;
+
+#ifndef __cplusplus
+_Static_assert(sizeof(hf_mbox_hdr_t) == 32u, "mailbox ABI changed");
+_Static_assert(sizeof(hf_dump_hdr_t) >= HF_DUMP_HDR_MIN_LEN, "dump ABI changed");
+_Static_assert(offsetof(hf_dump_hdr_t, stack_bytes) == 125u &&
+               offsetof(hf_dump_hdr_t, checksum) == 129u &&
+               offsetof(hf_dump_hdr_t, sp_limit) + 4u == HF_DUMP_HDR_MIN_LEN,
+               "dump ABI changed");
+_Static_assert(sizeof(hf_task_stack_t) == 64u, "task stack record changed");
+_Static_assert(sizeof(hf_shadow_rec_t) == 12u, "shadow stack record changed");
+_Static_assert(sizeof(hf_heap_op_t) == 16u, "heap op record changed");
+_Static_assert(sizeof(hf_scan_rec_t) == 32u, "scan record changed");
+#endif
+
+/* Slot size for a given area size: equal split, word aligned. */
+#define HF_MBOX_SLOT_SIZE(area_size) \
+    ((((uint32_t)(area_size) - (uint32_t)sizeof(hf_mbox_hdr_t)) / HF_MBOX_SLOTS) & ~3u)
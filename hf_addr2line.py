@@ -1,68 +1,401 @@
 #!/usr/bin/env python3
+"""Resolve the addresses of every HardFault dump in a log.
+
+  hf_addr2line.py [--json] <firmware.elf> <log-file>
+  hf_addr2line.py [--json] --image [NAME=]FILE[@LO-HI] ... [--map MAP] <log-file>
+
+Dumps are found with libhfdump's scanner (hfdump.py): full dump blocks,
+lone HF_ADDR lines and binary dumps in raw captures. If the library is
+not built, only HF_ADDR lines are used. All addresses for one ELF go to a
+single addr2line run: arm-none-eabi-addr2line, or $HF_ADDR2LINE if set.
+
+--json prints one JSON object per dump instead, with PC/LR symbolized.
+
+With several images (bootloader, application, vendor ROM, ...), each
+address is dispatched to the image whose load range contains it; the
+output names the image. FILE is an ELF or a symbol file: `nm` output
+(`08001234 [size] T name`) or linker-script lines (`name = 0x1FFF0000;`).
+Without @LO-HI, an ELF covers its executable sections and a symbol file
+the span of its symbols. A MAP file has one image per line, `NAME FILE
+[LO-HI]`, # comments allowed. Stack words of binary dumps that land in an
+image are listed as backtrace candidates, after the exact call sites of
+a shadow stack (HF_SHADOW_STACK) and the callers of the heap history
+(HF_HEAP_HISTORY) if the dump has them.
+
+If $HF_SYMD_SOCKET names a running hf_symd.py daemon, addresses are
+resolved through it instead (warm, no ELF reload).
+"""
+import argparse
+import bisect
+import json
+import os
 import re
 import subprocess
 import sys
 from pathlib import Path
 
+from hf_elf import ElfError, ElfFile
 
-def main() -> int:
-    if len(sys.argv) != 3:
-        print(f"Usage: {sys.argv[0]} <firmware.elf> <log-file>", file=sys.stderr)
-        return 1
+_noted = False
+
+
+def addr2line_tool() -> str:
+    return os.environ.get('HF_ADDR2LINE', 'arm-none-eabi-addr2line')
+
+
+def find_dumps(log):
+    """List of dicts with at least 'pc' and 'lr' as 0x%08X strings, and the
+    byte 'offset' of each dump. Pass raw bytes where there are any: binary
+    dumps do not survive a round trip through str."""
+    data = log if isinstance(log, (bytes, bytearray)) else log.encode('utf-8', 'replace')
+    try:
+        import hfdump
+        return hfdump.scan(data)
+    except ImportError as e:
+        global _noted
+        if not _noted:
+            print(f'note: {e}; falling back to HF_ADDR lines', file=sys.stderr)
+            _noted = True
+
+    # Find lines like: HF_ADDR PC=0x08001234 LR=0x08000F00
+    pattern = re.compile(rb'HF_ADDR\s+PC=0x([0-9a-fA-F]{8})\s+LR=0x([0-9a-fA-F]{8})')
+    return [{'source': 'hf_addr', 'pc': f'0x{int(m.group(1), 16):08X}',
+             'lr': f'0x{int(m.group(2), 16):08X}', 'offset': m.start()}
+            for m in pattern.finditer(data)]
+
+
+def addr2line_symd(sock: str, elf_path: Path, addrs):
+    """Same as addr2line(), through the hf_symd.py daemon."""
+    from hf_symd import SymdClient
+    client = SymdClient(sock)
+    try:
+        syms = client.lookup(elf_path.resolve(), addrs)
+    finally:
+        client.close()
+    return {a: (s[0], f'{s[1]}:{s[2]}') if s else ('??', '??:0')
+            for a, s in zip(addrs, syms)}
+
+
+def addr2line(elf_path: Path, addrs):
+    """Map addr -> (function, 'file:line') in one addr2line run."""
+    sock = os.environ.get('HF_SYMD_SOCKET')
+    if sock:
+        try:
+            return addr2line_symd(sock, elf_path, addrs)
+        except (OSError, RuntimeError) as e:
+            print(f'note: hf_symd unavailable ({e}); running addr2line', file=sys.stderr)
+
+    cmd = [
+        addr2line_tool(),
+        '-f',      # show function name
+        '-C',      # demangle
+        '-e', str(elf_path),
+    ] + [f'0x{a:08X}' for a in addrs]
+    try:
+        out = subprocess.check_output(cmd, text=True, stderr=subprocess.STDOUT)
+    except subprocess.CalledProcessError as e:
+        err = f'<addr2line error: {e.output.strip()}>'
+        return {a: (err, '') for a in addrs}
+    lines = out.splitlines()
+    return {a: (lines[2 * i], lines[2 * i + 1]) if 2 * i + 1 < len(lines) else ('??', '??:0')
+            for i, a in enumerate(addrs)}
+
+
+# ============================== Images ==============================
+
+# Sections of one image closer than this are treated as one range
+# (alignment padding between .isr_vector, .text, .ARM.exidx, ...).
+RANGE_GAP = 256
+
+NM_RE = re.compile(r'^\s*(?:0x)?([0-9a-fA-F]{4,16})\s+(?:([0-9a-fA-F]{4,16})\s+)?'
+                   r'([A-Za-z])\s+(\S+)\s*$')
+LD_RE = re.compile(r'^\s*(?:PROVIDE\s*\(\s*)?([A-Za-z_.$][\w.$]*)\s*=\s*(0x[0-9a-fA-F]+)')
+
+
+class Image:
+    """One ELF or symbol file and the address ranges it owns."""
+
+    def __init__(self, name: str, path: Path, ranges=None):
+        self.name = name
+        self.path = path
+        self.elf = None
+        self.syms = None          # sorted [(addr, end or None, name)] for symbol files
+        try:
+            self.elf = ElfFile(path)
+        except ElfError:
+            self.syms = self._load_symbols(path)
+        self.ranges = ranges if ranges else self._default_ranges()
+
+    @staticmethod
+    def _load_symbols(path: Path):
+        syms = []
+        for line in path.read_text(errors='replace').splitlines():
+            m = NM_RE.match(line)
+            if m:
+                addr = int(m.group(1), 16)
+                size = int(m.group(2), 16) if m.group(2) else 0
+                syms.append((addr, addr + size if size else None, m.group(4)))
+                continue
+            m = LD_RE.match(line)
+            if m:
+                syms.append((int(m.group(2), 16), None, m.group(1)))
+        if not syms:
+            raise ValueError(f'{path}: neither an ELF nor a symbol file')
+        syms.sort()
+        return syms
+
+    def _default_ranges(self):
+        if self.elf is not None:
+            ranges = []
+            for lo, hi in self.elf.code_ranges():
+                if ranges and lo - ranges[-1][1] <= RANGE_GAP:
+                    ranges[-1] = (ranges[-1][0], hi)
+                else:
+                    ranges.append((lo, hi))
+            if not ranges:
+                raise ValueError(f'{self.path}: no executable sections; give @LO-HI')
+            return ranges
+        lo = self.syms[0][0]
+        hi = max((end or addr) for addr, end, _ in self.syms) + 1
+        return [(lo, hi)]
+
+    def resolve(self, addrs):
+        """addr -> (function, 'file:line'); '??' where unknown."""
+        if self.elf is not None:
+            return addr2line(self.path, addrs)
+        starts = [s[0] for s in self.syms]
+        out = {}
+        for a in addrs:
+            i = bisect.bisect_right(starts, a) - 1
+            if i < 0 or (self.syms[i][1] is not None and a >= self.syms[i][1]):
+                out[a] = ('??', '??:0')
+                continue
+            addr, _, name = self.syms[i]
+            out[a] = (f'{name}+0x{a - addr:x}' if a != addr else name, '??:0')
+        return out
+
+
+class ImageMap:
+    """Address -> image in O(log n) over non-overlapping ranges."""
+
+    def __init__(self, images, catch_all=None):
+        self.images = images
+        self.catch_all = catch_all    # legacy single-ELF mode: owns everything
+        spans = sorted(((lo, hi, img) for img in images for lo, hi in img.ranges),
+                       key=lambda s: s[:2])
+        for (lo0, hi0, a), (lo1, hi1, b) in zip(spans, spans[1:]):
+            if lo1 < hi0:
+                raise ValueError(f'{a.name} 0x{lo0:08X}-0x{hi0:08X} overlaps '
+                                 f'{b.name} 0x{lo1:08X}-0x{hi1:08X}')
+        self.starts = [s[0] for s in spans]
+        self.spans = spans
 
-    elf_path = Path(sys.argv[1])
-    log_path = Path(sys.argv[2])
+    def image_for(self, addr: int):
+        if self.catch_all is not None:
+            return self.catch_all
+        i = bisect.bisect_right(self.starts, addr) - 1
+        if i >= 0 and addr < self.spans[i][1]:
+            return self.spans[i][2]
+        return None
 
-    if not elf_path.is_file():
-        print(f"ELF not found: {elf_path}", file=sys.stderr)
+    def resolve(self, addrs):
+        """addr -> (function, 'file:line', image name), or None outside every
+        image. One lookup batch per image."""
+        groups = {}
+        out = {}
+        for a in addrs:
+            img = self.image_for(a)
+            if img is None:
+                out[a] = None
+            else:
+                groups.setdefault(img, []).append(a)
+        for img, group in groups.items():
+            for a, (func, loc) in img.resolve(group).items():
+                out[a] = (func, loc, img.name)
+        return out
+
+
+def parse_range(text: str):
+    lo, _, hi = text.partition('-')
+    lo, hi = int(lo, 0), int(hi, 0)
+    if hi <= lo:
+        raise ValueError(f'empty range {text}')
+    return [(lo, hi)]
+
+
+def image_spec(spec: str) -> Image:
+    """[NAME=]FILE[@LO-HI]"""
+    name, eq, rest = spec.partition('=')
+    if not eq:
+        name, rest = '', spec
+    path, at, rng = rest.rpartition('@') if '@' in rest else (rest, '', '')
+    path = Path(path)
+    return Image(name or path.stem, path, parse_range(rng) if at else None)
+
+
+def load_map(path: Path):
+    images = []
+    for n, line in enumerate(path.read_text().splitlines(), 1):
+        line = line.split('#', 1)[0].split()
+        if not line:
+            continue
+        if len(line) not in (2, 3):
+            raise ValueError(f'{path}:{n}: expected NAME FILE [LO-HI]')
+        file = Path(line[1])
+        if not file.is_absolute():
+            file = path.parent / file
+        images.append(Image(line[0], file, parse_range(line[2]) if len(line) == 3 else None))
+    return images
+
+
+def symbolize_dumps(blobs, imap: ImageMap, decode=None):
+    """Decode each blob and resolve PC/LR and backtrace candidates through
+    imap, one lookup batch per image for all blobs together.
+
+    decode(blob, symbolize) is a hfdump.py parser (default: hfdump.scan).
+    Returns ([dumps per blob], {addr: (function, 'file:line', image)})."""
+    try:
+        import hfdump
+        hfdump.version()
+    except ImportError:
+        if decode is not None:
+            raise
+        hfdump = None
+
+    if hfdump is None:
+        per_blob = [find_dumps(b) for b in blobs]
+        addrs = list(dict.fromkeys(int(d[k], 16) & ~1
+                                   for dumps in per_blob for d in dumps for k in ('pc', 'lr')))
+        resolved = imap.resolve(addrs)
+        for dumps in per_blob:
+            for d in dumps:
+                d['symbols'] = {k: resolved[int(d[k], 16) & ~1] for k in ('pc', 'lr')}
+                d['backtrace'] = []
+        return per_blob, resolved
+
+    decode = decode or hfdump.scan
+
+    # Pass 1 records every address the decoder asks about (PC, LR, odd stack
+    # words), so each image gets one batch; pass 2 answers from the result.
+    wanted = {}
+
+    def collect(addr):
+        wanted[addr & ~1] = None
+        return None
+
+    for b in blobs:
+        decode(b, collect)
+    resolved = imap.resolve(list(wanted))
+
+    def answer(addr):
+        r = resolved.get(addr & ~1)
+        if r is None or r[0] == '??':
+            return None
+        file, _, line = r[1].rpartition(':')
+        return (r[0], file, int(line) if line.isdigit() else 0, r[2])
+
+    per_blob = [decode(b, answer) for b in blobs]
+    for dumps in per_blob:
+        for d in dumps:
+            d['symbols'] = {k: resolved.get(int(d[k], 16) & ~1) for k in ('pc', 'lr')}
+            d['backtrace'] = [{'sp': b['sp'], 'addr': b['addr'],
+                               'sym': resolved[int(b['addr'], 16) & ~1]}
+                              for b in d.get('backtrace', [])]
+            for c in d.get('shadow_stack', {}).get('calls', []):
+                c.pop('symbol', None)
+                c['sym'] = resolved.get(int(c['addr'], 16) & ~1)
+            for op in heap_callers(d):
+                op.pop('symbol', None)
+                op['sym'] = resolved.get(int(op['caller'], 16) & ~1)
+    return per_blob, resolved
+
+
+def heap_callers(d: dict) -> list:
+    """Alloc/free records of the heap history that name a caller."""
+    return [op for op in d.get('heap', {}).get('ops', [])
+            if int(op.get('caller', '0'), 16) != 0]
+
+
+def symbol_json(r, with_image: bool) -> dict:
+    s = {'function': r[0], 'location': r[1]} if r else {'function': '??', 'location': '??:0'}
+    if with_image:
+        s['image'] = r[2] if r else None
+    return s
+
+
+def dump_json(d: dict, with_image: bool) -> dict:
+    """Turn symbolize_dumps() results into the --json record shape, in place."""
+    d['symbols'] = {k: symbol_json(v, with_image) for k, v in d['symbols'].items()}
+    for b in d['backtrace'] + d.get('shadow_stack', {}).get('calls', []):
+        b.update(symbol_json(b.pop('sym'), with_image))
+    for op in heap_callers(d):
+        op['symbol'] = symbol_json(op.pop('sym'), with_image)
+    return d
+
+
+def main() -> int:
+    ap = argparse.ArgumentParser(description='Resolve HardFault dump addresses.')
+    ap.add_argument('--json', action='store_true')
+    ap.add_argument('--image', action='append', default=[],
+                    help='[NAME=]FILE[@LO-HI], repeatable')
+    ap.add_argument('--map', help='file with NAME FILE [LO-HI] lines')
+    ap.add_argument('files', nargs='+', help='[firmware.elf] log-file')
+    args = ap.parse_args()
+
+    try:
+        images = [image_spec(s) for s in args.image]
+        if args.map:
+            images += load_map(Path(args.map))
+        if len(args.files) == 2:
+            elf_path = Path(args.files[0])
+            if not elf_path.is_file():
+                print(f"ELF not found: {elf_path}", file=sys.stderr)
+                return 1
+            img = Image(elf_path.stem, elf_path, [(0, 1 << 32)] if not images else None)
+            images.insert(0, img)
+        elif len(args.files) != 1 or not images:
+            ap.print_usage(sys.stderr)
+            return 1
+        imap = ImageMap(images, catch_all=images[0] if len(images) == 1 else None)
+    except (OSError, ValueError) as e:
+        print(f'error: {e}', file=sys.stderr)
         return 1
+    multi = imap.catch_all is None
+
+    log_path = Path(args.files[-1])
     if not log_path.is_file():
         print(f"Log not found: {log_path}", file=sys.stderr)
         return 1
 
-    log_text = log_path.read_text(errors='ignore')
+    (dumps,), resolved = symbolize_dumps([log_path.read_bytes()], imap)
 
-    # Find lines like: HF_ADDR PC=0x08001234 LR=0x08000F00
-    pattern = re.compile(r'HF_ADDR\s+PC=0x([0-9a-fA-F]{8})\s+LR=0x([0-9a-fA-F]{8})')
-
-    addrs = []
-    for m in pattern.finditer(log_text):
-        pc_hex, lr_hex = m.groups()
-        addrs.append(int(pc_hex, 16))
-        addrs.append(int(lr_hex, 16))
-
-    # De-duplicate while preserving order
-    seen = set()
-    unique_addrs = []
-    for a in addrs:
-        if a not in seen:
-            seen.add(a)
-            unique_addrs.append(a)
+    # De-duplicate while preserving order: PC/LR, the exact shadow stack
+    # call sites and heap callers, then the heuristic backtrace words.
+    unique_addrs = list(dict.fromkeys(
+        [int(d[k], 16) for d in dumps for k in ('pc', 'lr')] +
+        [int(c['addr'], 16) for d in dumps
+         for c in d.get('shadow_stack', {}).get('calls', [])] +
+        [int(op['caller'], 16) for d in dumps for op in heap_callers(d)] +
+        [int(b['addr'], 16) for d in dumps for b in d['backtrace']]))
 
     if not unique_addrs:
         print("No HF_ADDR lines found in log.", file=sys.stderr)
         return 0
 
-    print(f"Found {len(unique_addrs)} unique addresses. Resolving with addr2line...\n")
+    if args.json:
+        for d in dumps:
+            print(json.dumps(dump_json(d, multi)))
+        return 0
 
-    def addr2line(addr: int) -> str:
-        """Call arm-none-eabi-addr2line -f -C -e ELF 0xADDR and capture output."""
-        cmd = [
-            'arm-none-eabi-addr2line',
-            '-f',      # show function name
-            '-C',      # demangle
-            '-e', str(elf_path),
-            f'0x{addr:08X}',
-        ]
-        try:
-            out = subprocess.check_output(cmd, text=True, stderr=subprocess.STDOUT)
-        except subprocess.CalledProcessError as e:
-            return f'<addr2line error: {e.output.strip()}>'
-        return out.strip()
+    print(f"Found {len(unique_addrs)} unique addresses. Resolving with addr2line...\n")
 
     for addr in unique_addrs:
-        print(f'0x{addr:08X}:')
-        print(addr2line(addr))
+        r = resolved.get(addr & ~1)
+        func, loc, image = r if r else ('??', '??:0', 'no image')
+        print(f'0x{addr:08X}:' + (f' [{image}]' if multi else ''))
+        print(func)
+        if loc:
+            print(loc)
         print()
 
     return 0
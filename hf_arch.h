@@ -0,0 +1,262 @@
+#pragma once
+
+/*
+ * Per-core capture layer, selected at compile time from the compiler's
+ * architecture macros. Include after the CMSIS device header.
+ *
+ *   Core        Arch       Fault status  FPU ctx  D-cache  Stack limit
+ *   M0/M0+      v6-M       -             -        -        -
+ *   M3          v7-M       CFSR...       -        -        -
+ *   M4          v7E-M      CFSR...       opt.     -        -
+ *   M7          v7E-M      CFSR...       opt.     clean    -
+ *   M33/M35P    v8-M Main  CFSR...       opt.     -        MSPLIM/PSPLIM
+ *
+ * Each block only provides what its core has; the rest compiles away.
+ *
+ * Provided to hardfault_dump.c:
+ *   HF_ARCH_ID                 HF_ARCH_* value stored in the dump
+ *   HF_ARCH_HAS_CFSR           1 if SCB fault status registers exist
+ *   HF_ARCH_HANDLER_ASM        naked HardFault entry (r0 = SP, r1 = EXC_RETURN)
+ *   hf_arch_fault_enable(p)    enable the configurable fault handlers and
+ *                              the traps of fault profile p (HF_FAULT_*)
+ *   hf_arch_fpu_take(mask)     read and clear FPSCR exception flags in mask
+ *   hf_arch_frame()            locate the basic exception frame
+ *   hf_arch_capture()          fault registers, flags and stack limit
+ *   hf_arch_flush()            make the dump visible to RAM before reset
+ *   HF_ARCH_HAS_CYCCNT         1 if DWT has a cycle counter
+ *   hf_arch_cycles_enable()    start it (never reset, use differences)
+ *   hf_arch_cycles()           read it
+ */
+
+#include <stdint.h>
+#include "hf_abi.h"
+
+#define HF_EXC_RETURN_SPSEL  (1u << 2)   /* 1 = frame on PSP */
+#define HF_EXC_RETURN_MODE   (1u << 3)   /* 1 = fault hit Thread mode */
+#define HF_EXC_RETURN_FTYPE  (1u << 4)   /* 0 = FP context stacked */
+#define HF_EXC_RETURN_DCRS   (1u << 5)   /* v8-M: 0 = callee regs stacked */
+#define HF_EXC_RETURN_S      (1u << 6)   /* v8-M: 1 = frame on Secure stack */
+
+#if defined(__ARM_ARCH_6M__)
+  #define HF_ARCH_ID        HF_ARCH_CM0
+  #define HF_ARCH_HAS_CFSR  0
+#elif defined(__ARM_ARCH_7M__)
+  #define HF_ARCH_ID        HF_ARCH_CM3
+  #define HF_ARCH_HAS_CFSR  1
+#elif defined(__ARM_ARCH_7EM__)
+  #if defined(__DCACHE_PRESENT) && (__DCACHE_PRESENT == 1U)
+    #define HF_ARCH_ID      HF_ARCH_CM7
+  #else
+    #define HF_ARCH_ID      HF_ARCH_CM4
+  #endif
+  #define HF_ARCH_HAS_CFSR  1
+#elif defined(__ARM_ARCH_8M_MAIN__)
+  #define HF_ARCH_ID        HF_ARCH_CM33
+  #define HF_ARCH_HAS_CFSR  1
+#else
+  #error "hardfault_dump: unsupported core (need v6-M, v7-M, v7E-M or v8-M Mainline)"
+#endif
+
+/* FP context can only be stacked if the image actually uses the FPU. */
+#if defined(__FPU_USED) && (__FPU_USED == 1U)
+  #define HF_ARCH_HAS_FP    1
+#else
+  #define HF_ARCH_HAS_FP    0
+#endif
+
+/* Secure image on a TrustZone part: frames may come from either state. */
+#if defined(__ARM_FEATURE_CMSE) && (__ARM_FEATURE_CMSE == 3)
+  #define HF_ARCH_SECURE    1
+#else
+  #define HF_ARCH_SECURE    0
+#endif
+
+/* ======================== Handler entry ======================== */
+
+#if (HF_ARCH_ID == HF_ARCH_CM0)
+/* Thumb-1: no IT blocks, and a plain `b` may not reach the C helper. */
+#define HF_ARCH_HANDLER_ASM                                                \
+    "movs  r0, #4                 \n"                                      \
+    "mov   r1, lr                 \n" /* r1 = EXC_RETURN       */          \
+    "tst   r0, r1                 \n" /* EXC_RETURN bit[2]     */          \
+    "beq   1f                     \n"                                      \
+    "mrs   r0, psp                \n" /* r0 = active SP (PSP)  */          \
+    "b     2f                     \n"                                      \
+    "1:                           \n"                                      \
+    "mrs   r0, msp                \n" /* r0 = active SP (MSP)  */          \
+    "2:                           \n"                                      \
+    "ldr   r2, 3f                 \n"                                      \
+    "bx    r2                     \n"                                      \
+    ".align 2                     \n"                                      \
+    "3: .word prvGetRegistersFromStack \n"
+#else
+#define HF_ARCH_HANDLER_ASM                                                \
+    "tst lr, #4                   \n" /* Check EXC_RETURN bit[2] SP used */ \
+    "ite eq                       \n"                                      \
+    "mrseq r0, msp                \n" /* r0 = active SP (MSP)  */          \
+    "mrsne r0, psp                \n" /* r0 = active SP (PSP)  */          \
+    "mov   r1, lr                 \n" /* r1 = EXC_RETURN       */          \
+    "b     prvGetRegistersFromStack \n"
+#endif
+
+/* ======================== Fault enable ======================== */
+
+static inline void hf_arch_fault_enable(uint32_t profile)
+{
+#if HF_ARCH_HAS_CFSR
+    /* Enable MemManage, BusFault, UsageFault so HardFault is more specific. */
+    SCB->SHCSR |= (SCB_SHCSR_MEMFAULTENA_Msk |
+                   SCB_SHCSR_BUSFAULTENA_Msk |
+                   SCB_SHCSR_USGFAULTENA_Msk);
+
+    /* Strict: SDIV/UDIV by zero and unaligned LDR/STR(H) fault instead of
+     * returning 0 or taking an extra bus transfer. Code built with unaligned
+     * access allowed, this library included, would trip the latter itself. */
+#if defined(__ARM_FEATURE_UNALIGNED)
+    const uint32_t strict = SCB_CCR_DIV_0_TRP_Msk;
+#else
+    const uint32_t strict = SCB_CCR_DIV_0_TRP_Msk | SCB_CCR_UNALIGN_TRP_Msk;
+#endif
+    if (profile >= HF_FAULT_STRICT) {
+        SCB->CCR = (SCB->CCR & ~SCB_CCR_UNALIGN_TRP_Msk) | strict;
+    } else {
+        SCB->CCR &= ~(SCB_CCR_DIV_0_TRP_Msk | SCB_CCR_UNALIGN_TRP_Msk);
+    }
+#if (HF_ARCH_ID == HF_ARCH_CM3) || (HF_ARCH_ID == HF_ARCH_CM4)
+    /* Diagnostic: no write buffer, so a faulting store is a precise
+     * BusFault (BFAR, exact PC), at a stall on every store. */
+    if (profile >= HF_FAULT_DIAGNOSTIC) {
+        SCnSCB->ACTLR |= SCnSCB_ACTLR_DISDEFWBUF_Msk;
+    } else {
+        SCnSCB->ACTLR &= ~SCnSCB_ACTLR_DISDEFWBUF_Msk;
+    }
+#endif
+    __DSB();
+    __ISB();
+#else
+    /* v6-M: everything escalates to HardFault, unaligned accesses always
+     * fault and there is no divide instruction; nothing to enable. */
+    (void)profile;
+#endif
+}
+
+/* FPSCR is per thread under an RTOS: this sees the caller's flags. */
+static inline uint32_t hf_arch_fpu_take(uint32_t mask)
+{
+#if HF_ARCH_HAS_FP
+    const uint32_t fpscr = __get_FPSCR();
+
+    if (fpscr & mask) {
+        __set_FPSCR(fpscr & ~mask);
+    }
+    return fpscr & mask;
+#else
+    (void)mask;
+    return 0;
+#endif
+}
+
+/* ======================== Frame location ======================== */
+
+static inline uint32_t *hf_arch_frame(uint32_t *sp, uint32_t exc_return)
+{
+#if HF_ARCH_SECURE
+    if ((exc_return & HF_EXC_RETURN_S) == 0u) {
+        /* Non-secure code faulted into this Secure handler. */
+        sp = (exc_return & HF_EXC_RETURN_SPSEL)
+           ? (uint32_t *)__TZ_get_PSP_NS()
+           : (uint32_t *)__TZ_get_MSP_NS();
+    } else if ((exc_return & HF_EXC_RETURN_DCRS) == 0u) {
+        /* Integrity signature, reserved word and R4-R11 sit below R0. */
+        sp += 10;
+    }
+#else
+    (void)exc_return;
+#endif
+    return sp;
+}
+
+/* ======================== Register capture ======================== */
+
+static inline void hf_arch_capture(hf_dump_hdr_t *h, uint32_t exc_return)
+{
+    h->arch  = HF_ARCH_ID;
+    h->flags = 0;
+
+#if HF_ARCH_HAS_FP
+    h->has_fp = ((exc_return & HF_EXC_RETURN_FTYPE) == 0u) ? 1u : 0u;
+#else
+    h->has_fp = 0;
+#endif
+
+#if HF_ARCH_HAS_CFSR
+    h->scb_cfsr  = SCB->CFSR;
+    h->scb_hfsr  = SCB->HFSR;
+    h->scb_dfsr  = SCB->DFSR;
+    h->scb_mmfar = SCB->MMFAR;
+    h->scb_bfar  = SCB->BFAR;
+    h->scb_afsr  = SCB->AFSR;
+    h->shcsr     = SCB->SHCSR;
+#endif
+
+#if (HF_ARCH_ID == HF_ARCH_CM33)
+    /* The hardware already knows the exact bottom of the faulting stack. */
+    const uint32_t on_psp = exc_return & HF_EXC_RETURN_SPSEL;
+  #if HF_ARCH_SECURE
+    if ((exc_return & HF_EXC_RETURN_S) == 0u) {
+        h->sp_limit = on_psp ? __TZ_get_PSPLIM_NS() : __TZ_get_MSPLIM_NS();
+    } else {
+        h->sp_limit = on_psp ? __get_PSPLIM() : __get_MSPLIM();
+        h->flags |= HF_DUMP_F_SECURE;
+    }
+  #else
+    h->sp_limit = on_psp ? __get_PSPLIM() : __get_MSPLIM();
+  #endif
+    h->flags |= HF_DUMP_F_SPLIM;
+
+    /* UFSR.STKOF, or no room left below the frame for another one. */
+    if ((h->scb_cfsr & (1u << 20)) != 0u ||
+        (h->sp_limit != 0u && h->active_sp < h->sp_limit + 32u)) {
+        h->flags |= HF_DUMP_F_STKOVF;
+    }
+#endif
+}
+
+/* ======================== Before reset ======================== */
+
+static inline void hf_arch_flush(void *area, uint32_t len)
+{
+#if (HF_ARCH_ID == HF_ARCH_CM7)
+    /* A write-back D-cache would drop the dump on NVIC_SystemReset(). */
+    SCB_CleanDCache_by_Addr((uint32_t *)area, (int32_t)len);
+#else
+    (void)area;
+    (void)len;
+#endif
+}
+
+/* ======================== Cycle counter ======================== */
+
+/* DWT CYCCNT (v7-M and up). A system reset leaves it running. */
+#if (HF_ARCH_ID == HF_ARCH_CM0)
+  #define HF_ARCH_HAS_CYCCNT 0
+#else
+  #define HF_ARCH_HAS_CYCCNT 1
+#endif
+
+static inline void hf_arch_cycles_enable(void)
+{
+#if HF_ARCH_HAS_CYCCNT
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#endif
+}
+
+static inline uint32_t hf_arch_cycles(void)
+{
+#if HF_ARCH_HAS_CYCCNT
+    return DWT->CYCCNT;
+#else
+    return 0;
+#endif
+}
@@ -0,0 +1,464 @@
+#!/usr/bin/env python3
+"""Capture daemon: many serial ports at once, dumps out as JSON records.
+
+Subcommands:
+
+  run        Read every configured port (one asyncio loop, no thread per
+             port), cut HardFault dump blocks and lone HF_ADDR lines out of
+             each stream, symbolize them with that board's ELF and append
+             one JSON record per dump to --out.
+  selftest   Create --ports pty pairs, play simulated boards into them at
+             --baud and check that every dump comes out, symbolized, on the
+             right port. Reports latency and memory.
+
+Ports are given as --port PATH[@BAUD][=ELF][:NAME] (repeatable), or as a
+JSON --config file:
+
+  {"ports": [{"path": "/dev/ttyUSB0", "baud": 115200,
+              "elf": "build/fw.elf", "name": "rack1-slot03"}, ...]}
+
+A board that prints `HF_BUILD_ID=<hex>` (e.g. in its boot banner) is
+symbolized with whichever configured ELF has that build-id, so a re-flashed
+board is picked up without touching the config.
+
+Record:
+
+  {"ts": "2026-10-18T09:03:57.123Z", "port": "/dev/ttyUSB0",
+   "name": "rack1-slot03", "build_id": "9f3c...", "dump": {...libhfdump...},
+   "symbols": {"pc": ["func", "file.c", 42], "lr": null}, "raw": "..."}
+
+Memory per port is bounded: lines longer than --max-line and dump blocks
+larger than --max-block are dropped (and counted). Dumps waiting for
+symbolization are bounded by --queue; when full, new ones are dropped and
+counted rather than buffered.
+"""
+import argparse
+import asyncio
+import contextlib
+import json
+import os
+import random
+import re
+import resource
+import sys
+import time
+from pathlib import Path
+
+from hf_addr2line import find_dumps
+from hf_elf import ElfFile
+from hf_fetch import open_port, open_pty_pair, write_all
+from hf_symd import BuildCache, code_addresses
+
+BEGIN = b'===== HARD FAULT DUMP ====='
+END = b'===== END HARD FAULT DUMP ====='
+ADDR = b'HF_ADDR'
+BUILD_RE = re.compile(rb'HF_BUILD_ID=([0-9a-fA-F]{8,40})')
+
+
+def iso(ts: float) -> str:
+    return time.strftime('%Y-%m-%dT%H:%M:%S', time.gmtime(ts)) + f'.{int(ts % 1 * 1000):03d}Z'
+
+
+# ============================== Ports ==============================
+
+class PortReader:
+    """One serial port: reconnecting reader plus line/block splitter."""
+
+    def __init__(self, daemon, path: str, baud: int, elf, name: str):
+        self.daemon = daemon
+        self.path = path
+        self.baud = baud
+        self.elf = elf
+        self.name = name
+        self.build_id = None
+        self.fd = None
+        self.buf = bytearray()
+        self.block = None            # list of lines while inside a dump
+        self.block_len = 0
+        self.block_ts = 0.0
+        self.stats = {'bytes': 0, 'dumps': 0, 'dropped_lines': 0,
+                      'dropped_blocks': 0, 'reopens': 0}
+
+    async def run(self):
+        loop = asyncio.get_running_loop()
+        while True:
+            try:
+                self.fd = open_port(self.path, self.baud)
+            except OSError:
+                await asyncio.sleep(self.daemon.reopen_wait)
+                continue
+            closed = loop.create_future()
+            loop.add_reader(self.fd, self._readable, closed)
+            try:
+                await closed
+            finally:
+                loop.remove_reader(self.fd)
+                os.close(self.fd)
+                self.fd = None
+            # Unplugged or board reset the link: drop the partial state.
+            self.buf.clear()
+            self.block = None
+            self.stats['reopens'] += 1
+            await asyncio.sleep(self.daemon.reopen_wait)
+
+    def _readable(self, closed):
+        try:
+            data = os.read(self.fd, 65536)
+        except BlockingIOError:
+            return
+        except OSError:
+            data = b''
+        if not data:
+            if not closed.done():
+                closed.set_result(None)
+            return
+        self.stats['bytes'] += len(data)
+        self.feed(data, time.time())
+
+    def feed(self, data: bytes, now: float):
+        self.buf += data
+        start = 0
+        while True:
+            nl = self.buf.find(b'\n', start)
+            if nl < 0:
+                break
+            self.line(bytes(self.buf[start:nl]).rstrip(b'\r'), now)
+            start = nl + 1
+        del self.buf[:start]
+        if len(self.buf) > self.daemon.max_line:
+            self.buf.clear()
+            self.stats['dropped_lines'] += 1
+
+    def line(self, line: bytes, now: float):
+        if self.block is not None:
+            if END in line:
+                self.block.append(line)
+                self.emit(b'\n'.join(self.block), self.block_ts)
+                self.block = None
+                return
+            if BEGIN in line:        # reset mid-print: keep the partial one
+                self.emit(b'\n'.join(self.block), self.block_ts)
+                self.block = None
+            else:
+                self.block_len += len(line) + 1
+                if self.block_len > self.daemon.max_block:
+                    self.block = None
+                    self.stats['dropped_blocks'] += 1
+                else:
+                    self.block.append(line)
+                return
+
+        if BEGIN in line:
+            self.block = [line]
+            self.block_len = len(line) + 1
+            self.block_ts = now
+        elif ADDR in line:
+            self.emit(line, now)
+        elif b'HF_BUILD_ID=' in line:
+            m = BUILD_RE.search(line)
+            if m:
+                self.build_id = m.group(1).decode().lower()
+
+    def emit(self, raw: bytes, ts: float):
+        self.daemon.submit(self, raw, ts)
+
+
+# ============================== Daemon ==============================
+
+class Daemon:
+    def __init__(self, out, max_line=4096, max_block=16384, queue=1024,
+                 max_builds=8, reopen_wait=1.0):
+        self.out = out
+        self.max_line = max_line
+        self.max_block = max_block
+        self.reopen_wait = reopen_wait
+        self.queue = asyncio.Queue(maxsize=queue)
+        self.builds = BuildCache(max_builds)
+        self.elfs = {}               # build-id -> ELF path
+        self.ports = []
+        self.dropped = 0
+        self.records = 0
+        self.on_record = None        # selftest hook
+
+    def add_port(self, path, baud=115200, elf=None, name=None):
+        if elf:
+            self.elfs.setdefault(ElfFile(elf).identity(), str(Path(elf).resolve()))
+        p = PortReader(self, path, baud, elf, name or os.path.basename(path))
+        self.ports.append(p)
+        return p
+
+    def submit(self, port, raw: bytes, ts: float):
+        try:
+            self.queue.put_nowait((port, raw, ts, port.build_id))
+        except asyncio.QueueFull:
+            self.dropped += 1
+
+    def elf_for(self, port, build_id):
+        if build_id:
+            for bid, elf in self.elfs.items():
+                if bid.startswith(build_id):
+                    return bid, elf
+        return (None, port.elf) if port.elf else (build_id, None)
+
+    async def worker(self, batch: int = 256):
+        """Drain the queue in batches: one addr2line round-trip per build per
+        batch, records written in arrival order."""
+        while True:
+            items = [await self.queue.get()]
+            while len(items) < batch and not self.queue.empty():
+                items.append(self.queue.get_nowait())
+            try:
+                await self.process(items)
+            except (OSError, ValueError) as e:
+                print(f'hf_capd: {e}', file=sys.stderr)
+            finally:
+                for _ in items:
+                    self.queue.task_done()
+
+    async def process(self, items):
+        # Builds stay pinned in the cache until the batch's lookups are done.
+        async with contextlib.AsyncExitStack() as pins:
+            await self._process(items, pins)
+
+    async def _process(self, items, pins):
+        recs, wanted = [], {}
+        for port, raw, ts, build_id in items:
+            text = raw.decode('utf-8', 'replace')
+            bid, elf = self.elf_for(port, build_id)
+            build = await pins.enter_async_context(self.builds.use(elf=elf)) if elf else None
+            if build is not None:
+                bid = build.build_id
+            for d in find_dumps(raw):
+                recs.append((port, build, {
+                    'ts': iso(ts), 'port': port.path, 'name': port.name,
+                    'build_id': bid, 'dump': d, 'symbols': {}, 'raw': text}))
+                if build is not None:
+                    addrs = wanted.setdefault(build, set())
+                    addrs.add(int(d['pc'], 16) & ~1)
+                    addrs.add(int(d['lr'], 16) & ~1)
+
+        syms = {}
+        for build, addrs in wanted.items():
+            addrs = list(addrs)
+            syms[build] = dict(zip(addrs, await build.lookup(addrs)))
+
+        for port, build, rec in recs:
+            if build is not None:
+                d = rec['dump']
+                rec['symbols'] = {'pc': syms[build][int(d['pc'], 16) & ~1],
+                                  'lr': syms[build][int(d['lr'], 16) & ~1]}
+            port.stats['dumps'] += 1
+            self.records += 1
+            if self.out is not None:
+                self.out.write(json.dumps(rec) + '\n')
+            if self.on_record:
+                self.on_record(rec)
+        if self.out is not None:
+            self.out.flush()
+
+    def stats(self) -> dict:
+        totals = {}
+        for p in self.ports:
+            for k, v in p.stats.items():
+                totals[k] = totals.get(k, 0) + v
+        totals['records'] = self.records
+        totals['queue_dropped'] = self.dropped
+        return totals
+
+    async def run(self):
+        tasks = [asyncio.create_task(p.run()) for p in self.ports]
+        tasks.append(asyncio.create_task(self.worker()))
+        try:
+            await asyncio.gather(*tasks)
+        finally:
+            self.builds.close()
+
+
+# ============================= Self-test =============================
+
+def board_traffic(idx: int, n_dumps: int, addrs, build_id, rnd: random.Random):
+    """Yield (bytes, pc) chunks of one simulated board's UART output."""
+    if build_id:
+        yield f'boot: HF_BUILD_ID={build_id[:12]}\r\n'.encode(), None
+    for k in range(n_dumps):
+        for _ in range(rnd.randrange(2, 12)):
+            yield f'[{k:06d}] board{idx:02d} sensor={rnd.random():.4f} ok\r\n'.encode(), None
+        pc = rnd.choice(addrs) if addrs else 0x08001000 + 4 * rnd.randrange(4096)
+        lr = (rnd.choice(addrs) if addrs else 0x08000F00) | 1
+        block = (
+            '\r\n===== HARD FAULT DUMP =====\r\n'
+            'Magic: 0x48464450, Ver: 4\r\n'
+            f'Image: application  Faults recorded: {k + 1}\r\n'
+            'EXC_RETURN: 0xFFFFFFFD  MSP: 0x20001000  PSP: 0x20002000\r\n'
+            'Active SP: 0x20002000  Used: PSP  FP ctx: NO\r\n'
+            'Core regs:\r\n'
+            ' R0 : 0x00000001  R1 : 0x00000002\r\n'
+            ' R2 : 0x00000003  R3 : 0x00000004\r\n'
+            f' R12: 0x0000000C  LR : 0x{lr:08X}\r\n'
+            f' PC : 0x{pc:08X}  PSR: 0x21000000\r\n'
+            'CFSR: 0x00008200 (MMFSR=0x00 BFSR=0x82 UFSR=0x0000)\r\n'
+            'HFSR: 0x40000000  DFSR: 0x00000000\r\n'
+            'MMFAR: 0x00000000  BFAR: 0x40001234\r\n'
+            'AFSR: 0x00000000  SHCSR: 0x00070000\r\n'
+            'RTOS info: not available (no RTOS or scheduler not started)\r\n'
+            'Stack dump bytes: 512\r\n'
+            f'HF_ADDR PC=0x{pc:08X} LR=0x{lr:08X}\r\n'
+            '===== END HARD FAULT DUMP =====\r\n')
+        yield block.encode(), pc
+
+
+async def play(master: int, chunks, baud: int, sent: list):
+    """Write chunks to a pty master at `baud` (8N1), like a UART would."""
+    loop = asyncio.get_running_loop()
+    bps = baud / 10
+    t = loop.time()
+    for data, pc in chunks:
+        # Write in small pieces so lines arrive split, as they do on a UART.
+        for i in range(0, len(data), 64):
+            piece = data[i:i + 64]
+            write_all(master, piece)
+            written = time.time()
+            t += len(piece) / bps
+            delay = t - loop.time()
+            if delay > 0:
+                await asyncio.sleep(delay)
+        if pc is not None:
+            sent.append((pc, written))
+
+
+async def selftest(args) -> int:
+    elf = Path(args.elf).resolve() if args.elf else None
+    addrs = code_addresses(elf, 512) if elf else None
+    build_id = ElfFile(elf).identity() if elf else None
+
+    daemon = Daemon(None, queue=args.queue, reopen_wait=0.1)
+    pairs, sent = [], []
+    for i in range(args.ports):
+        master, slave, path = open_pty_pair()
+        pairs.append((master, slave))
+        # Boards announce their build; the config has no ELF for them.
+        daemon.add_port(path, args.baud, elf=None, name=f'board{i:02d}')
+        sent.append([])
+    if elf:
+        daemon.elfs[build_id] = str(elf)
+
+    got = {p.name: [] for p in daemon.ports}
+    bad = []
+
+    def on_record(rec):
+        pc = int(rec['dump']['pc'], 16)
+        got[rec['name']].append((pc, time.time()))
+        if elf and not rec['symbols'].get('pc'):
+            bad.append(rec['name'])
+
+    daemon.on_record = on_record
+    runner = asyncio.create_task(daemon.run())
+    await asyncio.sleep(0.3)   # let the readers open their ports
+
+    t0 = time.time()
+    rnd = random.Random(1)
+    await asyncio.gather(*(
+        play(pairs[i][0], list(board_traffic(i, args.dumps, addrs, build_id, rnd)),
+             args.baud, sent[i])
+        for i in range(args.ports)))
+    await asyncio.sleep(0.5)
+    await daemon.queue.join()
+    elapsed = time.time() - t0
+    runner.cancel()
+    for m, s in pairs:
+        os.close(m)
+        os.close(s)
+
+    lost, lat = 0, []
+    for i, p in enumerate(daemon.ports):
+        exp = sent[i]
+        recv = got[p.name]
+        if [pc for pc, _ in exp] != [pc for pc, _ in recv]:
+            lost += 1
+        lat += [r[1] - e[1] for e, r in zip(exp, recv)]
+    lat.sort()
+    st = daemon.stats()
+    rss = resource.getrusage(resource.RUSAGE_SELF).ru_maxrss / 1024
+    n = sum(len(s) for s in sent)
+
+    print(f'{args.ports} ports @ {args.baud} baud, {n} dumps in {elapsed:.1f} s '
+          f'({st["bytes"] / elapsed / 1024:.0f} KiB/s total)')
+    print(f'records: {st["records"]}  ports with missing/misordered dumps: {lost}  '
+          f'unsymbolized: {len(bad)}')
+    if lat:
+        print(f'latency end-of-dump -> record: p50 {lat[len(lat) // 2] * 1000:.1f} ms  '
+              f'p99 {lat[int(len(lat) * 0.99)] * 1000:.1f} ms  max {lat[-1] * 1000:.1f} ms')
+    print(f'dropped: lines {st["dropped_lines"]}  blocks {st["dropped_blocks"]}  '
+          f'queue {st["queue_dropped"]}   max RSS {rss:.0f} MiB')
+    return 0 if (lost == 0 and not bad and st['records'] >= n) else 1
+
+
+# ================================ CLI ================================
+
+def parse_port(spec: str) -> dict:
+    """PATH[@BAUD][=ELF][:NAME]"""
+    m = re.fullmatch(r'([^@=:]+)(?:@(\d+))?(?:=([^:]+))?(?::(.+))?', spec)
+    if not m:
+        raise argparse.ArgumentTypeError(f'bad port spec: {spec}')
+    return {'path': m.group(1), 'baud': int(m.group(2) or 115200),
+            'elf': m.group(3), 'name': m.group(4)}
+
+
+def main() -> int:
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    sub = ap.add_subparsers(dest='cmd', required=True)
+
+    p = sub.add_parser('run')
+    p.add_argument('--port', type=parse_port, action='append', default=[])
+    p.add_argument('--config')
+    p.add_argument('--elf', action='append', default=[],
+                   help='extra ELF, matched by HF_BUILD_ID banners')
+    p.add_argument('--out', default='-', help='JSONL file (appended), - for stdout')
+    p.add_argument('--max-line', type=int, default=4096)
+    p.add_argument('--max-block', type=int, default=16384)
+    p.add_argument('--queue', type=int, default=1024)
+    p.add_argument('--stats-every', type=float, default=0,
+                   help='print counters to stderr every N seconds')
+
+    p = sub.add_parser('selftest')
+    p.add_argument('--ports', type=int, default=48)
+    p.add_argument('--dumps', type=int, default=10, help='per port')
+    p.add_argument('--baud', type=int, default=115200)
+    p.add_argument('--elf')
+    p.add_argument('--queue', type=int, default=1024)
+
+    args = ap.parse_args()
+    if args.cmd == 'selftest':
+        return asyncio.run(selftest(args))
+
+    ports = list(args.port)
+    if args.config:
+        ports += json.loads(Path(args.config).read_text())['ports']
+    if not ports:
+        ap.error('no ports (use --port or --config)')
+
+    out = sys.stdout if args.out == '-' else open(args.out, 'a')
+
+    async def go():
+        d = Daemon(out, args.max_line, args.max_block, args.queue)
+        for e in args.elf:
+            d.elfs.setdefault(ElfFile(e).identity(), str(Path(e).resolve()))
+        for cfg in ports:
+            d.add_port(cfg['path'], cfg.get('baud', 115200), cfg.get('elf'), cfg.get('name'))
+        if args.stats_every:
+            async def report():
+                while True:
+                    await asyncio.sleep(args.stats_every)
+                    print(f'hf_capd: {json.dumps(d.stats())}', file=sys.stderr, flush=True)
+            asyncio.create_task(report())
+        await d.run()
+
+    try:
+        asyncio.run(go())
+    except KeyboardInterrupt:
+        pass
+    return 0
+
+
+if __name__ == '__main__':
+    raise SystemExit(main())
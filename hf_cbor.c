@@ -0,0 +1,256 @@
+#include "hf_cbor.h"
+#include "hardfault_dump.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+/*
+ * CBOR encoder for stored dumps (see hf_cbor.h for the record layout).
+ *
+ * Like hf_proto.c, only the public dump API is used: the dump is read in
+ * place through HardFault_DumpData(), which checks it once.
+ */
+
+#define HF_CBOR_UINT     0u   /* major types */
+#define HF_CBOR_BYTES    2u
+#define HF_CBOR_TEXT     3u
+#define HF_CBOR_ARRAY    4u
+#define HF_CBOR_MAP      5u
+
+#define HF_CBOR_MRU      4u   /* stack word references, see hf_cbor.h */
+#define HF_CBOR_VARINT_MAX 5u /* 34-bit value */
+
+#define CFSR_MMARVALID   (1u << 7)
+#define CFSR_BFARVALID   (1u << 15)
+
+typedef struct {
+    uint8_t *buf;
+    uint32_t cap;
+    uint32_t pos;
+    bool     full;   /* something did not fit */
+} hf_cbor_w_t;
+
+/* ========================= CBOR primitives ========================= */
+
+static void cb_put(hf_cbor_w_t *w, const void *p, uint32_t len)
+{
+    if (w->full || len > w->cap - w->pos) {
+        w->full = true;
+        return;
+    }
+    memcpy(&w->buf[w->pos], p, len);
+    w->pos += len;
+}
+
+/* Shortest head for a major type and argument (RFC 8949, 3.1). */
+static uint32_t cb_head_len(uint32_t v)
+{
+    return (v < 24u) ? 1u : (v <= 0xFFu) ? 2u : (v <= 0xFFFFu) ? 3u : 5u;
+}
+
+static uint32_t cb_head_fill(uint8_t *p, uint8_t major, uint32_t v)
+{
+    const uint32_t n = cb_head_len(v);
+
+    switch (n) {
+    case 1u: p[0] = (uint8_t)((major << 5) | v);                  break;
+    case 2u: p[0] = (uint8_t)((major << 5) | 24u); p[1] = (uint8_t)v; break;
+    case 3u: p[0] = (uint8_t)((major << 5) | 25u);
+             p[1] = (uint8_t)(v >> 8); p[2] = (uint8_t)v;         break;
+    default: p[0] = (uint8_t)((major << 5) | 26u);
+             p[1] = (uint8_t)(v >> 24); p[2] = (uint8_t)(v >> 16);
+             p[3] = (uint8_t)(v >> 8);  p[4] = (uint8_t)v;        break;
+    }
+    return n;
+}
+
+static void cb_head(hf_cbor_w_t *w, uint8_t major, uint32_t v)
+{
+    uint8_t tmp[5];
+    cb_put(w, tmp, cb_head_fill(tmp, major, v));
+}
+
+static void cb_uint(hf_cbor_w_t *w, uint32_t key, uint32_t v)
+{
+    cb_head(w, HF_CBOR_UINT, key);
+    cb_head(w, HF_CBOR_UINT, v);
+}
+
+static void cb_uints(hf_cbor_w_t *w, uint32_t key, const uint32_t *v, uint32_t n)
+{
+    cb_head(w, HF_CBOR_UINT, key);
+    cb_head(w, HF_CBOR_ARRAY, n);
+    for (uint32_t i = 0; i < n; i++) {
+        cb_head(w, HF_CBOR_UINT, v[i]);
+    }
+}
+
+/* ========================= Stack words ========================= */
+
+static uint32_t varint_fill(uint8_t *p, uint64_t v)
+{
+    uint32_t n = 0;
+
+    do {
+        p[n] = (uint8_t)(v & 0x7Fu);
+        v >>= 7;
+        if (v != 0u) p[n] |= 0x80u;
+        n++;
+    } while (v != 0u);
+    return n;
+}
+
+/*
+ * Encode words from the payload src into dst[0..room) as long as they fit;
+ * returns bytes used. src need not be word aligned.
+ */
+static uint32_t hf_cbor_stack(const uint8_t *src, uint32_t words,
+                              uint8_t *dst, uint32_t room)
+{
+    uint32_t ref[HF_CBOR_MRU] = { 0 };
+    uint32_t used = 0;
+
+    for (uint32_t i = 0; i < words; i++) {
+        uint32_t word;
+        memcpy(&word, &src[4u * i], sizeof(word));
+
+        uint32_t best = 0, best_zz = 0xFFFFFFFFu;
+        for (uint32_t r = 0; r < HF_CBOR_MRU; r++) {
+            const int32_t  d  = (int32_t)(word - ref[r]);
+            const uint32_t zz = ((uint32_t)d << 1) ^ (uint32_t)(d >> 31);
+            if (zz < best_zz) {
+                best_zz = zz;
+                best = r;
+            }
+        }
+
+        uint8_t  tmp[HF_CBOR_VARINT_MAX];
+        const uint32_t n = varint_fill(tmp, ((uint64_t)best_zz << 2) | best);
+        if (n > room - used) {
+            break;
+        }
+        memcpy(&dst[used], tmp, n);
+        used += n;
+
+        memmove(&ref[1], &ref[0], best * sizeof(ref[0]));
+        ref[0] = word;
+    }
+    return used;
+}
+
+/* ========================= Record ========================= */
+
+int32_t HardFault_EncodeCbor(uint8_t id, uint32_t fields, uint32_t max_stack_bytes,
+                             uint8_t *buf, uint32_t cap)
+{
+    hf_dump_hdr_t h;
+    uint32_t      size;
+
+    const uint8_t *dump = HardFault_DumpData(id, &size);
+    if (dump == NULL) {
+        return HF_CBOR_ERR_NODUMP;
+    }
+    /* Fields a shorter (older) header does not have read as 0. */
+    memset(&h, 0, sizeof(h));
+    memcpy(&h, dump, 8u);
+    memcpy(&h, dump, (h.header_len < sizeof(h)) ? h.header_len : (uint32_t)sizeof(h));
+
+    uint32_t fault_addr = 0;
+    bool     have_addr  = true;
+    if (h.scb_cfsr & CFSR_MMARVALID) {
+        fault_addr = h.scb_mmfar;
+    } else if (h.scb_cfsr & CFSR_BFARVALID) {
+        fault_addr = h.scb_bfar;
+    } else {
+        have_addr = false;
+    }
+    h.rtos_task_name[HF_MAX_TASK_NAME_LEN] = '\0';
+    const uint32_t name_len = (h.rtos_present != 0u) ? (uint32_t)strlen(h.rtos_task_name) : 0u;
+    const bool     rtos     = (h.rtos_present != 0u) && (fields & HF_CBOR_F_RTOS);
+    const bool     msp      = (h.version >= 5u);
+
+    const uint32_t entries = 11u + (have_addr ? 1u : 0u) + ((name_len != 0u) ? 1u : 0u)
+                           + ((fields & HF_CBOR_F_REGS) ? 1u : 0u)
+                           + ((fields & HF_CBOR_F_SP)   ? (msp ? 2u : 1u) : 0u)
+                           + ((fields & HF_CBOR_F_SCB)  ? 1u : 0u)
+                           + (rtos ? 1u : 0u)
+                           + ((fields & HF_CBOR_F_STACK) ? 2u : 0u);
+
+    hf_cbor_w_t w = { buf, cap, 0u, false };
+
+    cb_head(&w, HF_CBOR_MAP, entries);
+    cb_uint(&w, 0u, HF_CBOR_FORMAT);
+    cb_uint(&w, 1u, id);
+    cb_uint(&w, 2u, HardFault_DumpCount(id));
+    cb_uint(&w, 3u, h.version);
+    cb_uint(&w, 4u, h.arch);
+    cb_uint(&w, 5u, h.flags);
+    cb_uint(&w, 6u, h.checksum);
+    cb_uint(&w, 7u, h.pc);
+    cb_uint(&w, 8u, h.lr);
+    cb_uint(&w, 9u, h.scb_cfsr);
+    cb_uint(&w, 10u, h.scb_hfsr);
+    if (have_addr) {
+        cb_uint(&w, 11u, fault_addr);
+    }
+    if (name_len != 0u) {
+        cb_head(&w, HF_CBOR_UINT, 12u);
+        cb_head(&w, HF_CBOR_TEXT, name_len);
+        cb_put(&w, h.rtos_task_name, name_len);
+    }
+
+    if (fields & HF_CBOR_F_REGS) {
+        const uint32_t v[] = { h.r0, h.r1, h.r2, h.r3, h.r12, h.psr };
+        cb_uints(&w, 13u, v, 6u);
+    }
+    if (fields & HF_CBOR_F_SP) {
+        const uint32_t v[] = { h.exc_return, h.msp, h.psp, h.active_sp,
+                               h.used_sp, h.has_fp, h.sp_limit };
+        cb_uints(&w, 14u, v, 7u);
+        if (msp) {
+            const uint32_t m[] = { h.msp_limit, h.msp_max_used };
+            cb_uints(&w, 19u, m, 2u);
+        }
+    }
+    if (fields & HF_CBOR_F_SCB) {
+        const uint32_t v[] = { h.scb_dfsr, h.scb_mmfar, h.scb_bfar,
+                               h.scb_afsr, h.shcsr };
+        cb_uints(&w, 15u, v, 5u);
+    }
+    if (rtos) {
+        const uint32_t v[] = { h.rtos_present, h.rtos_task_priority,
+                               h.rtos_stack_high_water_bytes, h.rtos_stack_base };
+        cb_uints(&w, 16u, v, 4u);
+    }
+
+    if (fields & HF_CBOR_F_STACK) {
+        cb_uint(&w, 17u, h.stack_bytes);
+        cb_head(&w, HF_CBOR_UINT, 18u);
+        cb_head(&w, HF_CBOR_BYTES, 0u);   /* placeholder, at least 1 byte */
+    }
+    if (w.full) {
+        return HF_CBOR_ERR_SPACE;
+    }
+
+    if (fields & HF_CBOR_F_STACK) {
+        /* Words go 3 bytes past the placeholder head (room for a 16-bit
+         * length) and are moved down once their length is known. */
+        const uint32_t at = w.pos - 1u;
+        uint32_t room = (cap - at > 3u) ? cap - at - 3u : 0u;
+        if (room > 0xFFFFu) room = 0xFFFFu;
+
+        uint32_t words = h.stack_bytes / 4u;
+        if (max_stack_bytes != 0u && words > max_stack_bytes / 4u) {
+            words = max_stack_bytes / 4u;
+        }
+
+        const uint32_t n = (room != 0u) ? hf_cbor_stack(&dump[h.header_len], words,
+                                                        &buf[at + 3u], room) : 0u;
+        if (n != 0u) {
+            memmove(&buf[at + cb_head_len(n)], &buf[at + 3u], n);
+        }
+        cb_head_fill(&buf[at], HF_CBOR_BYTES, n);
+        w.pos = at + cb_head_len(n) + n;
+    }
+    return (int32_t)w.pos;
+}
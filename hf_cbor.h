@@ -0,0 +1,77 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+ * Compact CBOR (RFC 8949) encoding of a stored dump for upload pipelines.
+ *
+ * Encodes a validated dump into a caller buffer, typically for a cellular
+ * or LoRa uplink where the ~2 KB text print is too expensive. The host side
+ * is hf_cbor.py (decode to the same JSON as libhfdump, size report).
+ *
+ * Record: one CBOR map with small unsigned keys. Keys 0-12 are always
+ * present (11/12 only when valid), the rest depend on the field policy:
+ *
+ *    0  format version (HF_CBOR_FORMAT)      7  pc
+ *    1  dump id (HF_IMAGE_*)                 8  lr
+ *    2  fault count of that slot             9  CFSR
+ *    3  dump header version                 10  HFSR
+ *    4  arch (HF_ARCH_*)                    11  fault address (MMFAR or BFAR,
+ *    5  flags (HF_DUMP_F_*)                      only if CFSR marks it valid)
+ *    6  dump checksum (dedup key)           12  task name (RTOS only)
+ *
+ *   13  [r0, r1, r2, r3, r12, psr]                          HF_CBOR_F_REGS
+ *   14  [exc_return, msp, psp, active_sp, used_sp, has_fp,  HF_CBOR_F_SP
+ *        sp_limit]
+ *   15  [dfsr, mmfar, bfar, afsr, shcsr]                    HF_CBOR_F_SCB
+ *   16  [rtos, priority, min_free_bytes, stack_base]        HF_CBOR_F_RTOS
+ *   17  stack_bytes of the stored dump                      HF_CBOR_F_STACK
+ *   18  stack words from active_sp up, as a byte string    HF_CBOR_F_STACK
+ *   19  [msp_limit, msp_max_used] (dump v5+)                HF_CBOR_F_SP
+ *
+ * Stack words (key 18) are unsigned LEB128 varints, one per word:
+ *
+ *   varint = zigzag(word - ref[i]) << 2 | i
+ *
+ * where ref[0..3] are the last four words in most-recently-used order
+ * (initially 0) and i is the entry with the smallest difference; the word
+ * then moves to ref[0]. A stack mixes RAM pointers, code addresses and
+ * small ints, so a delta to the previous word alone is often larger than
+ * the word; against the nearest of the last four, most words take 1-3
+ * bytes. The stack is cut to what fits the buffer (and max_stack_bytes);
+ * key 17 tells the decoder how much the dump had.
+ */
+
+#define HF_CBOR_FORMAT        1u
+
+/* Field groups on top of the essentials (keys 0-12). */
+#define HF_CBOR_F_REGS        0x01u
+#define HF_CBOR_F_SP          0x02u
+#define HF_CBOR_F_SCB         0x04u
+#define HF_CBOR_F_RTOS        0x08u
+#define HF_CBOR_F_STACK       0x10u
+
+/* Policies: what triage needs, or everything the dump holds. */
+#define HF_CBOR_ESSENTIALS    0x00u
+#define HF_CBOR_FULL          (HF_CBOR_F_REGS | HF_CBOR_F_SP | HF_CBOR_F_SCB | \
+                               HF_CBOR_F_RTOS | HF_CBOR_F_STACK)
+
+#define HF_CBOR_ERR_NODUMP    (-1)   /* no valid dump with that id */
+#define HF_CBOR_ERR_SPACE     (-2)   /* buffer too small for the essentials */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Encode dump id into buf[0..cap) with the given HF_CBOR_F_* fields.
+ * max_stack_bytes caps the stack words taken (0 = all). Returns the record
+ * length, or HF_CBOR_ERR_*. About 250 bytes of stack, no device dependency;
+ * call it from thread context like hf_proto.c.
+ */
+int32_t HardFault_EncodeCbor(uint8_t id, uint32_t fields, uint32_t max_stack_bytes,
+                             uint8_t *buf, uint32_t cap);
+
+#ifdef __cplusplus
+}
+#endif
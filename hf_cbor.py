@@ -0,0 +1,442 @@
+#!/usr/bin/env python3
+"""Host side of the compact CBOR dump records (see hf_cbor.h).
+
+Subcommands:
+
+  decode <file...>  Decode records (one or more per file, back to back) and
+                    print one JSON object each, in libhfdump's format plus
+                    "image", "fault_count" and "policy". --bin OUT also
+                    writes them back as binary dumps for hf_addr2line.py,
+                    hf_crashdb.py and friends.
+  encode <dump>     Encode a binary dump or mailbox extract the way the
+                    target would (--full, --max-stack, --cap); for gateways
+                    and for checking target output byte for byte.
+  size [dump...]    Encoded size per policy next to the binary dump size.
+                    Without files, for a set of synthetic typical dumps.
+
+The target encoder and encode() here produce identical bytes
+(tests/test_hf_cbor.py). Dumps are found and checked by libhfdump
+(hfdump.py), so encode and size need it built.
+"""
+import argparse
+import json
+import random
+import struct
+import sys
+from pathlib import Path
+
+import hfdump
+
+HF_MAGIC = 0x48464450
+HF_MBOX_MAGIC = 0x424D4648
+FORMAT = 1
+
+F_REGS, F_SP, F_SCB, F_RTOS, F_STACK = 0x01, 0x02, 0x04, 0x08, 0x10
+ESSENTIALS = 0x00
+FULL = F_REGS | F_SP | F_SCB | F_RTOS | F_STACK
+MRU = 4
+
+CFSR_MMARVALID = 1 << 7
+CFSR_BFARVALID = 1 << 15
+
+REGS = ('r0', 'r1', 'r2', 'r3', 'r12', 'psr')
+SP = ('exc_return', 'msp', 'psp', 'active_sp', 'used_sp', 'has_fp', 'sp_limit')
+MSP = ('msp_limit', 'msp_max_used')
+SCB = ('dfsr', 'mmfar', 'bfar', 'afsr', 'shcsr')
+RTOS = ('rtos', 'priority', 'min_free', 'stack_base')
+
+
+# ============================== Binary dumps ==============================
+
+def xor8(b: bytes) -> int:
+    x = 0
+    for v in b:
+        x ^= v
+    return x
+
+
+def find_dumps(data: bytes):
+    """[(id, fault_count, header, stack)] from a dump or mailbox extract, as
+    libhfdump finds and checks them; the header with its raw field values."""
+    magic = struct.unpack_from('<I', data)[0] if len(data) >= 4 else 0
+    if magic == HF_MAGIC:
+        found = hfdump.parse_binary(data)
+    elif magic == HF_MBOX_MAGIC:
+        found = hfdump.parse_mailbox(data)
+    else:
+        return []
+    out = []
+    for d in found:
+        if d['checksum'] != 'ok':
+            continue
+        h = hfdump.header(data, d['offset'])
+        h['task_name'] = h['task_name'].split(b'\0', 1)[0].decode('latin-1')
+        stack = data[d['offset'] + h['header_len']:][:h['stack_bytes']]
+        dump_id = 0 if d.get('image') == 'bootloader' else 1
+        out.append((dump_id, d.get('fault_count', 0), h, stack))
+    return out
+
+
+def build_dump(h: dict, stack: bytes) -> bytes:
+    """A v6 binary dump (no extension records) with a valid checksum."""
+    v = dict(h, magic=HF_MAGIC, header_len=hfdump.HDR.size, stack_bytes=len(stack),
+             checksum=0, ext_bytes=0, ext_checksum=0,
+             task_name=h['task_name'].encode('latin-1')[:16])
+    hdr = bytearray(hfdump.HDR.pack(*(v[k] for k in hfdump.FIELDS)))
+    struct.pack_into('<I', hdr, hfdump.CHECKSUM_OFF, xor8(bytes(hdr) + stack))
+    return bytes(hdr) + stack
+
+
+# ============================== CBOR ==============================
+
+def _head(major: int, v: int) -> bytes:
+    if v < 24:
+        return bytes([major << 5 | v])
+    if v <= 0xFF:
+        return bytes([major << 5 | 24, v])
+    if v <= 0xFFFF:
+        return bytes([major << 5 | 25]) + struct.pack('>H', v)
+    return bytes([major << 5 | 26]) + struct.pack('>I', v)
+
+
+def _varint(v: int) -> bytes:
+    out = bytearray()
+    while True:
+        b, v = v & 0x7F, v >> 7
+        out.append(b | (0x80 if v else 0))
+        if not v:
+            return bytes(out)
+
+
+def _zigzag(d: int) -> int:
+    d = (d + (1 << 31)) % (1 << 32) - (1 << 31)   # wrap to int32
+    return ((d << 1) ^ (d >> 31)) & 0xFFFFFFFF
+
+
+def pack_stack(words, room: int) -> bytes:
+    """hf_cbor_stack(): MRU-reference zigzag varints, cut at room bytes."""
+    ref, out = [0] * MRU, bytearray()
+    for w in words:
+        zz = [_zigzag(w - r) for r in ref]
+        i = zz.index(min(zz))
+        b = _varint(zz[i] << 2 | i)
+        if len(b) > room - len(out):
+            break
+        out += b
+        ref.insert(0, ref.pop(i))
+        ref[0] = w
+    return bytes(out)
+
+
+def unpack_stack(data: bytes):
+    ref, words, v, shift = [0] * MRU, [], 0, 0
+    for b in data:
+        v |= (b & 0x7F) << shift
+        shift += 7
+        if b & 0x80:
+            continue
+        i, zz = v & 3, v >> 2
+        w = (ref[i] + ((zz >> 1) ^ -(zz & 1))) & 0xFFFFFFFF
+        ref.insert(0, ref.pop(i))
+        ref[0] = w
+        words.append(w)
+        v, shift = 0, 0
+    if shift:
+        raise ValueError('truncated stack varint')
+    return words
+
+
+def encode(h: dict, stack: bytes, dump_id: int, fault_count: int,
+           fields: int = FULL, max_stack: int = 0, cap: int = 1 << 16) -> bytes:
+    """HardFault_EncodeCbor() on the host; raises ValueError where it
+    returns HF_CBOR_ERR_SPACE."""
+    cfsr = h['cfsr']
+    addr = h['mmfar'] if cfsr & CFSR_MMARVALID else h['bfar'] if cfsr & CFSR_BFARVALID else None
+    name = h['task_name'].encode('latin-1')[:16] if h['rtos'] else b''
+    items = [(0, FORMAT), (1, dump_id), (2, fault_count), (3, h['version']),
+             (4, h['arch']), (5, h['flags']), (6, h['checksum']), (7, h['pc']),
+             (8, h['lr']), (9, cfsr), (10, h['hfsr'])]
+    if addr is not None:
+        items.append((11, addr))
+    if name:
+        items.append((12, name))
+    for bit, key, names in ((F_REGS, 13, REGS), (F_SP, 14, SP), (F_SCB, 15, SCB),
+                            (F_RTOS, 16, RTOS)):
+        if fields & bit and (bit != F_RTOS or h['rtos']):
+            items.append((key, [h[k] for k in names]))
+        if bit == F_SP and fields & F_SP and h['version'] >= 5:
+            items.append((19, [h[k] for k in MSP]))
+    if fields & F_STACK:
+        items += [(17, h['stack_bytes']), (18, b'')]
+
+    out = bytearray(_head(5, len(items)))
+    for key, v in items:
+        out += _head(0, key)
+        if isinstance(v, list):
+            out += _head(4, len(v)) + b''.join(_head(0, x) for x in v)
+        elif key == 12:
+            out += _head(3, len(v)) + v
+        elif key == 18:
+            out += _head(2, 0)
+        else:
+            out += _head(0, v)
+    if len(out) > cap:
+        raise ValueError(f'{len(out)} bytes of essentials do not fit {cap}')
+    if fields & F_STACK:
+        n = len(stack) // 4
+        if max_stack:
+            n = min(n, max_stack // 4)
+        room = min(max(cap - (len(out) - 1) - 3, 0), 0xFFFF)
+        packed = pack_stack(struct.unpack(f'<{n}I', stack[:4 * n]), room)
+        out[-1:] = _head(2, len(packed)) + packed
+    return bytes(out)
+
+
+def loads(buf: bytes, pos: int = 0):
+    """(object, next position) for the definite-length subset used here."""
+    ib = buf[pos]
+    major, info = ib >> 5, ib & 0x1F
+    pos += 1
+    if info < 24:
+        v = info
+    elif info in (24, 25, 26, 27):
+        n = 1 << (info - 24)
+        if pos + n > len(buf):
+            raise ValueError('truncated record')
+        v = int.from_bytes(buf[pos:pos + n], 'big')
+        pos += n
+    else:
+        raise ValueError(f'unsupported CBOR item 0x{ib:02X}')
+    if major == 0:
+        return v, pos
+    if major == 1:
+        return -1 - v, pos
+    if major in (2, 3):
+        if pos + v > len(buf):
+            raise ValueError('truncated record')
+        s = bytes(buf[pos:pos + v])
+        return (s if major == 2 else s.decode('utf-8', 'replace')), pos + v
+    if major == 4:
+        out = []
+        for _ in range(v):
+            x, pos = loads(buf, pos)
+            out.append(x)
+        return out, pos
+    if major == 5:
+        out = {}
+        for _ in range(v):
+            k, pos = loads(buf, pos)
+            out[k], pos = loads(buf, pos)
+        return out, pos
+    raise ValueError(f'unsupported CBOR major type {major}')
+
+
+# ============================== Records ==============================
+
+def record_dump(rec: dict):
+    """(header dict, stack bytes, policy bits) from a decoded record map."""
+    if rec.get(0) != FORMAT:
+        raise ValueError(f'unknown record format {rec.get(0)}')
+    h = dict.fromkeys(hfdump.FIELDS, 0)
+    h.update(version=rec[3], arch=rec[4], flags=rec[5], checksum=rec[6], pc=rec[7],
+             lr=rec[8], cfsr=rec[9], hfsr=rec[10], task_name=rec.get(12, ''))
+    if 11 in rec:
+        h['mmfar' if rec[9] & CFSR_MMARVALID else 'bfar'] = rec[11]
+    if 12 in rec:
+        h['rtos'] = 1
+    fields = 0
+    for bit, key, names in ((F_REGS, 13, REGS), (F_SP, 14, SP), (F_SCB, 15, SCB),
+                            (F_RTOS, 16, RTOS)):
+        if key in rec:
+            h.update(zip(names, rec[key]))
+            fields |= bit
+    if 19 in rec:
+        h.update(zip(MSP, rec[19]))
+    stack = b''
+    if 18 in rec:
+        words = unpack_stack(rec[18])
+        stack = struct.pack(f'<{len(words)}I', *words)
+        fields |= F_STACK
+    return h, stack, fields
+
+
+def record_json(rec: dict, hfdump=None) -> dict:
+    h, stack, fields = record_dump(rec)
+    if hfdump is not None:
+        d = hfdump.parse_binary(build_dump(h, stack))[0]
+        d.pop('offset', None)
+        # Drop what the record did not carry instead of printing zeros.
+        regs, scb = d.get('regs', {}), d.get('scb', {})
+        if not fields & F_REGS:
+            for k in REGS:
+                regs.pop(k, None)
+        if not fields & F_SP:
+            for k in ('exc_return', 'msp', 'psp'):
+                regs.pop(k, None)
+            for k in ('active_sp', 'stack', 'fp_context', 'main_stack'):
+                d.pop(k, None)
+        if not fields & F_SCB:
+            for k in ('dfsr', 'afsr', 'shcsr', 'mmfar', 'bfar'):
+                scb.pop(k, None)
+        if not fields & F_RTOS and 'task' in d:
+            d['task'] = {'name': h['task_name']}
+        if not fields & F_STACK:
+            d.pop('stack_bytes', None)
+    else:
+        d = {'pc': f'0x{h["pc"]:08X}', 'lr': f'0x{h["lr"]:08X}',
+             'scb': {'cfsr': f'0x{h["cfsr"]:08X}', 'hfsr': f'0x{h["hfsr"]:08X}'}}
+        if h['rtos']:
+            d['task'] = {'name': h['task_name']}
+        if fields & F_STACK:
+            d['stack_bytes'] = len(stack)
+    d['source'] = 'cbor'
+    d['image'] = {0: 'bootloader', 1: 'application'}.get(rec[1], str(rec[1]))
+    d['fault_count'] = rec[2]
+    d['dump_checksum'] = f'0x{h["checksum"]:08X}'
+    d['policy'] = 'full' if fields == FULL else 'essentials' if fields == 0 else f'0x{fields:02X}'
+    if 17 in rec and len(stack) < rec[17]:
+        d['stack_truncated_from'] = rec[17]
+    return d
+
+
+def records(data: bytes):
+    pos = 0
+    while pos < len(data):
+        rec, pos = loads(data, pos)
+        if not isinstance(rec, dict):
+            raise ValueError('record is not a CBOR map')
+        yield rec
+
+
+# ============================== Typical dumps ==============================
+
+def synthetic_dump(stack_bytes: int, rtos: bool, seed: int = 7):
+    """A bus fault in a task with a plausible stack: saved registers, locals,
+    RAM pointers near SP, return addresses into a 32 KB text."""
+    rnd = random.Random(seed)
+    sp = 0x20001E00
+    words = []
+    while len(words) < stack_bytes // 4:
+        k = rnd.randint(2, 8)
+        for _ in range(k):
+            r = rnd.random()
+            if r < 0.30:
+                words.append(0)
+            elif r < 0.55:
+                words.append(rnd.randint(1, 300))
+            elif r < 0.80:
+                words.append((sp + rnd.randint(-64, 256)) & ~3)
+            elif r < 0.85:
+                words.append((0x40000000 + rnd.randint(0, 0x3000)) & ~3)
+            else:
+                words.append(0x08000000 + rnd.randint(0, 0x8000) | 1)
+        words.append(0x08000000 + rnd.randint(0, 0x8000) | 1)
+        sp += 4 * (k + 1)
+    stack = struct.pack(f'<{stack_bytes // 4}I', *words[:stack_bytes // 4])
+    h = dict.fromkeys(hfdump.FIELDS, 0)
+    h.update(version=6, exc_return=0xFFFFFFFD, msp=0x20007F80, psp=0x20001E00,
+             active_sp=0x20001E00, used_sp=1, cfsr=0x00008200, hfsr=0x40000000,
+             bfar=0x40011C04, shcsr=0x00070000, r0=0x40011C00, r1=0x2000014C, r2=7,
+             r3=0, r12=0x0800241F, lr=0x08003A61, pc=0x08003A7C, psr=0x21000000,
+             arch=3, msp_limit=0x20007C00, msp_max_used=604, task_name='')
+    if rtos:
+        h.update(rtos=1, priority=3, min_free=412, stack_base=0x20001800, task_name='net_rx')
+    return build_dump(h, stack)
+
+
+# ================================ CLI ================================
+
+def cmd_decode(args) -> int:
+    try:
+        hfdump.version()
+        lib = hfdump
+    except ImportError:
+        lib = None
+    bins = []
+    rc = 0
+    for f in args.files:
+        try:
+            for rec in records(Path(f).read_bytes()):
+                d = record_json(rec, lib)
+                print(json.dumps(d))
+                h, stack, _ = record_dump(rec)
+                bins.append(build_dump(h, stack))
+        except (OSError, ValueError, KeyError, IndexError) as e:
+            print(f'{f}: {e}', file=sys.stderr)
+            rc = 1
+    if args.bin:
+        Path(args.bin).write_bytes(b''.join(bins))
+    return rc
+
+
+def cmd_encode(args) -> int:
+    try:
+        dumps = find_dumps(Path(args.dump).read_bytes())
+    except (OSError, ImportError) as e:
+        print(f'error: {e}', file=sys.stderr)
+        return 1
+    if not dumps:
+        print(f'{args.dump}: no valid dump', file=sys.stderr)
+        return 1
+    out = bytearray()
+    for dump_id, count, h, stack in dumps:
+        try:
+            out += encode(h, stack, dump_id, count, FULL if args.full else ESSENTIALS,
+                          args.max_stack, args.cap)
+        except ValueError as e:
+            print(f'{args.dump}: {e}', file=sys.stderr)
+            return 1
+    Path(args.out).write_bytes(out)
+    print(f'{args.out}: {len(dumps)} record(s), {len(out)} bytes')
+    return 0
+
+
+def cmd_size(args) -> int:
+    try:
+        hfdump.version()
+    except ImportError as e:
+        print(f'error: {e}', file=sys.stderr)
+        return 1
+    if args.files:
+        inputs = [(f, Path(f).read_bytes()) for f in args.files]
+    else:
+        inputs = [(f'synthetic, {n} B stack{", RTOS" if r else ""}', synthetic_dump(n, r))
+                  for n, r in ((0, False), (128, True), (512, True), (2048, True))]
+    print(f'{"dump":34} {"binary":>7} {"essent.":>7} {"full":>7} {"stack":>13}')
+    for name, data in inputs:
+        for dump_id, count, h, stack in find_dumps(data):
+            ess = encode(h, stack, dump_id, count, ESSENTIALS)
+            full = encode(h, stack, dump_id, count, FULL)
+            st = f'{len(stack)} -> {len(loads(full)[0][18])}'
+            print(f'{name:34} {h["header_len"] + len(stack):7} {len(ess):7} '
+                  f'{len(full):7} {st:>13}')
+    return 0
+
+
+def main() -> int:
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    sub = ap.add_subparsers(dest='cmd', required=True)
+
+    p = sub.add_parser('decode', help='records to JSON')
+    p.add_argument('--bin', help='also write the records as binary dumps here')
+    p.add_argument('files', nargs='+')
+    p.set_defaults(fn=cmd_decode)
+
+    p = sub.add_parser('encode', help='binary dump to records')
+    p.add_argument('--full', action='store_true', help='HF_CBOR_FULL (default essentials)')
+    p.add_argument('--max-stack', type=int, default=0, help='stack bytes cap, 0 = all')
+    p.add_argument('--cap', type=int, default=1 << 16, help='buffer size on the target')
+    p.add_argument('-o', '--out', required=True)
+    p.add_argument('dump')
+    p.set_defaults(fn=cmd_encode)
+
+    p = sub.add_parser('size', help='encoded sizes')
+    p.add_argument('files', nargs='*')
+    p.set_defaults(fn=cmd_size)
+
+    args = ap.parse_args()
+    return args.fn(args)
+
+
+if __name__ == '__main__':
+    raise SystemExit(main())
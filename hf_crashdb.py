@@ -0,0 +1,424 @@
+#!/usr/bin/env python3
+"""Crash database: incremental log ingestion into SQLite, plus queries.
+
+Subcommands:
+
+  ingest DIR [--watch]   Decode and symbolize the dumps in every log under
+                         DIR. Only bytes appended since the last run are
+                         read (offset persisted per file, in the same
+                         transaction as the dumps). With --watch, keeps
+                         running and picks up changes via inotify, or by
+                         polling where inotify is unavailable.
+  top                    Most frequent crash signatures, e.g.
+                           hf_crashdb.py top --build 9f3c --since 7d
+  list                   Individual dumps, filtered by build, class, task,
+                         signature and time.
+  stats                  Database totals.
+
+Dumps are found with libhfdump when it is built (hfdump.py), otherwise from
+HF_ADDR lines, and symbolized like hf_addr2line.py does (through hf_symd.py
+if $HF_SYMD_SOCKET is set).
+
+A dump's build is the last `HF_BUILD_ID=<hex>` line before it in the log
+(print it in your boot banner), matched against the --elf files given, so
+a reflash mid-log is followed. Dumps with none before them are attributed
+to the first --elf.
+
+A dump's time (ts) is the date and time at the start of its first line,
+as serial loggers stamp them (`2026-10-18 12:34:56.789`, `[...T...Z]`;
+local time without a zone). Without one, it is the log's modification
+time when the dump was read: close for a log being followed, only an
+upper bound for an old one.
+"""
+import argparse
+import bisect
+import ctypes
+import ctypes.util
+import datetime
+import hashlib
+import json
+import os
+import re
+import select
+import sqlite3
+import sys
+import time
+from pathlib import Path
+
+from hf_addr2line import addr2line, find_dumps
+from hf_elf import ElfFile
+
+BEGIN = b'===== HARD FAULT DUMP ====='
+END = b'===== END HARD FAULT DUMP ====='
+BUILD_RE = re.compile(rb'HF_BUILD_ID=([0-9a-fA-F]{8,40})')
+STAMP_RE = re.compile(rb'[\[(<]?(\d{4}-\d\d-\d\d[T ]\d\d:\d\d:\d\d(?:[.,]\d{1,6})?)'
+                      rb'(Z|[+-]\d\d:?\d\d)?')
+
+# A dump block without its end marker stops holding back the offset when
+# this much has been written after its start (a dump prints far less), or
+# when the log has not changed for PARTIAL_IDLE seconds: the board reset
+# mid-print and the block will never end.
+PARTIAL_MAX = 64 * 1024
+PARTIAL_IDLE = 30.0
+
+SCHEMA = '''
+CREATE TABLE IF NOT EXISTS files (
+    path      TEXT PRIMARY KEY,
+    inode     INTEGER NOT NULL,
+    offset    INTEGER NOT NULL,
+    build_id  TEXT
+);
+CREATE TABLE IF NOT EXISTS dumps (
+    id         INTEGER PRIMARY KEY,
+    ts         REAL NOT NULL,
+    build_id   TEXT,
+    signature  TEXT NOT NULL,
+    class      TEXT NOT NULL,
+    task       TEXT,
+    pc         INTEGER NOT NULL,
+    lr         INTEGER NOT NULL,
+    pc_func    TEXT,
+    pc_loc     TEXT,
+    lr_func    TEXT,
+    file       TEXT NOT NULL,
+    file_off   INTEGER NOT NULL,
+    record     TEXT NOT NULL
+);
+-- Trailing signature: "top" queries are answered from the index alone.
+CREATE INDEX IF NOT EXISTS dumps_build_ts ON dumps (build_id, ts, signature);
+CREATE INDEX IF NOT EXISTS dumps_sig_ts   ON dumps (signature, ts);
+CREATE INDEX IF NOT EXISTS dumps_class_ts ON dumps (class, ts, signature);
+CREATE INDEX IF NOT EXISTS dumps_task_ts  ON dumps (task, ts, signature);
+CREATE INDEX IF NOT EXISTS dumps_ts       ON dumps (ts, signature);
+'''
+
+
+def open_db(path: str) -> sqlite3.Connection:
+    db = sqlite3.connect(path)
+    db.execute('PRAGMA journal_mode=WAL')
+    db.execute('PRAGMA synchronous=NORMAL')
+    db.executescript(SCHEMA)
+    return db
+
+
+# ============================== Ingestion ==============================
+
+def signature(cls: str, pc_func: str, lr_func: str, pc: int) -> str:
+    """Stable id of "the same crash": fault class + where it happened."""
+    where = pc_func if pc_func and pc_func != '??' else f'0x{pc:08X}'
+    caller = lr_func if lr_func and lr_func != '??' else ''
+    return hashlib.sha1(f'{cls}|{where}|{caller}'.encode()).hexdigest()[:16]
+
+
+def complete_prefix(data: bytes, idle: bool = False) -> int:
+    """Bytes that can be parsed now: whole lines, and no dump block still
+    being printed. The rest is re-read on the next pass. An unterminated
+    block past PARTIAL_MAX, or any once the log is idle, is given up on
+    and parsed as truncated."""
+    end = data.rfind(b'\n') + 1
+    begin = data.rfind(BEGIN, 0, end)
+    if begin >= 0 and data.find(END, begin, end) < 0 and \
+            not idle and len(data) - begin <= PARTIAL_MAX:
+        end = data.rfind(b'\n', 0, begin) + 1
+    return end
+
+
+def line_time(data: bytes, off: int):
+    """Epoch time stamped at the start of the line holding data[off], or None."""
+    start = data.rfind(b'\n', 0, off) + 1
+    m = STAMP_RE.match(data, start)
+    if not m:
+        return None
+    text = m.group(1).decode().replace(',', '.').replace(' ', 'T')
+    zone = (m.group(2) or b'').decode().replace('Z', '+00:00')
+    if zone and ':' not in zone:
+        zone = zone[:3] + ':' + zone[3:]
+    try:
+        t = datetime.datetime.fromisoformat(text + zone)
+    except ValueError:
+        return None
+    return t.timestamp()                   # naive: local time
+
+
+class Ingestor:
+    def __init__(self, db: sqlite3.Connection, elfs):
+        self.db = db
+        self.elfs = {}           # build-id -> Path
+        self.default_build = None
+        for e in elfs:
+            bid = ElfFile(e).identity()
+            self.elfs[bid] = Path(e)
+            if self.default_build is None:
+                self.default_build = bid
+
+    def full_build_id(self, build_id):
+        """Banners may print a shortened id; expand it if an ELF matches."""
+        if build_id is None or build_id in self.elfs:
+            return build_id
+        for bid in self.elfs:
+            if bid.startswith(build_id):
+                return bid
+        return build_id
+
+    def scan(self, root: Path, pattern: str) -> int:
+        n = 0
+        for path in sorted(root.rglob(pattern)):
+            if path.is_file():
+                n += self.ingest_file(path)
+        return n
+
+    def ingest_file(self, path: Path) -> int:
+        st = path.stat()
+        row = self.db.execute('SELECT inode, offset, build_id FROM files WHERE path = ?',
+                              (str(path),)).fetchone()
+        inode, offset, build_id = row if row else (st.st_ino, 0, None)
+        if inode != st.st_ino or st.st_size < offset:
+            offset, build_id = 0, None     # rotated or truncated: start over
+        if st.st_size == offset and row:
+            return 0
+
+        with open(path, 'rb') as f:
+            f.seek(offset)
+            chunk = f.read()
+        used = complete_prefix(chunk, time.time() - st.st_mtime > PARTIAL_IDLE)
+        data = chunk[:used]
+
+        # Build in effect from each banner on; before the first, the one
+        # the previous pass ended with.
+        builds = [(0, self.full_build_id(build_id) or self.default_build)]
+        builds += [(m.start(), self.full_build_id(m.group(1).decode().lower()))
+                   for m in BUILD_RE.finditer(data)]
+        build_id = builds[-1][1]
+
+        dumps = find_dumps(data) if data else []
+        rows = self.decode(dumps, builds, path, offset, data, st.st_mtime)
+
+        with self.db:
+            self.db.executemany(
+                'INSERT INTO dumps (ts, build_id, signature, class, task, pc, lr, pc_func,'
+                ' pc_loc, lr_func, file, file_off, record) VALUES (?,?,?,?,?,?,?,?,?,?,?,?,?)',
+                rows)
+            self.db.execute('INSERT OR REPLACE INTO files (path, inode, offset, build_id)'
+                            ' VALUES (?,?,?,?)',
+                            (str(path), st.st_ino, offset + used, build_id))
+        return len(rows)
+
+    def decode(self, dumps, builds, path: Path, base: int, data: bytes, mtime: float):
+        """builds: (offset, build-id) from which each build applies, ascending."""
+        if not dumps:
+            return []
+        starts = [off for off, _ in builds]
+        bids = [builds[bisect.bisect_right(starts, d.get('offset', len(data))) - 1][1]
+                for d in dumps]
+        syms = {}
+        for bid in set(bids):
+            elf = self.elfs.get(bid)
+            if elf is not None:
+                addrs = list(dict.fromkeys(int(d[k], 16) & ~1 for d, b in zip(dumps, bids)
+                                           if b == bid for k in ('pc', 'lr')))
+                syms[bid] = addr2line(elf, addrs)
+
+        rows = []
+        for d, build_id in zip(dumps, bids):
+            pc, lr = int(d['pc'], 16), int(d['lr'], 16)
+            pc_func, pc_loc = syms.get(build_id, {}).get(pc & ~1, (None, None))
+            lr_func, _ = syms.get(build_id, {}).get(lr & ~1, (None, None))
+            cls = d.get('class', 'unknown')
+            task = d.get('task', {}).get('name')
+            off = d.get('offset')
+            ts = (line_time(data, off) if off is not None else None) or mtime
+            rows.append((ts, build_id, signature(cls, pc_func, lr_func, pc), cls, task,
+                         pc, lr, pc_func, pc_loc, lr_func, str(path),
+                         base + d.get('offset', 0), json.dumps(d)))
+        return rows
+
+
+# ============================== Watching ==============================
+
+IN_MODIFY = 0x002
+IN_CLOSE_WRITE = 0x008
+IN_MOVED_TO = 0x080
+IN_CREATE = 0x100
+IN_NONBLOCK = 0o4000
+
+
+class Inotify:
+    """Just enough inotify (via libc) to wake up on changes under a tree."""
+
+    def __init__(self, root: Path):
+        self.libc = ctypes.CDLL(ctypes.util.find_library('c'), use_errno=True)
+        self.fd = self.libc.inotify_init1(IN_NONBLOCK)
+        if self.fd < 0:
+            raise OSError(ctypes.get_errno(), 'inotify_init1')
+        self.watched = set()
+        self.add_tree(root)
+
+    def add_tree(self, root: Path):
+        for d in [root] + [p for p in root.rglob('*') if p.is_dir()]:
+            if d in self.watched:
+                continue
+            mask = IN_MODIFY | IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE
+            if self.libc.inotify_add_watch(self.fd, os.fsencode(d), mask) >= 0:
+                self.watched.add(d)
+
+    def wait(self, timeout: float) -> bool:
+        r, _, _ = select.select([self.fd], [], [], timeout)
+        if not r:
+            return False
+        try:
+            while os.read(self.fd, 65536):
+                pass
+        except BlockingIOError:
+            pass
+        return True
+
+
+def watch(ing: Ingestor, root: Path, pattern: str, interval: float):
+    try:
+        notify = Inotify(root)
+        print(f'watching {root} (inotify)', file=sys.stderr)
+    except (OSError, AttributeError, TypeError):
+        notify = None
+        print(f'watching {root} (polling every {interval:g} s)', file=sys.stderr)
+
+    while True:
+        n = ing.scan(root, pattern)
+        if n:
+            print(f'{time.strftime("%H:%M:%S")} +{n} dumps', file=sys.stderr, flush=True)
+        if notify:
+            # Settle briefly so a burst of writes is read in one pass; the
+            # timeout still rescans, in case an event was missed.
+            if notify.wait(interval * 10):
+                time.sleep(0.05)
+            notify.add_tree(root)
+        else:
+            time.sleep(interval)
+
+
+# =============================== Queries ===============================
+
+def parse_since(s: str) -> float:
+    """'7d', '12h', '30m' or an epoch time -> epoch seconds."""
+    m = re.fullmatch(r'(\d+(?:\.\d+)?)([smhdw])', s)
+    if not m:
+        return float(s)
+    unit = {'s': 1, 'm': 60, 'h': 3600, 'd': 86400, 'w': 7 * 86400}[m.group(2)]
+    return time.time() - float(m.group(1)) * unit
+
+
+def prefix(cond, params, column, value):
+    """column starts with value, as a range so the index is used."""
+    cond.append(f'{column} >= ? AND {column} < ?')
+    params += [value, value + '\U0010FFFF']
+
+
+def where(args):
+    cond, params = [], []
+    if args.build:
+        prefix(cond, params, 'build_id', args.build.lower())
+    if args.since:
+        cond.append('ts >= ?')
+        params.append(parse_since(args.since))
+    if getattr(args, 'cls', None):
+        prefix(cond, params, 'class', args.cls)
+    if getattr(args, 'task', None):
+        cond.append('task = ?')
+        params.append(args.task)
+    if getattr(args, 'signature', None):
+        cond.append('signature = ?')
+        params.append(args.signature)
+    return (' WHERE ' + ' AND '.join(cond)) if cond else '', params
+
+
+def cmd_top(db, args):
+    w, params = where(args)
+    t0 = time.perf_counter()
+    # Count from the covering index, then fetch details for the few winners.
+    top = db.execute('SELECT signature, COUNT(*) AS n, MAX(ts) FROM dumps' + w +
+                     ' GROUP BY signature ORDER BY n DESC LIMIT ?',
+                     params + [args.limit]).fetchall()
+    rows = []
+    for sig, n, last in top:
+        cls, func, caller = db.execute(
+            'SELECT class, pc_func, lr_func FROM dumps WHERE signature = ? AND ts = ?',
+            (sig, last)).fetchone()
+        rows.append((sig, n, cls, func, caller, last))
+    ms = (time.perf_counter() - t0) * 1000
+    print(f'{"count":>6}  {"signature":16}  {"class":24}  {"last seen":16}  function (caller)')
+    for sig, n, cls, func, caller, last in rows:
+        stamp = time.strftime('%Y-%m-%d %H:%M', time.localtime(last))
+        print(f'{n:6}  {sig:16}  {cls:24}  {stamp:16}  {func or "?"} ({caller or "?"})')
+    print(f'({len(rows)} signatures, {ms:.1f} ms)', file=sys.stderr)
+
+
+def cmd_list(db, args):
+    w, params = where(args)
+    rows = db.execute('SELECT ts, build_id, signature, class, task, pc, pc_func, pc_loc, file'
+                      ' FROM dumps' + w + ' ORDER BY ts DESC LIMIT ?',
+                      params + [args.limit]).fetchall()
+    for ts, bid, sig, cls, task, pc, func, loc, path in rows:
+        stamp = time.strftime('%Y-%m-%d %H:%M:%S', time.localtime(ts))
+        print(f'{stamp}  {(bid or "-")[:12]:12}  {sig}  {cls:24}  {task or "-":16}  '
+              f'0x{pc:08X} {func or "?"} {loc or ""}  [{path}]')
+
+
+def cmd_stats(db, _args):
+    n, first, last = db.execute('SELECT COUNT(*), MIN(ts), MAX(ts) FROM dumps').fetchone()
+    files, = db.execute('SELECT COUNT(*) FROM files').fetchone()
+    sigs, = db.execute('SELECT COUNT(DISTINCT signature) FROM dumps').fetchone()
+    print(f'dumps: {n}  signatures: {sigs}  files: {files}')
+    for bid, cnt in db.execute('SELECT build_id, COUNT(*) FROM dumps GROUP BY build_id'
+                               ' ORDER BY 2 DESC'):
+        print(f'  {bid or "-"}: {cnt}')
+
+
+# ================================ CLI ================================
+
+def main() -> int:
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument('--db', default='hf_crash.db')
+    sub = ap.add_subparsers(dest='cmd', required=True)
+
+    p = sub.add_parser('ingest')
+    p.add_argument('dir')
+    p.add_argument('--elf', action='append', default=[],
+                   help='firmware ELF (repeat for several builds)')
+    p.add_argument('--pattern', default='*.log')
+    p.add_argument('--watch', action='store_true')
+    p.add_argument('--interval', type=float, default=1.0,
+                   help='polling period without inotify')
+
+    for name in ('top', 'list'):
+        p = sub.add_parser(name)
+        p.add_argument('--build', help='build-id (prefix)')
+        p.add_argument('--since', help='e.g. 7d, 12h, or epoch seconds')
+        p.add_argument('--class', dest='cls', help='e.g. BusFault or BusFault:PRECISERR')
+        p.add_argument('--task')
+        p.add_argument('--signature')
+        p.add_argument('--limit', type=int, default=10 if name == 'top' else 50)
+
+    sub.add_parser('stats')
+
+    args = ap.parse_args()
+    db = open_db(args.db)
+
+    if args.cmd == 'ingest':
+        ing = Ingestor(db, args.elf)
+        root = Path(args.dir)
+        if args.watch:
+            try:
+                watch(ing, root, args.pattern, args.interval)
+            except KeyboardInterrupt:
+                pass
+            return 0
+        n = ing.scan(root, args.pattern)
+        db.execute('PRAGMA optimize')   # keep planner stats current
+        print(f'{n} new dumps', file=sys.stderr)
+        return 0
+
+    {'top': cmd_top, 'list': cmd_list, 'stats': cmd_stats}[args.cmd](db, args)
+    return 0
+
+
+if __name__ == '__main__':
+    raise SystemExit(main())
@@ -0,0 +1,1063 @@
+#!/usr/bin/env python3
+"""Minimal DWARF reader for the host tools (no third-party modules).
+
+Enough to say what was in scope at a code address and where it lived:
+.debug_info/.debug_abbrev (DWARF 2-5, 32- and 64-bit format), location
+and range lists (.debug_loc/.debug_loclists, .debug_ranges/.debug_rnglists),
+call frame information from .debug_frame, and an evaluator for location
+expressions that asks the caller for registers and memory. Compressed
+(SHF_COMPRESSED, zlib) debug sections are inflated on load.
+
+Not handled: split DWARF (.dwo), type units, .eh_frame, DW_OP_entry_value
+and friends (reported as unavailable rather than guessed).
+
+  python hf_dwarf.py firmware.elf 0x08001234   # scopes and variables at PC
+"""
+import bisect
+import struct
+import sys
+import zlib
+
+from hf_elf import ElfError, ElfFile
+
+SHF_COMPRESSED = 0x800
+
+# Tags
+TAG_array_type = 0x01
+TAG_class_type = 0x02
+TAG_enumeration_type = 0x04
+TAG_formal_parameter = 0x05
+TAG_lexical_block = 0x0b
+TAG_member = 0x0d
+TAG_pointer_type = 0x0f
+TAG_reference_type = 0x10
+TAG_compile_unit = 0x11
+TAG_structure_type = 0x13
+TAG_subroutine_type = 0x15
+TAG_typedef = 0x16
+TAG_union_type = 0x17
+TAG_inlined_subroutine = 0x1d
+TAG_subrange_type = 0x21
+TAG_base_type = 0x24
+TAG_const_type = 0x26
+TAG_enumerator = 0x28
+TAG_subprogram = 0x2e
+TAG_variable = 0x34
+TAG_volatile_type = 0x35
+TAG_restrict_type = 0x37
+TAG_rvalue_reference_type = 0x42
+TAG_atomic_type = 0x47
+
+# Attributes
+AT_location = 0x02
+AT_name = 0x03
+AT_byte_size = 0x0b
+AT_bit_offset = 0x0c
+AT_bit_size = 0x0d
+AT_low_pc = 0x11
+AT_high_pc = 0x12
+AT_const_value = 0x1c
+AT_upper_bound = 0x2f
+AT_abstract_origin = 0x31
+AT_count = 0x37
+AT_data_member_location = 0x38
+AT_declaration = 0x3c
+AT_encoding = 0x3e
+AT_frame_base = 0x40
+AT_specification = 0x47
+AT_type = 0x49
+AT_ranges = 0x55
+AT_call_line = 0x59
+AT_data_bit_offset = 0x6b
+AT_str_offsets_base = 0x72
+AT_addr_base = 0x73
+AT_rnglists_base = 0x74
+AT_loclists_base = 0x8c
+
+# Base type encodings
+ATE_boolean = 0x02
+ATE_float = 0x04
+ATE_signed = 0x05
+ATE_signed_char = 0x06
+ATE_unsigned = 0x07
+ATE_unsigned_char = 0x08
+ATE_UTF = 0x10
+
+# Forms whose value is a reference into the same unit / .debug_info.
+REF_FORMS = {0x11, 0x12, 0x13, 0x14, 0x15}
+FORM_ref_addr = 0x10
+FORM_exprloc = 0x18
+FORM_sec_offset = 0x17
+FORM_loclistx = 0x22
+FORM_rnglistx = 0x23
+BLOCK_FORMS = {0x03, 0x04, 0x09, 0x0a, FORM_exprloc}
+CONST_FORMS = {0x05, 0x06, 0x07, 0x0b, 0x0d, 0x0f, 0x21}
+
+
+class DwarfError(Exception):
+    """Raised for debug info this reader cannot follow."""
+
+
+class Unavailable(Exception):
+    """A value's storage was not captured (or never existed): the reason."""
+
+
+# ============================== Reader ==============================
+
+class Reader:
+    __slots__ = ('d', 'off')
+
+    def __init__(self, data, off=0):
+        self.d = data
+        self.off = off
+
+    def u8(self):
+        v = self.d[self.off]
+        self.off += 1
+        return v
+
+    def u16(self):
+        v = struct.unpack_from('<H', self.d, self.off)[0]
+        self.off += 2
+        return v
+
+    def u24(self):
+        v = int.from_bytes(self.d[self.off:self.off + 3], 'little')
+        self.off += 3
+        return v
+
+    def u32(self):
+        v = struct.unpack_from('<I', self.d, self.off)[0]
+        self.off += 4
+        return v
+
+    def u64(self):
+        v = struct.unpack_from('<Q', self.d, self.off)[0]
+        self.off += 8
+        return v
+
+    def uint(self, size):
+        v = int.from_bytes(self.d[self.off:self.off + size], 'little')
+        self.off += size
+        return v
+
+    def sint(self, size):
+        v = int.from_bytes(self.d[self.off:self.off + size], 'little', signed=True)
+        self.off += size
+        return v
+
+    def uleb(self):
+        v = shift = 0
+        while True:
+            b = self.d[self.off]
+            self.off += 1
+            v |= (b & 0x7F) << shift
+            shift += 7
+            if not b & 0x80:
+                return v
+
+    def sleb(self):
+        v = shift = 0
+        while True:
+            b = self.d[self.off]
+            self.off += 1
+            v |= (b & 0x7F) << shift
+            shift += 7
+            if not b & 0x80:
+                return v - (1 << shift) if b & 0x40 else v
+
+    def cstr(self):
+        end = self.d.index(b'\0', self.off)
+        s = self.d[self.off:end].decode('utf-8', 'replace')
+        self.off = end + 1
+        return s
+
+    def bytes(self, n):
+        v = bytes(self.d[self.off:self.off + n])
+        self.off += n
+        return v
+
+    def initial_length(self):
+        """(length, offset size) of a unit or CFI entry."""
+        n = self.u32()
+        return (self.u64(), 8) if n == 0xFFFFFFFF else (n, 4)
+
+
+# ============================== DIEs ==============================
+
+class Die:
+    __slots__ = ('offset', 'tag', 'attrs', 'children', 'parent', 'cu')
+
+    def __init__(self, offset, tag, attrs, parent, cu):
+        self.offset = offset
+        self.tag = tag
+        self.attrs = attrs            # attr -> (form, raw value)
+        self.children = []
+        self.parent = parent
+        self.cu = cu
+
+    def has(self, at):
+        return at in self.attrs
+
+    def raw(self, at):
+        v = self.attrs.get(at)
+        return v[1] if v else None
+
+    def __repr__(self):
+        return f'<Die 0x{self.offset:x} tag 0x{self.tag:x}>'
+
+
+class Unit:
+    """One compilation unit: header, bases for the DWARF 5 index forms, and
+    its DIE tree once parsed."""
+
+    def __init__(self, dw, offset, version, addr_size, offset_size,
+                 abbrev_off, die_off, end):
+        self.dw = dw
+        self.offset = offset
+        self.version = version
+        self.addr_size = addr_size
+        self.offset_size = offset_size
+        self.abbrev_off = abbrev_off
+        self.die_off = die_off
+        self.end = end
+        self.root = None
+        self.dies = None              # offset -> Die, when fully parsed
+        self.base = 0
+        self.str_offsets_base = 8 if version >= 5 else 0
+        self.addr_base = 8
+        self.rnglists_base = 12
+        self.loclists_base = 12
+
+    def set_bases(self, root: Die):
+        dw = self.dw
+        self.root = root
+        for at, name in ((AT_str_offsets_base, 'str_offsets_base'),
+                         (AT_addr_base, 'addr_base'),
+                         (AT_rnglists_base, 'rnglists_base'),
+                         (AT_loclists_base, 'loclists_base')):
+            if root.has(at):
+                setattr(self, name, root.raw(at))
+        lo = root.attrs.get(AT_low_pc)
+        self.base = dw.address(self, *lo) if lo else 0
+
+
+class Dwarf:
+    def __init__(self, elf: ElfFile):
+        self.elf = elf
+        self.sec = {}
+        for s in elf.sections:
+            if s.name.startswith('.debug_'):
+                data = elf.section_data(s)
+                if s.flags & SHF_COMPRESSED:
+                    hdr = 24 if elf.is64 else 12
+                    if struct.unpack_from('<I', data)[0] != 1:
+                        raise DwarfError(f'{s.name}: unsupported compression')
+                    data = zlib.decompress(data[hdr:])
+                self.sec[s.name] = data
+        if '.debug_info' not in self.sec:
+            raise DwarfError(f'{elf.path}: no DWARF debug info (build with -g)')
+        self.addr_size = 8 if elf.is64 else 4
+        self._abbrevs = {}
+        self.units = self._read_units()
+        self._unit_starts = [u.offset for u in self.units]
+        self._fdes = None
+
+    # -- units and DIEs --
+
+    def _read_units(self):
+        info = self.sec['.debug_info']
+        units, off = [], 0
+        while off + 11 <= len(info):
+            r = Reader(info, off)
+            length, osz = r.initial_length()
+            end = r.off + length
+            version = r.u16()
+            if version >= 5:
+                unit_type = r.u8()
+                addr_size = r.u8()
+                abbrev = r.uint(osz)
+                if unit_type in (4, 5):                # skeleton, split_compile
+                    r.u64()
+                elif unit_type in (2, 6):              # type units
+                    r.u64()
+                    r.uint(osz)
+            elif version >= 2:
+                abbrev = r.uint(osz)
+                addr_size = r.u8()
+            else:
+                raise DwarfError(f'.debug_info+0x{off:x}: DWARF version {version}')
+            units.append(Unit(self, off, version, addr_size, osz, abbrev, r.off, end))
+            off = end
+        for u in units:
+            self._parse(u, root_only=True)
+        return units
+
+    def _abbrev_table(self, off):
+        table = self._abbrevs.get(off)
+        if table is not None:
+            return table
+        r = Reader(self.sec['.debug_abbrev'], off)
+        table = {}
+        while True:
+            code = r.uleb()
+            if code == 0:
+                break
+            tag = r.uleb()
+            children = r.u8()
+            specs = []
+            while True:
+                at, form = r.uleb(), r.uleb()
+                if at == 0 and form == 0:
+                    break
+                specs.append((at, form, r.sleb() if form == 0x21 else None))
+            table[code] = (tag, children, specs)
+        self._abbrevs[off] = table
+        return table
+
+    def _form(self, r: Reader, u: Unit, form, implicit):
+        if form == 0x01:
+            return r.uint(u.addr_size)
+        if form in (0x0b, 0x0c, 0x11, 0x25, 0x29):
+            return r.u8()
+        if form in (0x05, 0x12, 0x26, 0x2a):
+            return r.u16()
+        if form in (0x27, 0x2b):
+            return r.u24()
+        if form in (0x06, 0x13, 0x1c, 0x28, 0x2c):
+            return r.u32()
+        if form in (0x07, 0x14, 0x20, 0x24):
+            return r.u64()
+        if form == 0x1e:
+            return r.bytes(16)
+        if form in (0x0f, 0x15, 0x1a, 0x1b, 0x22, 0x23, 0x1f01, 0x1f02):
+            return r.uleb()
+        if form == 0x0d:
+            return r.sleb()
+        if form == 0x08:
+            return r.cstr()
+        if form in (0x0e, 0x17, 0x1f, 0x1d, 0x1f20, 0x1f21):
+            return r.uint(u.offset_size)
+        if form == FORM_ref_addr:
+            return r.uint(u.offset_size if u.version >= 3 else u.addr_size)
+        if form in (0x09, FORM_exprloc):
+            return r.bytes(r.uleb())
+        if form == 0x0a:
+            return r.bytes(r.u8())
+        if form == 0x03:
+            return r.bytes(r.u16())
+        if form == 0x04:
+            return r.bytes(r.u32())
+        if form == 0x19:
+            return True
+        if form == 0x21:
+            return implicit
+        if form == 0x16:
+            form = r.uleb()
+            return form, self._form(r, u, form, None)
+        raise DwarfError(f'unit 0x{u.offset:x}: unknown DW_FORM 0x{form:x}')
+
+    def _parse(self, u: Unit, root_only=False):
+        info = self.sec['.debug_info']
+        table = self._abbrev_table(u.abbrev_off)
+        r = Reader(info, u.die_off)
+        dies, stack, root = {}, [], None
+        while r.off < u.end:
+            off = r.off
+            code = r.uleb()
+            if code == 0:
+                if stack:
+                    stack.pop()
+                continue
+            tag, has_children, specs = table[code]
+            attrs = {}
+            for at, form, implicit in specs:
+                v = self._form(r, u, form, implicit)
+                if form == 0x16:
+                    form, v = v
+                if form in REF_FORMS:
+                    v += u.offset
+                attrs[at] = (form, v)
+            die = Die(off, tag, attrs, stack[-1] if stack else None, u)
+            dies[off] = die
+            if stack:
+                stack[-1].children.append(die)
+            else:
+                root = die
+                if u.root is None:
+                    u.set_bases(die)
+                if root_only:
+                    return
+            if has_children:
+                stack.append(die)
+            elif not stack:
+                break
+        u.root = root
+        u.dies = dies
+
+    def unit_at(self, offset) -> Unit:
+        i = bisect.bisect_right(self._unit_starts, offset) - 1
+        if i < 0:
+            raise DwarfError(f'.debug_info+0x{offset:x}: outside every unit')
+        return self.units[i]
+
+    def die(self, offset) -> Die:
+        u = self.unit_at(offset)
+        if u.dies is None:
+            self._parse(u)
+        d = u.dies.get(offset)
+        if d is None:
+            raise DwarfError(f'.debug_info+0x{offset:x}: no DIE there')
+        return d
+
+    def ref(self, die: Die, at):
+        """DIE an attribute refers to, or None."""
+        v = die.attrs.get(at)
+        if not v or (v[0] not in REF_FORMS and v[0] != FORM_ref_addr):
+            return None
+        return self.die(v[1])
+
+    def origin(self, die: Die, at):
+        """(form, value) of at on the DIE or along its abstract_origin /
+        specification chain (inlined and out-of-line instances carry little
+        of their own)."""
+        for _ in range(8):
+            if at in die.attrs:
+                return die.attrs[at]
+            nxt = self.ref(die, AT_abstract_origin) or self.ref(die, AT_specification)
+            if nxt is None:
+                return None
+            die = nxt
+        return None
+
+    def name(self, die: Die):
+        v = self.origin(die, AT_name)
+        return self.string(die.cu, *v) if v else None
+
+    def type_of(self, die: Die):
+        v = self.origin(die, AT_type)
+        return self.die(v[1]) if v else None
+
+    def const(self, die: Die, at, default=None):
+        v = die.attrs.get(at)
+        if not v or v[0] not in CONST_FORMS:
+            return default
+        return v[1]
+
+    def string(self, u: Unit, form, v):
+        if form == 0x08:
+            return v
+        if form == 0x0e:
+            return self._cstr('.debug_str', v)
+        if form == 0x1f:
+            return self._cstr('.debug_line_str', v)
+        if form in (0x1a, 0x25, 0x26, 0x27, 0x28, 0x1f02):
+            so = self.sec.get('.debug_str_offsets')
+            if so is None:
+                return None
+            off = Reader(so, u.str_offsets_base + v * u.offset_size).uint(u.offset_size)
+            return self._cstr('.debug_str', off)
+        return None
+
+    def _cstr(self, sec, off):
+        data = self.sec.get(sec)
+        return Reader(data, off).cstr() if data is not None else None
+
+    def address(self, u: Unit, form, v):
+        if form in (0x1b, 0x29, 0x2a, 0x2b, 0x2c, 0x1f01):
+            return self.addrx(u, v)
+        return v
+
+    def addrx(self, u: Unit, idx):
+        da = self.sec.get('.debug_addr')
+        if da is None:
+            raise DwarfError('DW_FORM_addrx without .debug_addr')
+        return Reader(da, u.addr_base + idx * u.addr_size).uint(u.addr_size)
+
+    # -- ranges --
+
+    def ranges(self, die: Die):
+        """[(lo, hi)] the DIE covers; [] if it has no address attributes."""
+        u = die.cu
+        lo = die.attrs.get(AT_low_pc)
+        hi = die.attrs.get(AT_high_pc)
+        if lo and hi:
+            lo = self.address(u, *lo)
+            hi_v = hi[1] if hi[0] in CONST_FORMS else self.address(u, *hi)
+            return [(lo, lo + hi_v if hi[0] in CONST_FORMS else hi_v)]
+        rg = die.attrs.get(AT_ranges)
+        if rg is None:
+            if lo is None:
+                return []
+            lo = self.address(u, *lo)
+            return [(lo, lo + 1)]                      # a single address
+        form, v = rg
+        if u.version >= 5:
+            if form == FORM_rnglistx:
+                sec = self.sec['.debug_rnglists']
+                v = u.rnglists_base + Reader(sec, u.rnglists_base + v * u.offset_size) \
+                    .uint(u.offset_size)
+            return self._rnglist(u, v)
+        return self._ranges_v4(u, v)
+
+    def _ranges_v4(self, u: Unit, off):
+        r = Reader(self.sec.get('.debug_ranges', b''), off)
+        top = (1 << (8 * u.addr_size)) - 1
+        base, out = u.base, []
+        while r.off + 2 * u.addr_size <= len(r.d):
+            a, b = r.uint(u.addr_size), r.uint(u.addr_size)
+            if a == 0 and b == 0:
+                break
+            if a == top:
+                base = b
+            else:
+                out.append((base + a, base + b))
+        return out
+
+    def _rnglist(self, u: Unit, off):
+        r = Reader(self.sec.get('.debug_rnglists', b''), off)
+        base, out = u.base, []
+        while r.off < len(r.d):
+            kind = r.u8()
+            if kind == 0:
+                break
+            if kind == 1:
+                base = self.addrx(u, r.uleb())
+            elif kind == 2:
+                a, b = self.addrx(u, r.uleb()), self.addrx(u, r.uleb())
+                out.append((a, b))
+            elif kind == 3:
+                a = self.addrx(u, r.uleb())
+                out.append((a, a + r.uleb()))
+            elif kind == 4:
+                a, b = r.uleb(), r.uleb()
+                out.append((base + a, base + b))
+            elif kind == 5:
+                base = r.uint(u.addr_size)
+            elif kind == 6:
+                out.append((r.uint(u.addr_size), r.uint(u.addr_size)))
+            elif kind == 7:
+                a = r.uint(u.addr_size)
+                out.append((a, a + r.uleb()))
+            else:
+                raise DwarfError(f'.debug_rnglists+0x{off:x}: entry kind {kind}')
+        return out
+
+    def covers(self, die: Die, pc) -> bool:
+        return any(lo <= pc < hi for lo, hi in self.ranges(die))
+
+    # -- locations --
+
+    def location(self, die: Die, at, pc):
+        """Expression bytes of a location (or frame base) attribute valid at
+        pc; None if the attribute is missing or no list entry covers pc."""
+        v = die.attrs.get(at)
+        if v is None:
+            return None
+        form, val = v
+        u = die.cu
+        if form in BLOCK_FORMS:
+            return val
+        if form == FORM_loclistx:
+            sec = self.sec['.debug_loclists']
+            val = u.loclists_base + Reader(sec, u.loclists_base + val * u.offset_size) \
+                .uint(u.offset_size)
+        elif form not in (FORM_sec_offset, 0x06, 0x07):
+            return None
+        if u.version >= 5:
+            return self._loclist(u, val, pc)
+        return self._loc_v4(u, val, pc)
+
+    def _loc_v4(self, u: Unit, off, pc):
+        r = Reader(self.sec.get('.debug_loc', b''), off)
+        top = (1 << (8 * u.addr_size)) - 1
+        base = u.base
+        while r.off + 2 * u.addr_size <= len(r.d):
+            a, b = r.uint(u.addr_size), r.uint(u.addr_size)
+            if a == 0 and b == 0:
+                return None
+            if a == top:
+                base = b
+                continue
+            expr = r.bytes(r.u16())
+            if base + a <= pc < base + b:
+                return expr
+        return None
+
+    def _loclist(self, u: Unit, off, pc):
+        r = Reader(self.sec.get('.debug_loclists', b''), off)
+        base, default = u.base, None
+        while r.off < len(r.d):
+            kind = r.u8()
+            if kind == 0:
+                break
+            if kind == 1:
+                base = self.addrx(u, r.uleb())
+                continue
+            if kind == 6:
+                base = r.uint(u.addr_size)
+                continue
+            if kind == 2:
+                lo, hi = self.addrx(u, r.uleb()), self.addrx(u, r.uleb())
+            elif kind == 3:
+                lo = self.addrx(u, r.uleb())
+                hi = lo + r.uleb()
+            elif kind == 4:
+                lo, hi = base + r.uleb(), base + r.uleb()
+            elif kind == 5:
+                lo = hi = None
+            elif kind == 7:
+                lo, hi = r.uint(u.addr_size), r.uint(u.addr_size)
+            elif kind == 8:
+                lo = r.uint(u.addr_size)
+                hi = lo + r.uleb()
+            else:
+                raise DwarfError(f'.debug_loclists+0x{off:x}: entry kind {kind}')
+            expr = r.bytes(r.uleb())
+            if lo is None:
+                default = expr
+            elif lo <= pc < hi:
+                return expr
+        return default
+
+    # -- scopes --
+
+    def unit_for(self, pc):
+        for u in self.units:
+            if u.root is not None and self.covers(u.root, pc):
+                return u
+        return None
+
+    def scopes(self, pc):
+        """[subprogram, inlined_subroutine, ...] containing pc, outermost
+        first; [] if no unit describes pc."""
+        u = self.unit_for(pc)
+        if u is None:
+            return []
+        if u.dies is None:
+            self._parse(u)
+        chain = []
+
+        def walk(die):
+            for c in die.children:
+                if c.tag == TAG_subprogram and not chain:
+                    if not c.has(AT_declaration) and self.covers(c, pc):
+                        chain.append(c)
+                        walk(c)
+                        return True
+                elif c.tag == TAG_inlined_subroutine and chain:
+                    if self.covers(c, pc):
+                        chain.append(c)
+                        walk(c)
+                        return True
+                elif c.tag in (TAG_lexical_block, TAG_class_type, TAG_structure_type,
+                               0x39):                  # namespace
+                    if c.tag != TAG_lexical_block or not self.ranges(c) \
+                            or self.covers(c, pc):
+                        if walk(c):
+                            return True
+            return False
+
+        walk(u.root)
+        return chain
+
+    def variables(self, scope: Die, pc):
+        """Parameters, then locals, of one subprogram or inlined call at pc:
+        lexical blocks that cover pc are searched, nested inlined calls are
+        not (they are scopes of their own)."""
+        params, local = [], []
+
+        def walk(die):
+            for c in die.children:
+                if c.tag == TAG_formal_parameter:
+                    params.append(c)
+                elif c.tag == TAG_variable:
+                    local.append(c)
+                elif c.tag == TAG_lexical_block and \
+                        (not self.ranges(c) or self.covers(c, pc)):
+                    walk(c)
+
+        walk(scope)
+        return params + local
+
+    # -- call frame information --
+
+    def _load_fdes(self):
+        data = self.sec.get('.debug_frame')
+        fdes, cies = [], {}
+        off = 0
+        while data is not None and off + 4 <= len(data):
+            r = Reader(data, off)
+            length, osz = r.initial_length()
+            if length == 0:
+                off = r.off
+                continue
+            end = r.off + length
+            cie_id = r.uint(osz)
+            if cie_id == (1 << (8 * osz)) - 1:
+                cies[off] = self._cie(r, end)
+            else:
+                fdes.append((off, cie_id, r.off, end))
+            off = end
+        out = []
+        for off, cie_off, body, end in fdes:
+            cie = cies.get(cie_off)
+            if cie is None:
+                continue
+            r = Reader(data, body)
+            lo = r.uint(cie['addr_size'])
+            n = r.uint(cie['addr_size'])
+            if cie['aug'].startswith('z'):
+                r.off += r.uleb()
+            out.append((lo, lo + n, cie, data[r.off:end]))
+        out.sort(key=lambda f: f[0])
+        self._fdes = out
+        self._fde_starts = [f[0] for f in out]
+
+    def _cie(self, r: Reader, end):
+        version = r.u8()
+        aug = r.cstr()
+        addr_size = self.addr_size
+        if version >= 4:
+            addr_size = r.u8()
+            r.u8()                                     # segment selector size
+        code_align = r.uleb()
+        data_align = r.sleb()
+        ra = r.u8() if version == 1 else r.uleb()
+        if aug.startswith('z'):
+            r.off += r.uleb()
+        return {'version': version, 'aug': aug, 'addr_size': addr_size,
+                'code_align': code_align, 'data_align': data_align, 'ra': ra,
+                'init': bytes(r.d[r.off:end])}
+
+    def has_cfi(self) -> bool:
+        if self._fdes is None:
+            self._load_fdes()
+        return bool(self._fdes)
+
+    def cfi_row(self, pc):
+        """(cfa rule, {reg: rule}, return address column) at pc, or None
+        without an FDE. CFA rules: ('reg', n, offset) or ('expr', bytes);
+        register rules: ('off', n) saved at CFA + n, ('val', n), ('reg', r),
+        ('same',), ('undef',), ('expr', bytes), ('vexpr', bytes)."""
+        if self._fdes is None:
+            self._load_fdes()
+        i = bisect.bisect_right(self._fde_starts, pc) - 1
+        if i < 0 or pc >= self._fdes[i][1]:
+            return None
+        lo, _, cie, insns = self._fdes[i]
+        state = {'cfa': ('reg', 0, 0), 'regs': {}}
+        self._run_cfa(cie, cie['init'], state, None, None, None)
+        init = dict(state['regs'])
+        self._run_cfa(cie, insns, state, lo, pc, init)
+        return state['cfa'], state['regs'], cie['ra']
+
+    def _run_cfa(self, cie, insns, state, loc, pc, init):
+        r = Reader(insns)
+        ca, da = cie['code_align'], cie['data_align']
+        regs = state['regs']
+        saved = []
+        while r.off < len(insns):
+            op = r.u8()
+            hi, low = op & 0xC0, op & 0x3F
+            adv = None
+            if hi == 0x40:
+                adv = low * ca
+            elif hi == 0x80:
+                regs[low] = ('off', r.uleb() * da)
+            elif hi == 0xC0:
+                regs.pop(low, None)
+                if init and low in init:
+                    regs[low] = init[low]
+            elif op == 0x00:
+                pass
+            elif op == 0x01:
+                new = r.uint(cie['addr_size'])
+                if loc is not None and new > pc:
+                    return
+                loc = new
+            elif op == 0x02:
+                adv = r.u8() * ca
+            elif op == 0x03:
+                adv = r.u16() * ca
+            elif op == 0x04:
+                adv = r.u32() * ca
+            elif op == 0x05:
+                n = r.uleb()
+                regs[n] = ('off', r.uleb() * da)
+            elif op == 0x06:
+                n = r.uleb()
+                regs.pop(n, None)
+                if init and n in init:
+                    regs[n] = init[n]
+            elif op == 0x07:
+                regs[r.uleb()] = ('undef',)
+            elif op == 0x08:
+                regs[r.uleb()] = ('same',)
+            elif op == 0x09:
+                n = r.uleb()
+                regs[n] = ('reg', r.uleb())
+            elif op == 0x0a:
+                saved.append((state['cfa'], dict(regs)))
+            elif op == 0x0b:
+                if saved:
+                    cfa, old = saved.pop()
+                    state['cfa'] = cfa
+                    regs.clear()
+                    regs.update(old)
+            elif op == 0x0c:
+                n = r.uleb()
+                state['cfa'] = ('reg', n, r.uleb())
+            elif op == 0x0d:
+                n = r.uleb()
+                c = state['cfa']
+                state['cfa'] = ('reg', n, c[2] if c[0] == 'reg' else 0)
+            elif op == 0x0e:
+                c = state['cfa']
+                state['cfa'] = ('reg', c[1] if c[0] == 'reg' else 0, r.uleb())
+            elif op == 0x0f:
+                state['cfa'] = ('expr', r.bytes(r.uleb()))
+            elif op == 0x10:
+                n = r.uleb()
+                regs[n] = ('expr', r.bytes(r.uleb()))
+            elif op == 0x11:
+                n = r.uleb()
+                regs[n] = ('off', r.sleb() * da)
+            elif op == 0x12:
+                n = r.uleb()
+                state['cfa'] = ('reg', n, r.sleb() * da)
+            elif op == 0x13:
+                c = state['cfa']
+                state['cfa'] = ('reg', c[1] if c[0] == 'reg' else 0, r.sleb() * da)
+            elif op == 0x14:
+                n = r.uleb()
+                regs[n] = ('val', r.uleb() * da)
+            elif op == 0x15:
+                n = r.uleb()
+                regs[n] = ('val', r.sleb() * da)
+            elif op == 0x16:
+                n = r.uleb()
+                regs[n] = ('vexpr', r.bytes(r.uleb()))
+            elif op == 0x2e:
+                r.uleb()                               # GNU_args_size
+            elif op == 0x2f:
+                n = r.uleb()
+                regs[n] = ('off', -r.uleb() * da)
+            else:
+                raise DwarfError(f'unknown DW_CFA 0x{op:02x}')
+            if adv is not None and loc is not None:
+                if loc + adv > pc:
+                    return
+                loc += adv
+
+
+# ============================== Expressions ==============================
+
+class Piece:
+    """Where (part of) a value lives: kind 'mem' (value = address), 'reg'
+    (register number), 'value' (the value itself, an int) or 'bytes'
+    (DW_OP_implicit_value); size in bytes, None for the whole object."""
+    __slots__ = ('kind', 'value', 'size')
+
+    def __init__(self, kind, value, size=None):
+        self.kind = kind
+        self.value = value
+        self.size = size
+
+
+class Context:
+    """What an expression may ask for. Subclasses supply the target state;
+    every hook raises Unavailable when it cannot answer."""
+    addr_size = 4
+
+    def reg(self, n) -> int:
+        raise Unavailable(f'register {n} not known')
+
+    def read(self, addr, size) -> bytes:
+        raise Unavailable(f'memory at 0x{addr:x} not captured')
+
+    def frame_base(self) -> int:
+        raise Unavailable('no frame base')
+
+    def cfa(self) -> int:
+        raise Unavailable('no CFA')
+
+    def addrx(self, idx) -> int:
+        raise Unavailable('no .debug_addr')
+
+
+_UNSUPPORTED = {0xa0: 'DW_OP_implicit_pointer', 0xa3: 'DW_OP_entry_value',
+                0xf3: 'DW_OP_GNU_entry_value', 0xf2: 'DW_OP_GNU_implicit_pointer',
+                0xfa: 'DW_OP_GNU_parameter_ref', 0x98: 'DW_OP_call4',
+                0x99: 'DW_OP_call_ref', 0x9b: 'DW_OP_form_tls_address',
+                0xe0: 'DW_OP_GNU_push_tls_address', 0x97: 'DW_OP_push_object_address'}
+
+_ENTRY_VALUE = ('DW_OP_entry_value', 'DW_OP_GNU_entry_value', 'DW_OP_GNU_parameter_ref')
+
+
+def evaluate(expr: bytes, ctx: Context, location=True, push=()):
+    """Evaluate a DWARF expression, with push already on the stack (the CFA
+    for DW_CFA_expression rules). As a location (default) the result is a
+    list of Piece; otherwise the value on top of the stack. An empty
+    location expression means the value was optimized out: []."""
+    mask = (1 << (8 * ctx.addr_size)) - 1
+    sbit = 1 << (8 * ctx.addr_size - 1)
+
+    def signed(v):
+        v &= mask
+        return v - (1 << (8 * ctx.addr_size)) if v & sbit else v
+
+    r = Reader(expr)
+    stack, pieces = list(push), []
+    pending = None                 # 'reg' / 'value' / 'bytes' result before DW_OP_piece
+    while r.off < len(expr):
+        op = r.u8()
+        if 0x30 <= op <= 0x4f:                         # lit0..31
+            stack.append(op - 0x30)
+        elif 0x50 <= op <= 0x6f:                       # reg0..31
+            pending = Piece('reg', op - 0x50)
+        elif 0x70 <= op <= 0x8f:                       # breg0..31
+            stack.append((ctx.reg(op - 0x70) + r.sleb()) & mask)
+        elif op == 0x03:
+            stack.append(r.uint(ctx.addr_size))
+        elif op in (0x08, 0x0a, 0x0c, 0x0e):           # const1u/2u/4u/8u
+            stack.append(r.uint({0x08: 1, 0x0a: 2, 0x0c: 4, 0x0e: 8}[op]))
+        elif op in (0x09, 0x0b, 0x0d, 0x0f):           # const1s/2s/4s/8s
+            stack.append(r.sint({0x09: 1, 0x0b: 2, 0x0d: 4, 0x0f: 8}[op]) & mask)
+        elif op == 0x10:
+            stack.append(r.uleb())
+        elif op == 0x11:
+            stack.append(r.sleb() & mask)
+        elif op == 0x12:
+            stack.append(stack[-1])
+        elif op == 0x13:
+            stack.pop()
+        elif op == 0x14:
+            stack.append(stack[-2])
+        elif op == 0x15:
+            stack.append(stack[-1 - r.u8()])
+        elif op == 0x16:
+            stack[-1], stack[-2] = stack[-2], stack[-1]
+        elif op == 0x17:
+            stack[-1], stack[-2], stack[-3] = stack[-2], stack[-3], stack[-1]
+        elif op in (0x06, 0x94):                       # deref, deref_size
+            n = ctx.addr_size if op == 0x06 else r.u8()
+            stack.append(int.from_bytes(ctx.read(stack.pop(), n), 'little'))
+        elif op == 0x19:
+            stack.append(abs(signed(stack.pop())) & mask)
+        elif op == 0x1f:
+            stack.append(-stack.pop() & mask)
+        elif op == 0x20:
+            stack.append(~stack.pop() & mask)
+        elif op == 0x23:
+            stack.append((stack.pop() + r.uleb()) & mask)
+        elif op in (0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x21, 0x22, 0x24, 0x25, 0x26, 0x27,
+                    0x29, 0x2a, 0x2b, 0x2c, 0x2d, 0x2e):
+            b, a = stack.pop(), stack.pop()
+            if op == 0x1a:
+                v = a & b
+            elif op == 0x1b:
+                if signed(b) == 0:
+                    raise Unavailable('division by zero in location')
+                v = int(signed(a) / signed(b))
+            elif op == 0x1c:
+                v = a - b
+            elif op == 0x1d:
+                if b == 0:
+                    raise Unavailable('division by zero in location')
+                v = a % b
+            elif op == 0x1e:
+                v = a * b
+            elif op == 0x21:
+                v = a | b
+            elif op == 0x22:
+                v = a + b
+            elif op == 0x24:
+                v = a << b
+            elif op == 0x25:
+                v = a >> b
+            elif op == 0x26:
+                v = signed(a) >> b
+            elif op == 0x27:
+                v = a ^ b
+            else:                                      # eq ge gt le lt ne
+                x, y = signed(a), signed(b)
+                v = int({0x29: x == y, 0x2a: x >= y, 0x2b: x > y,
+                         0x2c: x <= y, 0x2d: x < y, 0x2e: x != y}[op])
+            stack.append(v & mask)
+        elif op == 0x2f:                               # skip
+            d = r.sint(2)
+            r.off += d
+        elif op == 0x28:                               # bra
+            d = r.sint(2)
+            if stack.pop():
+                r.off += d
+        elif op == 0x90:
+            pending = Piece('reg', r.uleb())
+        elif op == 0x91:
+            stack.append((ctx.frame_base() + r.sleb()) & mask)
+        elif op == 0x92:
+            n = r.uleb()
+            stack.append((ctx.reg(n) + r.sleb()) & mask)
+        elif op == 0x93:                               # piece
+            size = r.uleb()
+            if pending is None:
+                pending = Piece('mem', stack.pop()) if stack else Piece('undef', None)
+            pending.size = size
+            pieces.append(pending)
+            pending = None
+        elif op == 0x96:
+            pass
+        elif op == 0x9c:
+            stack.append(ctx.cfa())
+        elif op == 0x9e:                               # implicit_value
+            pending = Piece('bytes', r.bytes(r.uleb()))
+        elif op == 0x9f:                               # stack_value
+            pending = Piece('value', stack.pop())
+        elif op in (0xa1, 0xa2, 0xfb, 0xfc):           # addrx, constx, GNU_*
+            stack.append(ctx.addrx(r.uleb()))
+        elif op in _UNSUPPORTED:
+            name = _UNSUPPORTED[op]
+            if name in _ENTRY_VALUE:
+                raise Unavailable('value at function entry (not captured)')
+            raise Unavailable(f'{name} not supported')
+        else:
+            raise Unavailable(f'DW_OP 0x{op:02x} not supported')
+    if not location:
+        if not stack:
+            raise Unavailable('empty expression')
+        return stack[-1]
+    if pending is not None:
+        pieces.append(pending)
+    elif stack:
+        pieces.append(Piece('mem', stack[-1]))
+    return pieces
+
+
+# ============================== CLI ==============================
+
+def main() -> int:
+    if len(sys.argv) != 3:
+        print(f'Usage: {sys.argv[0]} <file.elf> <pc>', file=sys.stderr)
+        return 1
+    try:
+        dw = Dwarf(ElfFile(sys.argv[1]))
+    except (OSError, ElfError, DwarfError) as e:
+        print(f'error: {e}', file=sys.stderr)
+        return 1
+    pc = int(sys.argv[2], 0)
+    for scope in dw.scopes(pc):
+        kind = 'inlined' if scope.tag == TAG_inlined_subroutine else 'function'
+        print(f'{kind} {dw.name(scope)}')
+        for v in dw.variables(scope, pc):
+            expr = dw.location(v, AT_location, pc)
+            where = expr.hex() if expr else ('const' if v.has(AT_const_value) else '-')
+            print(f'  {dw.name(v)}: {where}')
+    row = dw.cfi_row(pc)
+    if row:
+        print(f'cfa {row[0]}  regs {row[1]}  ra {row[2]}')
+    return 0
+
+
+if __name__ == '__main__':
+    raise SystemExit(main())
@@ -0,0 +1,216 @@
+#!/usr/bin/env python3
+"""Minimal ELF reader for the host tools (no third-party modules).
+
+Only what the tools need: section and program headers, the symbol table,
+code ranges and the GNU build-id. Handles 32- and 64-bit little-endian files, which covers
+Cortex-M firmware and host test binaries.
+
+  python hf_elf.py firmware.elf      # prints build-id and a few symbols
+"""
+import hashlib
+import struct
+import sys
+from pathlib import Path
+
+SHT_SYMTAB = 2
+SHT_PROGBITS = 1
+SHT_NOTE = 7
+SHT_NOBITS = 8
+STB_LOCAL = 0
+PT_LOAD = 1
+EM_ARM = 40
+SHF_ALLOC = 0x2
+SHF_EXECINSTR = 0x4
+NT_GNU_BUILD_ID = 3
+
+
+class ElfError(Exception):
+    """Raised for files that are not (supported) ELF images."""
+
+
+class Section:
+    __slots__ = ('name', 'type', 'flags', 'addr', 'offset', 'size', 'link', 'entsize')
+
+    def __init__(self, name, type_, flags, addr, offset, size, link, entsize):
+        self.name = name
+        self.type = type_
+        self.flags = flags
+        self.addr = addr
+        self.offset = offset
+        self.size = size
+        self.link = link
+        self.entsize = entsize
+
+
+class ElfFile:
+    def __init__(self, path):
+        self.path = Path(path)
+        self.data = self.path.read_bytes()
+        d = self.data
+        if d[:4] != b'\x7fELF':
+            raise ElfError(f'{path}: not an ELF file')
+        if d[5] != 1:
+            raise ElfError(f'{path}: big-endian ELF not supported')
+        self.is64 = d[4] == 2
+
+        if self.is64:
+            (self.machine, self.entry, shoff, shentsize, shnum, shstrndx) = (
+                struct.unpack_from('<H', d, 18)[0], struct.unpack_from('<Q', d, 24)[0],
+                struct.unpack_from('<Q', d, 40)[0], *struct.unpack_from('<HHH', d, 58))
+            self._phdr = (struct.unpack_from('<Q', d, 32)[0], *struct.unpack_from('<HH', d, 54))
+        else:
+            (self.machine, self.entry, shoff, shentsize, shnum, shstrndx) = (
+                struct.unpack_from('<H', d, 18)[0], struct.unpack_from('<I', d, 24)[0],
+                struct.unpack_from('<I', d, 32)[0], *struct.unpack_from('<HHH', d, 46))
+            self._phdr = (struct.unpack_from('<I', d, 28)[0], *struct.unpack_from('<HH', d, 42))
+        self.type = struct.unpack_from('<H', d, 16)[0]
+
+        raw = []
+        for i in range(shnum):
+            off = shoff + i * shentsize
+            if self.is64:
+                name, type_, flags, addr, offset, size, link, _info, _align, entsize = \
+                    struct.unpack_from('<IIQQQQIIQQ', d, off)
+            else:
+                name, type_, flags, addr, offset, size, link, _info, _align, entsize = \
+                    struct.unpack_from('<IIIIIIIIII', d, off)
+            raw.append((name, type_, flags, addr, offset, size, link, entsize))
+
+        strtab = raw[shstrndx] if shstrndx < len(raw) else None
+        self.sections = []
+        for name, *rest in raw:
+            sname = self._str(strtab[4], name) if strtab else ''
+            self.sections.append(Section(sname, *rest))
+        self._symbols = None
+
+    def _str(self, table_off: int, idx: int) -> str:
+        end = self.data.index(b'\0', table_off + idx)
+        return self.data[table_off + idx:end].decode('utf-8', 'replace')
+
+    def section(self, name: str):
+        for s in self.sections:
+            if s.name == name:
+                return s
+        return None
+
+    def section_data(self, s: Section) -> bytes:
+        return self.data[s.offset:s.offset + s.size]
+
+    def segments(self, physical: bool = False):
+        """[(vaddr, bytes)] of the PT_LOAD segments with file contents
+        (firmware load images, core files). With physical, the load
+        addresses instead: where .data's initial values sit in flash."""
+        phoff, phentsize, phnum = self._phdr
+        out = []
+        for i in range(phnum if phoff else 0):
+            off = phoff + i * phentsize
+            if self.is64:
+                p_type, _flags, p_offset, vaddr, paddr, filesz = \
+                    struct.unpack_from('<IIQQQQ', self.data, off)
+            else:
+                p_type, p_offset, vaddr, paddr, filesz = \
+                    struct.unpack_from('<IIIII', self.data, off)
+            if p_type == PT_LOAD and filesz:
+                out.append((paddr if physical else vaddr,
+                            self.data[p_offset:p_offset + filesz]))
+        return out
+
+    def read(self, addr: int, size: int):
+        """Initial contents of [addr, addr + size) from the image's loaded
+        sections (code, rodata), or None if no section holds all of it."""
+        for s in self.sections:
+            if s.type == SHT_PROGBITS and s.flags & SHF_ALLOC and \
+                    s.addr <= addr and addr + size <= s.addr + s.size:
+                off = s.offset + addr - s.addr
+                return self.data[off:off + size]
+        return None
+
+    def code_ranges(self):
+        """Sorted, merged [lo, hi) address ranges of the executable sections."""
+        spans = sorted((s.addr, s.addr + s.size) for s in self.sections
+                       if s.flags & SHF_ALLOC and s.flags & SHF_EXECINSTR
+                       and s.type != SHT_NOBITS and s.size)
+        merged = []
+        for lo, hi in spans:
+            if merged and lo <= merged[-1][1]:
+                merged[-1][1] = max(merged[-1][1], hi)
+            else:
+                merged.append([lo, hi])
+        return [tuple(r) for r in merged]
+
+    # -- symbols --
+
+    def symbols(self) -> dict:
+        """name -> [(value, size, type)] from .symtab (empty if stripped).
+        A name has several entries when static functions or variables in
+        different files share it; global definitions come first."""
+        if self._symbols is not None:
+            return self._symbols
+        syms = {}
+        for s in self.sections:
+            if s.type != SHT_SYMTAB:
+                continue
+            strtab = self.sections[s.link]
+            fmt, step = ('<IBBHQQ', 24) if self.is64 else ('<IIIBBH', 16)
+            for off in range(s.offset, s.offset + s.size, step):
+                if self.is64:
+                    name, info, _other, shndx, value, size = struct.unpack_from(fmt, self.data, off)
+                else:
+                    name, value, size, info, _other, shndx = struct.unpack_from(fmt, self.data, off)
+                if name == 0 or shndx == 0:
+                    continue
+                entries = syms.setdefault(self._str(strtab.offset, name), [])
+                sym = (value, size, info & 0xF)
+                if info >> 4 == STB_LOCAL:
+                    entries.append(sym)
+                else:
+                    entries.insert(0, sym)
+        self._symbols = syms
+        return syms
+
+    def symbol(self, name: str):
+        """Address of a symbol (the global one, if the name is also a file
+        static), or None."""
+        v = self.symbols().get(name)
+        return v[0][0] if v else None
+
+    # -- identity --
+
+    def build_id(self) -> str:
+        """GNU build-id as hex, or None if the image has none."""
+        for s in self.sections:
+            if s.type != SHT_NOTE:
+                continue
+            d = self.section_data(s)
+            off = 0
+            while off + 12 <= len(d):
+                namesz, descsz, ntype = struct.unpack_from('<III', d, off)
+                name = d[off + 12:off + 12 + namesz]
+                desc_off = off + 12 + ((namesz + 3) & ~3)
+                if ntype == NT_GNU_BUILD_ID and name.rstrip(b'\0') == b'GNU':
+                    return d[desc_off:desc_off + descsz].hex()
+                off = desc_off + ((descsz + 3) & ~3)
+        return None
+
+    def identity(self) -> str:
+        """build-id, or a content hash for images linked without one."""
+        return self.build_id() or 'sha1:' + hashlib.sha1(self.data).hexdigest()
+
+
+def main() -> int:
+    if len(sys.argv) != 2:
+        print(f'Usage: {sys.argv[0]} <file.elf>', file=sys.stderr)
+        return 1
+    elf = ElfFile(sys.argv[1])
+    print(f'identity: {elf.identity()}')
+    for lo, hi in elf.code_ranges():
+        print(f'code: 0x{lo:08X}-0x{hi:08X}')
+    for name in ('__hf_dump_start', '__hf_dump_end', 'HardFault_Handler', '_estack'):
+        addr = elf.symbol(name)
+        if addr is not None:
+            print(f'{name}: 0x{addr:08X}')
+    return 0
+
+
+if __name__ == '__main__':
+    raise SystemExit(main())
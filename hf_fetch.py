@@ -0,0 +1,486 @@
+#!/usr/bin/env python3
+"""Host side of the on-demand dump retrieval protocol (see hf_proto.h).
+
+Subcommands:
+
+  fetch <port>   List dumps on the target and download whatever is missing
+                 into --out. Partial downloads are kept as *.part files and
+                 resumed after link drops or restarts of this script.
+  sim <dump...>  Serve dump files over a pty like a target would, paced at
+                 --baud. Prints the pty path to point `fetch` at.
+  bench          Run sim + fetch over pty pairs at several baud rates and
+                 report throughput.
+"""
+import argparse
+import os
+import select
+import struct
+import sys
+import tempfile
+import termios
+import threading
+import time
+import tty
+import zlib
+from pathlib import Path
+
+SYNC = b'HF'
+CMD_LIST = 0x01
+CMD_READ = 0x02
+CMD_CLEAR = 0x03
+RESP = 0x80
+
+ST_OK = 0x00
+ST_NAMES = {0x00: 'ok', 0x01: 'bad command', 0x02: 'bad argument',
+            0x03: 'no dump'}
+
+DUMP_VALID = 0x01
+PROTO_VERSION = 1
+
+
+class LinkError(Exception):
+    """Raised when the link stays unusable after all retries."""
+
+
+def crc32(data: bytes, crc: int = 0) -> int:
+    return zlib.crc32(data, crc) & 0xFFFFFFFF
+
+
+def build_frame(cmd: int, seq: int, payload: bytes) -> bytes:
+    body = struct.pack('<BBH', cmd, seq, len(payload)) + payload
+    return SYNC + body + struct.pack('<I', crc32(body))
+
+
+class FrameParser:
+    """Incremental frame parser with resync on garbage or bad CRC."""
+
+    def __init__(self, max_len: int = 0xFFFF):
+        self.buf = bytearray()
+        self.max_len = max_len
+
+    def feed(self, data: bytes):
+        self.buf += data
+        frames = []
+        while True:
+            i = self.buf.find(SYNC)
+            if i < 0:
+                # Keep a trailing 'H' in case the 'F' is still in flight.
+                del self.buf[:max(0, len(self.buf) - 1)]
+                return frames
+            del self.buf[:i]
+            if len(self.buf) < 6:
+                return frames
+            cmd, seq, length = struct.unpack_from('<BBH', self.buf, 2)
+            if length > self.max_len:
+                del self.buf[:2]
+                continue
+            total = 2 + 4 + length + 4
+            if len(self.buf) < total:
+                return frames
+            body = bytes(self.buf[2:6 + length])
+            (crc,) = struct.unpack_from('<I', self.buf, 6 + length)
+            if crc32(body) != crc:
+                del self.buf[:2]
+                continue
+            del self.buf[:total]
+            frames.append((cmd, seq, body[4:]))
+
+
+# ============================ Serial port ============================
+
+BAUD_CONST = {b: getattr(termios, f'B{b}') for b in
+              (9600, 19200, 38400, 57600, 115200, 230400, 460800, 921600,
+               1000000, 2000000) if hasattr(termios, f'B{b}')}
+
+
+def open_port(path: str, baud: int) -> int:
+    fd = os.open(path, os.O_RDWR | os.O_NOCTTY | os.O_NONBLOCK)
+    tty.setraw(fd)
+    attrs = termios.tcgetattr(fd)
+    speed = BAUD_CONST.get(baud)
+    if speed is not None:
+        attrs[4] = attrs[5] = speed
+    termios.tcsetattr(fd, termios.TCSANOW, attrs)
+    termios.tcflush(fd, termios.TCIOFLUSH)
+    return fd
+
+
+def write_all(fd: int, data: bytes):
+    view = memoryview(data)
+    while view:
+        try:
+            n = os.write(fd, view)
+        except BlockingIOError:
+            select.select([], [fd], [], 1.0)
+            continue
+        view = view[n:]
+
+
+# ============================== Client ==============================
+
+class Client:
+    def __init__(self, port: str, baud: int, timeout: float = 1.0,
+                 retries: int = 5, reconnect_wait: float = 0.5,
+                 max_reconnects: int = 20):
+        self.port = port
+        self.baud = baud
+        self.timeout = timeout
+        self.retries = retries
+        self.reconnect_wait = reconnect_wait
+        self.max_reconnects = max_reconnects
+        self.fd = None
+        self.seq = 0
+        self.parser = FrameParser()
+        self.stats = {'requests': 0, 'retries': 0, 'reconnects': 0}
+
+    # -- link management --
+
+    def connect(self):
+        self.close()
+        self.fd = open_port(self.port, self.baud)
+        self.parser = FrameParser()
+
+    def close(self):
+        if self.fd is not None:
+            try:
+                os.close(self.fd)
+            except OSError:
+                pass
+            self.fd = None
+
+    def _transact_once(self, cmd: int, payload: bytes):
+        self.seq = (self.seq + 1) & 0xFF
+        write_all(self.fd, build_frame(cmd, self.seq, payload))
+        deadline = time.monotonic() + self.timeout
+        while True:
+            left = deadline - time.monotonic()
+            if left <= 0:
+                return None
+            r, _, _ = select.select([self.fd], [], [], left)
+            if not r:
+                continue
+            data = os.read(self.fd, 4096)
+            if not data:
+                raise OSError('port closed')
+            for rcmd, rseq, body in self.parser.feed(data):
+                # Late answers to an earlier, retried request are skipped.
+                if rcmd == (cmd | RESP) and rseq == self.seq:
+                    return body
+
+    def request(self, cmd: int, payload: bytes = b'') -> bytes:
+        """Send a request, retrying and reconnecting until it is answered."""
+        reconnects = 0
+        while True:
+            try:
+                if self.fd is None:
+                    self.connect()
+                for attempt in range(self.retries):
+                    self.stats['requests'] += 1
+                    if attempt:
+                        self.stats['retries'] += 1
+                    body = self._transact_once(cmd, payload)
+                    if body is not None:
+                        if not body:
+                            raise LinkError('empty response')
+                        if body[0] != ST_OK:
+                            raise LinkError('target error: ' +
+                                            ST_NAMES.get(body[0], hex(body[0])))
+                        return body[1:]
+            except OSError:
+                pass
+            # Treat repeated timeouts like a dropped link: reopen the port.
+            reconnects += 1
+            self.stats['reconnects'] += 1
+            if reconnects > self.max_reconnects:
+                raise LinkError(f'no response from {self.port}')
+            self.close()
+            time.sleep(self.reconnect_wait)
+
+    # -- commands --
+
+    def list(self):
+        body = self.request(CMD_LIST)
+        ver, max_chunk, count = struct.unpack_from('<BHB', body, 0)
+        if ver != PROTO_VERSION:
+            raise LinkError(f'unsupported protocol version {ver}')
+        dumps = []
+        for i in range(count):
+            did, flags, size, crc = struct.unpack_from('<BBII', body, 4 + i * 10)
+            dumps.append({'id': did, 'valid': bool(flags & DUMP_VALID),
+                          'size': size, 'crc': crc})
+        return max_chunk, dumps
+
+    def read(self, did: int, off: int, length: int) -> bytes:
+        body = self.request(CMD_READ, struct.pack('<BIH', did, off, length))
+        rid, roff = struct.unpack_from('<BI', body, 0)
+        if rid != did or roff != off:
+            raise LinkError('READ response for wrong range')
+        return body[5:]
+
+    def clear(self, did: int):
+        self.request(CMD_CLEAR, struct.pack('<B', did))
+
+
+def dump_name(d) -> str:
+    return f"hfdump_{d['id']}_{d['crc']:08x}.bin"
+
+
+def fetch(client: Client, out_dir: Path, clear: bool = False,
+          log=print) -> list:
+    """Download every valid dump not already in out_dir. Returns paths."""
+    out_dir.mkdir(parents=True, exist_ok=True)
+    max_chunk, dumps = client.list()
+    got = []
+
+    for d in dumps:
+        if not d['valid']:
+            continue
+        final = out_dir / dump_name(d)
+        part = final.with_suffix('.part')
+
+        if final.is_file() and final.stat().st_size == d['size']:
+            log(f"dump {d['id']}: already have {final.name}")
+            got.append(final)
+            if clear:
+                client.clear(d['id'])
+            continue
+
+        # Stale partials of an older dump in the same slot are useless.
+        for old in out_dir.glob(f"hfdump_{d['id']}_*.part"):
+            if old != part:
+                old.unlink()
+
+        have = part.stat().st_size if part.is_file() else 0
+        if have > d['size']:
+            part.unlink()
+            have = 0
+        if have:
+            log(f"dump {d['id']}: resuming at {have}/{d['size']} bytes")
+
+        with open(part, 'ab') as f:
+            off = have
+            while off < d['size']:
+                chunk = client.read(d['id'], off, min(max_chunk, d['size'] - off))
+                if not chunk:
+                    raise LinkError('target returned an empty chunk')
+                f.write(chunk)
+                f.flush()
+                off += len(chunk)
+
+        if crc32(part.read_bytes()) != d['crc']:
+            # Content changed under us (new fault); start over next run.
+            part.unlink()
+            raise LinkError(f"dump {d['id']}: CRC mismatch, restart fetch")
+
+        part.rename(final)
+        log(f"dump {d['id']}: saved {final.name} ({d['size']} bytes)")
+        got.append(final)
+        if clear:
+            client.clear(d['id'])
+
+    return got
+
+
+# ============================ Simulator ============================
+
+class TargetSim:
+    """Target-side protocol on a pty master, paced like a real UART.
+
+    drop_every: after this many sent bytes, go silent for `outage` seconds
+    (requests are ignored), emulating a cable pull or target reset.
+    """
+
+    def __init__(self, fd: int, dumps, baud: int, max_chunk: int = 256,
+                 drop_every: int = 0, outage: float = 0.0):
+        self.fd = fd
+        self.dumps = [bytearray(d) if d is not None else None for d in dumps]
+        self.baud = baud
+        self.max_chunk = max_chunk
+        self.drop_every = drop_every
+        self.outage = outage
+        self.parser = FrameParser(max_len=16)
+        self.sent = 0
+        self.next_drop = drop_every
+        self.silent_until = 0.0
+        self.stop = threading.Event()
+
+    def _pace(self, nbytes: int, since: float):
+        # 8N1: ten bit times per byte.
+        due = since + nbytes * 10.0 / self.baud
+        delay = due - time.monotonic()
+        if delay > 0:
+            time.sleep(delay)
+
+    def _reply(self, cmd: int, seq: int, payload: bytes, t0: float):
+        frame = build_frame(cmd | RESP, seq, payload)
+        self._pace(len(frame), t0)
+        write_all(self.fd, frame)
+        self.sent += len(frame)
+
+    def _handle(self, cmd: int, seq: int, body: bytes, t0: float):
+        if cmd == CMD_LIST:
+            out = struct.pack('<BBHB', ST_OK, PROTO_VERSION, self.max_chunk,
+                              len(self.dumps))
+            for i, d in enumerate(self.dumps):
+                if d:
+                    out += struct.pack('<BBII', i, DUMP_VALID, len(d), crc32(d))
+                else:
+                    out += struct.pack('<BBII', i, 0, 0, 0)
+            self._reply(cmd, seq, out, t0)
+        elif cmd == CMD_READ and len(body) == 7:
+            did, off, n = struct.unpack('<BIH', body)
+            d = self.dumps[did] if did < len(self.dumps) else None
+            if not d:
+                self._reply(cmd, seq, bytes([0x03]), t0)
+            elif off > len(d):
+                self._reply(cmd, seq, bytes([0x02]), t0)
+            else:
+                n = min(n, self.max_chunk, len(d) - off)
+                self._reply(cmd, seq, struct.pack('<BBI', ST_OK, did, off) +
+                            bytes(d[off:off + n]), t0)
+        elif cmd == CMD_CLEAR and len(body) == 1:
+            if body[0] < len(self.dumps):
+                self.dumps[body[0]] = None
+                self._reply(cmd, seq, bytes([ST_OK]), t0)
+            else:
+                self._reply(cmd, seq, bytes([0x02]), t0)
+        else:
+            self._reply(cmd, seq, bytes([0x01]), t0)
+
+    def run(self):
+        while not self.stop.is_set():
+            r, _, _ = select.select([self.fd], [], [], 0.05)
+            if not r:
+                continue
+            try:
+                data = os.read(self.fd, 4096)
+            except (BlockingIOError, OSError):
+                continue
+            t0 = time.monotonic()
+            for cmd, seq, body in self.parser.feed(data):
+                if time.monotonic() < self.silent_until:
+                    continue
+                if self.drop_every and self.sent >= self.next_drop:
+                    self.next_drop += self.drop_every
+                    self.silent_until = time.monotonic() + self.outage
+                    continue
+                self._handle(cmd, seq, body, t0)
+
+
+def open_pty_pair():
+    master, slave = os.openpty()
+    tty.setraw(master)
+    path = os.ttyname(slave)
+    return master, slave, path
+
+
+# ============================ CLI ============================
+
+def cmd_fetch(args) -> int:
+    client = Client(args.port, args.baud, timeout=args.timeout)
+    try:
+        got = fetch(client, Path(args.out), clear=args.clear)
+    except LinkError as e:
+        print(f'error: {e}', file=sys.stderr)
+        return 1
+    finally:
+        client.close()
+    if not got:
+        print('No dumps on target.')
+    return 0
+
+
+def cmd_sim(args) -> int:
+    dumps = [Path(p).read_bytes() for p in args.dumps]
+    master, slave, path = open_pty_pair()
+    print(f'Serving {len(dumps)} dump(s) on {path} at {args.baud} baud '
+          '(Ctrl-C to stop)')
+    sim = TargetSim(master, dumps, args.baud, args.max_chunk,
+                    drop_every=args.drop_every, outage=args.outage)
+    try:
+        sim.run()
+    except KeyboardInterrupt:
+        pass
+    finally:
+        os.close(slave)
+        os.close(master)
+    return 0
+
+
+def cmd_bench(args) -> int:
+    bauds = [int(b) for b in args.bauds.split(',')]
+    dump = os.urandom(args.size)
+
+    print(f'Dump size: {args.size} bytes, chunk: {args.max_chunk} bytes'
+          + (f', link drop every {args.drop_every} bytes' if args.drop_every else ''))
+    print(f"{'baud':>8} {'seconds':>9} {'B/s':>9} {'line %':>7} "
+          f"{'retries':>8} {'reconn':>7}")
+
+    for baud in bauds:
+        master, slave, path = open_pty_pair()
+        sim = TargetSim(master, [dump], baud, args.max_chunk,
+                        drop_every=args.drop_every, outage=args.outage)
+        th = threading.Thread(target=sim.run, daemon=True)
+        th.start()
+
+        # Time-outs scale with the chunk's time on the wire.
+        chunk_time = (args.max_chunk + 16) * 10.0 / baud
+        client = Client(path, baud, timeout=max(0.2, 4 * chunk_time),
+                        reconnect_wait=0.05)
+        with tempfile.TemporaryDirectory() as tmp:
+            t0 = time.monotonic()
+            got = fetch(client, Path(tmp), log=lambda *_: None)
+            dt = time.monotonic() - t0
+            ok = got and got[0].read_bytes() == dump
+        client.close()
+        sim.stop.set()
+        th.join()
+        os.close(slave)
+        os.close(master)
+
+        if not ok:
+            print(f'{baud:>8} transfer FAILED')
+            return 1
+        rate = args.size / dt
+        line = 100.0 * rate / (baud / 10.0)
+        print(f"{baud:>8} {dt:>9.3f} {rate:>9.0f} {line:>6.1f}% "
+              f"{client.stats['retries']:>8} {client.stats['reconnects']:>7}")
+    return 0
+
+
+def main() -> int:
+    ap = argparse.ArgumentParser(description=__doc__,
+                                 formatter_class=argparse.RawDescriptionHelpFormatter)
+    sub = ap.add_subparsers(dest='cmd', required=True)
+
+    p = sub.add_parser('fetch', help='download missing dumps from a target')
+    p.add_argument('port')
+    p.add_argument('--baud', type=int, default=115200)
+    p.add_argument('--out', default='dumps')
+    p.add_argument('--timeout', type=float, default=1.0)
+    p.add_argument('--clear', action='store_true',
+                   help='clear each dump on the target once saved')
+    p.set_defaults(func=cmd_fetch)
+
+    p = sub.add_parser('sim', help='serve dump files over a pty')
+    p.add_argument('dumps', nargs='+')
+    p.add_argument('--baud', type=int, default=115200)
+    p.add_argument('--max-chunk', type=int, default=256)
+    p.add_argument('--drop-every', type=int, default=0)
+    p.add_argument('--outage', type=float, default=2.0)
+    p.set_defaults(func=cmd_sim)
+
+    p = sub.add_parser('bench', help='throughput over pty pairs')
+    p.add_argument('--bauds', default='9600,57600,115200,460800,921600')
+    p.add_argument('--size', type=int, default=8 * 1024)
+    p.add_argument('--max-chunk', type=int, default=256)
+    p.add_argument('--drop-every', type=int, default=0)
+    p.add_argument('--outage', type=float, default=0.3)
+    p.set_defaults(func=cmd_bench)
+
+    args = ap.parse_args()
+    return args.func(args)
+
+
+if __name__ == '__main__':
+    raise SystemExit(main())
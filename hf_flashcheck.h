@@ -0,0 +1,116 @@
+#pragma once
+
+/*
+ * Post-crash flash integrity check: CRC of the application image on the
+ * STM32G4 CRC unit, fed by a memory-to-memory DMA channel so the CPU goes on
+ * with init (printing the dump, bringing up peripherals) while it runs.
+ * Included by hardfault_dump.c when HF_FLASH_CHECK is 1.
+ *
+ * The unit is set up for CRC-32/IEEE as used by zlib.crc32 and
+ * HardFaultProto_Crc32(): polynomial 0x04C11DB7, init 0xFFFFFFFF, input
+ * bit-reversed per 32-bit word (= reflected bytes, little-endian order),
+ * output reversed, final XOR done in software. The expected value is the
+ * word at __hf_image_crc that hf_imgcrc.py patches in after linking (see
+ * hf_image_crc.ld).
+ *
+ * The DMA channel moves at most 65535 words per run, so larger images are
+ * checked in chunks; each hf_flashcheck_step() call restarts the next one.
+ * CRC unit and channel are borrowed until hf_flashcheck_release().
+ *
+ * Provided to hardfault_dump.c:
+ *   hf_flashcheck_begin(addr, words)  reset the CRC unit, start the first chunk
+ *   hf_flashcheck_step()              HF_FLASHCHECK_BUSY / _DONE / _ERROR
+ *   hf_flashcheck_result()            CRC-32 of everything fed so far
+ *   hf_flashcheck_release()           stop the channel
+ */
+
+#include <stdint.h>
+
+/* Channel and its flag position in DMAx->ISR / IFCR (4 bits per channel). */
+#ifndef HF_FLASHCHECK_DMA
+#define HF_FLASHCHECK_DMA        DMA1
+#define HF_FLASHCHECK_DMA_CH     DMA1_Channel1
+#define HF_FLASHCHECK_DMA_CHNUM  1u
+#endif
+
+#ifndef HF_FLASHCHECK_CLK_ENABLE
+#define HF_FLASHCHECK_CLK_ENABLE() \
+    (RCC->AHB1ENR |= RCC_AHB1ENR_CRCEN | RCC_AHB1ENR_DMA1EN)
+#endif
+
+#define HF_FLASHCHECK_CHUNK  65535u   /* CNDTR is 16 bits wide */
+
+#define HF_FLASHCHECK_SHIFT  (4u * (HF_FLASHCHECK_DMA_CHNUM - 1u))
+#define HF_FLASHCHECK_TCIF   (DMA_ISR_TCIF1 << HF_FLASHCHECK_SHIFT)
+#define HF_FLASHCHECK_TEIF   (DMA_ISR_TEIF1 << HF_FLASHCHECK_SHIFT)
+#define HF_FLASHCHECK_CGIF   (DMA_IFCR_CGIF1 << HF_FLASHCHECK_SHIFT)
+
+#define HF_FLASHCHECK_BUSY   (-1)
+#define HF_FLASHCHECK_DONE   0
+#define HF_FLASHCHECK_ERROR  1
+
+static uint32_t s_hf_fc_next;   /* next flash word to feed */
+static uint32_t s_hf_fc_left;   /* words not yet handed to the DMA */
+
+static inline void hf_flashcheck_chunk(void)
+{
+    const uint32_t n = (s_hf_fc_left < HF_FLASHCHECK_CHUNK) ? s_hf_fc_left
+                                                            : HF_FLASHCHECK_CHUNK;
+
+    HF_FLASHCHECK_DMA_CH->CCR   = 0;
+    HF_FLASHCHECK_DMA->IFCR     = HF_FLASHCHECK_CGIF;
+    /* MEM2MEM with DIR = 0: source is CPAR (flash, incrementing),
+     * destination CMAR (CRC->DR, fixed), 32-bit on both sides. */
+    HF_FLASHCHECK_DMA_CH->CPAR  = s_hf_fc_next;
+    HF_FLASHCHECK_DMA_CH->CMAR  = (uint32_t)&CRC->DR;
+    HF_FLASHCHECK_DMA_CH->CNDTR = n;
+    HF_FLASHCHECK_DMA_CH->CCR   = DMA_CCR_MEM2MEM | DMA_CCR_PINC |
+                                  DMA_CCR_PSIZE_1 | DMA_CCR_MSIZE_1 |
+                                  DMA_CCR_EN;
+    s_hf_fc_next += 4u * n;
+    s_hf_fc_left -= n;
+}
+
+static inline void hf_flashcheck_begin(uint32_t addr, uint32_t words)
+{
+    HF_FLASHCHECK_CLK_ENABLE();
+
+    CRC->POL  = 0x04C11DB7u;
+    CRC->INIT = 0xFFFFFFFFu;
+    CRC->CR   = CRC_CR_REV_IN | CRC_CR_REV_OUT;   /* 32-bit poly, word reversal */
+    CRC->CR  |= CRC_CR_RESET;
+
+    s_hf_fc_next = addr;
+    s_hf_fc_left = words;
+    if (words != 0u) {
+        hf_flashcheck_chunk();
+    }
+}
+
+static inline int hf_flashcheck_step(void)
+{
+    const uint32_t isr = HF_FLASHCHECK_DMA->ISR;
+
+    if (isr & HF_FLASHCHECK_TEIF) {
+        return HF_FLASHCHECK_ERROR;
+    }
+    if ((HF_FLASHCHECK_DMA_CH->CCR & DMA_CCR_EN) && !(isr & HF_FLASHCHECK_TCIF)) {
+        return HF_FLASHCHECK_BUSY;
+    }
+    if (s_hf_fc_left != 0u) {
+        hf_flashcheck_chunk();
+        return HF_FLASHCHECK_BUSY;
+    }
+    return HF_FLASHCHECK_DONE;
+}
+
+static inline uint32_t hf_flashcheck_result(void)
+{
+    return ~CRC->DR;
+}
+
+static inline void hf_flashcheck_release(void)
+{
+    HF_FLASHCHECK_DMA_CH->CCR = 0;
+    HF_FLASHCHECK_DMA->IFCR   = HF_FLASHCHECK_CGIF;
+}
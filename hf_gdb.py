@@ -0,0 +1,300 @@
+#!/usr/bin/env python3
+"""gdb command `hf-dump`: decode the dump mailbox of a halted target in place.
+
+  (gdb) source hf_gdb.py           # once, or from .gdbinit
+  (gdb) hf-dump                    # every valid slot, symbolized
+  (gdb) hf-dump 1                  # slot 1 only
+  (gdb) hf-dump --json             # hfdump JSON lines
+  (gdb) hf-dump --frame [SLOT]     # registers := faulting context, then `bt`
+  (gdb) hf-dump --restore          # registers back to what they were
+
+The mailbox is read through the debugger from __hf_dump_start to
+__hf_dump_end (--area LO-HI for stripped builds), so there is no need to
+reset the board or wait for the UART print. Slots are decoded by libhfdump
+(hfdump.py, next to this file; build libhfdump.so first) with the target's
+checksum, and printed in the layout of HardFault_DecodeAndPrint(). PC, LR,
+the stack words that look like return addresses and the shadow stack's call
+sites are symbolized by gdb itself from the loaded ELF: no addr2line run.
+
+--frame writes the dump's R0-R3, R12, LR, PC, xPSR and SP (just above the
+exception frame) into the target registers, so `bt`, `info frame` and `up`
+work on the faulting context. R4-R11 are not in the dump and keep their
+current values. Frames above the first are unwound from live memory: they
+are right while the faulting stack is still intact (halted in the fault
+handler, an ELF core of RAM taken at the fault), not after a reset has
+reused it; hf_locals.py works from the dump's own stack copy instead.
+--restore puts back the registers saved by the first --frame; run it
+before continuing, or the core resumes at the faulting PC.
+"""
+import json
+import os
+import struct
+import sys
+
+try:
+    import gdb
+except ImportError:
+    gdb = None
+
+if gdb is not None and '__file__' in globals():
+    sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+
+HF_MBOX_MAGIC = 0x424D4648   # hf_abi.h
+
+# Registers --frame writes, by gdb name, and the dump field for each.
+FRAME_REGS = (('r0', 'r0'), ('r1', 'r1'), ('r2', 'r2'), ('r3', 'r3'),
+              ('r12', 'r12'), ('lr', 'lr'), ('pc', 'pc'), ('xpsr', 'psr'))
+SAVED_REGS = ('r0', 'r1', 'r2', 'r3', 'r4', 'r5', 'r6', 'r7', 'r8', 'r9', 'r10',
+              'r11', 'r12', 'sp', 'lr', 'pc', 'xpsr')
+
+
+# ============================== Target ==============================
+
+def _addr(expr: str) -> int:
+    return int(gdb.parse_and_eval(f'(unsigned long)({expr})')) & 0xFFFFFFFF
+
+
+def find_area(override):
+    if override:
+        lo, _, hi = override.partition('-')
+        try:
+            lo, hi = int(lo, 0), int(hi, 0)
+        except ValueError:
+            raise gdb.GdbError(f'bad --area {override!r}: expected LO-HI')
+    else:
+        try:
+            lo, hi = _addr('&__hf_dump_start'), _addr('&__hf_dump_end')
+        except gdb.error:
+            raise gdb.GdbError('no __hf_dump_start/__hf_dump_end symbols; '
+                               'load the firmware ELF or use --area LO-HI')
+    if hi <= lo:
+        raise gdb.GdbError(f'bad mailbox bounds 0x{lo:08X}-0x{hi:08X}')
+    return lo, hi
+
+
+def read_area(lo: int, hi: int) -> bytes:
+    try:
+        return bytes(gdb.selected_inferior().read_memory(lo, hi - lo))
+    except gdb.MemoryError as e:
+        raise gdb.GdbError(f'cannot read the mailbox 0x{lo:08X}-0x{hi:08X}: {e}')
+
+
+def symbolize(addr: int):
+    """(function, file, line) from gdb's symbol tables, or None if addr is
+    not code."""
+    pc = addr & ~1
+    try:
+        block = gdb.block_for_pc(pc)
+    except RuntimeError:
+        block = None
+    while block is not None and block.function is None:
+        block = block.superblock
+    if block is not None:
+        func = block.function.print_name
+    else:
+        # No debug info here: a minimal symbol, if it is in a code section.
+        out = gdb.execute(f'info symbol 0x{pc:x}', to_string=True).strip()
+        name, sep, section = out.partition(' in section ')
+        if not sep or not section.startswith('.text'):
+            return None
+        func = name.split(' + ')[0]
+    sal = gdb.find_pc_line(pc)
+    if sal.symtab is None:
+        return (func, '??', 0)
+    return (func, sal.symtab.filename, sal.line)
+
+
+def slot_of(area: bytes, offset: int):
+    if len(area) < 32 or struct.unpack_from('<I', area)[0] != HF_MBOX_MAGIC:
+        return None
+    hdr_len, _area, slot_size = struct.unpack_from('<HII', area, 6)
+    return (offset - hdr_len) // slot_size if slot_size else None
+
+
+# ============================== Report ==============================
+
+def _sym(s) -> str:
+    if not s:
+        return ''
+    at = f' at {s["file"]}:{s["line"]}' if s.get('file', '??') != '??' else ''
+    return f' in {s["function"]} (){at}'
+
+
+def print_dump(slot, d):
+    """The fields HardFault_DecodeAndPrint() shows, plus the symbols."""
+    r, scb = d['regs'], d.get('scb', {})
+    print(f'===== HARD FAULT DUMP (slot {slot}) =====')
+    print(f'Magic: ok, Ver: {d["version"]}  Arch: {d.get("arch", "?")}  '
+          f'Checksum: {d["checksum"]}')
+    print(f'Image: {d.get("image", "?")}  Faults recorded: {d.get("fault_count", 0)}')
+    print(f'Class: {d["class"]}')
+    if d.get('soft'):
+        print('Soft capture: no fault, the system kept running')
+    if 'fpu_trap' in d:
+        print(f'FPU trap: FPSCR flags {" ".join(d["fpu_trap"])}')
+    if 'integrity' in d:
+        f = d['integrity']
+        task = f' task \'{f["task"]}\'' if 'task' in f else ''
+        print(f'Integrity: {f["kind"]} at {f["addr"]} found {f["found"]} '
+              f'region {f["region"]}{task}')
+    print(f'EXC_RETURN: {r["exc_return"]}  MSP: {r["msp"]}  PSP: {r["psp"]}')
+    print(f'Active SP: {d["active_sp"]}  Used: {d["stack"]}  '
+          f'FP ctx: {"YES" if d["fp_context"] else "NO"}')
+    print('Core regs:')
+    print(f' R0 : {r["r0"]}  R1 : {r["r1"]}')
+    print(f' R2 : {r["r2"]}  R3 : {r["r3"]}')
+    print(f' R12: {r["r12"]}  LR : {r["lr"]}')
+    print(f' PC : {r["pc"]}  PSR: {r["psr"]}')
+    if scb:
+        bits = ' '.join(d.get('cfsr_bits', []) + d.get('hfsr_bits', []))
+        print(f'CFSR: {scb["cfsr"]}  HFSR: {scb["hfsr"]}  ({bits or "-"})')
+        print(f'MMFAR: {scb["mmfar"]}  BFAR: {scb["bfar"]}'
+              + (f'  Fault address: {d["fault_address"]}' if 'fault_address' in d else ''))
+    if 'sp_limit' in d:
+        print(f'SP limit: {d["sp_limit"]}' + ('  STACK OVERFLOW' if d['stack_overflow'] else ''))
+    if 'main_stack' in d:
+        m = d['main_stack']
+        used = f'  Max used: {m["max_used"]} bytes' if 'max_used' in m else ''
+        print(f'MSP bottom: {m["bottom"]}{used}' + ('  NEAR LIMIT' if m['near_limit'] else ''))
+    if 'task' in d:
+        t = d['task']
+        print(f'{t["rtos"]}: task \'{t["name"]}\' prio {t["priority"]}, '
+              f'stack base {t["stack_base"]}, min free {t["min_free"]} bytes')
+    print(f'Stack dump bytes: {d["stack_bytes"]}')
+
+    syms = d.get('symbols', {})
+    print(f'PC {d["pc"]}{_sym(syms.get("pc"))}')
+    print(f'LR {d["lr"]}{_sym(syms.get("lr"))}')
+    calls = d.get('shadow_stack', {}).get('calls', [])
+    if calls:
+        print('Call sites (shadow stack, innermost first):')
+        for i, c in enumerate(calls):
+            print(f'  #{i:<2} {c["addr"]}{_sym(c.get("symbol"))}')
+    if d.get('backtrace'):
+        print('Backtrace candidates (return addresses on the stack):')
+        for b in d['backtrace']:
+            print(f'  [{b["sp"]}] {b["addr"]}{_sym(b.get("symbol"))}')
+    for m in d.get('heap', {}).get('matches', []):
+        print(f'Heap: {m["what"]} {m["addr"]} in block {m["block"]} ({m["state"]})')
+    print('===== END HARD FAULT DUMP =====')
+
+
+# ============================== Registers ==============================
+
+_saved = None
+
+
+def _frame0():
+    gdb.execute('frame 0', to_string=True)
+    return gdb.selected_frame()
+
+
+def switch_to(d):
+    """Load the faulting context of dump d into the target registers."""
+    global _saved
+    f = _frame0()
+    regs = {}
+    for name in SAVED_REGS:
+        try:
+            regs[name] = int(f.read_register(name)) & 0xFFFFFFFF
+        except ValueError:
+            pass                                       # no such register here
+    if _saved is None:
+        _saved = regs
+    r = d['regs']
+    psr = int(r['psr'], 16)
+    # Caller's SP: past the frame, the FP extension and the alignment pad.
+    sp = int(d['active_sp'], 16) + (0x68 if d['fp_context'] else 0x20) + \
+        (4 if psr & (1 << 9) else 0)
+    values = [(reg, int(r[key], 16)) for reg, key in FRAME_REGS] + [('sp', sp)]
+    try:
+        for reg, v in values:
+            if reg in regs:
+                gdb.execute(f'set ${reg} = 0x{v:08X}', to_string=True)
+    except gdb.error as e:
+        raise gdb.GdbError(f'cannot write registers on this target: {e}')
+
+
+def restore():
+    global _saved
+    if _saved is None:
+        raise gdb.GdbError('nothing to restore: hf-dump --frame was not used')
+    _frame0()
+    for reg, v in _saved.items():
+        gdb.execute(f'set ${reg} = 0x{v:08X}', to_string=True)
+    _saved = None
+
+
+# ================================ Command ================================
+
+if gdb is not None:
+    class HfDump(gdb.Command):
+        """Decode the HardFault dump mailbox of the target.
+Usage: hf-dump [--json] [--area LO-HI] [SLOT]
+       hf-dump --frame [--area LO-HI] [SLOT]
+       hf-dump --restore
+--frame loads the faulting registers so `bt` shows the faulting context;
+--restore puts the previous registers back."""
+
+        def __init__(self):
+            super().__init__('hf-dump', gdb.COMMAND_DATA)
+
+        def invoke(self, arg, from_tty):
+            argv = gdb.string_to_argv(arg)
+            as_json = '--json' in argv
+            frame = '--frame' in argv
+            if '--restore' in argv:
+                restore()
+                print('hf-dump: registers restored')
+                return
+            area, slot = None, None
+            rest = [a for a in argv if a not in ('--json', '--frame')]
+            while rest:
+                a = rest.pop(0)
+                if a == '--area' and rest:
+                    area = rest.pop(0)
+                elif a.isdigit():
+                    slot = int(a)
+                else:
+                    raise gdb.GdbError(f'hf-dump: unexpected argument {a!r}; see help hf-dump')
+
+            try:
+                import hfdump
+            except ImportError as e:
+                raise gdb.GdbError(f'hf-dump: {e}')
+
+            lo, hi = find_area(area)
+            data = read_area(lo, hi)
+            dumps = [(slot_of(data, d['offset']), d)
+                     for d in hfdump.parse_mailbox(data, symbolize)]
+            if slot is not None:
+                dumps = [(s, d) for s, d in dumps if s == slot]
+            if not dumps:
+                magic = struct.unpack_from('<I', data)[0] if len(data) >= 4 else 0
+                why = 'no valid slot' if magic == HF_MBOX_MAGIC \
+                    else f'no mailbox at 0x{lo:08X} (magic 0x{magic:08X})'
+                print(f'hf-dump: {why}' + (f' {slot}' if slot is not None and
+                                           magic == HF_MBOX_MAGIC else ''))
+                return
+
+            if frame:
+                s, d = dumps[0]
+                switch_to(d)
+                print(f'hf-dump: registers now hold the faulting context of slot {s} '
+                      f'(PC {d["pc"]}, R4-R11 unchanged)')
+                print('hf-dump: continuing now resumes at the faulting PC; '
+                      'run `hf-dump --restore` first')
+                gdb.execute('frame', from_tty)
+                return
+            for s, d in dumps:
+                if as_json:
+                    d['slot'] = s
+                    print(json.dumps(d))
+                else:
+                    print_dump(s, d)
+
+    HfDump()
+elif __name__ == '__main__':
+    print(f'{sys.argv[0]}: a gdb extension; load it with (gdb) source {sys.argv[0]}',
+          file=sys.stderr)
+    raise SystemExit(1)
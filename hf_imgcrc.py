@@ -0,0 +1,82 @@
+#!/usr/bin/env python3
+"""Patch the flash image CRC into a linked firmware ELF (HF_FLASH_CHECK).
+
+  hf_imgcrc.py firmware.elf            # compute and write the CRC word
+  hf_imgcrc.py --check firmware.elf    # verify only, exit 1 on mismatch
+
+Run after every link, before objcopy, for images built with
+hf_image_crc.ld. The CRC is CRC-32/IEEE (zlib.crc32), the same the STM32G4
+CRC unit computes in hf_flashcheck.h, over the flash bytes from
+__hf_image_start up to the __hf_image_crc word. The flash contents are
+rebuilt from the PT_LOAD segments at their load addresses (so .data's
+initial values count where they are stored); gaps between sections read as
+erased flash, 0xFF. Build .bin/.hex files with
+
+  arm-none-eabi-objcopy -O binary --gap-fill 0xFF firmware.elf firmware.bin
+
+so a programmer does not leave other bytes in the gaps.
+"""
+import argparse
+import struct
+import sys
+import zlib
+
+from hf_elf import ElfError, ElfFile
+
+ERASED = 0xFF
+
+
+def flash_image(elf: ElfFile, lo: int, hi: int) -> bytes:
+    """Bytes [lo, hi) as programmed into flash."""
+    buf = bytearray([ERASED]) * (hi - lo)
+    for addr, data in elf.segments(physical=True):
+        a, b = max(addr, lo), min(addr + len(data), hi)
+        if a < b:
+            buf[a - lo:b - lo] = data[a - addr:b - addr]
+    return bytes(buf)
+
+
+def crc_word(elf: ElfFile):
+    """(file offset of the CRC word, stored value, computed CRC, bytes covered)."""
+    lo, hi = elf.symbol('__hf_image_start'), elf.symbol('__hf_image_crc')
+    if lo is None or hi is None:
+        raise ElfError(f'{elf.path}: no __hf_image_start/__hf_image_crc; '
+                       'is hf_image_crc.ld included?')
+    if hi <= lo or (hi - lo) % 4:
+        raise ElfError(f'{elf.path}: bad CRC range 0x{lo:08X}-0x{hi:08X}')
+    sec = elf.section('.hf_image_crc')
+    if sec is None or not sec.addr <= hi < sec.addr + sec.size:
+        raise ElfError(f'{elf.path}: __hf_image_crc is not in .hf_image_crc')
+    off = sec.offset + hi - sec.addr
+    stored = struct.unpack_from('<I', elf.data, off)[0]
+    return off, stored, zlib.crc32(flash_image(elf, lo, hi)), hi - lo
+
+
+def main() -> int:
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument('--check', action='store_true', help='verify, do not write')
+    ap.add_argument('elf')
+    args = ap.parse_args()
+
+    try:
+        elf = ElfFile(args.elf)
+        off, stored, crc, size = crc_word(elf)
+    except (OSError, ElfError) as e:
+        print(f'error: {e}', file=sys.stderr)
+        return 1
+
+    if args.check:
+        ok = stored == crc
+        print(f'{args.elf}: {size} bytes, CRC 0x{crc:08X}, stored 0x{stored:08X}: '
+              f'{"OK" if ok else "MISMATCH"}')
+        return 0 if ok else 1
+
+    with open(args.elf, 'r+b') as f:
+        f.seek(off)
+        f.write(struct.pack('<I', crc))
+    print(f'{args.elf}: {size} bytes, CRC 0x{crc:08X}')
+    return 0
+
+
+if __name__ == '__main__':
+    raise SystemExit(main())
@@ -0,0 +1,663 @@
+#!/usr/bin/env python3
+"""Arguments and local variables of the faulting frames, like gdb's `bt full`.
+
+  hf_locals.py [--json] --elf firmware.elf [--ram RAM[@BASE]]... DUMP...
+
+DUMP is a raw binary dump (hf_fetch.py, a UART capture cut to one dump) or
+anything hf_ramdump.py reads that covers the mailbox; every valid slot is
+shown. The firmware ELF must carry DWARF (-g; no third-party modules needed).
+
+The registers are the ones the dump holds: R0-R3, R12, LR, PC and xPSR from
+the exception frame, and SP just above that frame. The stack payload is
+memory from SP up, as much as HF_MAX_STACK_COPY and the slot allowed. The
+call chain is unwound with the ELF's .debug_frame (GCC emits it with -g); a
+caller's R4-R11 are known only where a callee saved them to the captured
+stack, and a caller's R0-R3/R12 never are. Each parameter and local in scope
+at the frame PC (inlined calls are frames of their own) has its DWARF
+location evaluated against that: registers, frame-base and CFA offsets,
+location lists, pieces, computed values. Reads are served from the stack
+payload, then --ram images (a full RAM read makes globals and static locals
+readable too), then the ELF's read-only sections. Values whose storage is
+outside all of that are printed as <unavailable: why>; no location at the PC
+is <optimized out>.
+
+FP registers are never shown: with lazy stacking (the default) the space the
+exception frame reserves for S0-S15 is not written before the dump is taken.
+
+--json prints one JSON object per dump with the frames and their typed
+values (null plus "unavailable" where a value could not be recovered).
+"""
+import argparse
+import json
+import struct
+import sys
+
+import hf_addr2line
+from hf_dwarf import (ATE_boolean, ATE_float, ATE_signed, ATE_signed_char, ATE_UTF,
+                      ATE_unsigned_char, AT_bit_offset, AT_bit_size, AT_byte_size,
+                      AT_call_line, AT_const_value, AT_count, AT_data_bit_offset,
+                      AT_data_member_location, AT_encoding, AT_frame_base, AT_location,
+                      AT_upper_bound, BLOCK_FORMS, TAG_array_type,
+                      TAG_atomic_type, TAG_base_type, TAG_class_type, TAG_const_type,
+                      TAG_enumeration_type, TAG_enumerator, TAG_formal_parameter,
+                      TAG_inlined_subroutine, TAG_member, TAG_pointer_type,
+                      TAG_reference_type, TAG_restrict_type, TAG_rvalue_reference_type,
+                      TAG_structure_type, TAG_subrange_type, TAG_subroutine_type,
+                      TAG_typedef, TAG_union_type, TAG_volatile_type, Context, Dwarf,
+                      DwarfError, Unavailable, evaluate)
+from hf_elf import EM_ARM, SHF_ALLOC, SHT_PROGBITS, ElfError, ElfFile
+from hf_ramdump import HF_MAGIC, HF_MBOX_MAGIC, Memory, expand, find_area, load_memory
+
+SHF_WRITE = 0x1
+
+# hf_dump_hdr_t (hf_abi.h, packed): the fields this tool needs.
+HDR_EXC_RETURN = 8
+HDR_ACTIVE_SP = 20
+HDR_HAS_FP = 28
+HDR_R0 = 60                  # r0 r1 r2 r3 r12 lr pc psr
+HDR_STACK_BYTES = 125
+HDR_CHECKSUM = 129
+HDR_MIN = 141               # v4; v3 moved stack_bytes with the task name length
+HDR_VERSION_MIN = 4
+
+MAX_ELEMENTS = 16            # array elements shown
+MAX_STRING = 64              # bytes of a char * / char[] shown
+MAX_DEPTH = 3                # nested aggregates shown
+
+
+class Arch:
+    """DWARF register numbering and unwinding rules of one target."""
+
+    def __init__(self, names, pc, sp, callee_saved, addr_size, thumb):
+        self.names = names
+        self.pc = pc
+        self.sp = sp
+        self.callee_saved = callee_saved
+        self.addr_size = addr_size
+        self.thumb = thumb
+
+    def name(self, n):
+        return self.names.get(n, f'reg{n}')
+
+
+ARM = Arch({**{n: f'r{n}' for n in range(13)}, 13: 'sp', 14: 'lr', 15: 'pc',
+            **{64 + n: f's{n}' for n in range(32)}, **{256 + n: f'd{n}' for n in range(32)}},
+           pc=15, sp=13, callee_saved=set(range(4, 12)), addr_size=4, thumb=True)
+
+
+# ============================== Dumps ==============================
+
+def _xor(b: bytes) -> int:
+    x = 0
+    for v in b:
+        x ^= v
+    return x
+
+
+def parse_dump(blob: bytes, off: int):
+    """Registers and stack payload of the dump at blob[off:], or None if
+    there is none; 'check' says whether the on-target checksum matched."""
+    if off + HDR_MIN > len(blob) or struct.unpack_from('<I', blob, off)[0] != HF_MAGIC:
+        return None
+    version, header_len = struct.unpack_from('<HH', blob, off + 4)
+    if version < HDR_VERSION_MIN:
+        return None
+    stack_bytes = struct.unpack_from('<I', blob, off + HDR_STACK_BYTES)[0]
+    if header_len < HDR_MIN or off + header_len + stack_bytes > len(blob):
+        return None
+    hdr = blob[off:off + header_len]
+    payload = blob[off + header_len:off + header_len + stack_bytes]
+    checksum = struct.unpack_from('<I', hdr, HDR_CHECKSUM)[0]
+    computed = _xor(hdr) ^ _xor(hdr[HDR_CHECKSUM:HDR_CHECKSUM + 4]) ^ _xor(payload)
+    r0, r1, r2, r3, r12, lr, pc, psr = struct.unpack_from('<8I', hdr, HDR_R0)
+    exc_return, = struct.unpack_from('<I', hdr, HDR_EXC_RETURN)
+    active_sp, = struct.unpack_from('<I', hdr, HDR_ACTIVE_SP)
+    has_fp, = struct.unpack_from('<I', hdr, HDR_HAS_FP)
+    # Caller's SP: past the frame, the FP extension and the alignment pad.
+    sp = active_sp + (0x68 if has_fp else 0x20) + (4 if psr & (1 << 9) else 0)
+    return {'offset': off, 'check': 'ok' if computed == checksum else 'bad',
+            'exc_return': exc_return, 'active_sp': active_sp, 'stack': payload,
+            'regs': {0: r0, 1: r1, 2: r2, 3: r3, 12: r12, 14: lr, 15: pc & ~1, 13: sp}}
+
+
+def dumps_in(blob: bytes):
+    """[(slot or None, dump)] of a raw dump or a mailbox image."""
+    magic = struct.unpack_from('<I', blob)[0] if len(blob) >= 4 else 0
+    if magic == HF_MAGIC:
+        d = parse_dump(blob, 0)
+        return [(None, d)] if d else []
+    if magic != HF_MBOX_MAGIC or len(blob) < 32:
+        return []
+    hdr_len, _area, slot_size, count = struct.unpack_from('<HIIH', blob, 6)
+    out = []
+    for i in range(min(count, 8)):
+        d = parse_dump(blob, hdr_len + i * slot_size)
+        if d:
+            out.append((i, d))
+    return out
+
+
+class Target:
+    """Memory as far as it is known: the dump's stack payload, RAM images,
+    then the ELF's read-only sections (their contents cannot have changed)."""
+
+    def __init__(self, elf: ElfFile, stack_base, stack, ram: Memory):
+        self.elf = elf
+        self.stack = Memory([(stack_base, stack)]) if stack else Memory([])
+        self.ram = ram
+        self.rom = [s for s in elf.sections
+                    if s.flags & SHF_ALLOC and not s.flags & SHF_WRITE and s.type == SHT_PROGBITS]
+
+    def read(self, addr, size):
+        for m in (self.stack, self.ram):
+            b = m.read(addr, size)
+            if b is not None:
+                return b
+        for s in self.rom:
+            if s.addr <= addr and addr + size <= s.addr + s.size:
+                off = s.offset + addr - s.addr
+                return self.elf.data[off:off + size]
+        raise Unavailable(f'0x{addr:08X} not captured')
+
+
+# ============================== Frames ==============================
+
+class Frame(Context):
+    """One physical frame: its registers, CFA, and the target memory."""
+
+    def __init__(self, dw: Dwarf, arch: Arch, tgt: Target, regs, pc, exact):
+        self.dw = dw
+        self.arch = arch
+        self.tgt = tgt
+        self.regs = regs
+        self.pc = pc
+        self.exact = exact                         # faulting PC, not a return address
+        self.lookup = pc if exact else pc - 1      # inside the call instruction
+        self.addr_size = arch.addr_size
+        self.row = dw.cfi_row(self.lookup)
+        self._cfa = None
+        self.scope = None                          # subprogram, for the frame base
+        self.unit = None
+
+    def reg(self, n):
+        if n in self.regs:
+            return self.regs[n]
+        raise Unavailable(f'{self.arch.name(n)} not recovered')
+
+    def read(self, addr, size):
+        return self.tgt.read(addr, size)
+
+    def cfa(self):
+        if self._cfa is None:
+            if self.row is None:
+                raise Unavailable('no call frame info here')
+            rule = self.row[0]
+            if rule[0] == 'reg':
+                self._cfa = (self.reg(rule[1]) + rule[2]) & ((1 << 8 * self.addr_size) - 1)
+            else:
+                self._cfa = evaluate(rule[1], self, location=False)
+        return self._cfa
+
+    def frame_base(self):
+        expr = self.dw.location(self.scope, AT_frame_base, self.lookup) \
+            if self.scope is not None else None
+        if expr is None:
+            raise Unavailable('no frame base')
+        pieces = evaluate(expr, self)
+        if len(pieces) != 1:
+            raise Unavailable('unusual frame base')
+        p = pieces[0]
+        return self.reg(p.value) if p.kind == 'reg' else p.value
+
+    def addrx(self, idx):
+        return self.dw.addrx(self.unit, idx)
+
+    def caller(self):
+        """The calling frame, or (None, why) at the end of the chain."""
+        if self.row is None:
+            return None, 'no call frame info for this address'
+        cfa = self.cfa()
+        _, rules, ra_col = self.row
+        regs = {}
+        for n in set(rules) | self.arch.callee_saved | {ra_col}:
+            rule = rules.get(n, ('same',) if n in self.arch.callee_saved or n == ra_col
+                             else ('undef',))
+            try:
+                if rule[0] == 'off':
+                    regs[n] = int.from_bytes(self.read(cfa + rule[1], self.addr_size), 'little')
+                elif rule[0] == 'val':
+                    regs[n] = cfa + rule[1]
+                elif rule[0] == 'reg':
+                    regs[n] = self.reg(rule[1])
+                elif rule[0] == 'same':
+                    regs[n] = self.reg(n)
+                elif rule[0] == 'expr':
+                    addr = evaluate(rule[1], self, location=False, push=(cfa,))
+                    regs[n] = int.from_bytes(self.read(addr, self.addr_size), 'little')
+                elif rule[0] == 'vexpr':
+                    regs[n] = evaluate(rule[1], self, location=False, push=(cfa,))
+            except Unavailable:
+                pass
+        ra = regs.pop(ra_col, None)
+        if ra is None:
+            return None, 'return address not recovered'
+        if self.arch.thumb and ra >= 0xF0000000:
+            return None, 'exception entry (EXC_RETURN)'
+        if self.arch.thumb:
+            ra &= ~1
+        if ra == 0:
+            return None, 'end of the call chain'
+        # A frameless leaf has CFA == SP (the ARM CIE default is r13+0), so
+        # only a CFA below SP, or the same CFA and PC again, is a stall.
+        sp = self.regs.get(self.arch.sp)
+        if sp is not None and (cfa < sp or (cfa == sp and ra == self.pc)):
+            return None, 'stack does not unwind'
+        regs[self.arch.sp] = cfa
+        regs[self.arch.pc] = ra
+        return Frame(self.dw, self.arch, self.tgt, regs, ra, False), None
+
+
+def unwind(dw: Dwarf, arch: Arch, tgt: Target, regs, max_frames):
+    """([Frame], why the chain ended)."""
+    frames = [Frame(dw, arch, tgt, regs, regs[arch.pc], True)]
+    why = None
+    while len(frames) < max_frames:
+        try:
+            nxt, why = frames[-1].caller()
+        except Unavailable as e:
+            nxt, why = None, str(e)
+        if nxt is None:
+            break
+        frames.append(nxt)
+    else:
+        why = f'stopped after {max_frames} frames'
+    return frames, why
+
+
+# ============================== Types ==============================
+
+_QUALIFIERS = {TAG_const_type: 'const', TAG_volatile_type: 'volatile',
+               TAG_restrict_type: 'restrict', TAG_atomic_type: '_Atomic'}
+_AGGREGATES = {TAG_structure_type: 'struct', TAG_union_type: 'union',
+               TAG_class_type: 'class', TAG_enumeration_type: 'enum'}
+_POINTERS = {TAG_pointer_type: '*', TAG_reference_type: '&', TAG_rvalue_reference_type: '&&'}
+
+
+def strip(dw: Dwarf, t):
+    while t is not None and (t.tag in _QUALIFIERS or t.tag == TAG_typedef):
+        t = dw.type_of(t)
+    return t
+
+
+def dims(dw: Dwarf, t):
+    """Element counts of an array type, outermost first (None = unknown)."""
+    out = []
+    for c in t.children:
+        if c.tag != TAG_subrange_type:
+            continue
+        n = dw.const(c, AT_count)
+        if n is None:
+            ub = dw.const(c, AT_upper_bound)
+            n = ub + 1 if ub is not None and ub < (1 << 31) else None
+        out.append(n)
+    return out or [None]
+
+
+def type_size(dw: Dwarf, t, asz):
+    t = strip(dw, t)
+    if t is None:
+        return 0
+    n = dw.const(t, AT_byte_size)
+    if n is not None:
+        return n
+    if t.tag in _POINTERS:
+        return asz
+    if t.tag == TAG_array_type:
+        total = type_size(dw, dw.type_of(t), asz)
+        for n in dims(dw, t):
+            total *= n or 0
+        return total
+    return 0
+
+
+def type_name(dw: Dwarf, t) -> str:
+    if t is None:
+        return 'void'
+    if t.tag in _QUALIFIERS:
+        inner = dw.type_of(t)
+        if inner is not None and inner.tag in _POINTERS:
+            return f'{type_name(dw, inner)} {_QUALIFIERS[t.tag]}'
+        return f'{_QUALIFIERS[t.tag]} {type_name(dw, inner)}'
+    if t.tag in _POINTERS:
+        inner = dw.type_of(t)
+        if inner is not None and inner.tag == TAG_subroutine_type:
+            return f'{type_name(dw, dw.type_of(inner))} (*)(...)'
+        return f'{type_name(dw, inner)} {_POINTERS[t.tag]}'
+    if t.tag == TAG_array_type:
+        return type_name(dw, dw.type_of(t)) + \
+            ''.join(f'[{n}]' if n is not None else '[]' for n in dims(dw, t))
+    name = dw.name(t)
+    if t.tag in _AGGREGATES:
+        return f'{_AGGREGATES[t.tag]} {name or "{...}"}'
+    return name or '?'
+
+
+def _is_char(dw: Dwarf, t):
+    t = strip(dw, t)
+    return t is not None and t.tag == TAG_base_type and dw.const(t, AT_byte_size) == 1 and \
+        dw.const(t, AT_encoding) in (ATE_signed_char, ATE_unsigned_char)
+
+
+_ESCAPES = {0x07: '\\a', 0x08: '\\b', 0x09: '\\t', 0x0A: '\\n', 0x0B: '\\v',
+            0x0C: '\\f', 0x0D: '\\r', 0x22: '\\"', 0x5C: '\\\\'}
+
+
+def _c_string(b: bytes, cut=False) -> str:
+    """C literal of the bytes up to the first NUL; cut: the buffer ended
+    before one was seen."""
+    s = b.split(b'\0', 1)[0]
+    text = ''.join(_ESCAPES.get(c) or (chr(c) if 0x20 <= c < 0x7F else f'\\{c:03o}')
+                   for c in s)
+    return f'"{text}"' + ('...' if cut and b'\0' not in b else '')
+
+
+def render(dw: Dwarf, t, data: bytes, tgt: Target, depth=0) -> str:
+    """Value of type t stored in data, in C-ish notation."""
+    asz = 8 if dw.elf.is64 else 4
+    t = strip(dw, t)
+    if t is None:
+        return data.hex()
+    if t.tag == TAG_base_type:
+        enc = dw.const(t, AT_encoding)
+        n = len(data)
+        if enc == ATE_float and n in (4, 8):
+            return repr(struct.unpack('<f' if n == 4 else '<d', data)[0])
+        if enc == ATE_boolean:
+            return 'true' if any(data) else 'false'
+        signed = enc in (ATE_signed, ATE_signed_char)
+        v = int.from_bytes(data, 'little', signed=signed)
+        if enc in (ATE_signed_char, ATE_unsigned_char, ATE_UTF) and n == 1:
+            c = chr(v & 0xFF)
+            return f"{v} '{c}'" if c.isprintable() and v >= 0x20 else str(v)
+        return str(v)
+    if t.tag in _POINTERS:
+        v = int.from_bytes(data, 'little')
+        out = f'0x{v:0{2 * len(data)}X}'
+        if v and _is_char(dw, dw.type_of(t)):
+            for n in (MAX_STRING, 16, 1):
+                try:
+                    return f'{out} {_c_string(tgt.read(v, n), cut=True)}'
+                except Unavailable:
+                    continue
+        return out
+    if t.tag == TAG_enumeration_type:
+        v = int.from_bytes(data, 'little', signed=True)
+        for c in t.children:
+            if c.tag == TAG_enumerator and dw.const(c, AT_const_value) in (v, v & 0xFFFFFFFF):
+                return dw.name(c)
+        return str(v)
+    if t.tag == TAG_array_type:
+        elem = dw.type_of(t)
+        if _is_char(dw, elem):
+            return _c_string(data)
+        esz = type_size(dw, elem, asz)
+        if esz == 0:
+            return '{...}'
+        if depth >= MAX_DEPTH:
+            return '{...}'
+        items = [render(dw, elem, data[i:i + esz], tgt, depth + 1)
+                 for i in range(0, min(len(data), MAX_ELEMENTS * esz), esz)]
+        more = ', ...' if len(data) > MAX_ELEMENTS * esz else ''
+        return '{' + ', '.join(items) + more + '}'
+    if t.tag in (TAG_structure_type, TAG_union_type, TAG_class_type):
+        if depth >= MAX_DEPTH:
+            return '{...}'
+        fields = []
+        for m in t.children:
+            if m.tag != TAG_member:
+                continue
+            fields.append(f'{dw.name(m) or "<anon>"} = {member(dw, m, data, tgt, depth)}')
+        return '{' + ', '.join(fields) + '}'
+    if t.tag == TAG_subroutine_type:
+        return '<function>'
+    return data.hex()
+
+
+def member(dw: Dwarf, m, data: bytes, tgt: Target, depth) -> str:
+    asz = 8 if dw.elf.is64 else 4
+    v = m.attrs.get(AT_data_member_location)
+    off = 0
+    if v is not None:
+        if v[0] in BLOCK_FORMS:
+            try:
+                off = evaluate(v[1], Context(), location=False, push=(0,))
+            except (Unavailable, IndexError):
+                return '<unavailable: member location>'
+        else:
+            off = v[1]
+    mt = dw.type_of(m)
+    bits = dw.const(m, AT_bit_size)
+    if bits is None:
+        size = type_size(dw, mt, asz)
+        if off + size > len(data):
+            return '<unavailable: truncated>'
+        return render(dw, mt, data[off:off + size], tgt, depth + 1)
+    # Bit-field: DWARF 4+ counts from the start of the struct, DWARF 2/3 from
+    # the most significant bit of the storage unit.
+    dbo = dw.const(m, AT_data_bit_offset)
+    if dbo is None:
+        unit = dw.const(m, AT_byte_size) or type_size(dw, mt, asz)
+        dbo = off * 8 + unit * 8 - (dw.const(m, AT_bit_offset) or 0) - bits
+    raw = int.from_bytes(data, 'little') >> dbo & ((1 << bits) - 1)
+    st = strip(dw, mt)
+    if st is not None and dw.const(st, AT_encoding) in (ATE_signed, ATE_signed_char) and \
+            raw >> (bits - 1):
+        raw -= 1 << bits
+    return str(raw)
+
+
+# ============================== Variables ==============================
+
+def value_bytes(frame: Frame, pieces, size):
+    if not pieces:
+        raise Unavailable('optimized out')
+    out = b''
+    asz = frame.addr_size
+    for p in pieces:
+        n = p.size if p.size is not None else size - len(out)
+        if p.kind == 'mem':
+            out += frame.read(p.value, n)
+        elif p.kind == 'reg':
+            b = b''
+            reg = p.value
+            while len(b) < n:                          # wide values span r0:r1
+                b += frame.reg(reg).to_bytes(asz, 'little')
+                reg += 1
+            out += b[:n]
+        elif p.kind == 'value':
+            out += (p.value & ((1 << 8 * max(n, asz)) - 1)).to_bytes(max(n, asz), 'little')[:n]
+        elif p.kind == 'bytes':
+            out += p.value[:n].ljust(n, b'\0')
+        else:
+            raise Unavailable('optimized out')
+    if len(out) < size:
+        raise Unavailable('partly optimized out')
+    return out[:size]
+
+
+def variable(dw: Dwarf, frame: Frame, v):
+    """{'name', 'type', 'value' or None, 'unavailable' when None}."""
+    t = dw.type_of(v)
+    rec = {'name': dw.name(v) or '?', 'type': type_name(dw, t)}
+    size = type_size(dw, t, frame.addr_size)
+    try:
+        c = dw.origin(v, AT_const_value)
+        if c is not None:
+            form, val = c
+            data = val if form in BLOCK_FORMS else \
+                (val & ((1 << 8 * max(size, 1)) - 1)).to_bytes(max(size, 1), 'little')
+            rec['value'] = render(dw, t, data[:size] if size else data, frame.tgt)
+            return rec
+        expr = dw.location(v, AT_location, frame.lookup)
+        if expr is None:
+            raise Unavailable('optimized out')
+        pieces = evaluate(expr, frame)
+        rec['value'] = render(dw, t, value_bytes(frame, pieces, size), frame.tgt)
+    except Unavailable as e:
+        rec['value'] = None
+        rec['unavailable'] = str(e)
+    except (DwarfError, IndexError, struct.error) as e:
+        rec['value'] = None
+        rec['unavailable'] = f'bad debug info ({e or type(e).__name__})'
+    return rec
+
+
+def frame_scopes(dw: Dwarf, frame: Frame):
+    """[{'function', 'inlined', 'call_line', 'args', 'locals'}], innermost
+    first; one per inlined call plus the function itself."""
+    chain = dw.scopes(frame.lookup)
+    if not chain:
+        return []
+    frame.scope = chain[0]
+    frame.unit = chain[0].cu
+    out = []
+    for i in range(len(chain) - 1, -1, -1):
+        scope = chain[i]
+        rec = {'function': dw.name(scope) or '??',
+               'inlined': scope.tag == TAG_inlined_subroutine,
+               'args': [], 'locals': []}
+        if i + 1 < len(chain):
+            rec['call_line'] = dw.const(chain[i + 1], AT_call_line)
+        for v in dw.variables(scope, frame.lookup):
+            key = 'args' if v.tag == TAG_formal_parameter else 'locals'
+            rec[key].append(variable(dw, frame, v))
+        out.append(rec)
+    return out
+
+
+# ============================== Report ==============================
+
+def show(v) -> str:
+    if v['value'] is not None:
+        return v['value']
+    why = v['unavailable']
+    return '<optimized out>' if why == 'optimized out' else f'<unavailable: {why}>'
+
+
+def lines_for(elf_path, frames):
+    """pc -> 'file:line' through addr2line (hf_symd when running); {} if
+    the toolchain is not installed."""
+    addrs = sorted({f.lookup for f in frames})
+    try:
+        got = hf_addr2line.addr2line(elf_path, addrs)
+    except OSError:
+        return {}
+    return {a: loc for a, (_, loc) in got.items() if loc and not loc.startswith('??')}
+
+
+def report(name, slot, dump, dw: Dwarf, arch: Arch, ram: Memory, elf: ElfFile,
+           max_frames, as_json):
+    tgt = Target(elf, dump['active_sp'], dump['stack'], ram)
+    frames, why = unwind(dw, arch, tgt, dump['regs'], max_frames)
+    where = lines_for(elf.path, frames)
+    recs = []
+    for f in frames:
+        scopes = frame_scopes(dw, f)
+        if not scopes:
+            scopes = [{'function': '??', 'inlined': False, 'args': [], 'locals': []}]
+        for s in scopes:
+            s['pc'] = f'0x{f.pc:08X}'
+            if f.regs.get(arch.sp) is not None:
+                s['sp'] = f'0x{f.regs[arch.sp]:08X}'
+        if f.lookup in where:
+            scopes[0]['at'] = where[f.lookup]
+        recs += scopes
+
+    stack = dump['stack']
+    if as_json:
+        print(json.dumps({'file': str(name), 'slot': slot, 'checksum': dump['check'],
+                          'stack': [f'0x{dump["active_sp"]:08X}',
+                                    f'0x{dump["active_sp"] + len(stack):08X}'],
+                          'frames': recs, 'end': why}))
+        return
+
+    label = f'slot {slot}' if slot is not None else 'dump'
+    print(f'{name}: {label}, checksum {dump["check"]}, stack 0x{dump["active_sp"]:08X}'
+          f'-0x{dump["active_sp"] + len(stack):08X} ({len(stack)} bytes)')
+    for i, r in enumerate(recs):
+        args = ', '.join(f'{a["name"]}={show(a)}' for a in r['args'])
+        at = f' at {r["at"]}' if 'at' in r else ''
+        if r.get('call_line'):
+            at = f' at line {r["call_line"]}'
+        inl = ' [inlined]' if r['inlined'] else ''
+        print(f'#{i:<2} {r["pc"]} in {r["function"]} ({args}){at}{inl}')
+        for v in r['locals']:
+            print(f'        {v["name"]} = {show(v)}')
+    if why:
+        print(f'    ({why})')
+    print()
+
+
+# ================================ CLI ================================
+
+def main() -> int:
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument('--json', action='store_true')
+    ap.add_argument('--elf', required=True, help='firmware ELF with DWARF (-g)')
+    ap.add_argument('--area', help='LO-HI of the mailbox instead of the ELF symbols')
+    ap.add_argument('--base', type=lambda s: int(s, 0),
+                    help='load address of raw images without @BASE')
+    ap.add_argument('--ram', action='append', default=[],
+                    help='RAM[@BASE] read for values outside the stack payload, repeatable')
+    ap.add_argument('--frames', type=int, default=16, help='max frames to unwind')
+    ap.add_argument('dumps', nargs='+', help='DUMP[@BASE] or directory')
+    args = ap.parse_args()
+
+    try:
+        elf = ElfFile(args.elf)
+        if elf.machine != EM_ARM:
+            raise ElfError(f'{args.elf}: not an ARM ELF')
+        dw = Dwarf(elf)
+        runs = []
+        for path, base in expand(args.ram, args.base):
+            runs += load_memory(path, base, None).runs
+        ram = Memory(runs)
+    except (OSError, ValueError, ElfError, DwarfError) as e:
+        print(f'error: {e}', file=sys.stderr)
+        return 1
+    if not dw.has_cfi():
+        print('note: no .debug_frame in the ELF; only the faulting frame is shown',
+              file=sys.stderr)
+
+    area = None
+    rc = 0
+    for path, base in expand(args.dumps, args.base):
+        try:
+            data = path.read_bytes()
+            found = dumps_in(data) if base is None else []
+            mem = None
+            if not found:
+                if area is None:
+                    area = find_area(elf, args.area)
+                mem = load_memory(path, base, area)
+                blob = mem.read(area[0], area[1] - area[0])
+                if blob is None:
+                    raise ValueError(f'does not cover the mailbox '
+                                     f'0x{area[0]:08X}-0x{area[1]:08X}')
+                found = dumps_in(blob)
+        except (OSError, ValueError, ElfError) as e:
+            print(f'{path}: {e}', file=sys.stderr)
+            rc = 1
+            continue
+        if not found:
+            print(f'{path}: no dump', file=sys.stderr)
+            rc = 1
+        # A RAM image that holds the mailbox holds the rest of RAM too.
+        extra = Memory(ram.runs + mem.runs) if mem is not None else ram
+        for slot, dump in found:
+            report(path, slot, dump, dw, ARM, extra, elf, args.frames, args.json)
+    return rc
+
+
+if __name__ == '__main__':
+    raise SystemExit(main())
@@ -0,0 +1,278 @@
+#include "hf_proto.h"
+#include "hardfault_dump.h"
+
+#include <string.h>
+
+/*
+ * Target side of the dump retrieval protocol (see hf_proto.h).
+ *
+ * Only the public dump API is used, so this file has no device dependency
+ * and runs from normal thread context, never from the fault path.
+ */
+
+#define HF_PROTO_SYNC0      'H'
+#define HF_PROTO_SYNC1      'F'
+#define HF_PROTO_HDR_LEN    4u      /* cmd, seq, len u16 */
+#define HF_PROTO_MAX_REQ    16u     /* largest request payload we accept */
+
+/* READ response payload: status, id, off u32, data[] */
+#define HF_PROTO_READ_HDR   6u
+
+typedef enum {
+    RX_SYNC0 = 0,
+    RX_SYNC1,
+    RX_HDR,
+    RX_PAYLOAD,
+    RX_CRC
+} hf_rx_state_t;
+
+static const hf_transport_t *s_tp;
+
+static hf_rx_state_t s_rx_state;
+static uint8_t  s_rx_hdr[HF_PROTO_HDR_LEN];
+static uint8_t  s_rx_payload[HF_PROTO_MAX_REQ];
+static uint8_t  s_rx_crc[4];
+static uint16_t s_rx_len;
+static uint16_t s_rx_pos;
+
+static uint8_t  s_tx_buf[2u + HF_PROTO_HDR_LEN + HF_PROTO_READ_HDR +
+                         HF_PROTO_MAX_CHUNK + 4u];
+
+/* ========================= Little helpers ========================= */
+
+static void put_u16(uint8_t *p, uint16_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static void put_u32(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+static uint16_t get_u16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] | ((uint16_t)p[1] << 8));
+}
+
+static uint32_t get_u32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+           ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+uint32_t HardFaultProto_Crc32(uint32_t crc, const void *data, uint32_t len)
+{
+    /* Nibble-wise table: 64 bytes of flash, fast enough for UART rates. */
+    static const uint32_t tbl[16] = {
+        0x00000000u, 0x1DB71064u, 0x3B6E20C8u, 0x26D930ACu,
+        0x76DC4190u, 0x6B6B51F4u, 0x4DB26158u, 0x5005713Cu,
+        0xEDB88320u, 0xF00F9344u, 0xD6D6A3E8u, 0xCB61B38Cu,
+        0x9B64C2B0u, 0x86D3D2D4u, 0xA00AE278u, 0xBDBDF21Cu
+    };
+    const uint8_t *b = (const uint8_t *)data;
+
+    crc = ~crc;
+    for (uint32_t i = 0; i < len; i++) {
+        crc ^= b[i];
+        crc = (crc >> 4) ^ tbl[crc & 0x0Fu];
+        crc = (crc >> 4) ^ tbl[crc & 0x0Fu];
+    }
+    return ~crc;
+}
+
+/* ========================= Response framing ========================= */
+
+/* Payload is built in place at s_tx_buf[6]; this adds header and CRC. */
+static void hf_send(uint8_t cmd, uint8_t seq, uint16_t len)
+{
+    uint8_t *p = s_tx_buf;
+
+    p[0] = HF_PROTO_SYNC0;
+    p[1] = HF_PROTO_SYNC1;
+    p[2] = (uint8_t)(cmd | HF_PROTO_RESP);
+    p[3] = seq;
+    put_u16(&p[4], len);
+
+    uint32_t crc = HardFaultProto_Crc32(0, &p[2], HF_PROTO_HDR_LEN + len);
+    put_u32(&p[2u + HF_PROTO_HDR_LEN + len], crc);
+
+    s_tp->write(s_tp->ctx, p, 2u + HF_PROTO_HDR_LEN + len + 4u);
+}
+
+static void hf_send_status(uint8_t cmd, uint8_t seq, uint8_t status)
+{
+    s_tx_buf[2u + HF_PROTO_HDR_LEN] = status;
+    hf_send(cmd, seq, 1u);
+}
+
+/* ========================= Command handlers ========================= */
+
+static void hf_cmd_list(uint8_t seq)
+{
+    uint8_t *out = &s_tx_buf[2u + HF_PROTO_HDR_LEN];
+    uint16_t n = 0;
+
+    out[n++] = HF_PROTO_OK;
+    out[n++] = (uint8_t)HF_PROTO_VERSION;
+    put_u16(&out[n], (uint16_t)HF_PROTO_MAX_CHUNK);
+    n += 2u;
+    out[n++] = (uint8_t)HF_DUMP_COUNT;
+
+    for (uint8_t id = 0; id < HF_DUMP_COUNT; id++) {
+        uint32_t size;
+        const uint8_t *dump = HardFault_DumpData(id, &size);
+
+        out[n++] = id;
+        out[n++] = (dump != NULL) ? HF_PROTO_DUMP_VALID : 0u;
+        put_u32(&out[n], size);
+        put_u32(&out[n + 4u], (dump != NULL) ? HardFaultProto_Crc32(0, dump, size) : 0u);
+        n += 8u;
+    }
+
+    hf_send(HF_PROTO_CMD_LIST, seq, n);
+}
+
+static void hf_cmd_read(uint8_t seq, const uint8_t *req, uint16_t len)
+{
+    if (len != 7u) {
+        hf_send_status(HF_PROTO_CMD_READ, seq, HF_PROTO_ERR_ARG);
+        return;
+    }
+
+    const uint8_t  id   = req[0];
+    const uint32_t off  = get_u32(&req[1]);
+    uint32_t       want = get_u16(&req[5]);
+    uint32_t       size = 0u;
+    const uint8_t *dump = (id < HF_DUMP_COUNT) ? HardFault_DumpData(id, &size) : NULL;
+
+    if (dump == NULL) {
+        hf_send_status(HF_PROTO_CMD_READ, seq, HF_PROTO_ERR_NODUMP);
+        return;
+    }
+    if (off > size) {
+        hf_send_status(HF_PROTO_CMD_READ, seq, HF_PROTO_ERR_ARG);
+        return;
+    }
+    if (want > HF_PROTO_MAX_CHUNK) want = HF_PROTO_MAX_CHUNK;
+    if (want > size - off)         want = size - off;
+
+    uint8_t *out = &s_tx_buf[2u + HF_PROTO_HDR_LEN];
+    out[0] = HF_PROTO_OK;
+    out[1] = id;
+    put_u32(&out[2], off);
+    memcpy(&out[HF_PROTO_READ_HDR], &dump[off], want);
+
+    hf_send(HF_PROTO_CMD_READ, seq, (uint16_t)(HF_PROTO_READ_HDR + want));
+}
+
+static void hf_cmd_clear(uint8_t seq, const uint8_t *req, uint16_t len)
+{
+    if (len != 1u || req[0] >= HF_DUMP_COUNT) {
+        hf_send_status(HF_PROTO_CMD_CLEAR, seq, HF_PROTO_ERR_ARG);
+        return;
+    }
+    HardFault_ClearDumpId(req[0]);
+    hf_send_status(HF_PROTO_CMD_CLEAR, seq, HF_PROTO_OK);
+}
+
+static void hf_dispatch(void)
+{
+    const uint8_t  cmd = s_rx_hdr[0];
+    const uint8_t  seq = s_rx_hdr[1];
+
+    switch (cmd) {
+    case HF_PROTO_CMD_LIST:
+        hf_cmd_list(seq);
+        break;
+    case HF_PROTO_CMD_READ:
+        hf_cmd_read(seq, s_rx_payload, s_rx_len);
+        break;
+    case HF_PROTO_CMD_CLEAR:
+        hf_cmd_clear(seq, s_rx_payload, s_rx_len);
+        break;
+    default:
+        hf_send_status(cmd, seq, HF_PROTO_ERR_CMD);
+        break;
+    }
+}
+
+/* ========================= Receive state machine ========================= */
+
+static void hf_rx_byte(uint8_t b)
+{
+    switch (s_rx_state) {
+    case RX_SYNC0:
+        if (b == HF_PROTO_SYNC0) s_rx_state = RX_SYNC1;
+        break;
+
+    case RX_SYNC1:
+        if (b == HF_PROTO_SYNC1) {
+            s_rx_state = RX_HDR;
+            s_rx_pos = 0;
+        } else if (b != HF_PROTO_SYNC0) {
+            s_rx_state = RX_SYNC0;
+        }
+        break;
+
+    case RX_HDR:
+        s_rx_hdr[s_rx_pos++] = b;
+        if (s_rx_pos == HF_PROTO_HDR_LEN) {
+            s_rx_len = get_u16(&s_rx_hdr[2]);
+            s_rx_pos = 0;
+            if (s_rx_len > HF_PROTO_MAX_REQ) {
+                s_rx_state = RX_SYNC0;          /* garbage: hunt again */
+            } else {
+                s_rx_state = (s_rx_len != 0u) ? RX_PAYLOAD : RX_CRC;
+            }
+        }
+        break;
+
+    case RX_PAYLOAD:
+        s_rx_payload[s_rx_pos++] = b;
+        if (s_rx_pos == s_rx_len) {
+            s_rx_pos = 0;
+            s_rx_state = RX_CRC;
+        }
+        break;
+
+    case RX_CRC:
+        s_rx_crc[s_rx_pos++] = b;
+        if (s_rx_pos == 4u) {
+            uint32_t crc = HardFaultProto_Crc32(0, s_rx_hdr, HF_PROTO_HDR_LEN);
+            crc = HardFaultProto_Crc32(crc, s_rx_payload, s_rx_len);
+
+            /* Corrupted requests are dropped silently; the host retries. */
+            if (crc == get_u32(s_rx_crc)) {
+                hf_dispatch();
+            }
+            s_rx_state = RX_SYNC0;
+        }
+        break;
+    }
+}
+
+/* ========================= Public API ========================= */
+
+void HardFaultProto_Init(const hf_transport_t *transport)
+{
+    s_tp = transport;
+    s_rx_state = RX_SYNC0;
+    s_rx_pos = 0;
+}
+
+void HardFaultProto_Poll(void)
+{
+    if (s_tp == NULL) {
+        return;
+    }
+
+    int c;
+    while ((c = s_tp->getc(s_tp->ctx)) >= 0) {
+        hf_rx_byte((uint8_t)c);
+    }
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * On-demand dump retrieval protocol.
+ *
+ * Instead of printing the whole dump on every boot, the target keeps the
+ * dump in .noinit and answers small requests from a host client
+ * (hf_fetch.py) over any byte transport you provide (UART, USB CDC, RTT...).
+ *
+ * Frame (both directions, little-endian):
+ *
+ *   'H' 'F' | cmd u8 | seq u8 | len u16 | payload[len] | crc32 u32
+ *
+ * The CRC-32 (IEEE 802.3, same as zlib.crc32) covers cmd..payload, so every
+ * READ response is a self-checking chunk. Responses echo seq and set bit 7
+ * of cmd; the first payload byte is a status code.
+ *
+ * Commands:
+ *   LIST  ()                       -> status, proto ver, max chunk u16,
+ *                                     count, count x { id u8, flags u8,
+ *                                                      size u32, crc32 u32 }
+ *   READ  (id u8, off u32, len u16) -> status, id u8, off u32, data[...]
+ *   CLEAR (id u8)                  -> status
+ *
+ * The per-dump CRC in LIST lets the host detect that a dump it has partially
+ * fetched is still the same one, and resume from where the link dropped.
+ *
+ * Usage:
+ *   static int  my_getc(void *ctx);                       // -1 if no byte
+ *   static void my_write(void *ctx, const uint8_t *p, uint32_t n);
+ *   static const hf_transport_t t = { my_getc, my_write, NULL };
+ *
+ *   HardFaultProto_Init(&t);
+ *   for (;;) { HardFaultProto_Poll(); ... }
+ */
+
+#define HF_PROTO_VERSION     1u
+
+#ifndef HF_PROTO_MAX_CHUNK
+#define HF_PROTO_MAX_CHUNK   256u   /* max data bytes per READ response */
+#endif
+
+#define HF_PROTO_CMD_LIST    0x01u
+#define HF_PROTO_CMD_READ    0x02u
+#define HF_PROTO_CMD_CLEAR   0x03u
+#define HF_PROTO_RESP        0x80u
+
+#define HF_PROTO_OK          0x00u
+#define HF_PROTO_ERR_CMD     0x01u   /* unknown command */
+#define HF_PROTO_ERR_ARG     0x02u   /* bad length / range */
+#define HF_PROTO_ERR_NODUMP  0x03u   /* no valid dump with that id */
+
+#define HF_PROTO_DUMP_VALID  0x01u   /* LIST flags */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* User-supplied byte transport. */
+typedef struct {
+    /* Return the next received byte (0..255), or -1 if none is pending. */
+    int  (*getc)(void *ctx);
+    /* Send len bytes; may block until they are queued. */
+    void (*write)(void *ctx, const uint8_t *data, uint32_t len);
+    void *ctx;
+} hf_transport_t;
+
+/* Bind the protocol to a transport. The struct must outlive the protocol. */
+void HardFaultProto_Init(const hf_transport_t *transport);
+
+/* Drain pending bytes and answer any complete request. Call periodically. */
+void HardFaultProto_Poll(void);
+
+/* CRC-32 (IEEE, reflected, init/xorout 0xFFFFFFFF) used on the wire. */
+uint32_t HardFaultProto_Crc32(uint32_t crc, const void *data, uint32_t len);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,151 @@
+#pragma once
+
+/*
+ * Power-fail early warning on STM32G4: the programmable voltage detector
+ * (PVD, EXTI line 16) interrupts while VDD is still above the brown-out
+ * level, and the handler programs the persistent records into a flash page
+ * kept erased for it (hf_pvd.ld). Included by hardfault_dump.c when
+ * HF_PVD_SAVE is 1.
+ *
+ * Programming is the standard double-word (PG) mode, one 64-bit write at a
+ * time. Fast programming (FSTPG) writes a 32-double-word row in about a
+ * third of the time, but any flash read while it runs aborts it with
+ * FASTERR, and this handler runs from flash. Cat 3 parts (G47x/G48x) have
+ * 2 KB pages only in dual-bank mode (DBANK = 1, the factory setting).
+ *
+ * Provided to hardfault_dump.c:
+ *   hf_pvd_arm()                    PVD on at HF_PVD_LEVEL, rising edge on
+ *                                   EXTI 16, interrupt enabled
+ *   hf_pvd_ack()                    clear the EXTI pending bit
+ *   hf_pvd_low()                    VDD is below the threshold right now
+ *   hf_pvd_flash_unlock()           / hf_pvd_flash_lock()
+ *   hf_pvd_flash_erase(addr)        erase the page at addr (~22 ms), false on error
+ *   hf_pvd_flash_dw(addr, lo, hi)   program one double word (~82 us), false on error
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * PWR_CR2.PLS: falling thresholds 0 = 2.0 V, 1 = 2.2 V, 2 = 2.4 V,
+ * 3 = 2.5 V, 4 = 2.6 V, 5 = 2.8 V, 6 = 2.9 V (typical, see the datasheet's
+ * PVD table). The higher it is, the more hold-up time the save gets.
+ */
+#ifndef HF_PVD_LEVEL
+#define HF_PVD_LEVEL 6u
+#endif
+
+#ifndef HF_PVD_IRQ_PRIO
+#define HF_PVD_IRQ_PRIO 0u
+#endif
+
+/* Start of bank 2 in dual-bank mode (512 KB parts). */
+#ifndef HF_PVD_BANK2_BASE
+#define HF_PVD_BANK2_BASE 0x08040000u
+#endif
+
+#define HF_PVD_PAGE      2048u
+#define HF_PVD_KEY1      0x45670123u
+#define HF_PVD_KEY2      0xCDEF89ABu
+#define HF_PVD_SR_ERRORS (FLASH_SR_OPERR | FLASH_SR_PROGERR | FLASH_SR_WRPERR | \
+                          FLASH_SR_PGAERR | FLASH_SR_SIZERR | FLASH_SR_PGSERR | \
+                          FLASH_SR_MISERR | FLASH_SR_FASTERR)
+
+/* Bounded: a wedged controller must not keep the handler from returning. */
+#define HF_PVD_BSY_SPIN  0x01000000u
+
+static inline void hf_pvd_arm(void)
+{
+    RCC->APB1ENR1 |= RCC_APB1ENR1_PWREN;
+    (void)RCC->APB1ENR1;
+
+    PWR->CR2 = (PWR->CR2 & ~PWR_CR2_PLS) | (HF_PVD_LEVEL << PWR_CR2_PLS_Pos);
+    PWR->CR2 |= PWR_CR2_PVDE;
+
+    /* PVDO goes high when VDD falls below the threshold: rising edge. */
+    EXTI->RTSR1 |= EXTI_RTSR1_RT16;
+    EXTI->PR1    = EXTI_PR1_PIF16;
+    EXTI->IMR1  |= EXTI_IMR1_IM16;
+
+    NVIC_SetPriority(PVD_PVM_IRQn, HF_PVD_IRQ_PRIO);
+    NVIC_EnableIRQ(PVD_PVM_IRQn);
+}
+
+static inline void hf_pvd_ack(void)
+{
+    EXTI->PR1 = EXTI_PR1_PIF16;
+}
+
+static inline bool hf_pvd_low(void)
+{
+    return (PWR->SR2 & PWR_SR2_PVDO) != 0u;
+}
+
+static inline void hf_pvd_flash_unlock(void)
+{
+    if (FLASH->CR & FLASH_CR_LOCK) {
+        FLASH->KEYR = HF_PVD_KEY1;
+        FLASH->KEYR = HF_PVD_KEY2;
+    }
+}
+
+static inline void hf_pvd_flash_lock(void)
+{
+    FLASH->CR |= FLASH_CR_LOCK;
+}
+
+/* Wait for the operation to end; true if it ended without an error flag. */
+static inline bool hf_pvd_flash_wait(void)
+{
+    for (uint32_t n = 0; FLASH->SR & FLASH_SR_BSY; n++) {
+        if (n == HF_PVD_BSY_SPIN) {
+            return false;
+        }
+    }
+    return (FLASH->SR & HF_PVD_SR_ERRORS) == 0u;
+}
+
+/* Ready for a new operation: not busy, flags of earlier ones cleared. */
+static inline bool hf_pvd_flash_ready(void)
+{
+    (void)hf_pvd_flash_wait();
+    FLASH->SR = HF_PVD_SR_ERRORS | FLASH_SR_EOP;
+    return (FLASH->SR & FLASH_SR_BSY) == 0u;
+}
+
+static inline bool hf_pvd_flash_erase(uint32_t addr)
+{
+    uint32_t off = addr - FLASH_BASE;
+    uint32_t bker = 0;
+
+#ifdef FLASH_OPTR_DBANK
+    if ((FLASH->OPTR & FLASH_OPTR_DBANK) && addr >= HF_PVD_BANK2_BASE) {
+        off  = addr - HF_PVD_BANK2_BASE;
+        bker = FLASH_CR_BKER;
+    }
+#endif
+    if (!hf_pvd_flash_ready()) {
+        return false;
+    }
+    FLASH->CR = (FLASH->CR & ~(FLASH_CR_PNB | FLASH_CR_BKER)) | FLASH_CR_PER | bker |
+                ((off / HF_PVD_PAGE) << FLASH_CR_PNB_Pos);
+    FLASH->CR |= FLASH_CR_STRT;
+    const bool ok = hf_pvd_flash_wait();
+    FLASH->CR &= ~(FLASH_CR_PER | FLASH_CR_PNB | FLASH_CR_BKER);
+    return ok;
+}
+
+/* addr must be 8-aligned and erased; lo goes to addr, hi to addr + 4. */
+static inline bool hf_pvd_flash_dw(uint32_t addr, uint32_t lo, uint32_t hi)
+{
+    if (!hf_pvd_flash_ready()) {
+        return false;
+    }
+    FLASH->CR |= FLASH_CR_PG;
+    *(volatile uint32_t *)addr = lo;
+    __ISB();
+    *(volatile uint32_t *)(addr + 4u) = hi;
+    const bool ok = hf_pvd_flash_wait();
+    FLASH->CR &= ~FLASH_CR_PG;
+    return ok;
+}
@@ -0,0 +1,253 @@
+#!/usr/bin/env python3
+"""Decode dumps straight out of target RAM images (probe reads, core files).
+
+  hf_ramdump.py [--json] --elf firmware.elf [--image ...|--map MAP] IMAGE[@BASE]...
+
+With a probe attached there is no need to wait for the UART print: read the
+dump mailbox with the debugger and decode the file here.
+
+  (gdb)    dump binary memory hf.bin &__hf_dump_start &__hf_dump_end
+  OpenOCD: dump_image hf.bin 0x2001F000 0x1000
+  J-Link:  savemem hf.bin 0x2001F000 0x1000
+
+IMAGE is one of:
+
+  - a raw binary: the mailbox extract above, or a larger RAM dump whose
+    load address is given as IMAGE@0x20000000 (or --base);
+  - an Intel HEX file (*.hex, *.ihex);
+  - an ELF core / memory image (PT_LOAD segments), e.g. from gdb's gcore.
+
+Directories are searched recursively for such files, so a whole batch of
+bench captures is one command.
+
+The mailbox is located with the firmware ELF's __hf_dump_start and
+__hf_dump_end symbols (--area LO-HI for stripped builds). Every slot is
+checked and decoded by libhfdump with the on-target checksum, then symbolized
+exactly like hf_addr2line.py: --image/--map for bootloader + application +
+ROM setups, else the --elf alone. All addresses of all images go to one
+addr2line batch per ELF.
+
+--json prints one JSON object per dump (hf_addr2line.py --json fields plus
+"file"); the default is a short report per image.
+"""
+import argparse
+import json
+import struct
+import sys
+from pathlib import Path
+
+from hf_addr2line import Image, ImageMap, dump_json, image_spec, load_map, symbolize_dumps
+from hf_elf import ElfError, ElfFile
+
+HF_MBOX_MAGIC = 0x424D4648   # hf_abi.h
+HF_MAGIC = 0x48464450
+IMAGE_SUFFIXES = {'.bin', '.raw', '.hex', '.ihex', '.elf', '.core'}
+
+
+# ============================== Memory ==============================
+
+class Memory:
+    """Sparse target memory: sorted, merged (address, bytes) runs."""
+
+    def __init__(self, runs):
+        merged = []
+        for addr, data in sorted(runs, key=lambda r: r[0]):
+            if merged and addr == merged[-1][0] + len(merged[-1][1]):
+                merged[-1][1].extend(data)
+            else:
+                merged.append((addr, bytearray(data)))
+        self.runs = merged
+
+    def read(self, addr: int, size: int):
+        """Bytes at [addr, addr + size), or None if not fully covered."""
+        for base, data in self.runs:
+            if base <= addr and addr + size <= base + len(data):
+                return bytes(data[addr - base:addr - base + size])
+        return None
+
+    def word(self, addr: int):
+        b = self.read(addr, 4)
+        return struct.unpack('<I', b)[0] if b is not None else None
+
+
+def load_ihex(text: str):
+    runs, upper = [], 0
+    for n, line in enumerate(text.splitlines(), 1):
+        line = line.strip()
+        if not line:
+            continue
+        if not line.startswith(':'):
+            raise ValueError(f'line {n}: not an Intel HEX record')
+        rec = bytes.fromhex(line[1:])
+        if len(rec) < 5 or len(rec) != rec[0] + 5 or sum(rec) & 0xFF:
+            raise ValueError(f'line {n}: bad record length or checksum')
+        offset, rtype, data = (rec[1] << 8) | rec[2], rec[3], rec[4:-1]
+        if rtype == 0x00:
+            runs.append((upper + offset, data))
+        elif rtype == 0x01:
+            break
+        elif rtype == 0x02:
+            upper = int.from_bytes(data, 'big') << 4
+        elif rtype == 0x04:
+            upper = int.from_bytes(data, 'big') << 16
+    return runs
+
+
+def load_memory(path: Path, base, area) -> Memory:
+    data = path.read_bytes()
+    if data[:4] == b'\x7fELF':
+        return Memory(ElfFile(path).segments())
+    if path.suffix.lower() in ('.hex', '.ihex') or data[:1] == b':':
+        return Memory(load_ihex(data.decode('ascii', 'replace')))
+    if base is None:
+        if area is None:
+            raise ValueError('raw image without load address; give FILE@BASE or --base')
+        # A mailbox extract: exactly the area, or at least starting with it.
+        magic = struct.unpack_from('<I', data)[0] if len(data) >= 4 else 0
+        if len(data) != area[1] - area[0] and magic != HF_MBOX_MAGIC:
+            raise ValueError('raw image is not a mailbox extract; give FILE@BASE or --base')
+        base = area[0]
+    return Memory([(base, data)])
+
+
+# ============================== Inputs ==============================
+
+def expand(specs, default_base):
+    """(path, base) for every file named or found under a directory."""
+    for spec in specs:
+        path, at, base = spec.rpartition('@') if '@' in spec else (spec, '', '')
+        base = int(base, 0) if at else default_base
+        p = Path(path)
+        if p.is_dir():
+            for f in sorted(p.rglob('*')):
+                if f.is_file() and f.suffix.lower() in IMAGE_SUFFIXES:
+                    yield f, base
+        else:
+            yield p, base
+
+
+def find_area(elf: ElfFile, override):
+    if override:
+        lo, _, hi = override.partition('-')
+        return int(lo, 0), int(hi, 0)
+    lo, hi = elf.symbol('__hf_dump_start'), elf.symbol('__hf_dump_end')
+    if lo is None or hi is None or hi <= lo:
+        raise ValueError(f'{elf.path}: no __hf_dump_start/__hf_dump_end symbols; use --area LO-HI')
+    return lo, hi
+
+
+def rejected_slots(area_bytes: bytes, dumps):
+    """Slots that hold a dump header the decoder refused (torn write, bit
+    flips): the target would treat them as empty, a bench user wants to know."""
+    if len(area_bytes) < 32 or struct.unpack_from('<I', area_bytes)[0] != HF_MBOX_MAGIC:
+        return []
+    hdr_len, _area, slot_size, count = struct.unpack_from('<HIIH', area_bytes, 6)
+    decoded = {d['offset'] for d in dumps}
+    out = []
+    for i in range(count):
+        off = hdr_len + i * slot_size
+        if off + 4 > len(area_bytes):
+            break
+        if off not in decoded and struct.unpack_from('<I', area_bytes, off)[0] == HF_MAGIC:
+            out.append(i)
+    return out
+
+
+# ================================ Report ================================
+
+def print_report(path, area_bytes, dumps, multi: bool):
+    for i in rejected_slots(area_bytes, dumps):
+        print(f'{path}: slot {i}: dump header present but checksum/header invalid')
+    if not dumps:
+        magic = struct.unpack_from('<I', area_bytes)[0]
+        why = 'mailbox empty (no valid slot)' if magic == HF_MBOX_MAGIC \
+            else f'no mailbox (magic 0x{magic:08X}; area never initialised?)'
+        print(f'{path}: {why}')
+        return
+
+    def sym(r):
+        if not r:
+            return '??'
+        return f'{r[0]} ({r[1]})' + (f' [{r[2]}]' if multi else '')
+
+    for d in dumps:
+        task = d.get('task', {}).get('name')
+        print(f'{path}: {d.get("image", "?")} fault #{d.get("fault_count", "?")} '
+              f'{d["class"]}, checksum {d["checksum"]}' + (f', task {task}' if task else ''))
+        print(f'  PC {d["pc"]}  {sym(d["symbols"]["pc"])}')
+        print(f'  LR {d["lr"]}  {sym(d["symbols"]["lr"])}')
+        for b in d['backtrace']:
+            print(f'  [{b["sp"]}] {b["addr"]}  {sym(b["sym"])}')
+
+
+# ================================ CLI ================================
+
+def main() -> int:
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument('--json', action='store_true')
+    ap.add_argument('--elf', required=True, help='firmware ELF with the mailbox symbols')
+    ap.add_argument('--area', help='LO-HI of the mailbox instead of the ELF symbols')
+    ap.add_argument('--base', type=lambda s: int(s, 0),
+                    help='load address of raw images without @BASE')
+    ap.add_argument('--image', action='append', default=[],
+                    help='[NAME=]FILE[@LO-HI] for symbolization, repeatable')
+    ap.add_argument('--map', help='file with NAME FILE [LO-HI] lines')
+    ap.add_argument('images', nargs='+', help='IMAGE[@BASE] or directory')
+    args = ap.parse_args()
+
+    try:
+        import hfdump
+    except ImportError as e:
+        print(f'error: {e}', file=sys.stderr)
+        return 1
+
+    try:
+        elf = ElfFile(args.elf)
+        area = find_area(elf, args.area)
+        images = [image_spec(s) for s in args.image]
+        if args.map:
+            images += load_map(Path(args.map))
+        if images:
+            imap = ImageMap(images)
+        else:
+            imap = ImageMap([Image(elf.path.stem, elf.path, [(0, 1 << 32)])])
+            imap.catch_all = imap.images[0]
+    except (OSError, ValueError, ElfError) as e:
+        print(f'error: {e}', file=sys.stderr)
+        return 1
+    multi = imap.catch_all is None
+
+    rc = 0
+    names, blobs = [], []
+    for path, base in expand(args.images, args.base):
+        try:
+            mem = load_memory(path, base, area)
+        except (OSError, ValueError, ElfError) as e:
+            print(f'{path}: {e}', file=sys.stderr)
+            rc = 1
+            continue
+        blob = mem.read(area[0], area[1] - area[0])
+        if blob is None:
+            print(f'{path}: does not cover the mailbox 0x{area[0]:08X}-0x{area[1]:08X}',
+                  file=sys.stderr)
+            rc = 1
+            continue
+        names.append(path)
+        blobs.append(blob)
+
+    per_blob, _ = symbolize_dumps(blobs, imap, decode=hfdump.parse_mailbox)
+
+    for path, blob, dumps in zip(names, blobs, per_blob):
+        if args.json:
+            for i in rejected_slots(blob, dumps):
+                print(json.dumps({'file': str(path), 'slot': i, 'checksum': 'bad'}))
+            for d in dumps:
+                d['file'] = str(path)
+                print(json.dumps(dump_json(d, multi)))
+        else:
+            print_report(path, blob, dumps, multi)
+    return rc
+
+
+if __name__ == '__main__':
+    raise SystemExit(main())
@@ -0,0 +1,60 @@
+#pragma once
+
+/*
+ * RTOS adapter selection.
+ *
+ * Pick one at compile time with -DHF_RTOS=HF_RTOS_FREERTOS (etc.); the
+ * default is HF_RTOS_NONE (bare metal). The legacy
+ * HF_ENABLE_FREERTOS_SUPPORT switch still selects FreeRTOS.
+ *
+ * Every adapter is a header of static inline accessors that read the
+ * kernel's own current-thread bookkeeping directly, so the fault path has
+ * no indirect calls and no weak-symbol tests:
+ *
+ *   HF_RTOS_STACK_FILL                  word the kernel paints stacks with
+ *   bool        hf_rtos_running(void)   scheduler started, thread valid
+ *   const char *hf_rtos_thread_name(void)      may return NULL
+ *   uint32_t    hf_rtos_thread_priority(void)
+ *   void        hf_rtos_thread_stack(uint32_t *lo, uint32_t *hi)
+ *                                       stack bounds, hi = 0 if unknown
+ *
+ * and the same for any thread by handle (TaskHandle_t, struct k_thread *,
+ * TX_THREAD *, osThreadId_t), for the background stack sampler:
+ *
+ *   const char *hf_rtos_name_of(const void *thread)
+ *   void        hf_rtos_stack_of(const void *thread, uint32_t *lo, uint32_t *hi)
+ *   uint32_t    hf_rtos_tick(void)      kernel tick count, ISR safe
+ *
+ * and the running thread's handle as one plain load, for the shadow call
+ * stack hooks (NULL before the kernel has a current thread):
+ *
+ *   const void *hf_rtos_thread(void)
+ *
+ * The adapter id is stored in hf_dump_hdr_t.rtos_present.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "hf_abi.h"
+
+#if !defined(HF_RTOS) && defined(HF_ENABLE_FREERTOS_SUPPORT)
+  #define HF_RTOS HF_RTOS_FREERTOS
+#endif
+
+#ifndef HF_RTOS
+  #define HF_RTOS HF_RTOS_NONE
+#endif
+
+#if (HF_RTOS == HF_RTOS_NONE)
+  /* Bare metal: nothing to capture. */
+#elif (HF_RTOS == HF_RTOS_FREERTOS)
+  #include "hf_rtos_freertos.h"
+#elif (HF_RTOS == HF_RTOS_ZEPHYR)
+  #include "hf_rtos_zephyr.h"
+#elif (HF_RTOS == HF_RTOS_THREADX)
+  #include "hf_rtos_threadx.h"
+#elif (HF_RTOS == HF_RTOS_RTX5)
+  #include "hf_rtos_rtx5.h"
+#else
+  #error "hardfault_dump: unknown HF_RTOS"
+#endif
@@ -0,0 +1,83 @@
+#pragma once
+
+/*
+ * FreeRTOS adapter (single core).
+ *
+ * Reads the running task's TCB through pxCurrentTCB, using StaticTask_t,
+ * the kernel's public mirror of the private TCB_t layout, instead of
+ * vTaskGetInfo(), which fills a whole TaskStatus_t and scans the stack.
+ *
+ * Requires in FreeRTOSConfig.h:
+ *   #define INCLUDE_xTaskGetSchedulerState   1
+ *   #define configRECORD_STACK_HIGH_ADDRESS  1   (optional: exact stack top)
+ */
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#if defined(configNUMBER_OF_CORES) && (configNUMBER_OF_CORES > 1)
+  #error "hf_rtos_freertos.h: SMP kernels (pxCurrentTCBs[]) are not supported"
+#endif
+
+#define HF_RTOS_STACK_FILL  0xA5A5A5A5u   /* tskSTACK_FILL_BYTE */
+
+/*
+ * Defined in tasks.c as TCB_t * volatile. TCB_t is private, so declare it
+ * as void * and cast: declaring it as StaticTask_t * (a different struct
+ * type) is undefined behaviour and breaks under LTO.
+ */
+extern void * volatile pxCurrentTCB;
+
+static inline const StaticTask_t *hf_freertos_tcb(void)
+{
+    return (const StaticTask_t *)pxCurrentTCB;
+}
+
+static inline bool hf_rtos_running(void)
+{
+    return pxCurrentTCB != NULL &&
+           xTaskGetSchedulerState() != taskSCHEDULER_NOT_STARTED;
+}
+
+static inline const void *hf_rtos_thread(void)
+{
+    return hf_freertos_tcb();
+}
+
+static inline const char *hf_rtos_name_of(const void *thread)
+{
+    return (const char *)((const StaticTask_t *)thread)->ucDummy7;   /* pcTaskName */
+}
+
+static inline void hf_rtos_stack_of(const void *thread, uint32_t *lo, uint32_t *hi)
+{
+    const StaticTask_t *t = (const StaticTask_t *)thread;
+
+    *lo = (uint32_t)t->pxDummy6;                        /* pxStack */
+#if (configRECORD_STACK_HIGH_ADDRESS == 1)
+    /* pxEndOfStack is the last usable word. */
+    *hi = (uint32_t)t->pxDummy8 + sizeof(StackType_t);
+#else
+    *hi = 0;
+#endif
+}
+
+static inline uint32_t hf_rtos_tick(void)
+{
+    return (uint32_t)xTaskGetTickCountFromISR();
+}
+
+static inline const char *hf_rtos_thread_name(void)
+{
+    return hf_rtos_name_of(hf_freertos_tcb());
+}
+
+static inline uint32_t hf_rtos_thread_priority(void)
+{
+    return (uint32_t)hf_freertos_tcb()->uxDummy5;            /* uxPriority */
+}
+
+static inline void hf_rtos_thread_stack(uint32_t *lo, uint32_t *hi)
+{
+    hf_rtos_stack_of(hf_freertos_tcb(), lo, hi);
+}
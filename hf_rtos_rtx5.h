@@ -0,0 +1,60 @@
+#pragma once
+
+/*
+ * Keil RTX5 (CMSIS-RTOS2) adapter.
+ *
+ * osRtxInfo is RTX's global kernel state; the running thread's control
+ * block holds name, priority and stack bounds. Build RTX with
+ * OS_STACK_WATERMARK=1 for a meaningful high-water mark.
+ */
+
+#include "rtx_os.h"
+
+#define HF_RTOS_STACK_FILL  osRtxStackFillPattern
+
+static inline bool hf_rtos_running(void)
+{
+    return osRtxInfo.kernel.state >= osRtxKernelRunning &&
+           osRtxInfo.kernel.state <= osRtxKernelSuspended &&
+           osRtxInfo.thread.run.curr != NULL;
+}
+
+static inline const void *hf_rtos_thread(void)
+{
+    return osRtxInfo.thread.run.curr;
+}
+
+static inline const char *hf_rtos_name_of(const void *thread)
+{
+    return ((const osRtxThread_t *)thread)->name;
+}
+
+static inline void hf_rtos_stack_of(const void *thread, uint32_t *lo, uint32_t *hi)
+{
+    const osRtxThread_t *t = (const osRtxThread_t *)thread;
+
+    /* stack_mem[0] holds osRtxStackMagicWord, not the fill pattern: the
+     * usable stack, and the part watermarking fills, starts above it. */
+    *lo = (uint32_t)t->stack_mem + sizeof(uint32_t);
+    *hi = (uint32_t)t->stack_mem + t->stack_size;
+}
+
+static inline uint32_t hf_rtos_tick(void)
+{
+    return osRtxInfo.kernel.tick;
+}
+
+static inline const char *hf_rtos_thread_name(void)
+{
+    return hf_rtos_name_of(osRtxInfo.thread.run.curr);
+}
+
+static inline uint32_t hf_rtos_thread_priority(void)
+{
+    return (uint32_t)(int32_t)osRtxInfo.thread.run.curr->priority;
+}
+
+static inline void hf_rtos_thread_stack(uint32_t *lo, uint32_t *hi)
+{
+    hf_rtos_stack_of(osRtxInfo.thread.run.curr, lo, hi);
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+/*
+ * Eclipse ThreadX (Azure RTOS) adapter.
+ *
+ * _tx_thread_current_ptr is the kernel's own current-thread pointer; it
+ * stays on the interrupted thread while an ISR runs and is NULL before
+ * tx_kernel_enter() schedules the first thread.
+ */
+
+#include "tx_api.h"
+
+#define HF_RTOS_STACK_FILL  0xEFEFEFEFu   /* TX_STACK_FILL */
+
+extern TX_THREAD *_tx_thread_current_ptr;
+
+static inline bool hf_rtos_running(void)
+{
+    return _tx_thread_current_ptr != TX_NULL;
+}
+
+static inline const void *hf_rtos_thread(void)
+{
+    return _tx_thread_current_ptr;
+}
+
+static inline const char *hf_rtos_name_of(const void *thread)
+{
+    return ((const TX_THREAD *)thread)->tx_thread_name;
+}
+
+static inline void hf_rtos_stack_of(const void *thread, uint32_t *lo, uint32_t *hi)
+{
+    const TX_THREAD *t = (const TX_THREAD *)thread;
+
+    *lo = (uint32_t)t->tx_thread_stack_start;
+    /* tx_thread_stack_end is the last byte of the stack. */
+    *hi = (uint32_t)t->tx_thread_stack_end + 1u;
+}
+
+static inline uint32_t hf_rtos_tick(void)
+{
+    return (uint32_t)tx_time_get();
+}
+
+static inline const char *hf_rtos_thread_name(void)
+{
+    return hf_rtos_name_of(_tx_thread_current_ptr);
+}
+
+static inline uint32_t hf_rtos_thread_priority(void)
+{
+    return (uint32_t)_tx_thread_current_ptr->tx_thread_priority;
+}
+
+static inline void hf_rtos_thread_stack(uint32_t *lo, uint32_t *hi)
+{
+    hf_rtos_stack_of(_tx_thread_current_ptr, lo, hi);
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+/*
+ * Zephyr adapter (single core).
+ *
+ * Zephyr normally owns the fault vectors; this adapter is for builds that
+ * route HardFault to this library instead. It reads _kernel directly.
+ *
+ * Useful Kconfig: CONFIG_THREAD_NAME, CONFIG_THREAD_STACK_INFO,
+ * CONFIG_INIT_STACKS (for the high-water mark).
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/kernel_structs.h>
+
+#define HF_RTOS_STACK_FILL  0xAAAAAAAAu   /* CONFIG_INIT_STACKS pattern */
+
+static inline bool hf_rtos_running(void)
+{
+    return _kernel.cpus[0].current != NULL;
+}
+
+static inline const void *hf_rtos_thread(void)
+{
+    return _kernel.cpus[0].current;
+}
+
+static inline const char *hf_rtos_name_of(const void *thread)
+{
+#ifdef CONFIG_THREAD_NAME
+    return ((const struct k_thread *)thread)->name;
+#else
+    (void)thread;
+    return NULL;
+#endif
+}
+
+static inline void hf_rtos_stack_of(const void *thread, uint32_t *lo, uint32_t *hi)
+{
+#ifdef CONFIG_THREAD_STACK_INFO
+    const struct k_thread *t = (const struct k_thread *)thread;
+
+    *lo = (uint32_t)t->stack_info.start;
+    *hi = (uint32_t)t->stack_info.start + (uint32_t)t->stack_info.size;
+#else
+    (void)thread;
+    *lo = 0;
+    *hi = 0;
+#endif
+}
+
+static inline uint32_t hf_rtos_tick(void)
+{
+    return (uint32_t)k_uptime_ticks();
+}
+
+static inline const char *hf_rtos_thread_name(void)
+{
+    return hf_rtos_name_of(_kernel.cpus[0].current);
+}
+
+static inline uint32_t hf_rtos_thread_priority(void)
+{
+    return (uint32_t)(int32_t)_kernel.cpus[0].current->base.prio;
+}
+
+static inline void hf_rtos_thread_stack(uint32_t *lo, uint32_t *hi)
+{
+    hf_rtos_stack_of(_kernel.cpus[0].current, lo, hi);
+}
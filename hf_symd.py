@@ -0,0 +1,457 @@
+#!/usr/bin/env python3
+"""Symbolization daemon: warm addr2line processes served over a Unix socket.
+
+Every hf_addr2line.py run loads the ELF and parses its DWARF again. This
+daemon keeps one addr2line process per firmware build (keyed by GNU
+build-id, see hf_elf.py) plus a cache of resolved addresses, for the most
+recently used --max-builds builds. The least recently used build is
+evicted first.
+
+Subcommands:
+
+  serve              Run the daemon on --socket.
+  lookup ELF ADDR..  Resolve addresses through the daemon.
+  stats              Print the daemon's counters.
+  bench --elf ELF    Start a daemon and load it with --clients concurrent
+                     clients; compare with one addr2line run per request.
+
+Protocol: one JSON object per line in each direction.
+
+  -> {"elf": "/path/fw.elf", "addrs": [134222388, "0x08000F01"]}
+  -> {"build_id": "9f3c...", "addrs": [...]}      (build already loaded)
+  <- {"ok": true, "build_id": "9f3c...",
+      "symbols": [["main", "Src/main.c", 42], null, ...]}
+
+  -> {"op": "stats"}
+  <- {"ok": true, "builds": [...], "requests": N, ...}
+
+Errors come back as {"ok": false, "error": "..."}; the connection stays
+usable. `null` means addr2line did not know the address. Thumb bit 0 is
+ignored.
+"""
+import argparse
+import asyncio
+import contextlib
+import json
+import os
+import random
+import shutil
+import socket
+import subprocess
+import sys
+import tempfile
+import time
+from collections import OrderedDict
+from pathlib import Path
+
+from hf_addr2line import addr2line_tool
+from hf_elf import ElfFile, ElfError
+
+STT_FUNC = 2
+MAX_LINE = 4 * 1024 * 1024
+
+
+def default_socket() -> str:
+    run = os.environ.get('XDG_RUNTIME_DIR')
+    if run:
+        return os.path.join(run, 'hf_symd.sock')
+    return os.path.join(tempfile.gettempdir(), f'hf_symd-{os.getuid()}.sock')
+
+
+def parse_addr(a) -> int:
+    return (int(a, 0) if isinstance(a, str) else int(a)) & 0xFFFFFFFE
+
+
+# ============================== Builds ==============================
+
+class Build:
+    """One warm addr2line process for one ELF, plus its result cache. The
+    process starts with the first lookup, under the lock."""
+
+    MAX_CACHED = 1 << 16       # resolved addresses kept, least recently used dropped
+
+    def __init__(self, build_id: str, elf: Path):
+        self.build_id = build_id
+        self.elf = elf
+        self.proc = None
+        self.cache = OrderedDict()
+        self.lock = asyncio.Lock()
+        self.hits = 0
+        self.misses = 0
+        self.users = 0         # requests holding it; never evicted while > 0
+
+    async def start(self):
+        self.proc = await asyncio.create_subprocess_exec(
+            addr2line_tool(), '-f', '-C', '-e', str(self.elf),
+            stdin=asyncio.subprocess.PIPE, stdout=asyncio.subprocess.PIPE,
+            stderr=asyncio.subprocess.DEVNULL)
+
+    def _cached(self, addrs, found):
+        missing = []
+        for a in addrs:
+            if a in self.cache:
+                self.cache.move_to_end(a)
+                found[a] = self.cache[a]
+            else:
+                missing.append(a)
+        return missing
+
+    def _remember(self, a, sym):
+        self.cache[a] = sym
+        if len(self.cache) > self.MAX_CACHED:
+            self.cache.popitem(last=False)
+
+    async def lookup(self, addrs):
+        found = {}
+        missing = self._cached(dict.fromkeys(addrs), found)
+        self.hits += len(addrs) - len(missing)
+        self.misses += len(missing)
+        if missing:
+            # One writer/reader at a time: answers come back in order.
+            async with self.lock:
+                missing = self._cached(missing, found)
+                if missing:
+                    try:
+                        found.update(await self._resolve(missing))
+                    except (OSError, ValueError):
+                        self.close()   # half-read answers: restart next time
+                        self.proc = None
+                        raise
+        return [found[a] for a in addrs]
+
+    async def _resolve(self, addrs) -> dict:
+        syms = {}
+        if self.proc is None or self.proc.returncode is not None:
+            await self.start()
+        self.proc.stdin.write(''.join(f'0x{a:08X}\n' for a in addrs).encode())
+        await self.proc.stdin.drain()
+        for a in addrs:
+            func = (await self.proc.stdout.readline()).decode(errors='replace').strip()
+            loc = (await self.proc.stdout.readline()).decode(errors='replace').strip()
+            if not func and not loc:
+                raise OSError(f'{addr2line_tool()} exited')
+            if func == '??':
+                syms[a] = None
+            else:
+                file, _, line = loc.rpartition(':')
+                line = line.split()[0] if line else '0'
+                syms[a] = [func, file, int(line) if line.isdigit() else 0]
+            self._remember(a, syms[a])
+        return syms
+
+    def close(self):
+        if self.proc is not None and self.proc.returncode is None:
+            self.proc.kill()
+
+
+class BuildCache:
+    """LRU of Build objects keyed by build-id."""
+
+    IDS_PER_BUILD = 4          # rebuilt or renamed ELFs remembered per build
+
+    def __init__(self, max_builds: int):
+        self.max_builds = max_builds
+        self.builds = OrderedDict()
+        self.ids = OrderedDict()   # (path, mtime, size) -> build-id, LRU as well
+        self.max_ids = self.IDS_PER_BUILD * max_builds
+        self.hashing = {}          # key -> future of an identity being computed
+        self.evictions = 0
+
+    async def _identity(self, elf: Path) -> str:
+        st = elf.stat()
+        key = (str(elf), st.st_mtime_ns, st.st_size)
+        bid = self.ids.get(key)
+        if bid is not None:
+            self.ids.move_to_end(key)
+            return bid
+        fut = self.hashing.get(key)
+        if fut is not None:            # same ELF asked for again meanwhile
+            return await fut
+        # Hashing a whole image takes long enough to stall other clients.
+        fut = asyncio.get_running_loop().run_in_executor(
+            None, lambda: ElfFile(elf).identity())
+        self.hashing[key] = fut
+        try:
+            bid = await fut
+        finally:
+            del self.hashing[key]
+        self.ids[key] = bid
+        if len(self.ids) > self.max_ids:
+            self.ids.popitem(last=False)
+        return bid
+
+    async def _get(self, elf, build_id) -> Build:
+        if elf is not None:
+            elf = Path(elf).resolve()
+            build_id = await self._identity(elf)
+        # No await from here until the caller pins it: concurrent requests
+        # for a new build all get this one Build and its one addr2line.
+        b = self.builds.get(build_id)
+        if b is None:
+            if elf is None:
+                raise KeyError(f'build {build_id} not loaded; send "elf" once')
+            b = Build(build_id, elf)
+            self.builds[build_id] = b
+        self.builds.move_to_end(build_id)
+        return b
+
+    def _trim(self):
+        # Oldest first, skipping pinned builds: while every build is in use
+        # the cache runs over max_builds until a request finishes.
+        for bid in [k for k, b in self.builds.items() if not b.users]:
+            if len(self.builds) <= self.max_builds:
+                break
+            self.builds.pop(bid).close()
+            self.evictions += 1
+
+    @contextlib.asynccontextmanager
+    async def use(self, elf=None, build_id=None):
+        """The build for an ELF path or a known build-id, pinned until the
+        block exits so that eviction cannot kill its addr2line mid-lookup."""
+        b = await self._get(elf, build_id)
+        b.users += 1
+        self._trim()
+        try:
+            yield b
+        finally:
+            b.users -= 1
+            self._trim()
+
+    def close(self):
+        for b in self.builds.values():
+            b.close()
+
+
+# ============================== Server ==============================
+
+class Server:
+    def __init__(self, path: str, max_builds: int):
+        self.path = path
+        self.cache = BuildCache(max_builds)
+        self.requests = 0
+        self.addresses = 0
+        self.errors = 0
+        self.clients = 0
+
+    async def handle_request(self, req: dict) -> dict:
+        if req.get('op') == 'stats':
+            return {'ok': True, 'requests': self.requests, 'addresses': self.addresses,
+                    'errors': self.errors, 'clients': self.clients,
+                    'evictions': self.cache.evictions,
+                    'builds': [{'build_id': b.build_id, 'elf': str(b.elf),
+                                'cached': len(b.cache), 'hits': b.hits,
+                                'misses': b.misses}
+                               for b in self.cache.builds.values()]}
+
+        addrs = [parse_addr(a) for a in req.get('addrs', [])]
+        async with self.cache.use(req.get('elf'), req.get('build_id')) as build:
+            self.requests += 1
+            self.addresses += len(addrs)
+            return {'ok': True, 'build_id': build.build_id,
+                    'symbols': await build.lookup(addrs)}
+
+    async def client(self, reader, writer):
+        self.clients += 1
+        try:
+            while True:
+                line = await reader.readline()
+                if not line:
+                    break
+                try:
+                    resp = await self.handle_request(json.loads(line))
+                except (ValueError, KeyError, OSError, ElfError) as e:
+                    self.errors += 1
+                    msg = e.args[0] if isinstance(e, KeyError) else str(e)
+                    resp = {'ok': False, 'error': msg}
+                writer.write(json.dumps(resp, separators=(',', ':')).encode() + b'\n')
+                await writer.drain()
+        except (ConnectionError, asyncio.LimitOverrunError, ValueError):
+            pass
+        finally:
+            self.clients -= 1
+            writer.close()
+
+    async def run(self):
+        if os.path.exists(self.path):
+            os.unlink(self.path)   # stale socket from a previous run
+        srv = await asyncio.start_unix_server(self.client, self.path, limit=MAX_LINE)
+        os.chmod(self.path, 0o600)
+        print(f'hf_symd: listening on {self.path}', file=sys.stderr, flush=True)
+        try:
+            async with srv:
+                await srv.serve_forever()
+        finally:
+            self.cache.close()
+            if os.path.exists(self.path):
+                os.unlink(self.path)
+
+
+# ============================== Client ==============================
+
+class SymdClient:
+    """Blocking client; one connection, requests in sequence."""
+
+    def __init__(self, path: str = None, timeout: float = 30.0):
+        self.sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        self.sock.settimeout(timeout)
+        self.sock.connect(path or default_socket())
+        self.rfile = self.sock.makefile('rb')
+
+    def call(self, req: dict) -> dict:
+        self.sock.sendall(json.dumps(req).encode() + b'\n')
+        line = self.rfile.readline()
+        if not line:
+            raise ConnectionError('hf_symd closed the connection')
+        resp = json.loads(line)
+        if not resp.get('ok'):
+            raise RuntimeError(resp.get('error', 'hf_symd error'))
+        return resp
+
+    def lookup(self, elf, addrs):
+        """List of (function, file, line) or None, in the order of addrs."""
+        # The daemon has its own working directory.
+        resp = self.call({'elf': str(Path(elf).resolve()), 'addrs': [int(a) for a in addrs]})
+        return [tuple(s) if s else None for s in resp['symbols']]
+
+    def close(self):
+        self.rfile.close()
+        self.sock.close()
+
+
+# =============================== Bench ===============================
+
+def code_addresses(elf: Path, n: int, seed: int = 1):
+    funcs = [v for entries in ElfFile(elf).symbols().values() for v, size, t in entries
+             if t == STT_FUNC and size > 0 and v]
+    if not funcs:
+        raise SystemExit(f'{elf}: no function symbols')
+    rnd = random.Random(seed)
+    return [rnd.choice(funcs) + 2 * rnd.randrange(4) for _ in range(n)]
+
+
+def percentile(sorted_vals, p):
+    if not sorted_vals:
+        return 0.0
+    return sorted_vals[min(len(sorted_vals) - 1, int(p / 100 * len(sorted_vals)))]
+
+
+async def bench_clients(path, elf, clients, requests, batch, pool):
+    lat = []
+
+    async def one(idx):
+        reader, writer = await asyncio.open_unix_connection(path, limit=MAX_LINE)
+        rnd = random.Random(idx)
+        for _ in range(requests):
+            addrs = [rnd.choice(pool) for _ in range(batch)]
+            t0 = time.perf_counter()
+            writer.write(json.dumps({'elf': str(elf), 'addrs': addrs}).encode() + b'\n')
+            await writer.drain()
+            resp = json.loads(await reader.readline())
+            lat.append(time.perf_counter() - t0)
+            if not resp.get('ok'):
+                raise RuntimeError(resp.get('error'))
+        writer.close()
+
+    t0 = time.perf_counter()
+    await asyncio.gather(*(one(i) for i in range(clients)))
+    return time.perf_counter() - t0, sorted(lat)
+
+
+def bench(args) -> int:
+    elf = Path(args.elf).resolve()
+    pool = code_addresses(elf, 4096)
+    tmp = tempfile.mkdtemp(prefix='hf_symd_')
+    path = os.path.join(tmp, 'symd.sock')
+    server = subprocess.Popen([sys.executable, os.path.abspath(__file__),
+                               '--socket', path, 'serve', '--max-builds', '4'],
+                              stderr=subprocess.DEVNULL)
+    try:
+        for _ in range(100):
+            if os.path.exists(path) or server.poll() is not None:
+                break
+            time.sleep(0.05)
+        if not os.path.exists(path):
+            raise SystemExit('hf_symd: daemon did not start')
+
+        # Baseline: what a one-shot tool pays per request.
+        t0 = time.perf_counter()
+        for i in range(args.cold):
+            subprocess.run([addr2line_tool(), '-f', '-C', '-e', str(elf)] +
+                           [f'0x{a:08X}' for a in pool[i * args.batch:(i + 1) * args.batch]],
+                           stdout=subprocess.DEVNULL, check=True)
+        cold = (time.perf_counter() - t0) / max(1, args.cold)
+
+        print(f'{args.clients} clients x {args.requests} requests x {args.batch} addresses, '
+              f'{elf.name}')
+        print(f'one addr2line per request: {cold * 1000:8.2f} ms/request')
+        print(f'{"pass":>6} {"req/s":>9} {"addr/s":>10} {"p50 ms":>8} {"p99 ms":>8} {"max ms":>8}')
+        for name in ('cold', 'warm'):
+            secs, lat = asyncio.run(bench_clients(path, elf, args.clients, args.requests,
+                                                  args.batch, pool))
+            n = len(lat)
+            print(f'{name:>6} {n / secs:9.0f} {n * args.batch / secs:10.0f} '
+                  f'{percentile(lat, 50) * 1000:8.2f} {percentile(lat, 99) * 1000:8.2f} '
+                  f'{lat[-1] * 1000:8.2f}')
+    finally:
+        server.terminate()
+        server.wait()
+        shutil.rmtree(tmp, ignore_errors=True)
+    return 0
+
+
+# ================================ CLI ================================
+
+def main() -> int:
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument('--socket', default=default_socket())
+    sub = ap.add_subparsers(dest='cmd', required=True)
+
+    p = sub.add_parser('serve')
+    p.add_argument('--max-builds', type=int, default=8)
+
+    p = sub.add_parser('lookup')
+    p.add_argument('elf')
+    p.add_argument('addrs', nargs='+')
+
+    sub.add_parser('stats')
+
+    p = sub.add_parser('bench')
+    p.add_argument('--elf', required=True)
+    p.add_argument('--clients', type=int, default=32)
+    p.add_argument('--requests', type=int, default=200)
+    p.add_argument('--batch', type=int, default=8)
+    p.add_argument('--cold', type=int, default=20,
+                   help='one-shot addr2line runs for the baseline')
+
+    args = ap.parse_args()
+
+    if args.cmd == 'serve':
+        try:
+            asyncio.run(Server(args.socket, args.max_builds).run())
+        except KeyboardInterrupt:
+            pass
+        return 0
+    if args.cmd == 'bench':
+        return bench(args)
+
+    try:
+        client = SymdClient(args.socket)
+        if args.cmd == 'stats':
+            print(json.dumps(client.call({'op': 'stats'}), indent=2))
+            return 0
+        addrs = [int(a, 0) for a in args.addrs]
+        syms = client.lookup(args.elf, addrs)
+    except (OSError, RuntimeError) as e:
+        print(f'hf_symd: {e}', file=sys.stderr)
+        return 1
+
+    for a, sym in zip(addrs, syms):
+        print(f'0x{a:08X}:')
+        print(sym[0] if sym else '??')
+        print(f'{sym[1]}:{sym[2]}' if sym else '??:0')
+        print()
+    return 0
+
+
+if __name__ == '__main__':
+    raise SystemExit(main())
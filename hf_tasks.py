@@ -0,0 +1,363 @@
+#!/usr/bin/env python3
+"""Backtrace of every FreeRTOS task from a RAM image, like gdb's
+`thread apply all bt`.
+
+  hf_tasks.py [--json] --elf firmware.elf [--image ...|--map MAP] RAM[@BASE]...
+
+RAM is anything hf_ramdump.py reads (raw read at BASE, Intel HEX, ELF
+core); several files are combined, so a full-RAM read plus extra captured
+regions work together. The kernel's task lists are found by symbol
+(pxCurrentTCB, pxReadyTasksLists, xDelayedTaskList1/2, xPendingReadyList,
+xTasksWaitingTermination, xSuspendedTaskList); every TCB on them is read.
+
+For a task that is not running, pxTopOfStack points at the context the port
+saved on its stack: R4-R11 (and EXC_RETURN, plus S16-S31 if the task used
+the FPU, on the CM4F/CM7 port), then the hardware frame with R0-R3, R12, LR,
+PC and xPSR. The running task's saved context is stale; if the mailbox in the
+image holds a dump for that task (same name and stack base), its registers
+are used instead.
+
+Unwinding is the same heuristic the dump's backtrace uses: PC, LR, then
+words above SP that are Thumb return addresses into code. For ARM ELFs a
+candidate must also follow a BL/BLX, which removes most false hits.
+
+TCB and list layouts (TCB_t in tasks.c, list.h) follow the kernel options:
+--list-integrity for configUSE_LIST_DATA_INTEGRITY_CHECK_BYTES,
+--mpu-settings N for MPU wrappers (N = sizeof(xMPU_SETTINGS) of the port),
+--no-mini-list-item for configUSE_MINI_LIST_ITEM 0 and --name-len for
+configMAX_TASK_NAME_LEN. --name-offset overrides where pcTaskName is.
+"""
+import argparse
+import bisect
+import json
+import struct
+import sys
+from pathlib import Path
+
+from hf_addr2line import Image, ImageMap, image_spec, load_map, symbol_json
+from hf_elf import EM_ARM, ElfError, ElfFile
+from hf_ramdump import Memory, expand, load_memory
+
+LISTS = [('pxReadyTasksLists', 'ready'), ('xDelayedTaskList1', 'blocked'),
+         ('xDelayedTaskList2', 'blocked'), ('xPendingReadyList', 'ready'),
+         ('xTasksWaitingTermination', 'deleted'), ('xSuspendedTaskList', 'suspended')]
+
+MAX_TASKS = 256
+MAX_SCAN = 2048      # bytes above SP scanned when the stack top is unknown
+
+
+class Layout:
+    """Offsets in TCB_t, ListItem_t and List_t for a 32-bit target."""
+
+    def __init__(self, integrity: bool = False, mpu_settings: int = 0,
+                 mini_list_item: bool = True, name_offset: int = None, name_len: int = 16):
+        chk = 4 if integrity else 0                    # one check word at each end
+        # ListItem_t: [chk] xItemValue pxNext pxPrevious pvOwner pxContainer [chk]
+        self.item_next = chk + 4
+        self.item_owner = chk + 12
+        self.list_item = chk + 20 + chk
+        # MiniListItem_t: [chk] xItemValue pxNext pxPrevious
+        mini = chk + 12 if mini_list_item else self.list_item
+        # List_t: [chk] uxNumberOfItems pxIndex xListEnd [chk]
+        self.list_end = chk + 8
+        self.list = self.list_end + mini + chk
+        # TCB_t: pxTopOfStack [xMPUSettings] xStateListItem xEventListItem
+        #        uxPriority pxStack pcTaskName[] [pxEndOfStack]
+        self.priority = 4 + mpu_settings + 2 * self.list_item
+        self.stack = self.priority + 4
+        self.name = name_offset if name_offset is not None else self.stack + 4
+        self.name_len = name_len
+        self.end_of_stack = self.name + name_len       # pxEndOfStack, if recorded
+
+
+# =============================== Kernel ===============================
+
+class Kernel:
+    def __init__(self, elf: ElfFile, mem: Memory, layout: Layout):
+        self.elf = elf
+        self.mem = mem
+        self.lay = layout
+
+    def word(self, addr: int):
+        return self.mem.word(addr)
+
+    def walk(self, list_addr: int):
+        """TCB addresses on one List_t, in list order."""
+        lay = self.lay
+        end = list_addr + lay.list_end
+        item = self.word(end + lay.item_next)          # xListEnd.pxNext
+        seen = 0
+        while item is not None and item != end and seen < MAX_TASKS:
+            owner = self.word(item + lay.item_owner)   # pvOwner
+            if owner is None:
+                break
+            yield owner
+            item = self.word(item + lay.item_next)     # pxNext
+            seen += 1
+
+    def tasks(self):
+        """[(tcb, state)]: every TCB found, current task first."""
+        syms = self.elf.symbols()
+        if 'pxCurrentTCB' not in syms:
+            raise ValueError(f'{self.elf.path}: no pxCurrentTCB symbol (not a FreeRTOS build?)')
+        current = self.word(syms['pxCurrentTCB'][0][0])
+        if current is None:
+            raise ValueError('RAM image does not cover pxCurrentTCB')
+
+        found = {}
+        for name, state in LISTS:
+            if name not in syms:
+                continue
+            addr, size, _ = syms[name][0]
+            count = max(1, size // self.lay.list) if name == 'pxReadyTasksLists' else 1
+            for i in range(count):
+                for tcb in self.walk(addr + i * self.lay.list):
+                    found.setdefault(tcb, state)
+        # A task blocked without timeout sits on xSuspendedTaskList, so
+        # 'suspended' also covers waiting forever on a queue or semaphore.
+        if current:
+            found.pop(current, None)
+            return [(current, 'running')] + list(found.items())
+        return list(found.items())
+
+    def tcb(self, addr: int) -> dict:
+        lay = self.lay
+        raw = self.mem.read(addr + lay.name, lay.name_len) or b''
+        stack = self.word(addr + lay.stack)
+        end = self.word(addr + lay.end_of_stack)
+        # pxEndOfStack only exists with configRECORD_STACK_HIGH_ADDRESS;
+        # otherwise the word there is something else. Keep it if plausible.
+        if end is None or stack is None or not stack < end <= stack + 0x40000:
+            end = None
+        return {
+            'tcb': addr,
+            'name': raw.split(b'\0', 1)[0].decode('utf-8', 'replace'),
+            'priority': self.word(addr + lay.priority),
+            'top': self.word(addr),
+            'stack': stack,
+            'stack_end': end + 4 if end is not None else None,
+        }
+
+
+def saved_context(mem: Memory, top: int, fpu_port: bool):
+    """Registers a FreeRTOS context switch left at pxTopOfStack:
+    {'r4'..'r11', 'lr', 'pc', 'psr', 'sp'} or None if not readable."""
+    n = 9 if fpu_port else 8
+    sw = mem.read(top, 4 * n)
+    if sw is None:
+        return None
+    words = struct.unpack(f'<{n}I', sw)
+    regs = {f'r{4 + i}': words[i] for i in range(8)}
+    frame = top + 4 * n
+    exc_return = words[8] if fpu_port else 0xFFFFFFFD
+    if not exc_return & 0x10:
+        frame += 16 * 4                                # S16-S31
+    hw = mem.read(frame, 32)
+    if hw is None:
+        return None
+    r0, r1, r2, r3, r12, lr, pc, psr = struct.unpack('<8I', hw)
+    regs.update(r0=r0, r1=r1, r2=r2, r3=r3, r12=r12, lr=lr, pc=pc, psr=psr)
+    # Caller's SP: past the frame, the FP extension and the alignment pad.
+    sp = frame + (32 if exc_return & 0x10 else 32 + 18 * 4)
+    if psr & (1 << 9):
+        sp += 4
+    regs['sp'] = sp
+    return regs
+
+
+# ============================== Unwinding ==============================
+
+class CodeCheck:
+    """Is an address a plausible return address? In an image's code and,
+    where the bytes are known, right after a BL/BLX."""
+
+    def __init__(self, elf: ElfFile, imap: ImageMap):
+        self.imap = imap
+        self.elfs = {}
+        if imap.catch_all is None:
+            for img in imap.images:
+                if img.elf is not None:
+                    self.elfs[img] = img.elf
+            self.ranges = None
+        else:
+            self.elfs[imap.catch_all] = elf
+            self.ranges = elf.code_ranges()
+            self.starts = [r[0] for r in self.ranges]
+
+    def owner(self, addr: int):
+        if self.ranges is None:
+            return self.imap.image_for(addr)
+        i = bisect.bisect_right(self.starts, addr) - 1
+        return self.imap.catch_all if i >= 0 and addr < self.ranges[i][1] else None
+
+    def is_return(self, addr: int) -> bool:
+        if not addr & 1:
+            return False
+        ret = addr & ~1
+        img = self.owner(ret)
+        if img is None:
+            return False
+        elf = self.elfs.get(img)
+        if elf is None or elf.machine != EM_ARM:
+            return True
+        hw = elf.read(ret - 4, 4)
+        if hw is None:
+            return False
+        h1, h2 = struct.unpack('<HH', hw)
+        return ((h1 & 0xF800) == 0xF000 and (h2 & 0xC000) == 0xC000) or \
+            (h2 & 0xFF87) == 0x4780                    # BL/BLX imm, BLX Rm
+
+
+def unwind(mem: Memory, regs: dict, stack_end, check: CodeCheck, max_frames: int):
+    """[(addr, sp or None)]: PC, LR if it is code, then return addresses on
+    the stack above SP."""
+    frames = [(regs['pc'], None)]
+    if check.is_return(regs['lr'] | 1) and (regs['lr'] & ~1) != regs['pc']:
+        frames.append((regs['lr'], None))
+    sp = regs['sp']
+    end = stack_end if stack_end and stack_end > sp else sp + MAX_SCAN
+    end = min(end, sp + 0x10000)
+    data = mem.read(sp, end - sp)
+    while data is None and end > sp + 4:               # clip to what was captured
+        end -= 4 if end - sp <= 64 else (end - sp) // 2
+        data = mem.read(sp, end - sp)
+    if data is None:
+        return frames
+    for i in range(0, len(data) - 3, 4):
+        w = struct.unpack_from('<I', data, i)[0]
+        if check.is_return(w) and (not frames or frames[-1][0] != w):
+            frames.append((w, sp + i))
+            if len(frames) >= max_frames:
+                break
+    return frames
+
+
+def mailbox_dumps(elf: ElfFile, mem: Memory):
+    """Dumps in the image's mailbox, any slot."""
+    lo, hi = elf.symbol('__hf_dump_start'), elf.symbol('__hf_dump_end')
+    if lo is None or hi is None:
+        return []
+    blob = mem.read(lo, hi - lo)
+    if blob is None:
+        return []
+    try:
+        import hfdump
+    except ImportError:
+        return []
+    return hfdump.parse_mailbox(blob)
+
+
+def dump_for(dumps, t: dict):
+    """The dump taken while task t ran: same name and stack base. Each slot
+    counts its own faults, so fault_count cannot say which dump is newer;
+    the task itself can."""
+    for d in dumps:
+        task = d.get('task', {})
+        base = task.get('stack_base')
+        if task.get('name') == t['name'] and base is not None and \
+                t['stack'] is not None and int(base, 16) == t['stack']:
+            return d
+    return None
+
+
+# ================================ CLI ================================
+
+def main() -> int:
+    ap = argparse.ArgumentParser(description='Backtrace every FreeRTOS task from RAM.')
+    ap.add_argument('--json', action='store_true')
+    ap.add_argument('--elf', required=True)
+    ap.add_argument('--base', type=lambda s: int(s, 0),
+                    help='load address of raw images without @BASE')
+    ap.add_argument('--image', action='append', default=[],
+                    help='[NAME=]FILE[@LO-HI] for symbolization, repeatable')
+    ap.add_argument('--map', help='file with NAME FILE [LO-HI] lines')
+    ap.add_argument('--port', choices=('cm4f', 'cm3'), default='cm4f',
+                    help='FreeRTOS port: cm4f/cm7 save EXC_RETURN, cm3/cm0 do not')
+    ap.add_argument('--list-integrity', action='store_true',
+                    help='configUSE_LIST_DATA_INTEGRITY_CHECK_BYTES is 1')
+    ap.add_argument('--mpu-settings', type=int, default=0, metavar='BYTES',
+                    help='sizeof(xMPU_SETTINGS) with MPU wrappers, else 0')
+    ap.add_argument('--no-mini-list-item', dest='mini_list_item', action='store_false',
+                    help='configUSE_MINI_LIST_ITEM is 0')
+    ap.add_argument('--name-offset', type=int, help='pcTaskName offset in TCB_t')
+    ap.add_argument('--name-len', type=int, default=16, help='configMAX_TASK_NAME_LEN')
+    ap.add_argument('--frames', type=int, default=16, help='max frames per task')
+    ap.add_argument('ram', nargs='+', help='RAM[@BASE] (combined)')
+    args = ap.parse_args()
+
+    try:
+        elf = ElfFile(args.elf)
+        runs = []
+        for path, base in expand(args.ram, args.base):
+            runs += load_memory(path, base, None).runs
+        mem = Memory(runs)
+        images = [image_spec(s) for s in args.image]
+        if args.map:
+            images += load_map(Path(args.map))
+        if images:
+            imap = ImageMap(images)
+        else:
+            imap = ImageMap([Image(elf.path.stem, elf.path, [(0, 1 << 32)])])
+            imap.catch_all = imap.images[0]
+        kernel = Kernel(elf, mem, Layout(args.list_integrity, args.mpu_settings,
+                                         args.mini_list_item, args.name_offset, args.name_len))
+        task_list = kernel.tasks()
+    except (OSError, ValueError, ElfError) as e:
+        print(f'error: {e}', file=sys.stderr)
+        return 1
+
+    check = CodeCheck(elf, imap)
+    dumps = mailbox_dumps(elf, mem)
+    threads = []
+    for tcb, state in task_list:
+        t = kernel.tcb(tcb)
+        t['state'] = state
+        regs = saved_context(mem, t['top'], args.port == 'cm4f') if t['top'] else None
+        dump = dump_for(dumps, t) if state == 'running' else None
+        if dump:
+            regs = {'pc': int(dump['pc'], 16), 'lr': int(dump['lr'], 16),
+                    'sp': int(dump['active_sp'], 16)}
+            t['state'] = 'faulted'
+        t['frames'] = unwind(mem, regs, t['stack_end'], check, args.frames) if regs else []
+        t['sp'] = regs['sp'] if regs else None
+        threads.append(t)
+
+    addrs = list(dict.fromkeys(a & ~1 for t in threads for a, _ in t['frames']))
+    resolved = imap.resolve(addrs)
+    multi = imap.catch_all is None
+
+    if args.json:
+        for n, t in enumerate(threads, 1):
+            rec = {'thread': n, 'name': t['name'], 'state': t['state'],
+                   'priority': t['priority'], 'tcb': f'0x{t["tcb"]:08X}',
+                   'sp': f'0x{t["sp"]:08X}' if t['sp'] is not None else None,
+                   'frames': []}
+            for a, sp in t['frames']:
+                f = {'addr': f'0x{a:08X}'}
+                if sp is not None:
+                    f['sp'] = f'0x{sp:08X}'
+                f.update(symbol_json(resolved[a & ~1], multi))
+                rec['frames'].append(f)
+            print(json.dumps(rec))
+        return 0
+
+    for n, t in enumerate(threads, 1):
+        sp = f'0x{t["sp"]:08X}' if t['sp'] is not None else '?'
+        prio = t['priority'] if t['priority'] is not None else '?'
+        print(f'Thread {n} "{t["name"]}" ({t["state"]}, prio {prio}) '
+              f'TCB 0x{t["tcb"]:08X}  SP {sp}')
+        if not t['frames']:
+            print('    <TCB or saved context not in the image>')
+        for i, (a, fsp) in enumerate(t['frames']):
+            r = resolved[a & ~1]
+            func, loc = (r[0], r[1]) if r else ('??', '??:0')
+            where = f' at {loc}' if loc and not loc.startswith('??') else ''
+            img = f'  [{r[2]}]' if multi and r else ''
+            at_sp = f'  (sp 0x{fsp:08X})' if fsp is not None else ''
+            print(f'#{i:<2} 0x{a & ~1:08X} in {func} (){where}{img}{at_sp}')
+        print()
+    return 0
+
+
+if __name__ == '__main__':
+    raise SystemExit(main())
@@ -0,0 +1,214 @@
+#!/usr/bin/env python3
+"""Python bindings for libhfdump (libhfdump/hfdump.h), via ctypes.
+
+Build the library first:
+
+  c++ -std=c++17 -O2 -fPIC -shared -o libhfdump.so libhfdump/hfdump.cpp libhfdump/hfdump_scan.cpp
+
+It is looked up in $HFDUMP_LIB, then next to this file.
+
+  import hfdump
+  for d in hfdump.parse_text(open('uart.log').read()):
+      print(d['class'], d['pc'])
+
+`python hfdump.py bench-scan CAPTURE` compares the native scanner with the
+regex scan hf_addr2line.py used to do.
+
+Every parse_* and scan() returns a list of dicts with the same keys as the
+`hfdump` CLI's JSON lines. `symbolize`, if given, is called as symbolize(addr) and
+returns None or (function, file, line).
+"""
+import ctypes
+import json
+import mmap
+import os
+import re
+import struct
+import sys
+import time
+from pathlib import Path
+from typing import Callable, List, Optional, Tuple
+
+# hf_dump_hdr_t up to v6 (hf_abi.h), for tools that re-encode the raw words of
+# a dump the library has found and checked.
+HDR = struct.Struct('<IHH6I7I8I4I17sIIHHIIIII')
+FIELDS = ('magic version header_len exc_return msp psp active_sp used_sp has_fp '
+          'cfsr hfsr dfsr mmfar bfar afsr shcsr r0 r1 r2 r3 r12 lr pc psr '
+          'rtos priority min_free stack_base task_name stack_bytes checksum '
+          'arch flags sp_limit msp_limit msp_max_used ext_bytes ext_checksum').split()
+CHECKSUM_OFF = 129
+
+Symbol = Tuple[str, str, int]
+Symbolizer = Callable[[int], Optional[Symbol]]
+
+_SYMBOLIZE_FN = ctypes.CFUNCTYPE(
+    ctypes.c_int, ctypes.c_void_p, ctypes.c_uint32,
+    ctypes.c_void_p, ctypes.c_size_t,
+    ctypes.c_void_p, ctypes.c_size_t,
+    ctypes.POINTER(ctypes.c_uint32),
+    ctypes.c_void_p, ctypes.c_size_t)
+
+_lib = None
+
+
+def _load() -> ctypes.CDLL:
+    global _lib
+    if _lib is not None:
+        return _lib
+
+    path = os.environ.get('HFDUMP_LIB') or str(Path(__file__).resolve().parent / 'libhfdump.so')
+    try:
+        lib = ctypes.CDLL(path)
+    except OSError as e:
+        raise ImportError(
+            f'libhfdump not found at {path} ({e}); build it with: '
+            'c++ -std=c++17 -O2 -fPIC -shared -o libhfdump.so '
+            'libhfdump/hfdump.cpp libhfdump/hfdump_scan.cpp') from e
+
+    for name in ('hfd_parse_text_json', 'hfd_parse_binary_json', 'hfd_parse_mailbox_json',
+                 'hfd_scan_json'):
+        fn = getattr(lib, name)
+        fn.argtypes = [ctypes.c_char_p, ctypes.c_size_t, _SYMBOLIZE_FN, ctypes.c_void_p]
+        fn.restype = ctypes.c_void_p   # keep the pointer so it can be freed
+    lib.hfd_scan_impl_json.argtypes = [ctypes.c_char_p, ctypes.c_size_t, ctypes.c_int,
+                                       _SYMBOLIZE_FN, ctypes.c_void_p]
+    lib.hfd_scan_impl_json.restype = ctypes.c_void_p
+    lib.hfd_scan_count.argtypes = [ctypes.c_void_p, ctypes.c_size_t, ctypes.c_int]
+    lib.hfd_scan_count.restype = ctypes.c_size_t
+    lib.hfd_scan_impl.argtypes = [ctypes.c_int]
+    lib.hfd_scan_impl.restype = ctypes.c_char_p
+    lib.hfd_count_text.argtypes = [ctypes.c_char_p, ctypes.c_size_t]
+    lib.hfd_count_text.restype = ctypes.c_size_t
+    lib.hfd_free.argtypes = [ctypes.c_void_p]
+    lib.hfd_free.restype = None
+    lib.hfd_version.restype = ctypes.c_char_p
+
+    _lib = lib
+    return lib
+
+
+def _put(dst: int, cap: int, s: str) -> None:
+    b = s.encode('utf-8', 'replace')[:cap - 1]
+    ctypes.memmove(dst, b + b'\0', len(b) + 1)
+
+
+def _callback(symbolize: Optional[Symbolizer]):
+    if symbolize is None:
+        return _SYMBOLIZE_FN()   # NULL
+
+    def cb(_user, addr, func, func_len, file, file_len, line, image, image_len):
+        try:
+            sym = symbolize(addr)
+        except Exception:   # an exception must not cross into C++
+            return 0
+        if not sym:
+            return 0
+        _put(func, func_len, sym[0])
+        _put(file, file_len, sym[1])
+        line[0] = int(sym[2]) & 0xFFFFFFFF
+        _put(image, image_len, sym[3] if len(sym) > 3 else '')
+        return 1
+
+    return _SYMBOLIZE_FN(cb)
+
+
+def _call(fn_name: str, data: bytes, symbolize: Optional[Symbolizer], *args) -> List[dict]:
+    lib = _load()
+    cb = _callback(symbolize)
+    ptr = getattr(lib, fn_name)(data, len(data), *args, cb, None)
+    if not ptr:
+        raise MemoryError('libhfdump: out of memory')
+    try:
+        return json.loads(ctypes.string_at(ptr).decode('utf-8', 'replace'))
+    finally:
+        lib.hfd_free(ptr)
+
+
+def parse_text(text, symbolize: Optional[Symbolizer] = None) -> List[dict]:
+    """Dump blocks and lone HF_ADDR lines in a UART/RTT log."""
+    if isinstance(text, str):
+        text = text.encode('utf-8', 'replace')
+    return _call('hfd_parse_text_json', text, symbolize)
+
+
+def parse_binary(data: bytes, symbolize: Optional[Symbolizer] = None) -> List[dict]:
+    """One raw dump (header + payload), e.g. as saved by hf_fetch.py."""
+    return _call('hfd_parse_binary_json', bytes(data), symbolize)
+
+
+def parse_mailbox(data: bytes, symbolize: Optional[Symbolizer] = None) -> List[dict]:
+    """Every valid slot of a mailbox image read from __hf_dump_start."""
+    return _call('hfd_parse_mailbox_json', bytes(data), symbolize)
+
+
+def header(data: bytes, offset: int = 0) -> dict:
+    """Raw header fields of the dump a parse_*() reported at `offset`; the
+    fields a shorter (older) header does not have read as 0."""
+    hl = struct.unpack_from('<H', data, offset + 6)[0]
+    raw = bytes(data[offset:offset + min(hl, HDR.size)]).ljust(HDR.size, b'\0')
+    return dict(zip(FIELDS, HDR.unpack(raw)))
+
+
+SCAN_IMPLS = {'scalar': 1, 'sse2': 2, 'avx2': 3}
+
+
+def scan(data: bytes, symbolize: Optional[Symbolizer] = None, impl: str = 'auto') -> List[dict]:
+    """Dumps anywhere in raw bytes: mixed UART captures, RAM images, ..."""
+    return _call('hfd_scan_impl_json', bytes(data), symbolize, SCAN_IMPLS.get(impl, 0))
+
+
+def scan_count(buf, impl: str = 'auto') -> int:
+    """Scanner only, over any buffer (bytes, mmap). Returns candidate spans."""
+    lib = _load()
+    if isinstance(buf, mmap.mmap):
+        addr = ctypes.addressof(ctypes.c_char.from_buffer(buf))
+    else:
+        addr = ctypes.cast(ctypes.c_char_p(buf), ctypes.c_void_p).value
+    return lib.hfd_scan_count(addr, len(buf), SCAN_IMPLS.get(impl, 0))
+
+
+def count_text(text) -> int:
+    if isinstance(text, str):
+        text = text.encode('utf-8', 'replace')
+    return _load().hfd_count_text(text, len(text))
+
+
+def version() -> str:
+    return _load().hfd_version().decode()
+
+
+# =============================== Bench ===============================
+
+def bench_scan(path: str, limit_mb: int) -> int:
+    """Throughput of the native scanner vs. the Python regex path."""
+    with open(path, 'rb') as f:
+        mm = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+        data = mm[:limit_mb * 1024 * 1024] if limit_mb else mm[:]
+        mm.close()
+    mb = len(data) / 1e6
+    print(f'{path}: {mb:.1f} MB')
+
+    # What hf_addr2line.py did: decode, then one regex over the text.
+    pattern = re.compile(r'HF_ADDR\s+PC=0x([0-9a-fA-F]{8})\s+LR=0x([0-9a-fA-F]{8})')
+    t0 = time.perf_counter()
+    n = sum(1 for _ in pattern.finditer(data.decode('utf-8', 'ignore')))
+    dt = time.perf_counter() - t0
+    print(f'  {"python re":10} {mb / dt:9.1f} MB/s  {n} HF_ADDR lines')
+
+    for impl in ('scalar', 'sse2', 'avx2'):
+        t0 = time.perf_counter()
+        n = scan_count(data, impl)
+        dt = time.perf_counter() - t0
+        name = _load().hfd_scan_impl(SCAN_IMPLS[impl]).decode()
+        if name != impl:
+            continue   # CPU lacks it
+        print(f'  {impl:10} {mb / dt:9.1f} MB/s  {n} spans')
+    return 0
+
+
+if __name__ == '__main__':
+    if len(sys.argv) >= 3 and sys.argv[1] == 'bench-scan':
+        limit = int(sys.argv[3]) if len(sys.argv) > 3 else 0
+        raise SystemExit(bench_scan(sys.argv[2], limit))
+    print(f'Usage: {sys.argv[0]} bench-scan <capture> [limit-MB]', file=sys.stderr)
+    raise SystemExit(1)
@@ -0,0 +1,1437 @@
+#include "hfdump.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <map>
+
+extern "C" {
+#include "../hf_abi.h"
+}
+
+namespace hfdump {
+
+/* ============================ Binary ============================ */
+
+namespace {
+
+uint32_t rd32(const uint8_t *p)
+{
+    return uint32_t(p[0]) | uint32_t(p[1]) << 8 |
+           uint32_t(p[2]) << 16 | uint32_t(p[3]) << 24;
+}
+
+uint16_t rd16(const uint8_t *p)
+{
+    return uint16_t(p[0] | p[1] << 8);
+}
+
+#define HF_OFF(field) offsetof(hf_dump_hdr_t, field)
+#define HF_END(field) (HF_OFF(field) + sizeof(((hf_dump_hdr_t *)nullptr)->field))
+
+uint32_t xor_bytes(const uint8_t *p, size_t n)
+{
+    uint32_t x = 0;
+    for (size_t i = 0; i < n; i++) {
+        x ^= p[i];
+    }
+    return x;
+}
+
+bool fail(std::string *err, const char *msg)
+{
+    if (err) *err = msg;
+    return false;
+}
+
+void parse_task_stacks(const uint8_t *p, size_t len, Dump &d)
+{
+    if (len < sizeof(hf_stack_table_t)) return;
+    const uint8_t  count = p[offsetof(hf_stack_table_t, count)];
+    const uint8_t  marks = p[offsetof(hf_stack_table_t, marks)];
+    const uint16_t esize = rd16(p + offsetof(hf_stack_table_t, entry_size));
+
+    /* Entry layout up to mark[] is fixed; the writer's mark count and entry
+     * size tell where the next entry starts. */
+    const size_t fixed = offsetof(hf_task_stack_t, mark);
+    if (esize < fixed + size_t(marks) * sizeof(hf_stack_mark_t) ||
+        sizeof(hf_stack_table_t) + size_t(count) * esize > len) {
+        return;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        const uint8_t *e = p + sizeof(hf_stack_table_t) + i * esize;
+        TaskStack t;
+        const char *name = reinterpret_cast<const char *>(e + offsetof(hf_task_stack_t, name));
+        t.name.assign(name, strnlen(name, HF_STACK_NAME_LEN));
+        t.stack_base = rd32(e + offsetof(hf_task_stack_t, stack_lo));
+        t.stack_size = rd32(e + offsetof(hf_task_stack_t, stack_size));
+        t.min_free   = rd32(e + offsetof(hf_task_stack_t, min_free));
+        t.last_free  = rd32(e + offsetof(hf_task_stack_t, last_free));
+        t.boot       = rd16(e + offsetof(hf_task_stack_t, boot));
+
+        const uint8_t flags = e[offsetof(hf_task_stack_t, flags)];
+        t.sampled = (flags & HF_STACK_F_SAMPLED) != 0;
+        t.live    = (flags & HF_STACK_F_LIVE) != 0;
+
+        const uint8_t n = e[offsetof(hf_task_stack_t, mark_count)];
+        for (size_t m = 0; m < n && m < marks; m++) {
+            const uint8_t *k = e + fixed + m * sizeof(hf_stack_mark_t);
+            TaskStack::Low low;
+            low.tick = rd32(k + offsetof(hf_stack_mark_t, tick));
+            low.free = rd16(k + offsetof(hf_stack_mark_t, free));
+            low.boot = rd16(k + offsetof(hf_stack_mark_t, boot));
+            t.lows.push_back(low);
+        }
+        d.task_stacks.push_back(std::move(t));
+    }
+}
+
+void parse_shadow_stack(const uint8_t *p, size_t len, Dump &d)
+{
+    if (len < sizeof(hf_shadow_rec_t)) return;
+    const uint16_t count = rd16(p + offsetof(hf_shadow_rec_t, count));
+    if (sizeof(hf_shadow_rec_t) + size_t(count) * 4u > len) return;
+
+    ShadowStack &s = d.shadow;
+    const uint8_t flags = p[offsetof(hf_shadow_rec_t, flags)];
+    s.present  = true;
+    s.thread   = rd32(p + offsetof(hf_shadow_rec_t, thread));
+    s.depth    = rd32(p + offsetof(hf_shadow_rec_t, depth));
+    s.handler  = (flags & HF_SHADOW_F_HANDLER) != 0;
+    s.wrapped  = (flags & HF_SHADOW_F_WRAPPED) != 0;
+    s.unsynced = (flags & HF_SHADOW_F_UNSYNCED) != 0;
+    s.calls.clear();
+    for (size_t i = 0; i < count; i++) {
+        s.calls.push_back(rd32(p + sizeof(hf_shadow_rec_t) + i * 4u));
+    }
+}
+
+void parse_heap_ops(const uint8_t *p, size_t len, Dump &d)
+{
+    if (len < sizeof(hf_heap_hist_t)) return;
+    const uint16_t count = rd16(p + offsetof(hf_heap_hist_t, count));
+    const uint16_t esize = rd16(p + offsetof(hf_heap_hist_t, entry_size));
+    if (esize < sizeof(hf_heap_op_t) ||
+        sizeof(hf_heap_hist_t) + size_t(count) * esize > len) {
+        return;
+    }
+
+    d.heap_total = rd32(p + offsetof(hf_heap_hist_t, total));
+    d.heap_ops.clear();
+    for (size_t i = 0; i < count; i++) {
+        const uint8_t *e = p + sizeof(hf_heap_hist_t) + i * esize;
+        const uint32_t info = rd32(e + offsetof(hf_heap_op_t, info));
+        HeapOp op;
+        op.op     = uint8_t(HF_HEAP_INFO_OP(info));
+        op.size   = HF_HEAP_INFO_SIZE(info);
+        op.ptr    = rd32(e + offsetof(hf_heap_op_t, ptr));
+        op.caller = rd32(e + offsetof(hf_heap_op_t, caller));
+        op.ctx    = rd32(e + offsetof(hf_heap_op_t, ctx));
+        d.heap_ops.push_back(op);
+    }
+}
+
+void parse_scan(const uint8_t *p, size_t len, Dump &d)
+{
+    if (len < sizeof(hf_scan_rec_t)) return;
+    ScanFinding &f = d.integrity;
+    const char *name = reinterpret_cast<const char *>(p + offsetof(hf_scan_rec_t, name));
+
+    f.present  = true;
+    f.kind     = p[offsetof(hf_scan_rec_t, kind)];
+    f.addr     = rd32(p + offsetof(hf_scan_rec_t, addr));
+    f.found    = rd32(p + offsetof(hf_scan_rec_t, found));
+    f.expected = rd32(p + offsetof(hf_scan_rec_t, expected));
+    f.region   = rd32(p + offsetof(hf_scan_rec_t, region));
+    f.task.assign(name, strnlen(name, HF_STACK_NAME_LEN));
+}
+
+/* Walk the extension records; unknown types are skipped. */
+void parse_ext(const uint8_t *p, size_t len, Dump &d)
+{
+    size_t off = 0;
+
+    while (off + sizeof(hf_ext_hdr_t) <= len) {
+        const uint16_t type = rd16(p + off + offsetof(hf_ext_hdr_t, type));
+        const uint16_t n    = rd16(p + off + offsetof(hf_ext_hdr_t, len));
+        const size_t   data = off + sizeof(hf_ext_hdr_t);
+        if (data + n > len) break;
+
+        if (type == HF_EXT_TASK_STACKS) parse_task_stacks(p + data, n, d);
+        if (type == HF_EXT_SHADOW_STACK) parse_shadow_stack(p + data, n, d);
+        if (type == HF_EXT_HEAP_OPS) parse_heap_ops(p + data, n, d);
+        if (type == HF_EXT_SCAN) parse_scan(p + data, n, d);
+        off = data + ((size_t(n) + 3u) & ~size_t(3));
+    }
+}
+
+} // namespace
+
+bool parse_binary(const uint8_t *p, size_t len, Dump &d, std::string *err)
+{
+    if (len < HF_DUMP_HDR_MIN_LEN)            return fail(err, "too short");
+    if (rd32(p + HF_OFF(magic)) != HF_MAGIC)  return fail(err, "bad magic");
+
+    d = Dump{};
+    d.source     = Source::Binary;
+    d.version    = rd16(p + HF_OFF(version));
+    d.header_len = rd16(p + HF_OFF(header_len));
+
+    if (d.version < HF_VERSION_MIN)           return fail(err, "version too old");
+    if (d.header_len < HF_DUMP_HDR_MIN_LEN ||
+        d.header_len > len)                   return fail(err, "bad header_len");
+
+    d.exc_return = rd32(p + HF_OFF(exc_return));
+    d.msp        = rd32(p + HF_OFF(msp));
+    d.psp        = rd32(p + HF_OFF(psp));
+    d.active_sp  = rd32(p + HF_OFF(active_sp));
+    d.used_psp   = rd32(p + HF_OFF(used_sp)) != 0;
+    d.has_fp     = rd32(p + HF_OFF(has_fp)) != 0;
+
+    d.cfsr  = rd32(p + HF_OFF(scb_cfsr));
+    d.hfsr  = rd32(p + HF_OFF(scb_hfsr));
+    d.dfsr  = rd32(p + HF_OFF(scb_dfsr));
+    d.mmfar = rd32(p + HF_OFF(scb_mmfar));
+    d.bfar  = rd32(p + HF_OFF(scb_bfar));
+    d.afsr  = rd32(p + HF_OFF(scb_afsr));
+    d.shcsr = rd32(p + HF_OFF(shcsr));
+
+    d.r0  = rd32(p + HF_OFF(r0));
+    d.r1  = rd32(p + HF_OFF(r1));
+    d.r2  = rd32(p + HF_OFF(r2));
+    d.r3  = rd32(p + HF_OFF(r3));
+    d.r12 = rd32(p + HF_OFF(r12));
+    d.lr  = rd32(p + HF_OFF(lr));
+    d.pc  = rd32(p + HF_OFF(pc));
+    d.psr = rd32(p + HF_OFF(psr));
+
+    d.rtos            = rd32(p + HF_OFF(rtos_present));
+    d.task_priority   = rd32(p + HF_OFF(rtos_task_priority));
+    d.task_min_free   = rd32(p + HF_OFF(rtos_stack_high_water_bytes));
+    d.task_stack_base = rd32(p + HF_OFF(rtos_stack_base));
+    {
+        const char *name = reinterpret_cast<const char *>(p + HF_OFF(rtos_task_name));
+        d.task_name.assign(name, strnlen(name, HF_MAX_TASK_NAME_LEN));
+    }
+
+    d.stack_bytes = rd32(p + HF_OFF(stack_bytes));
+    d.checksum    = rd32(p + HF_OFF(checksum));
+
+    /* Appended fields only when the writer knew them. */
+    if (d.header_len >= HF_END(sp_limit)) {
+        d.arch     = rd16(p + HF_OFF(arch));
+        d.flags    = rd16(p + HF_OFF(flags));
+        d.sp_limit = rd32(p + HF_OFF(sp_limit));
+    }
+    if (d.header_len >= HF_END(msp_max_used)) {
+        d.msp_limit    = rd32(p + HF_OFF(msp_limit));
+        d.msp_max_used = rd32(p + HF_OFF(msp_max_used));
+    }
+    uint32_t ext_sum = 0;
+    if (d.header_len >= HF_END(ext_checksum)) {
+        d.ext_bytes = rd32(p + HF_OFF(ext_bytes));
+        ext_sum     = rd32(p + HF_OFF(ext_checksum));
+    }
+
+    if (d.stack_bytes > len - d.header_len)   return fail(err, "truncated payload");
+
+    const uint8_t *payload = p + d.header_len;
+    d.stack.assign(payload, payload + d.stack_bytes);
+
+    const uint32_t computed = xor_bytes(p, d.header_len)
+                            ^ xor_bytes(p + HF_OFF(checksum), 4)
+                            ^ xor_bytes(payload, d.stack_bytes);
+    d.check = (computed == d.checksum) ? Check::Ok : Check::Bad;
+
+    /* Extension records have their own checksum; a bad one only loses them. */
+    if (d.ext_bytes) {
+        const uint8_t *ext = payload + d.stack_bytes;
+        if (d.ext_bytes > len - d.header_len - d.stack_bytes ||
+            xor_bytes(ext, d.ext_bytes) != ext_sum) {
+            d.ext_check = Check::Bad;
+        } else {
+            d.ext_check = Check::Ok;
+            parse_ext(ext, d.ext_bytes, d);
+        }
+    }
+    return true;
+}
+
+bool parse_mailbox(const uint8_t *p, size_t len, std::vector<Dump> &out,
+                   std::string *err)
+{
+    if (len < sizeof(hf_mbox_hdr_t))                       return fail(err, "too short");
+    if (rd32(p + offsetof(hf_mbox_hdr_t, magic)) != HF_MBOX_MAGIC)
+                                                           return fail(err, "bad mailbox magic");
+    if (rd16(p + offsetof(hf_mbox_hdr_t, abi_version)) != HF_MBOX_ABI_VERSION)
+                                                           return fail(err, "unsupported mailbox ABI");
+
+    const uint32_t area  = rd32(p + offsetof(hf_mbox_hdr_t, area_size));
+    const uint32_t slot  = rd32(p + offsetof(hf_mbox_hdr_t, slot_size));
+    const uint16_t count = rd16(p + offsetof(hf_mbox_hdr_t, slot_count));
+    const uint16_t hlen  = rd16(p + offsetof(hf_mbox_hdr_t, hdr_len));
+
+    if (area > len || count == 0 || count > HF_MBOX_SLOTS ||
+        uint64_t(hlen) + uint64_t(slot) * count > area)   return fail(err, "bad mailbox geometry");
+
+    for (uint16_t i = 0; i < count; i++) {
+        const uint8_t *s = p + hlen + size_t(i) * slot;
+        Dump d;
+        if (!parse_binary(s, slot, d) || d.check != Check::Ok) {
+            continue;
+        }
+        d.slot = i;
+        d.fault_count = rd32(p + offsetof(hf_mbox_hdr_t, fault_count) + 4u * i);
+        d.offset = size_t(s - p);
+        out.push_back(std::move(d));
+    }
+    return true;
+}
+
+/* ============================= Text ============================= */
+
+namespace {
+
+constexpr std::string_view kBegin = "===== HARD FAULT DUMP =====";
+constexpr std::string_view kEnd   = "===== END HARD FAULT DUMP =====";
+constexpr std::string_view kAddr  = "HF_ADDR";
+
+bool hexval(std::string_view s, size_t pos, uint32_t &v)
+{
+    /* Expects "0x" at pos. */
+    if (pos + 2 >= s.size() || s[pos] != '0' || (s[pos + 1] != 'x' && s[pos + 1] != 'X')) {
+        return false;
+    }
+    size_t i = pos + 2;
+    uint32_t x = 0;
+    size_t n = 0;
+    for (; i < s.size() && n < 8; i++, n++) {
+        const char c = s[i];
+        uint32_t dgt;
+        if (c >= '0' && c <= '9')      dgt = uint32_t(c - '0');
+        else if (c >= 'a' && c <= 'f') dgt = uint32_t(c - 'a' + 10);
+        else if (c >= 'A' && c <= 'F') dgt = uint32_t(c - 'A' + 10);
+        else break;
+        x = (x << 4) | dgt;
+    }
+    if (n == 0) return false;
+    v = x;
+    return true;
+}
+
+bool decval(std::string_view s, size_t pos, uint32_t &v)
+{
+    while (pos < s.size() && s[pos] == ' ') pos++;
+    uint64_t x = 0;
+    size_t n = 0;
+    for (; pos < s.size() && s[pos] >= '0' && s[pos] <= '9' && n < 10; pos++, n++) {
+        x = x * 10 + uint64_t(s[pos] - '0');
+    }
+    if (n == 0 || x > 0xFFFFFFFFull) return false;
+    v = uint32_t(x);
+    return true;
+}
+
+/* Value of "<key> 0x..." (key includes its ':' or '='), spaces allowed. */
+bool keyhex(std::string_view line, std::string_view key, uint32_t &v)
+{
+    const size_t k = line.find(key);
+    if (k == std::string_view::npos) return false;
+    size_t pos = k + key.size();
+    while (pos < line.size() && line[pos] == ' ') pos++;
+    return hexval(line, pos, v);
+}
+
+bool keydec(std::string_view line, std::string_view key, uint32_t &v)
+{
+    const size_t k = line.find(key);
+    if (k == std::string_view::npos) return false;
+    return decval(line, k + key.size(), v);
+}
+
+bool has(std::string_view line, std::string_view what)
+{
+    return line.find(what) != std::string_view::npos;
+}
+
+/* What a label of a block line sets. */
+enum class Act : uint8_t {
+    Hex,        /* field = the 0x... value after the label */
+    Dec,        /* field = the decimal value after the label */
+    Version,
+    Flag,       /* flags |= arg, if word is in the line too (or empty) */
+    Image,      /* slot = arg */
+    Psp,
+    Fp,
+    Task,       /* task name, in quotes after the label */
+    Rtos,       /* RTOS section header: rtos = arg */
+    Shadow,     /* lines for parse_shadow_line() */
+    Heap,       /* ... parse_heap_line() */
+    Scan,       /* ... parse_scan_line() */
+};
+
+struct Label {
+    std::string_view key;              /* one ':' in it */
+    Act              act;
+    uint32_t Dump::*field = nullptr;
+    uint32_t         arg = 0;
+    std::string_view word = {};
+};
+
+/* Keys are unique enough as substrings of the target's fixed-format lines.
+ * Each acts on its first occurrence in a line. */
+const Label kLabels[] = {
+    {"EXC_RETURN:",  Act::Hex, &Dump::exc_return},
+    {"MSP:",         Act::Hex, &Dump::msp},
+    {"PSP:",         Act::Hex, &Dump::psp},
+    {"Active SP:",   Act::Hex, &Dump::active_sp},
+    {"R0 :",         Act::Hex, &Dump::r0},
+    {"R1 :",         Act::Hex, &Dump::r1},
+    {"R2 :",         Act::Hex, &Dump::r2},
+    {"R3 :",         Act::Hex, &Dump::r3},
+    {"R12:",         Act::Hex, &Dump::r12},
+    {"LR :",         Act::Hex, &Dump::lr},
+    {"PC :",         Act::Hex, &Dump::pc},
+    {"PSR:",         Act::Hex, &Dump::psr},
+    {"CFSR:",        Act::Hex, &Dump::cfsr},
+    {"HFSR:",        Act::Hex, &Dump::hfsr},
+    {"DFSR:",        Act::Hex, &Dump::dfsr},
+    {"MMFAR:",       Act::Hex, &Dump::mmfar},
+    {"BFAR:",        Act::Hex, &Dump::bfar},
+    {"AFSR:",        Act::Hex, &Dump::afsr},
+    {"SHCSR:",       Act::Hex, &Dump::shcsr},
+    {"SP limit:",    Act::Hex, &Dump::sp_limit},
+    {"MSP bottom:",  Act::Hex, &Dump::msp_limit},
+    {"Stack base :", Act::Hex, &Dump::task_stack_base},
+
+    {"Ver:",              Act::Version},
+    {"Faults recorded:",  Act::Dec, &Dump::fault_count},
+    {"Prio :",            Act::Dec, &Dump::task_priority},
+    {"Min free   :",      Act::Dec, &Dump::task_min_free},
+    {"Stack dump bytes:", Act::Dec, &Dump::stack_bytes},
+    {"Max used:",         Act::Dec, &Dump::msp_max_used},
+
+    {"Image: bootloader",  Act::Image, nullptr, HF_IMAGE_BOOTLOADER},
+    {"Image: application", Act::Image, nullptr, HF_IMAGE_APPLICATION},
+    {"Used: PSP",          Act::Psp},
+    {"FP ctx: YES",        Act::Fp},
+    {"SP limit:",          Act::Flag, nullptr, HF_DUMP_F_SPLIM},
+    {"SP limit:",          Act::Flag, nullptr, HF_DUMP_F_STKOVF, "STACK OVERFLOW"},
+    {"State: Secure",      Act::Flag, nullptr, HF_DUMP_F_SECURE},
+    {"MSP bottom:",        Act::Flag, nullptr, HF_DUMP_F_MSP_NEAR, "NEAR LIMIT"},
+    {"Soft capture:",      Act::Flag, nullptr, HF_DUMP_F_SOFT},
+    {"FPU trap:",          Act::Flag, nullptr, HF_DUMP_F_FPU_TRAP},
+    {"Task : '",           Act::Task},
+
+    /* The RTOS section header is the bare kernel name followed by ':'. */
+    {"FreeRTOS:",  Act::Rtos, nullptr, HF_RTOS_FREERTOS},
+    {"Zephyr:",    Act::Rtos, nullptr, HF_RTOS_ZEPHYR},
+    {"ThreadX:",   Act::Rtos, nullptr, HF_RTOS_THREADX},
+    {"RTX5:",      Act::Rtos, nullptr, HF_RTOS_RTX5},
+
+    {"Shadow stack: depth", Act::Shadow},
+    {" Called from:",       Act::Shadow},
+    {"Heap ops:",           Act::Heap},
+    {"Heap boot:",          Act::Heap},
+    {"Heap alloc:",         Act::Heap},
+    {"Heap free:",          Act::Heap},
+    {"Integrity:",          Act::Scan},
+};
+
+constexpr size_t kLabelCount = sizeof(kLabels) / sizeof(kLabels[0]);
+static_assert(kLabelCount <= 64, "one bit per label in parse_block_line()");
+
+/*
+ * kLabels by the character before their ':'. A line is only compared with
+ * the labels whose ':' lines up with one of its own and is preceded by the
+ * same character, instead of being searched once per label (which kept
+ * text parsing under 100k dumps/s).
+ */
+struct LabelIndex {
+    std::vector<uint8_t> by_char[256];
+    size_t               colon[kLabelCount];
+
+    LabelIndex()
+    {
+        for (size_t i = 0; i < kLabelCount; i++) {
+            colon[i] = kLabels[i].key.find(':');
+            by_char[uint8_t(kLabels[i].key[colon[i] - 1])].push_back(uint8_t(i));
+        }
+    }
+};
+
+const LabelIndex &label_index()
+{
+    static const LabelIndex idx;
+    return idx;
+}
+
+/* " 'name' min: F of S  last: L[  gone]  lows: F (bB tT)..." */
+void parse_task_stack_line(std::string_view line, Dump &d)
+{
+    if (line.size() < 3 || line[0] != ' ' || line[1] != '\'') {
+        return;
+    }
+    const size_t k = line.rfind("' min:");
+    if (k == std::string_view::npos || k < 2) {
+        return;
+    }
+    const std::string_view rest = line.substr(k);
+    TaskStack t;
+    t.name.assign(line.substr(2, k - 2));
+    t.live = !has(rest, "  gone");
+
+    uint32_t v;
+    if (keydec(rest, "min:", v)) {
+        t.sampled  = true;
+        t.min_free = v;
+        if (keydec(rest, " of ", v))  t.stack_size = v;
+        if (keydec(rest, "last:", v)) t.last_free = v;
+
+        constexpr size_t npos = std::string_view::npos;
+        const size_t lows = rest.find("lows:");
+        size_t pos = (lows == npos) ? npos : lows + 5;
+        while (pos != npos) {
+            const size_t at = rest.find(" (b", pos);
+            uint32_t b, tick;
+            if (at == npos || !decval(rest, pos, v) || !decval(rest, at + 3, b) ||
+                !keydec(rest.substr(at), " t", tick)) {
+                break;
+            }
+            TaskStack::Low low;
+            low.tick = tick;
+            low.free = v;
+            low.boot = uint16_t(b);
+            t.lows.push_back(low);
+            const size_t close = rest.find(')', at);
+            pos = (close == npos) ? npos : close + 1;
+        }
+    }
+    d.task_stacks.push_back(std::move(t));
+}
+
+/* "Shadow stack: depth D  thread 0x...[  handler][  wrapped][  unsynced]"
+ * and its " Called from: 0x..." lines. */
+void parse_shadow_line(std::string_view line, Dump &d)
+{
+    uint32_t v;
+
+    if (keydec(line, "Shadow stack: depth", v)) {
+        ShadowStack &s = d.shadow;
+        s.present  = true;
+        s.depth    = v;
+        s.handler  = has(line, "  handler");
+        s.wrapped  = has(line, "  wrapped");
+        s.unsynced = has(line, "  unsynced");
+        if (keyhex(line, "thread", v)) s.thread = v;
+    } else if (d.shadow.present && keyhex(line, " Called from:", v)) {
+        d.shadow.calls.push_back(v);
+    }
+}
+
+/* "Heap ops: N logged, newest first", then " Heap alloc: 0x... size S
+ * from 0x... ctx 0x..." ("failed" instead of the pointer), " Heap free:
+ * 0x... from 0x... ctx 0x..." and " Heap boot: N". */
+void parse_heap_line(std::string_view line, Dump &d)
+{
+    uint32_t v;
+    HeapOp   op;
+
+    if (keydec(line, "Heap ops:", v)) {
+        d.heap_total = v;
+        return;
+    }
+    if (keydec(line, "Heap boot:", v)) {
+        op.op   = HF_HEAP_OP_BOOT;
+        op.size = v;
+        d.heap_ops.push_back(op);
+        return;
+    }
+    if (has(line, "Heap alloc:")) {
+        op.op = HF_HEAP_OP_ALLOC;
+        if (!keyhex(line, "Heap alloc:", op.ptr) && !has(line, "failed")) return;
+        keydec(line, "size", op.size);
+    } else if (keyhex(line, "Heap free:", v)) {
+        op.op  = HF_HEAP_OP_FREE;
+        op.ptr = v;
+    } else {
+        return;
+    }
+    keyhex(line, "from", op.caller);
+    keyhex(line, "ctx", op.ctx);
+    d.heap_ops.push_back(op);
+}
+
+/* "Integrity: heap link at 0x... found 0x...[ expected 0x...] region
+ * 0x...[ task 'name']". */
+void parse_scan_line(std::string_view line, Dump &d)
+{
+    static const struct { const char *label; uint8_t kind; } kinds[] = {
+        {"Integrity: task stack", HF_SCAN_TASK_STACK},
+        {"Integrity: main stack", HF_SCAN_MAIN_STACK},
+        {"Integrity: heap size",  HF_SCAN_HEAP_SIZE},
+        {"Integrity: heap link",  HF_SCAN_HEAP_LINK},
+    };
+    ScanFinding &f = d.integrity;
+
+    for (const auto &k : kinds) {
+        if (!has(line, k.label)) continue;
+        f.present = true;
+        f.kind    = k.kind;
+        keyhex(line, " at", f.addr);
+        keyhex(line, "found", f.found);
+        keyhex(line, "expected", f.expected);
+        keyhex(line, "region", f.region);
+        const size_t t = line.find("task '");
+        const size_t b = line.rfind('\'');
+        if (t != std::string_view::npos && b > t + 6) {
+            f.task.assign(line.substr(t + 6, b - t - 6));
+        }
+        return;
+    }
+}
+
+void parse_block_line(std::string_view line, Dump &d)
+{
+    const LabelIndex &idx = label_index();
+    uint64_t seen = 0;
+    bool shadow = false, heap = false, scan = false;
+
+    for (size_t c = line.find(':', 1); c != std::string_view::npos; c = line.find(':', c + 1)) {
+        for (const uint8_t i : idx.by_char[uint8_t(line[c - 1])]) {
+            const Label &l = kLabels[i];
+            const size_t k = idx.colon[i];
+            if (((seen >> i) & 1u) || c < k || c - k + l.key.size() > line.size() ||
+                line.compare(c - k, l.key.size(), l.key) != 0) {
+                continue;
+            }
+            seen |= uint64_t(1) << i;
+
+            const size_t end = c - k + l.key.size();
+            size_t pos = end;
+            uint32_t v;
+            switch (l.act) {
+            case Act::Hex:
+                while (pos < line.size() && line[pos] == ' ') pos++;
+                if (hexval(line, pos, v)) d.*(l.field) = v;
+                break;
+            case Act::Dec:
+                if (decval(line, end, v)) d.*(l.field) = v;
+                break;
+            case Act::Version:
+                if (decval(line, end, v)) d.version = uint16_t(v);
+                break;
+            case Act::Flag:
+                if (l.word.empty() || has(line, l.word)) d.flags |= uint16_t(l.arg);
+                break;
+            case Act::Image:
+                d.slot = int(l.arg);
+                break;
+            case Act::Psp:
+                d.used_psp = true;
+                break;
+            case Act::Fp:
+                d.has_fp = true;
+                break;
+            case Act::Task: {
+                const size_t b = line.rfind('\'');
+                if (b != std::string_view::npos && b >= end) {
+                    d.task_name.assign(line.substr(end, b - end));
+                }
+                break;
+            }
+            case Act::Rtos:
+                if (d.rtos == 0) d.rtos = l.arg;
+                break;
+            case Act::Shadow: shadow = true; break;
+            case Act::Heap:   heap = true;   break;
+            case Act::Scan:   scan = true;   break;
+            }
+        }
+    }
+
+    parse_task_stack_line(line, d);
+    if (shadow) parse_shadow_line(line, d);
+    if (heap)   parse_heap_line(line, d);
+    if (scan)   parse_scan_line(line, d);
+}
+
+bool parse_addr_line(std::string_view line, Dump &d)
+{
+    const size_t k = line.find(kAddr);
+    if (k == std::string_view::npos) return false;
+    const std::string_view rest = line.substr(k);
+    uint32_t pc, lr;
+    if (!keyhex(rest, "PC=", pc) || !keyhex(rest, "LR=", lr)) return false;
+    d.pc = pc;
+    d.lr = lr;
+    return true;
+}
+
+/* No END line between pos and the next BEGIN line (or the end of the log).
+ * Both markers end in kMarker: one search finds whichever comes first, and
+ * stopping there keeps parse_text() linear. */
+bool is_truncated(std::string_view log, size_t pos)
+{
+    constexpr std::string_view kMarker = kBegin.substr(6);
+    constexpr size_t kEndLead = kEnd.size() - kMarker.size();
+    for (size_t k = log.find(kMarker, pos); k != std::string_view::npos;
+         k = log.find(kMarker, k + 1)) {
+        if (k >= pos + kEndLead && log.compare(k - kEndLead, kEnd.size(), kEnd) == 0) {
+            return false;
+        }
+        if (k >= pos + 6 && log.compare(k - 6, kBegin.size(), kBegin) == 0) {
+            return true;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+bool block_line(std::string_view line)
+{
+    /* The lines no kLabels entry matches. */
+    static constexpr std::string_view kOther[] = {
+        kAddr, "Core regs:", "MSP worst ever:", "RTOS:", "RTOS info:",
+        "Task stacks (free bytes):", "' min:",
+    };
+    for (const std::string_view s : kOther) {
+        if (has(line, s)) return true;
+    }
+    const LabelIndex &idx = label_index();
+    for (size_t c = line.find(':', 1); c != std::string_view::npos; c = line.find(':', c + 1)) {
+        for (const uint8_t i : idx.by_char[uint8_t(line[c - 1])]) {
+            const std::string_view key = kLabels[i].key;
+            const size_t k = idx.colon[i];
+            if (c >= k && c - k + key.size() <= line.size() &&
+                line.compare(c - k, key.size(), key) == 0) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+size_t parse_text(std::string_view log, std::vector<Dump> &out)
+{
+    const size_t before = out.size();
+    bool in_block = false;
+    bool truncated = false;     /* no END line before the next block */
+    Dump cur;
+    size_t pos = 0;
+
+    while (pos < log.size()) {
+        size_t eol = log.find('\n', pos);
+        if (eol == std::string_view::npos) eol = log.size();
+        std::string_view line = log.substr(pos, eol - pos);
+        const size_t line_off = pos;
+        pos = eol + 1;
+
+        if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+
+        if (in_block && truncated && !block_line(line)) {
+            /* Reset mid-print: the block ends with the target's lines, and
+             * what follows (boot log, lone HF_ADDR lines) is read as such. */
+            out.push_back(std::move(cur));
+            in_block = false;
+        }
+
+        /* Cheap reject: every line we care about contains '=' or ':'. */
+        if (line.find_first_of("=:") == std::string_view::npos) continue;
+
+        if (!in_block) {
+            if (has(line, kBegin) && !has(line, kEnd)) {
+                in_block = true;
+                truncated = is_truncated(log, pos);
+                cur = Dump{};
+                cur.source = Source::Text;
+                cur.offset = line_off;
+            } else if (has(line, kAddr)) {
+                Dump d;
+                d.source = Source::AddrLine;
+                d.offset = line_off;
+                if (parse_addr_line(line, d)) out.push_back(std::move(d));
+            }
+            continue;
+        }
+
+        if (has(line, kEnd)) {
+            out.push_back(std::move(cur));
+            in_block = false;
+            continue;
+        }
+        if (has(line, kBegin)) {
+            /* Truncated block (reset mid-print): keep what we have. */
+            out.push_back(std::move(cur));
+            truncated = is_truncated(log, pos);
+            cur = Dump{};
+            cur.source = Source::Text;
+            cur.offset = line_off;
+            continue;
+        }
+        if (has(line, kAddr)) {
+            continue;   /* PC/LR already came from the register lines */
+        }
+        parse_block_line(line, cur);
+    }
+
+    if (in_block) {
+        out.push_back(std::move(cur));
+    }
+    return out.size() - before;
+}
+
+/* =========================== Analysis =========================== */
+
+namespace {
+
+struct Bit {
+    uint32_t    mask;
+    const char *name;
+};
+
+const Bit kCfsrBits[] = {
+    {1u << 0,  "IACCVIOL"},   {1u << 1,  "DACCVIOL"},  {1u << 3,  "MUNSTKERR"},
+    {1u << 4,  "MSTKERR"},    {1u << 5,  "MLSPERR"},   {1u << 7,  "MMARVALID"},
+    {1u << 8,  "IBUSERR"},    {1u << 9,  "PRECISERR"}, {1u << 10, "IMPRECISERR"},
+    {1u << 11, "UNSTKERR"},   {1u << 12, "STKERR"},    {1u << 13, "LSPERR"},
+    {1u << 15, "BFARVALID"},  {1u << 16, "UNDEFINSTR"},{1u << 17, "INVSTATE"},
+    {1u << 18, "INVPC"},      {1u << 19, "NOCP"},      {1u << 20, "STKOF"},
+    {1u << 24, "UNALIGNED"},  {1u << 25, "DIVBYZERO"},
+};
+
+const Bit kHfsrBits[] = {
+    {1u << 1,  "VECTTBL"}, {1u << 30, "FORCED"}, {1u << 31, "DEBUGEVT"},
+};
+
+const Bit kFpscrBits[] = {
+    {HF_FPSCR_IOC, "IOC"}, {HF_FPSCR_DZC, "DZC"}, {HF_FPSCR_OFC, "OFC"},
+    {HF_FPSCR_UFC, "UFC"}, {HF_FPSCR_IXC, "IXC"}, {HF_FPSCR_IDC, "IDC"},
+};
+
+} // namespace
+
+std::vector<const char *> cfsr_bits(uint32_t cfsr)
+{
+    std::vector<const char *> v;
+    for (const Bit &b : kCfsrBits) {
+        if (cfsr & b.mask) v.push_back(b.name);
+    }
+    return v;
+}
+
+std::vector<const char *> hfsr_bits(uint32_t hfsr)
+{
+    std::vector<const char *> v;
+    for (const Bit &b : kHfsrBits) {
+        if (hfsr & b.mask) v.push_back(b.name);
+    }
+    return v;
+}
+
+std::vector<const char *> fpscr_bits(uint32_t flags)
+{
+    std::vector<const char *> v;
+    for (const Bit &b : kFpscrBits) {
+        if (flags & b.mask) v.push_back(b.name);
+    }
+    return v;
+}
+
+const char *scan_kind_name(uint8_t kind)
+{
+    switch (kind) {
+    case HF_SCAN_TASK_STACK: return "TASK_STACK";
+    case HF_SCAN_MAIN_STACK: return "MAIN_STACK";
+    case HF_SCAN_HEAP_SIZE:  return "HEAP_SIZE";
+    case HF_SCAN_HEAP_LINK:  return "HEAP_LINK";
+    default:                 return "unknown";
+    }
+}
+
+std::string fault_class(const Dump &d)
+{
+    if (d.flags & HF_DUMP_F_SOFT) {
+        return std::string("Integrity:") + scan_kind_name(d.integrity.kind);
+    }
+    if (d.flags & HF_DUMP_F_FPU_TRAP) {
+        const auto bits = fpscr_bits(d.r0);
+        return std::string("FpuTrap:") + (bits.empty() ? "unknown" : bits.front());
+    }
+
+    /* First cause bit per group; the *VALID bits are not causes. */
+    static const struct { uint32_t lo, hi; const char *group; } groups[] = {
+        {0, 7,   "MemManage"},
+        {8, 15,  "BusFault"},
+        {16, 31, "UsageFault"},
+    };
+    for (const auto &g : groups) {
+        for (const Bit &b : kCfsrBits) {
+            const uint32_t bit = uint32_t(__builtin_ctz(b.mask));
+            if (bit < g.lo || bit > g.hi) continue;
+            if (b.mask == (1u << 7) || b.mask == (1u << 15)) continue;
+            if (d.cfsr & b.mask) return std::string(g.group) + ":" + b.name;
+        }
+    }
+    if (d.hfsr & (1u << 1))  return "HardFault:VECTTBL";
+    if (d.hfsr & (1u << 30)) return "HardFault:FORCED";
+    if (d.source == Source::AddrLine) return "unknown";
+    return d.arch == HF_ARCH_CM0 ? "HardFault" : "unknown";
+}
+
+std::optional<uint32_t> fault_address(const Dump &d)
+{
+    if (d.cfsr & (1u << 7))  return d.mmfar;
+    if (d.cfsr & (1u << 15)) return d.bfar;
+    return std::nullopt;
+}
+
+HeapReport heap_report(const Dump &d)
+{
+    /* Room for the allocator's own header below the block (heap_4: 8
+     * bytes, newlib: 8 plus alignment). */
+    constexpr uint32_t kHeader = 16;
+
+    struct Block {
+        uint32_t size  = 0;
+        int      alloc = -1;
+        int      free  = -1;
+    };
+    std::map<uint32_t, Block> blocks;
+    HeapReport r;
+
+    for (int i = int(d.heap_ops.size()) - 1; i >= 0; i--) {
+        const HeapOp &op = d.heap_ops[size_t(i)];
+        if (op.op == HF_HEAP_OP_BOOT) {
+            blocks.clear();              /* a new heap */
+        } else if (op.op == HF_HEAP_OP_ALLOC && op.ptr != 0) {
+            blocks[op.ptr] = Block{op.size, i, -1};
+        } else if (op.op == HF_HEAP_OP_FREE) {
+            Block &b = blocks[op.ptr];   /* allocated before the history if new */
+            if (b.free >= 0) {
+                r.double_frees.push_back({op.ptr, b.free, i});
+            } else {
+                b.free = i;
+            }
+        }
+    }
+
+    auto match = [&](const char *what, uint32_t a) {
+        if (a < kHeader) return;
+        for (const auto &[ptr, b] : blocks) {
+            if (a + kHeader >= ptr && a < ptr + (b.size ? b.size : 1u)) {
+                r.matches.push_back({what, a, ptr, b.size, b.alloc, b.free});
+            }
+        }
+    };
+    if (d.cfsr & (1u << 7))  match("mmfar", d.mmfar);
+    if (d.cfsr & (1u << 15)) match("bfar", d.bfar);
+    match("r0", d.r0);
+    match("r1", d.r1);
+    match("r2", d.r2);
+    match("r3", d.r3);
+    match("r12", d.r12);
+    return r;
+}
+
+std::vector<uint32_t> stack_words(const Dump &d)
+{
+    std::vector<uint32_t> w(d.stack.size() / 4);
+    for (size_t i = 0; i < w.size(); i++) {
+        w[i] = rd32(&d.stack[i * 4]);
+    }
+    return w;
+}
+
+const char *arch_name(uint16_t arch)
+{
+    switch (arch) {
+    case HF_ARCH_CM0:  return "Cortex-M0/M0+";
+    case HF_ARCH_CM3:  return "Cortex-M3";
+    case HF_ARCH_CM4:  return "Cortex-M4";
+    case HF_ARCH_CM7:  return "Cortex-M7";
+    case HF_ARCH_CM33: return "Cortex-M33";
+    default:           return "unknown";
+    }
+}
+
+const char *rtos_name(uint32_t rtos)
+{
+    switch (rtos) {
+    case HF_RTOS_NONE:     return "none";
+    case HF_RTOS_FREERTOS: return "FreeRTOS";
+    case HF_RTOS_ZEPHYR:   return "Zephyr";
+    case HF_RTOS_THREADX:  return "ThreadX";
+    case HF_RTOS_RTX5:     return "RTX5";
+    default:               return "unknown";
+    }
+}
+
+/* ============================= JSON ============================= */
+
+namespace {
+
+class Json {
+public:
+    explicit Json(std::string &s) : s_(s) {}
+
+    void open()  { s_ += '{'; first_ = true; }
+    void close() { s_ += '}'; first_ = false; }
+
+    void key(std::string_view k)
+    {
+        if (!first_) s_ += ',';
+        first_ = true;
+        str(k);
+        s_ += ':';
+    }
+
+    void field(std::string_view k, std::string_view v) { key(k); str(v); first_ = false; }
+    void field(std::string_view k, const char *v) { field(k, std::string_view(v)); }
+    void field(std::string_view k, bool v)  { key(k); s_ += v ? "true" : "false"; first_ = false; }
+    void field(std::string_view k, uint64_t v) { key(k); s_ += std::to_string(v); first_ = false; }
+    void hex(std::string_view k, uint32_t v)
+    {
+        char b[16];
+        snprintf(b, sizeof(b), "\"0x%08X\"", v);
+        key(k);
+        s_ += b;
+        first_ = false;
+    }
+
+    void begin_obj(std::string_view k) { key(k); open(); }
+    void end_obj() { close(); }
+    void begin_arr(std::string_view k) { key(k); s_ += '['; first_ = true; }
+    void end_arr() { s_ += ']'; first_ = false; }
+    void elem_sep() { if (!first_) s_ += ','; first_ = false; }
+
+    void str(std::string_view v)
+    {
+        s_ += '"';
+        for (const char c : v) {
+            switch (c) {
+            case '"':  s_ += "\\\""; break;
+            case '\\': s_ += "\\\\"; break;
+            case '\n': s_ += "\\n"; break;
+            case '\r': s_ += "\\r"; break;
+            case '\t': s_ += "\\t"; break;
+            default:
+                if (uint8_t(c) < 0x20) {
+                    char b[8];
+                    snprintf(b, sizeof(b), "\\u%04x", c);
+                    s_ += b;
+                } else {
+                    s_ += c;
+                }
+            }
+        }
+        s_ += '"';
+    }
+
+    void symbol(const Symbol &sym)
+    {
+        open();
+        field("function", sym.function);
+        field("file", sym.file);
+        field("line", uint64_t(sym.line));
+        if (!sym.image.empty()) field("image", sym.image);
+        close();
+    }
+
+    std::string &s_;
+    bool first_ = true;
+};
+
+const char *source_name(Source s)
+{
+    switch (s) {
+    case Source::Binary:   return "binary";
+    case Source::Text:     return "text";
+    case Source::AddrLine: return "hf_addr";
+    }
+    return "?";
+}
+
+const char *heap_op_name(uint8_t op)
+{
+    switch (op) {
+    case HF_HEAP_OP_ALLOC: return "alloc";
+    case HF_HEAP_OP_FREE:  return "free";
+    case HF_HEAP_OP_BOOT:  return "boot";
+    default:               return "?";
+    }
+}
+
+const char *check_name(Check c)
+{
+    switch (c) {
+    case Check::Ok:      return "ok";
+    case Check::Bad:     return "bad";
+    case Check::Unknown: return "none";
+    }
+    return "?";
+}
+
+void bit_list(Json &j, std::string_view k, const std::vector<const char *> &bits)
+{
+    j.begin_arr(k);
+    for (const char *b : bits) {
+        j.elem_sep();
+        j.str(b);
+    }
+    j.end_arr();
+}
+
+} // namespace
+
+std::string to_json(const Dump &d, const Symbolizer *sym)
+{
+    std::string s;
+    s.reserve(1024);
+    Json j(s);
+
+    j.open();
+    j.field("source", source_name(d.source));
+    j.field("checksum", check_name(d.check));
+    if (d.slot >= 0) {
+        j.field("image", d.slot == int(HF_IMAGE_BOOTLOADER) ? "bootloader" : "application");
+    }
+    if (d.fault_count) j.field("fault_count", uint64_t(d.fault_count));
+    j.field("offset", uint64_t(d.offset));
+
+    j.hex("pc", d.pc);
+    j.hex("lr", d.lr);
+
+    if (d.source != Source::AddrLine) {
+        j.field("version", uint64_t(d.version));
+        j.field("arch", arch_name(d.arch));
+        j.field("class", fault_class(d));
+        if (d.flags & HF_DUMP_F_SOFT) j.field("soft", true);
+
+        j.begin_obj("regs");
+        j.hex("r0", d.r0);   j.hex("r1", d.r1);
+        j.hex("r2", d.r2);   j.hex("r3", d.r3);
+        j.hex("r12", d.r12); j.hex("lr", d.lr);
+        j.hex("pc", d.pc);   j.hex("psr", d.psr);
+        j.hex("msp", d.msp); j.hex("psp", d.psp);
+        j.hex("exc_return", d.exc_return);
+        j.end_obj();
+
+        j.hex("active_sp", d.active_sp);
+        j.field("stack", d.used_psp ? "PSP" : "MSP");
+        j.field("fp_context", d.has_fp);
+
+        j.begin_obj("scb");
+        j.hex("cfsr", d.cfsr);   j.hex("hfsr", d.hfsr);
+        j.hex("dfsr", d.dfsr);   j.hex("mmfar", d.mmfar);
+        j.hex("bfar", d.bfar);   j.hex("afsr", d.afsr);
+        j.hex("shcsr", d.shcsr);
+        j.end_obj();
+        bit_list(j, "cfsr_bits", cfsr_bits(d.cfsr));
+        bit_list(j, "hfsr_bits", hfsr_bits(d.hfsr));
+        if (d.flags & HF_DUMP_F_FPU_TRAP) bit_list(j, "fpu_trap", fpscr_bits(d.r0));
+        if (auto fa = fault_address(d)) j.hex("fault_address", *fa);
+
+        if (d.flags & HF_DUMP_F_SPLIM) {
+            j.hex("sp_limit", d.sp_limit);
+            j.field("stack_overflow", (d.flags & HF_DUMP_F_STKOVF) != 0);
+            j.field("secure", (d.flags & HF_DUMP_F_SECURE) != 0);
+        }
+        if (d.msp_limit) {
+            j.begin_obj("main_stack");
+            j.hex("bottom", d.msp_limit);
+            if (d.msp_max_used) j.field("max_used", uint64_t(d.msp_max_used));
+            j.field("near_limit", (d.flags & HF_DUMP_F_MSP_NEAR) != 0);
+            j.end_obj();
+        }
+
+        if (d.ext_bytes) j.field("ext_checksum", check_name(d.ext_check));
+        if (d.integrity.present) {
+            const ScanFinding &f = d.integrity;
+            j.begin_obj("integrity");
+            j.field("kind", scan_kind_name(f.kind));
+            j.hex("addr", f.addr);
+            j.hex("found", f.found);
+            if (f.kind == HF_SCAN_TASK_STACK || f.kind == HF_SCAN_MAIN_STACK) {
+                j.hex("expected", f.expected);
+            }
+            j.hex("region", f.region);
+            if (!f.task.empty()) j.field("task", f.task);
+            j.end_obj();
+        }
+        if (!d.task_stacks.empty()) {
+            j.begin_arr("task_stacks");
+            for (const TaskStack &t : d.task_stacks) {
+                j.elem_sep();
+                j.open();
+                j.field("name", t.name);
+                if (t.stack_base) j.hex("stack_base", t.stack_base);
+                if (t.stack_size) j.field("stack_size", uint64_t(t.stack_size));
+                j.field("live", t.live);
+                if (t.sampled) {
+                    j.field("min_free", uint64_t(t.min_free));
+                    j.field("last_free", uint64_t(t.last_free));
+                }
+                j.begin_arr("lows");
+                for (const TaskStack::Low &low : t.lows) {
+                    j.elem_sep();
+                    j.open();
+                    j.field("free", uint64_t(low.free));
+                    j.field("boot", uint64_t(low.boot));
+                    j.field("tick", uint64_t(low.tick));
+                    j.close();
+                }
+                j.end_arr();
+                j.close();
+            }
+            j.end_arr();
+        }
+
+        if (d.shadow.present) {
+            const ShadowStack &sh = d.shadow;
+            j.begin_obj("shadow_stack");
+            j.hex("thread", sh.thread);
+            j.field("depth", uint64_t(sh.depth));
+            j.field("handler", sh.handler);
+            j.field("wrapped", sh.wrapped);
+            j.field("unsynced", sh.unsynced);
+            j.begin_arr("calls");
+            for (const uint32_t c : sh.calls) {
+                j.elem_sep();
+                j.open();
+                j.hex("addr", c);
+                if (sym && *sym) {
+                    if (auto s_c = (*sym)(c)) { j.key("symbol"); j.symbol(*s_c); j.first_ = false; }
+                }
+                j.close();
+            }
+            j.end_arr();
+            j.end_obj();
+        }
+
+        if (!d.heap_ops.empty()) {
+            j.begin_obj("heap");
+            j.field("total", uint64_t(d.heap_total));
+            j.begin_arr("ops");
+            for (const HeapOp &op : d.heap_ops) {
+                j.elem_sep();
+                j.open();
+                j.field("op", heap_op_name(op.op));
+                if (op.op == HF_HEAP_OP_BOOT) {
+                    j.field("boot", uint64_t(op.size));
+                    j.close();
+                    continue;
+                }
+                j.hex("ptr", op.ptr);
+                if (op.op == HF_HEAP_OP_ALLOC) j.field("size", uint64_t(op.size));
+                j.hex("caller", op.caller);
+                j.hex("ctx", op.ctx);
+                if (sym && *sym) {
+                    if (auto s_c = (*sym)(op.caller)) { j.key("symbol"); j.symbol(*s_c); j.first_ = false; }
+                }
+                j.close();
+            }
+            j.end_arr();
+
+            const HeapReport r = heap_report(d);
+            j.begin_arr("matches");
+            for (const HeapReport::Match &m : r.matches) {
+                j.elem_sep();
+                j.open();
+                j.field("what", m.what);
+                j.hex("addr", m.addr);
+                j.hex("block", m.block);
+                if (m.size) j.field("size", uint64_t(m.size));
+                if (m.addr >= m.block) {
+                    j.field("offset", uint64_t(m.addr - m.block));
+                } else {
+                    j.field("header", true);
+                }
+                j.field("state", m.free >= 0 ? "freed" : "live");
+                if (m.alloc >= 0) j.field("alloc", uint64_t(m.alloc));
+                if (m.free >= 0)  j.field("free", uint64_t(m.free));
+                j.close();
+            }
+            j.end_arr();
+            j.begin_arr("double_frees");
+            for (const HeapReport::DoubleFree &df : r.double_frees) {
+                j.elem_sep();
+                j.open();
+                j.hex("block", df.block);
+                j.field("first", uint64_t(df.first));
+                j.field("second", uint64_t(df.second));
+                j.close();
+            }
+            j.end_arr();
+            j.end_obj();
+        }
+
+        if (d.rtos) {
+            j.begin_obj("task");
+            j.field("rtos", rtos_name(d.rtos));
+            j.field("name", d.task_name);
+            j.field("priority", uint64_t(d.task_priority));
+            j.hex("stack_base", d.task_stack_base);
+            j.field("min_free", uint64_t(d.task_min_free));
+            j.end_obj();
+        }
+
+        j.field("stack_bytes", uint64_t(d.stack_bytes));
+    }
+
+    if (sym && *sym) {
+        j.begin_obj("symbols");
+        if (auto s_pc = (*sym)(d.pc)) { j.key("pc"); j.symbol(*s_pc); j.first_ = false; }
+        if (auto s_lr = (*sym)(d.lr)) { j.key("lr"); j.symbol(*s_lr); j.first_ = false; }
+        j.end_obj();
+
+        /* Thumb return addresses on the stack: backtrace candidates. */
+        j.begin_arr("backtrace");
+        const std::vector<uint32_t> words = stack_words(d);
+        for (size_t i = 0; i < words.size(); i++) {
+            const uint32_t w = words[i];
+            if ((w & 1u) == 0u) continue;
+            auto s_w = (*sym)(w);
+            if (!s_w) continue;
+            j.elem_sep();
+            j.open();
+            j.hex("sp", d.active_sp + uint32_t(i * 4));
+            j.hex("addr", w);
+            j.key("symbol");
+            j.symbol(*s_w);
+            j.first_ = false;
+            j.close();
+        }
+        j.end_arr();
+    }
+
+    j.close();
+    return s;
+}
+
+} // namespace hfdump
+
+/* ============================ C API ============================ */
+
+#include "hfdump.h"
+
+#include <cstdlib>
+
+namespace {
+
+char *dup_cstr(const std::string &s)
+{
+    char *p = static_cast<char *>(malloc(s.size() + 1));
+    if (p) memcpy(p, s.c_str(), s.size() + 1);
+    return p;
+}
+
+hfdump::Symbolizer wrap(hfd_symbolize_fn fn, void *user)
+{
+    if (!fn) return {};
+    return [fn, user](uint32_t addr) -> std::optional<hfdump::Symbol> {
+        char func[256] = "", file[512] = "", image[128] = "";
+        uint32_t line = 0;
+        if (!fn(user, addr, func, sizeof(func), file, sizeof(file), &line,
+                image, sizeof(image))) {
+            return std::nullopt;
+        }
+        return hfdump::Symbol{func, file, line, image};
+    };
+}
+
+/* Dumps as a JSON array, one object per dump. */
+char *json_array(const std::vector<hfdump::Dump> &dumps, hfd_symbolize_fn fn, void *user)
+{
+    const hfdump::Symbolizer sym = wrap(fn, user);
+    std::string s = "[";
+    for (size_t i = 0; i < dumps.size(); i++) {
+        if (i) s += ',';
+        s += hfdump::to_json(dumps[i], fn ? &sym : nullptr);
+    }
+    s += ']';
+    return dup_cstr(s);
+}
+
+} // namespace
+
+extern "C" {
+
+char *hfd_parse_text_json(const char *text, size_t len,
+                          hfd_symbolize_fn fn, void *user)
+{
+    std::vector<hfdump::Dump> dumps;
+    hfdump::parse_text(std::string_view(text, len), dumps);
+    return json_array(dumps, fn, user);
+}
+
+char *hfd_parse_binary_json(const uint8_t *data, size_t len,
+                            hfd_symbolize_fn fn, void *user)
+{
+    std::vector<hfdump::Dump> dumps(1);
+    std::string err;
+    if (!hfdump::parse_binary(data, len, dumps[0], &err)) {
+        dumps.clear();
+    }
+    return json_array(dumps, fn, user);
+}
+
+char *hfd_parse_mailbox_json(const uint8_t *data, size_t len,
+                             hfd_symbolize_fn fn, void *user)
+{
+    std::vector<hfdump::Dump> dumps;
+    hfdump::parse_mailbox(data, len, dumps);
+    return json_array(dumps, fn, user);
+}
+
+char *hfd_scan_json(const uint8_t *data, size_t len,
+                    hfd_symbolize_fn fn, void *user)
+{
+    return hfd_scan_impl_json(data, len, 0, fn, user);
+}
+
+char *hfd_scan_impl_json(const uint8_t *data, size_t len, int impl,
+                         hfd_symbolize_fn fn, void *user)
+{
+    std::vector<hfdump::Span> spans;
+    std::vector<hfdump::Dump> dumps;
+    hfdump::scan(data, len, spans, static_cast<hfdump::ScanImpl>(impl));
+    hfdump::decode_spans(data, len, spans, dumps);
+    return json_array(dumps, fn, user);
+}
+
+size_t hfd_scan_count(const uint8_t *data, size_t len, int impl)
+{
+    std::vector<hfdump::Span> spans;
+    return hfdump::scan(data, len, spans, static_cast<hfdump::ScanImpl>(impl));
+}
+
+const char *hfd_scan_impl(int impl)
+{
+    return hfdump::scan_impl_name(static_cast<hfdump::ScanImpl>(impl));
+}
+
+size_t hfd_count_text(const char *text, size_t len)
+{
+    std::vector<hfdump::Dump> dumps;
+    return hfdump::parse_text(std::string_view(text, len), dumps);
+}
+
+void hfd_free(char *p)
+{
+    free(p);
+}
+
+const char *hfd_version(void)
+{
+    static char buf[64];
+    if (!buf[0]) {
+        snprintf(buf, sizeof(buf), "libhfdump 1 (dump v%u-v%u, mailbox ABI %u)",
+                 unsigned(HF_VERSION_MIN), unsigned(HF_VERSION),
+                 unsigned(HF_MBOX_ABI_VERSION));
+    }
+    return buf;
+}
+
+} // extern "C"
@@ -0,0 +1,58 @@
+#pragma once
+
+/*
+ * C API of libhfdump, for bindings (hfdump.py uses it through ctypes).
+ *
+ * Every hfd_parse_*_json() call returns a malloc'd JSON array with one
+ * object per dump found (see hfdump::to_json()); release it with hfd_free().
+ * An input with no dump gives "[]".
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Optional symbolizer: fill func/file/line (and image, may stay empty) and
+ * return nonzero, or return 0 if addr is not code. Called from the parsing
+ * thread, synchronously.
+ */
+typedef int (*hfd_symbolize_fn)(void *user, uint32_t addr,
+                                char *func, size_t func_len,
+                                char *file, size_t file_len,
+                                uint32_t *line,
+                                char *image, size_t image_len);
+
+char  *hfd_parse_text_json(const char *text, size_t len,
+                           hfd_symbolize_fn fn, void *user);
+char  *hfd_parse_binary_json(const uint8_t *data, size_t len,
+                             hfd_symbolize_fn fn, void *user);
+char  *hfd_parse_mailbox_json(const uint8_t *data, size_t len,
+                              hfd_symbolize_fn fn, void *user);
+
+/* Dumps anywhere in raw bytes (mixed traffic, memory images): text blocks,
+ * HF_ADDR lines, binary dumps and mailboxes. See hfdump::scan(). */
+char  *hfd_scan_json(const uint8_t *data, size_t len,
+                     hfd_symbolize_fn fn, void *user);
+
+/* impl: 0 auto, 1 scalar, 2 SSE2, 3 AVX2 (falls back if the CPU lacks it;
+ * see hfd_scan_impl()). Every impl finds the same dumps. */
+char  *hfd_scan_impl_json(const uint8_t *data, size_t len, int impl,
+                          hfd_symbolize_fn fn, void *user);
+
+/* Scanner only: number of candidate spans, impl as above. */
+size_t hfd_scan_count(const uint8_t *data, size_t len, int impl);
+const char *hfd_scan_impl(int impl);
+
+/* Number of dumps in a text log, without rendering anything. */
+size_t hfd_count_text(const char *text, size_t len);
+
+void        hfd_free(char *p);
+const char *hfd_version(void);
+
+#ifdef __cplusplus
+}
+#endif
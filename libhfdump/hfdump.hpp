@@ -0,0 +1,256 @@
+#pragma once
+
+/*
+ * libhfdump: host-side decoding of HardFault dumps.
+ *
+ * Parses the raw binary dump (as fetched by hf_fetch.py or read out of a
+ * RAM image), a whole dump mailbox, or the text printed by
+ * HardFault_DecodeAndPrint() (including bare HF_ADDR lines) into typed
+ * records. Verifies the on-target XOR checksum, decodes the fault status
+ * bits, and renders JSON with optional symbolization.
+ *
+ * The binary layout comes straight from ../hf_abi.h, so target and host
+ * cannot drift apart.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace hfdump {
+
+enum class Source {
+    Binary,     /* raw header + payload bytes, checksum verified */
+    Text,       /* ===== HARD FAULT DUMP ===== block */
+    AddrLine,   /* lone "HF_ADDR PC=... LR=..." line */
+};
+
+enum class Check {
+    Ok,
+    Bad,
+    Unknown,    /* text dumps carry no checksum */
+};
+
+/* One task of the background stack sampler's table (HF_EXT_TASK_STACKS). */
+struct TaskStack {
+    struct Low {
+        uint32_t tick = 0;
+        uint32_t free = 0;
+        uint16_t boot = 0;
+    };
+
+    std::string name;
+    uint32_t stack_base = 0;         /* 0 in text dumps */
+    uint32_t stack_size = 0;         /* 0 = unknown */
+    uint32_t min_free   = 0;         /* over all boots */
+    uint32_t last_free  = 0;
+    uint16_t boot       = 0;         /* boot it was last tracked on (binary only) */
+    bool     sampled    = false;
+    bool     live       = false;     /* tracked when the dump was written */
+    std::vector<Low> lows;           /* new lows, oldest first */
+};
+
+/* Call sites of the faulting context (HF_EXT_SHADOW_STACK), innermost first. */
+struct ShadowStack {
+    bool     present  = false;
+    uint32_t thread   = 0;           /* kernel thread handle, 0 = none */
+    uint32_t depth    = 0;           /* instrumented calls active at the fault */
+    bool     handler  = false;       /* fault hit Handler mode */
+    bool     wrapped  = false;       /* deeper than calls: outer ones lost */
+    bool     unsynced = false;       /* more exits than entries were seen */
+    std::vector<uint32_t> calls;
+};
+
+/* One allocator call of the heap history (HF_EXT_HEAP_OPS). */
+struct HeapOp {
+    uint8_t  op     = 0;             /* HF_HEAP_OP_* */
+    uint32_t ptr    = 0;             /* 0 for a failed allocation */
+    uint32_t size   = 0;             /* bytes requested; boot count for a boot */
+    uint32_t caller = 0;             /* return address into the caller */
+    uint32_t ctx    = 0;             /* thread handle, exception number (< 512), 0 */
+};
+
+/* First corruption the integrity scanner found (HF_EXT_SCAN). */
+struct ScanFinding {
+    bool        present  = false;
+    uint8_t     kind     = 0;        /* HF_SCAN_* */
+    uint32_t    addr     = 0;        /* word found wrong */
+    uint32_t    found    = 0;
+    uint32_t    expected = 0;        /* fill word, stacks only */
+    uint32_t    region   = 0;        /* stack bottom or heap region start */
+    std::string task;                /* HF_SCAN_TASK_STACK */
+};
+
+struct Dump {
+    Source   source  = Source::Binary;
+    Check    check   = Check::Unknown;
+    int      slot    = -1;           /* mailbox slot / image id, -1 if unknown */
+    uint32_t fault_count = 0;        /* from mailbox or text, 0 if unknown */
+
+    uint16_t version    = 0;
+    uint16_t header_len = 0;
+
+    uint32_t exc_return = 0;
+    uint32_t msp = 0, psp = 0, active_sp = 0;
+    bool     used_psp = false;
+    bool     has_fp   = false;
+
+    uint32_t cfsr = 0, hfsr = 0, dfsr = 0, mmfar = 0, bfar = 0, afsr = 0;
+    uint32_t shcsr = 0;
+
+    uint32_t r0 = 0, r1 = 0, r2 = 0, r3 = 0, r12 = 0;
+    uint32_t lr = 0, pc = 0, psr = 0;
+
+    uint32_t    rtos = 0;            /* HF_RTOS_* id, 0 = none */
+    uint32_t    task_priority = 0;
+    uint32_t    task_min_free = 0;
+    uint32_t    task_stack_base = 0;
+    std::string task_name;
+
+    uint32_t stack_bytes = 0;        /* as recorded by the target */
+    uint32_t checksum    = 0;
+
+    /* v4 */
+    uint16_t arch     = 0;           /* HF_ARCH_* */
+    uint16_t flags    = 0;           /* HF_DUMP_F_* */
+    uint32_t sp_limit = 0;
+
+    /* v5 */
+    uint32_t msp_limit    = 0;       /* bottom of the main stack, 0 = unknown */
+    uint32_t msp_max_used = 0;       /* bytes, 0 = stack not painted */
+
+    /* v6: extension records after the payload, own checksum */
+    uint32_t ext_bytes = 0;
+    Check    ext_check = Check::Unknown;
+    std::vector<TaskStack> task_stacks;
+    ShadowStack shadow;
+    uint32_t heap_total = 0;         /* ops the target logged in all */
+    std::vector<HeapOp> heap_ops;    /* newest first */
+    ScanFinding integrity;
+
+    /* Stack payload (binary dumps only), starting at active_sp. */
+    std::vector<uint8_t> stack;
+
+    /* Byte offset of the dump in the parsed input (text: of its first line). */
+    size_t offset = 0;
+};
+
+struct Symbol {
+    std::string function;
+    std::string file;
+    uint32_t    line = 0;
+    std::string image;               /* which ELF it came from, if several */
+};
+
+/* Return the symbol for an address, or nullopt if it isn't code. */
+using Symbolizer = std::function<std::optional<Symbol>(uint32_t addr)>;
+
+/* ---- Parsing ---- */
+
+/* One dump from raw bytes. Returns false (and sets *err) if it isn't one;
+ * a dump with a bad checksum parses with check == Check::Bad. */
+bool parse_binary(const uint8_t *data, size_t len, Dump &out,
+                  std::string *err = nullptr);
+
+/* All valid slots of a dump mailbox image starting at __hf_dump_start. */
+bool parse_mailbox(const uint8_t *data, size_t len, std::vector<Dump> &out,
+                   std::string *err = nullptr);
+
+/* Every dump block and lone HF_ADDR line in a text log. Returns the number
+ * of dumps appended. A block without its END line ends at the first line
+ * block_line() rejects. */
+size_t parse_text(std::string_view log, std::vector<Dump> &out);
+
+/* Whether the target prints such a line inside a dump block (any prefix
+ * the host logger added is allowed). */
+bool block_line(std::string_view line);
+
+/* ---- Scanning raw captures ---- */
+
+enum class Mark : uint8_t {
+    TextDump,   /* "===== HARD FAULT DUMP =====" ... END line */
+    AddrLine,   /* "HF_ADDR ..." line outside a dump block */
+    BinaryDump, /* hf_dump_hdr_t magic + plausible header */
+    Mailbox,    /* hf_mbox_hdr_t magic + plausible geometry */
+};
+
+struct Span {
+    Mark   kind;
+    size_t begin;
+    size_t end;                      /* exclusive */
+};
+
+enum class ScanImpl { Auto, Scalar, SSE2, AVX2 };
+
+/* Find dump candidates in arbitrary bytes (mixed UART traffic, memory
+ * images, multi-GB files). Marker search is vectorized where the CPU allows;
+ * candidates are then checked and sized. Spans do not overlap. Returns the
+ * number of spans appended. */
+size_t scan(const uint8_t *data, size_t len, std::vector<Span> &out,
+            ScanImpl impl = ScanImpl::Auto);
+
+bool        scan_impl_available(ScanImpl impl);
+const char *scan_impl_name(ScanImpl impl);   /* Auto: the one it resolves to */
+
+/* Decode the spans found by scan(); offsets are relative to data. */
+size_t decode_spans(const uint8_t *data, size_t len,
+                    const std::vector<Span> &spans, std::vector<Dump> &out);
+
+/* ---- Analysis ---- */
+
+/* Names of the set CFSR / HFSR bits, e.g. {"PRECISERR", "BFARVALID"}. */
+std::vector<const char *> cfsr_bits(uint32_t cfsr);
+std::vector<const char *> hfsr_bits(uint32_t hfsr);
+std::vector<const char *> fpscr_bits(uint32_t flags);   /* HF_FPSCR_*: {"DZC", ...} */
+
+/* Coarse class for indexing: "MemManage:DACCVIOL", "BusFault:PRECISERR",
+ * "UsageFault:UNDEFINSTR", "HardFault:VECTTBL", "HardFault:FORCED" or
+ * "unknown"; soft dumps (HF_DUMP_F_SOFT) give "Integrity:HEAP_LINK" etc.,
+ * FPU traps (HF_DUMP_F_FPU_TRAP) "FpuTrap:DZC" etc. */
+std::string fault_class(const Dump &d);
+
+/* Fault address if the hardware latched one (MMARVALID/BFARVALID). */
+std::optional<uint32_t> fault_address(const Dump &d);
+
+/* The heap history replayed oldest first: which blocks the fault address
+ * and r0-r3/r12 point into (or just below, into the allocator's header),
+ * and blocks freed twice. Indices refer to Dump::heap_ops. */
+struct HeapReport {
+    struct Match {
+        const char *what = "";       /* "mmfar", "bfar", "r0", ... */
+        uint32_t addr  = 0;
+        uint32_t block = 0;          /* pointer the allocator handed out */
+        uint32_t size  = 0;          /* 0 if allocated before the history */
+        int      alloc = -1;         /* its allocation, -1 if before the history */
+        int      free  = -1;         /* its free, -1 while live */
+    };
+    struct DoubleFree {
+        uint32_t block = 0;
+        int      first  = -1;
+        int      second = -1;
+    };
+    std::vector<Match>      matches;
+    std::vector<DoubleFree> double_frees;
+};
+
+HeapReport heap_report(const Dump &d);
+
+/* 32-bit little-endian words of the stack payload. */
+std::vector<uint32_t> stack_words(const Dump &d);
+
+const char *arch_name(uint16_t arch);
+const char *scan_kind_name(uint8_t kind);       /* "TASK_STACK", ... */
+const char *rtos_name(uint32_t rtos);
+
+/* ---- Output ---- */
+
+/* One JSON object (single line). With a symbolizer, PC/LR, shadow stack
+ * call sites and heap callers are resolved, and stack words that resolve to
+ * code are listed as backtrace candidates. */
+std::string to_json(const Dump &d, const Symbolizer *sym = nullptr);
+
+} // namespace hfdump
@@ -0,0 +1,332 @@
+/*
+ * hfdump: decode HardFault dumps to JSON lines.
+ *
+ *   hfdump [--text|--bin|--mailbox|--scan] [--elf firmware.elf] [--bench N] FILE...
+ *   hfdump --bench-scan FILE...
+ *
+ * Input type is guessed from the first bytes unless forced. --scan finds
+ * dumps anywhere in raw captures of any size (the file is mapped, not read).
+ * With --elf, PC, LR and stack words are resolved through one long-running
+ * arm-none-eabi-addr2line process (override with $HF_ADDR2LINE).
+ * --bench-scan reports the marker scanner's speed per SIMD level.
+ * --bench N parses every input N times and reports dumps/s on stderr.
+ */
+
+#include "hfdump.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <unordered_map>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+
+enum class Mode { Auto, Text, Bin, Mailbox, Scan };
+
+/* ============================ addr2line ============================ */
+
+/* addr2line reads addresses on stdin and answers two lines each. */
+class Addr2Line {
+public:
+    explicit Addr2Line(const std::string &elf) : elf_(elf)
+    {
+        const char *tool = getenv("HF_ADDR2LINE");
+        if (!tool) tool = "arm-none-eabi-addr2line";
+
+        int in[2], out[2];
+        if (pipe(in) != 0 || pipe(out) != 0) return;
+        pid_ = fork();
+        if (pid_ == 0) {
+            dup2(in[0], 0);
+            dup2(out[1], 1);
+            close(in[1]);
+            close(out[0]);
+            execlp(tool, tool, "-f", "-C", "-e", elf.c_str(), (char *)nullptr);
+            _exit(127);
+        }
+        close(in[0]);
+        close(out[1]);
+        to_ = fdopen(in[1], "w");
+        from_ = fdopen(out[0], "r");
+    }
+
+    ~Addr2Line()
+    {
+        if (to_) fclose(to_);
+        if (from_) fclose(from_);
+        if (pid_ > 0) waitpid(pid_, nullptr, 0);
+    }
+
+    std::optional<hfdump::Symbol> operator()(uint32_t addr)
+    {
+        auto it = cache_.find(addr);
+        if (it != cache_.end()) return it->second;
+
+        std::optional<hfdump::Symbol> r = query(addr);
+        cache_.emplace(addr, r);
+        return r;
+    }
+
+private:
+    std::optional<hfdump::Symbol> query(uint32_t addr)
+    {
+        if (!to_ || !from_) return std::nullopt;
+
+        fprintf(to_, "0x%08X\n", addr & ~1u);
+        fflush(to_);
+
+        char func[512], loc[1024];
+        if (!fgets(func, sizeof(func), from_) || !fgets(loc, sizeof(loc), from_)) {
+            fclose(to_);
+            to_ = nullptr;
+            return std::nullopt;
+        }
+        func[strcspn(func, "\n")] = '\0';
+        loc[strcspn(loc, "\n")] = '\0';
+        if (strcmp(func, "??") == 0) return std::nullopt;
+
+        hfdump::Symbol s;
+        s.function = func;
+        char *colon = strrchr(loc, ':');
+        if (colon) {
+            *colon = '\0';
+            s.line = uint32_t(strtoul(colon + 1, nullptr, 10));
+        }
+        s.file = loc;
+        return s;
+    }
+
+    std::string elf_;
+    pid_t pid_ = -1;
+    FILE *to_ = nullptr;
+    FILE *from_ = nullptr;
+    std::unordered_map<uint32_t, std::optional<hfdump::Symbol>> cache_;
+};
+
+/* ============================== Input ============================== */
+
+/* Read-only mapping of a whole file; captures can be larger than RAM. */
+class Mapped {
+public:
+    explicit Mapped(const char *path)
+    {
+        const int fd = open(path, O_RDONLY);
+        if (fd < 0) return;
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            void *m = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if (m != MAP_FAILED) {
+                data_ = static_cast<const uint8_t *>(m);
+                size_ = size_t(st.st_size);
+                madvise(m, size_, MADV_SEQUENTIAL);
+            }
+        } else if (fstat(fd, &st) == 0) {
+            ok_empty_ = true;
+        }
+        close(fd);
+    }
+
+    ~Mapped()
+    {
+        if (data_) munmap(const_cast<uint8_t *>(data_), size_);
+    }
+
+    bool           ok() const   { return data_ != nullptr || ok_empty_; }
+    const uint8_t *data() const { return data_; }
+    size_t         size() const { return size_; }
+
+private:
+    const uint8_t *data_ = nullptr;
+    size_t size_ = 0;
+    bool ok_empty_ = false;
+};
+
+int scan_files(const std::vector<const char *> &files, const char *elf, bool bench)
+{
+    std::optional<Addr2Line> a2l;
+    hfdump::Symbolizer sym;
+    if (elf) {
+        a2l.emplace(elf);
+        sym = [&a2l](uint32_t addr) { return (*a2l)(addr); };
+    }
+
+    for (const char *f : files) {
+        Mapped m(f);
+        if (!m.ok()) {
+            fprintf(stderr, "%s: cannot map\n", f);
+            return 1;
+        }
+        if (!bench) {
+            std::vector<hfdump::Span> spans;
+            std::vector<hfdump::Dump> dumps;
+            hfdump::scan(m.data(), m.size(), spans);
+            hfdump::decode_spans(m.data(), m.size(), spans, dumps);
+            for (const hfdump::Dump &d : dumps) {
+                puts(hfdump::to_json(d, elf ? &sym : nullptr).c_str());
+            }
+            continue;
+        }
+
+        /* Touch the file once so every level sees it in the page cache. */
+        std::vector<hfdump::Span> spans;
+        hfdump::scan(m.data(), m.size(), spans, hfdump::ScanImpl::Auto);
+
+        fprintf(stderr, "%s: %.1f MB\n", f, double(m.size()) / 1e6);
+        for (hfdump::ScanImpl impl : {hfdump::ScanImpl::Scalar, hfdump::ScanImpl::SSE2,
+                                      hfdump::ScanImpl::AVX2}) {
+            if (!hfdump::scan_impl_available(impl)) continue;
+            double best = 1e9;
+            size_t found = 0;
+            for (int rep = 0; rep < 3; rep++) {
+                spans.clear();
+                const auto t0 = std::chrono::steady_clock::now();
+                found = hfdump::scan(m.data(), m.size(), spans, impl);
+                const double s = std::chrono::duration<double>(
+                                     std::chrono::steady_clock::now() - t0).count();
+                if (s < best) best = s;
+            }
+            fprintf(stderr, "  %-7s %8.2f GB/s  %zu spans\n", hfdump::scan_impl_name(impl),
+                    best > 0 ? double(m.size()) / best / 1e9 : 0.0, found);
+        }
+    }
+    return 0;
+}
+
+bool read_file(const char *path, std::string &out)
+{
+    std::ifstream f(path, std::ios::binary);
+    if (!f) return false;
+    out.assign(std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>());
+    return true;
+}
+
+Mode guess(const std::string &data)
+{
+    if (data.size() >= 4) {
+        const uint8_t *p = reinterpret_cast<const uint8_t *>(data.data());
+        const uint32_t magic = uint32_t(p[0]) | uint32_t(p[1]) << 8 |
+                               uint32_t(p[2]) << 16 | uint32_t(p[3]) << 24;
+        if (magic == 0x424D4648u) return Mode::Mailbox;   /* HF_MBOX_MAGIC */
+        if (magic == 0x48464450u) return Mode::Bin;       /* HF_MAGIC */
+    }
+    return Mode::Text;
+}
+
+size_t parse(Mode mode, const std::string &data, std::vector<hfdump::Dump> &out,
+             std::string &err)
+{
+    const uint8_t *p = reinterpret_cast<const uint8_t *>(data.data());
+    const size_t before = out.size();
+
+    switch (mode) {
+    case Mode::Text:
+        hfdump::parse_text(data, out);
+        break;
+    case Mode::Bin: {
+        hfdump::Dump d;
+        if (hfdump::parse_binary(p, data.size(), d, &err)) out.push_back(std::move(d));
+        break;
+    }
+    case Mode::Mailbox:
+        hfdump::parse_mailbox(p, data.size(), out, &err);
+        break;
+    case Mode::Auto:
+    case Mode::Scan:
+        break;
+    }
+    return out.size() - before;
+}
+
+int usage(const char *argv0)
+{
+    fprintf(stderr,
+            "Usage: %s [--text|--bin|--mailbox|--scan] [--elf ELF] [--bench N] FILE...\n"
+            "       %s --bench-scan FILE...\n",
+            argv0, argv0);
+    return 1;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    Mode force = Mode::Auto;
+    const char *elf = nullptr;
+    long bench = 0;
+    bool bench_scan = false;
+    std::vector<const char *> files;
+
+    for (int i = 1; i < argc; i++) {
+        const std::string a = argv[i];
+        if (a == "--text")         force = Mode::Text;
+        else if (a == "--bin")     force = Mode::Bin;
+        else if (a == "--mailbox") force = Mode::Mailbox;
+        else if (a == "--scan")    force = Mode::Scan;
+        else if (a == "--bench-scan") bench_scan = true;
+        else if (a == "--elf" && i + 1 < argc)   elf = argv[++i];
+        else if (a == "--bench" && i + 1 < argc) bench = strtol(argv[++i], nullptr, 10);
+        else if (a.size() > 1 && a[0] == '-')    return usage(argv[0]);
+        else files.push_back(argv[i]);
+    }
+    if (files.empty()) return usage(argv[0]);
+    if (force == Mode::Scan || bench_scan) return scan_files(files, elf, bench_scan);
+
+    std::vector<std::pair<Mode, std::string>> inputs;
+    for (const char *f : files) {
+        std::string data;
+        if (!read_file(f, data)) {
+            fprintf(stderr, "%s: cannot read\n", f);
+            return 1;
+        }
+        const Mode m = (force == Mode::Auto) ? guess(data) : force;
+        inputs.emplace_back(m, std::move(data));
+    }
+
+    if (bench > 0) {
+        size_t total = 0;
+        std::vector<hfdump::Dump> dumps;
+        std::string err;
+        const auto t0 = std::chrono::steady_clock::now();
+        for (long n = 0; n < bench; n++) {
+            for (const auto &in : inputs) {
+                dumps.clear();
+                total += parse(in.first, in.second, dumps, err);
+            }
+        }
+        const double s = std::chrono::duration<double>(
+                             std::chrono::steady_clock::now() - t0).count();
+        fprintf(stderr, "%zu dumps in %.3f s: %.0f dumps/s\n",
+                total, s, s > 0 ? double(total) / s : 0.0);
+        return 0;
+    }
+
+    std::optional<Addr2Line> a2l;
+    hfdump::Symbolizer sym;
+    if (elf) {
+        a2l.emplace(elf);
+        sym = [&a2l](uint32_t addr) { return (*a2l)(addr); };
+    }
+
+    int rc = 0;
+    for (size_t i = 0; i < inputs.size(); i++) {
+        std::vector<hfdump::Dump> dumps;
+        std::string err;
+        if (parse(inputs[i].first, inputs[i].second, dumps, err) == 0 && !err.empty()) {
+            fprintf(stderr, "%s: %s\n", files[i], err.c_str());
+            rc = 1;
+        }
+        for (const hfdump::Dump &d : dumps) {
+            puts(hfdump::to_json(d, elf ? &sym : nullptr).c_str());
+        }
+    }
+    return rc;
+}
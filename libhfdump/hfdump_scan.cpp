@@ -0,0 +1,350 @@
+/*
+ * Marker scanner for raw captures.
+ *
+ * Finding a dump in gigabytes of UART traffic is a substring search for a
+ * handful of markers. Rather than one memmem() per marker, every position is
+ * tested against all of them at once with a cheap two-byte filter (first
+ * byte + one distinguishing byte further in), 16 or 32 positions per step:
+ *
+ *   "===== HARD FAULT DUMP"   '=' at +0, 'H' at +6
+ *   "HF_ADDR"                 'H' at +0, 'D' at +4
+ *   "HFMB" (mailbox magic)    'H' at +0, 'M' at +2
+ *   "PDFH" (dump magic)       'P' at +0, 'H' at +3
+ *
+ * Hits are rare in normal traffic, so the exact compare and sizing that
+ * follow cost nothing measurable.
+ */
+
+#include "hfdump.hpp"
+
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+  #include <immintrin.h>
+  #define HFD_X86 1
+#else
+  #define HFD_X86 0
+#endif
+
+extern "C" {
+#include "../hf_abi.h"
+}
+
+namespace hfdump {
+
+namespace {
+
+constexpr char   kBegin[]    = "===== HARD FAULT DUMP =====";
+constexpr char   kEnd[]      = "===== END HARD FAULT DUMP =====";
+constexpr char   kAddr[]     = "HF_ADDR";
+constexpr size_t kLookahead  = 6;            /* furthest filter byte */
+constexpr size_t kMaxText    = 64u * 1024u;  /* a dump block is ~1 KB */
+constexpr size_t kMaxLine    = 256u;
+constexpr size_t kMaxBinary  = 1024u * 1024u;
+
+uint32_t rd32(const uint8_t *p)
+{
+    return uint32_t(p[0]) | uint32_t(p[1]) << 8 |
+           uint32_t(p[2]) << 16 | uint32_t(p[3]) << 24;
+}
+
+uint16_t rd16(const uint8_t *p)
+{
+    return uint16_t(p[0] | p[1] << 8);
+}
+
+/* ======================= Candidate filters ======================= */
+
+inline bool filter_at(const uint8_t *p)
+{
+    const uint8_t c = p[0];
+    return (c == '=' && p[6] == 'H') ||
+           (c == 'H' && (p[4] == 'D' || p[2] == 'M')) ||
+           (c == 'P' && p[3] == 'H');
+}
+
+/*
+ * Each kernel walks [from, n) and calls hit(i) for every position passing
+ * the filter, in order. hit() returns where scanning resumes (i + 1, or
+ * the end of the span it found), so the kernels never re-test bytes that
+ * belong to a span. Positions too close to the end for the filter's
+ * lookahead are left to the scalar tail.
+ */
+template <class Hit>
+size_t run_scalar(const uint8_t *p, size_t from, size_t n, Hit &hit)
+{
+    size_t i = from;
+    while (i + kLookahead < n) {
+        i = filter_at(p + i) ? hit(i) : i + 1;
+    }
+    return i;
+}
+
+/* Feed the set bits of one block's mask to hit(); returns the resume point. */
+template <class Hit>
+size_t run_mask(uint32_t mask, size_t base, size_t next, Hit &hit)
+{
+    while (mask) {
+        const size_t pos = base + size_t(__builtin_ctz(mask));
+        mask &= mask - 1u;
+        if (pos >= next) next = hit(pos);
+    }
+    return next;
+}
+
+#if HFD_X86
+
+template <class Hit>
+__attribute__((target("sse2")))
+size_t run_sse2(const uint8_t *p, size_t from, size_t n, Hit &hit)
+{
+    const __m128i eq = _mm_set1_epi8('='), h = _mm_set1_epi8('H');
+    const __m128i d = _mm_set1_epi8('D'), m = _mm_set1_epi8('M');
+    const __m128i pp = _mm_set1_epi8('P');
+
+    size_t i = from;
+    while (i + 16 + kLookahead <= n) {
+        const __m128i b0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i));
+        const __m128i b2 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i + 2));
+        const __m128i b3 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i + 3));
+        const __m128i b4 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i + 4));
+        const __m128i b6 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i + 6));
+
+        const __m128i hits =
+            _mm_or_si128(
+                _mm_or_si128(
+                    _mm_and_si128(_mm_cmpeq_epi8(b0, eq), _mm_cmpeq_epi8(b6, h)),
+                    _mm_and_si128(_mm_cmpeq_epi8(b0, h),
+                                  _mm_or_si128(_mm_cmpeq_epi8(b4, d),
+                                               _mm_cmpeq_epi8(b2, m)))),
+                _mm_and_si128(_mm_cmpeq_epi8(b0, pp), _mm_cmpeq_epi8(b3, h)));
+
+        const uint32_t mask = uint32_t(_mm_movemask_epi8(hits));
+        const size_t next = mask ? run_mask(mask, i, i, hit) : i;
+        i = (next > i + 16) ? next : i + 16;
+    }
+    return run_scalar(p, i, n, hit);
+}
+
+template <class Hit>
+__attribute__((target("avx2")))
+size_t run_avx2(const uint8_t *p, size_t from, size_t n, Hit &hit)
+{
+    const __m256i eq = _mm256_set1_epi8('='), h = _mm256_set1_epi8('H');
+    const __m256i d = _mm256_set1_epi8('D'), m = _mm256_set1_epi8('M');
+    const __m256i pp = _mm256_set1_epi8('P');
+
+    size_t i = from;
+    while (i + 32 + kLookahead <= n) {
+        const __m256i b0 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + i));
+        const __m256i b2 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + i + 2));
+        const __m256i b3 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + i + 3));
+        const __m256i b4 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + i + 4));
+        const __m256i b6 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + i + 6));
+
+        const __m256i hits =
+            _mm256_or_si256(
+                _mm256_or_si256(
+                    _mm256_and_si256(_mm256_cmpeq_epi8(b0, eq), _mm256_cmpeq_epi8(b6, h)),
+                    _mm256_and_si256(_mm256_cmpeq_epi8(b0, h),
+                                     _mm256_or_si256(_mm256_cmpeq_epi8(b4, d),
+                                                     _mm256_cmpeq_epi8(b2, m)))),
+                _mm256_and_si256(_mm256_cmpeq_epi8(b0, pp), _mm256_cmpeq_epi8(b3, h)));
+
+        const uint32_t mask = uint32_t(_mm256_movemask_epi8(hits));
+        const size_t next = mask ? run_mask(mask, i, i, hit) : i;
+        i = (next > i + 32) ? next : i + 32;
+    }
+    return run_scalar(p, i, n, hit);
+}
+
+#endif /* HFD_X86 */
+
+bool cpu_has(ScanImpl impl)
+{
+    switch (impl) {
+#if HFD_X86
+    case ScanImpl::AVX2: return __builtin_cpu_supports("avx2");
+    case ScanImpl::SSE2: return __builtin_cpu_supports("sse2");
+#endif
+    case ScanImpl::Scalar: return true;
+    default:               return false;
+    }
+}
+
+/* Requested level if the CPU has it, else the best one it has. */
+ScanImpl resolve(ScanImpl impl)
+{
+    if (impl != ScanImpl::Auto && cpu_has(impl)) return impl;
+    if (cpu_has(ScanImpl::AVX2)) return ScanImpl::AVX2;
+    if (cpu_has(ScanImpl::SSE2)) return ScanImpl::SSE2;
+    return ScanImpl::Scalar;
+}
+
+/* ========================= Verification ========================= */
+
+bool starts(const uint8_t *p, size_t i, size_t n, const char *lit, size_t len)
+{
+    return i + len <= n && memcmp(p + i, lit, len) == 0;
+}
+
+size_t find(const uint8_t *p, size_t from, size_t to, const char *lit, size_t len)
+{
+    const void *r = memmem(p + from, to - from, lit, len);
+    return r ? size_t(static_cast<const uint8_t *>(r) - p) : to;
+}
+
+size_t line_end(const uint8_t *p, size_t i, size_t n)
+{
+    const size_t lim = (n - i > kMaxLine) ? i + kMaxLine : n;
+    const void *nl = memchr(p + i, '\n', lim - i);
+    return nl ? size_t(static_cast<const uint8_t *>(nl) - p) + 1 : lim;
+}
+
+/* End of the block lines of a truncated dump block whose BEGIN line runs
+ * on from `from`: the start of the first other line, at most `to`. */
+size_t block_end(const uint8_t *p, size_t from, size_t to)
+{
+    const void *nl = memchr(p + from, '\n', to - from);
+    size_t e = nl ? size_t(static_cast<const uint8_t *>(nl) - p) + 1 : to;
+    while (e < to) {
+        nl = memchr(p + e, '\n', to - e);
+        const size_t next = nl ? size_t(static_cast<const uint8_t *>(nl) - p) + 1 : to;
+        if (!block_line(std::string_view(reinterpret_cast<const char *>(p + e), next - e))) {
+            break;
+        }
+        e = next;
+    }
+    return e;
+}
+
+/* Exact check and extent of the candidate at i; false if it is none. */
+bool verify(const uint8_t *p, size_t i, size_t n, Span &s)
+{
+    switch (p[i]) {
+    case '=': {
+        if (!starts(p, i, n, kBegin, sizeof(kBegin) - 1)) return false;
+        const size_t lim = (n - i > kMaxText) ? i + kMaxText : n;
+        const size_t from = i + sizeof(kBegin) - 1;
+        size_t e = find(p, from, lim, kEnd, sizeof(kEnd) - 1);
+        const size_t next = find(p, from, e, kBegin, sizeof(kBegin) - 1);
+        if (next == e && e < lim) {
+            e = line_end(p, e, n);
+        } else {
+            /* Truncated (reset mid-print): stop at the next block or at the
+             * first line that is not the target's, so the lines after it
+             * (lone HF_ADDR ones among them) get spans of their own. */
+            e = block_end(p, from, next);
+        }
+        s = {Mark::TextDump, i, e};
+        return true;
+    }
+    case 'H':
+        if (starts(p, i, n, kAddr, sizeof(kAddr) - 1)) {
+            s = {Mark::AddrLine, i, line_end(p, i, n)};
+            return true;
+        }
+        if (i + sizeof(hf_mbox_hdr_t) <= n && rd32(p + i) == HF_MBOX_MAGIC) {
+            const uint32_t area = rd32(p + i + offsetof(hf_mbox_hdr_t, area_size));
+            if (rd16(p + i + offsetof(hf_mbox_hdr_t, abi_version)) != HF_MBOX_ABI_VERSION ||
+                area < sizeof(hf_mbox_hdr_t) || area > kMaxBinary) {
+                return false;
+            }
+            s = {Mark::Mailbox, i, (area > n - i) ? n : i + area};
+            return true;
+        }
+        return false;
+    case 'P': {
+        if (i + HF_DUMP_HDR_MIN_LEN > n || rd32(p + i) != HF_MAGIC) return false;
+        const uint16_t ver  = rd16(p + i + offsetof(hf_dump_hdr_t, version));
+        const uint16_t hlen = rd16(p + i + offsetof(hf_dump_hdr_t, header_len));
+        const uint32_t sb   = rd32(p + i + offsetof(hf_dump_hdr_t, stack_bytes));
+        if (ver < HF_VERSION_MIN || ver > 0xFF || hlen < HF_DUMP_HDR_MIN_LEN ||
+            hlen > 4096u || sb > kMaxBinary) {
+            return false;
+        }
+        size_t len = size_t(hlen) + sb;
+        if (hlen >= offsetof(hf_dump_hdr_t, ext_checksum) + 4u && i + hlen <= n) {
+            const uint32_t ext = rd32(p + i + offsetof(hf_dump_hdr_t, ext_bytes));
+            if (ext <= kMaxBinary) len += ext;   /* v6 extension records */
+        }
+        s = {Mark::BinaryDump, i, (len > n - i) ? n : i + len};
+        return true;
+    }
+    default:
+        return false;
+    }
+}
+
+} // namespace
+
+/* ============================== API ============================== */
+
+size_t scan(const uint8_t *p, size_t n, std::vector<Span> &out, ScanImpl impl)
+{
+    const size_t before = out.size();
+
+    auto hit = [&](size_t i) -> size_t {
+        Span s;
+        if (!verify(p, i, n, s)) return i + 1;
+        out.push_back(s);
+        return (s.end > i) ? s.end : i + 1;   /* nested markers are the span's */
+    };
+
+    /* The last kLookahead bytes are never tested: no marker fits there. */
+    switch (resolve(impl)) {
+#if HFD_X86
+    case ScanImpl::AVX2: run_avx2(p, 0, n, hit); break;
+    case ScanImpl::SSE2: run_sse2(p, 0, n, hit); break;
+#endif
+    default:             run_scalar(p, 0, n, hit); break;
+    }
+    return out.size() - before;
+}
+
+bool scan_impl_available(ScanImpl impl)
+{
+    return impl == ScanImpl::Auto || cpu_has(impl);
+}
+
+const char *scan_impl_name(ScanImpl impl)
+{
+    switch (resolve(impl)) {
+    case ScanImpl::AVX2: return "avx2";
+    case ScanImpl::SSE2: return "sse2";
+    default:             return "scalar";
+    }
+}
+
+size_t decode_spans(const uint8_t *p, size_t n, const std::vector<Span> &spans,
+                    std::vector<Dump> &out)
+{
+    const size_t before = out.size();
+
+    for (const Span &s : spans) {
+        if (s.end > n || s.begin >= s.end) continue;
+        const size_t first = out.size();
+
+        switch (s.kind) {
+        case Mark::TextDump:
+        case Mark::AddrLine:
+            parse_text(std::string_view(reinterpret_cast<const char *>(p + s.begin),
+                                        s.end - s.begin), out);
+            break;
+        case Mark::BinaryDump: {
+            Dump d;
+            if (parse_binary(p + s.begin, s.end - s.begin, d)) out.push_back(std::move(d));
+            break;
+        }
+        case Mark::Mailbox:
+            parse_mailbox(p + s.begin, s.end - s.begin, out);
+            break;
+        }
+        for (size_t k = first; k < out.size(); k++) {
+            out[k].offset += s.begin;
+        }
+    }
+    return out.size() - before;
+}
+
+} // namespace hfdump
@@ -0,0 +1,105 @@
+#!/usr/bin/env python3
+"""Inputs and runs behind the libhfdump figures in README.md.
+
+  python tests/bench_libhfdump.py ./hfdump [--mb 1024] [--dir DIR]
+
+Writes a text log of dump blocks, one binary dump and a synthetic UART
+capture of --mb megabytes (boot chatter with dumps of every kind mixed
+in), then runs `hfdump --bench` on the first two and `hfdump --bench-scan`
+on the capture. The inputs are deterministic, so runs on different
+machines compare.
+"""
+import argparse
+import os
+import random
+import subprocess
+import sys
+import tempfile
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+sys.path[:0] = [HERE, os.path.dirname(HERE)]   # dumps.py, and hfdump.py it uses
+from dumps import dump, mailbox  # noqa: E402
+
+TEXT_DUMP = '''===== HARD FAULT DUMP =====
+Magic: 0x48464450, Ver: 6
+Image: application  Faults recorded: {n}
+EXC_RETURN: 0xFFFFFFFD  MSP: 0x20017F80  PSP: 0x20004A10
+Active SP: 0x20004A10  Used: PSP  FP ctx: NO
+Core regs:
+ R0 : 0x00000000  R1 : 0x2000{n:04X}
+ R2 : 0x00000010  R3 : 0x00000001
+ R12: 0x00000000  LR : 0x08000F01
+ PC : 0x0800{pc:04X}  PSR: 0x21000000
+CFSR: 0x00008200 (MMFSR=0x00 BFSR=0x82 UFSR=0x0000)
+HFSR: 0x40000000  DFSR: 0x00000000
+MMFAR: 0xE000ED34  BFAR: 0x00000000
+AFSR: 0x00000000  SHCSR: 0x00070000
+RTOS info: FreeRTOS task 'worker' prio 3, stack base 0x20004000, min free 112 bytes
+Stack dump bytes: 512
+HF_ADDR PC=0x0800{pc:04X} LR=0x08000F01
+===== END HARD FAULT DUMP =====
+'''
+
+CHATTER = ['[boot] clocks 170 MHz\n', 'sensor: t=23.5 rh=41\n', 'HF_BUILD_ID=9f3c2a1b\n',
+           'worker: queue depth 3\n', 'ota: idle\n', 'uart: rx 1024 tx 980\n']
+
+
+def text_dump(rng, n):
+    return TEXT_DUMP.format(n=n & 0xFFFF, pc=rng.randrange(0x1000, 0xFFFF) & ~1)
+
+
+def binary_dump(rng):
+    stack = bytes(rng.randrange(256) for _ in range(256))
+    return dump(stack, pc=0x08000000 | rng.randrange(0x1000, 0xFFFF) & ~1,
+                active_sp=0x20004A10, cfsr=0x8200)
+
+
+def capture(path, mb, rng):
+    """Mostly chatter, plus about one dump of some kind per 5 MB."""
+    blobs = [binary_dump(rng) for _ in range(8)]
+    size, n = mb * 1000 * 1000, 0
+    with open(path, 'wb') as f:
+        while f.tell() < size:
+            chunk = ''.join(rng.choice(CHATTER) for _ in range(20000)).encode()
+            f.write(chunk)
+            kind = n % 4
+            if kind == 0:
+                f.write(text_dump(rng, n).encode())
+            elif kind == 1:
+                f.write(b'HF_ADDR PC=0x08001234 LR=0x08000F01\n')
+            elif kind == 2:
+                f.write(rng.choice(blobs))
+            else:
+                f.write(mailbox([None, rng.choice(blobs)]))
+            n += 1
+
+
+def main() -> int:
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument('hfdump', help='the hfdump CLI built from libhfdump/')
+    ap.add_argument('--mb', type=int, default=1024, help='size of the scan capture')
+    ap.add_argument('--dir', help='keep the inputs here')
+    args = ap.parse_args()
+
+    rng = random.Random(1)
+    work = args.dir or tempfile.mkdtemp(prefix='hfdump-bench-')
+    os.makedirs(work, exist_ok=True)
+    text, binary, cap = (os.path.join(work, n) for n in ('text.log', 'dump.bin', 'capture.bin'))
+    with open(text, 'w') as f:
+        f.write(''.join(rng.choice(CHATTER) + text_dump(rng, n) for n in range(1000)))
+    with open(binary, 'wb') as f:
+        f.write(binary_dump(rng))
+    if not os.path.exists(cap) or os.path.getsize(cap) < args.mb * 1000 * 1000:
+        capture(cap, args.mb, rng)
+
+    for cmd in ([args.hfdump, '--bench', '200', text],
+                [args.hfdump, '--bench', '200000', binary],
+                [args.hfdump, '--bench-scan', cap]):
+        print('$', ' '.join(os.path.basename(c) if c.startswith(work) else c for c in cmd),
+              flush=True)
+        subprocess.run(cmd, check=True)
+    return 0
+
+
+if __name__ == '__main__':
+    raise SystemExit(main())
@@ -0,0 +1,28 @@
+"""pytest setup: the host tools live in the repository root, and the tests
+that decode dumps need libhfdump built for the host."""
+import os
+import shutil
+import subprocess
+import sys
+
+import pytest
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+sys.path.insert(0, ROOT)
+
+LIBHFDUMP = ('libhfdump/hfdump.cpp', 'libhfdump/hfdump_scan.cpp')
+
+
+@pytest.fixture(scope='session')
+def hfdump_lib(tmp_path_factory):
+    """hfdump.py bound to a libhfdump.so freshly built from this tree."""
+    cxx = os.environ.get('CXX', 'c++')
+    if not shutil.which(cxx):
+        pytest.skip(f'no C++ compiler ({cxx})')
+    lib = tmp_path_factory.mktemp('libhfdump') / 'libhfdump.so'
+    subprocess.run([cxx, '-std=c++17', '-O2', '-fPIC', '-shared', '-o', str(lib)] +
+                   [os.path.join(ROOT, s) for s in LIBHFDUMP], check=True)
+    os.environ['HFDUMP_LIB'] = str(lib)
+    import hfdump
+    hfdump._lib = None
+    return hfdump
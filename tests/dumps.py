@@ -0,0 +1,34 @@
+"""Dump and mailbox images laid out as in hf_abi.h, for the tests."""
+import struct
+
+from hfdump import CHECKSUM_OFF as CHECKSUM, FIELDS, HDR
+
+HF_MAGIC = 0x48464450
+HF_MBOX_MAGIC = 0x424D4648
+
+
+def _xor(b):
+    x = 0
+    for v in b:
+        x ^= v
+    return x
+
+
+def dump(stack=b'', ext=b'', version=6, **fields):
+    """One dump: header, stack payload, extension records; checksums set."""
+    f = dict.fromkeys(FIELDS, 0)
+    f.update(magic=HF_MAGIC, version=version, header_len=HDR.size,
+             exc_return=0xFFFFFFFD, used_sp=1, arch=3, task_name=b'',
+             lr=0x08000F01, pc=0x08001234, psr=0x01000000)
+    f.update(fields)
+    f.update(stack_bytes=len(stack), ext_bytes=len(ext), ext_checksum=_xor(ext))
+    hdr = HDR.pack(*(f[k] for k in FIELDS))
+    checksum = fields.get('checksum', _xor(hdr) ^ _xor(stack))
+    return hdr[:CHECKSUM] + struct.pack('<I', checksum) + hdr[CHECKSUM + 4:] + stack + ext
+
+
+def mailbox(slots, slot_size=0x1F0, faults=(1, 1)):
+    """Mailbox area with one image (or None) per slot."""
+    hdr = struct.pack('<IHHIIHHIII', HF_MBOX_MAGIC, 1, 32, 32 + slot_size * len(slots),
+                      slot_size, len(slots), 0, *faults, 0)
+    return hdr + b''.join((s or b'').ljust(slot_size, b'\0') for s in slots)
@@ -0,0 +1,74 @@
+/*
+ * hf_cbor.c on the host, for tests/test_hf_cbor.py:
+ *
+ *   cbor_host ID FAULT_COUNT FIELDS MAX_STACK CAP DUMP
+ *
+ * Encodes the dump file as slot ID with the target's own encoder and
+ * writes the record to stdout; on an error prints the HF_CBOR_ERR_* code
+ * to stderr and exits 1. The dump is taken as valid, as
+ * HardFault_DumpData() would have checked it.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "hardfault_dump.h"
+#include "hf_cbor.h"
+
+static uint8_t *s_dump;
+static uint32_t s_size;
+static uint8_t  s_id;
+static uint32_t s_count;
+
+/* ---- The hardfault_dump.c calls hf_cbor.c makes ---- */
+
+const uint8_t *HardFault_DumpData(uint8_t id, uint32_t *size)
+{
+    *size = (id == s_id) ? s_size : 0u;
+    return (*size != 0u) ? s_dump : NULL;
+}
+
+uint32_t HardFault_DumpCount(uint8_t id)
+{
+    return (id == s_id) ? s_count : 0u;
+}
+
+static bool load(const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        perror(path);
+        return false;
+    }
+    fseek(f, 0, SEEK_END);
+    s_size = (uint32_t)ftell(f);
+    rewind(f);
+    s_dump = malloc(s_size ? s_size : 1u);
+    const bool ok = fread(s_dump, 1, s_size, f) == s_size;
+    fclose(f);
+    return ok;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 7) {
+        fprintf(stderr, "usage: %s ID FAULT_COUNT FIELDS MAX_STACK CAP DUMP\n", argv[0]);
+        return 2;
+    }
+    s_id    = (uint8_t)strtoul(argv[1], NULL, 0);
+    s_count = (uint32_t)strtoul(argv[2], NULL, 0);
+    const uint32_t fields    = (uint32_t)strtoul(argv[3], NULL, 0);
+    const uint32_t max_stack = (uint32_t)strtoul(argv[4], NULL, 0);
+    const uint32_t cap       = (uint32_t)strtoul(argv[5], NULL, 0);
+    if (!load(argv[6])) {
+        return 2;
+    }
+
+    uint8_t *buf = malloc(cap ? cap : 1u);
+    const int32_t n = HardFault_EncodeCbor(s_id, fields, max_stack, buf, cap);
+    if (n < 0) {
+        fprintf(stderr, "%d\n", (int)n);
+        return 1;
+    }
+    fwrite(buf, 1, (size_t)n, stdout);
+    return 0;
+}
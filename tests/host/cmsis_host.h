@@ -0,0 +1,73 @@
+#pragma once
+
+/*
+ * Just enough of a CMSIS device header to build hardfault_dump.c for the
+ * host (fault_host.c): a Cortex-M4F whose system registers are plain
+ * structs the test sets and reads. Inline asm is compiled out.
+ */
+
+#include <stdint.h>
+
+#define __IOM volatile
+#define __IM  volatile
+#define __ASM if (0) __asm__
+#define __STATIC_INLINE static inline
+
+#ifndef __ARM_ARCH_7EM__
+#define __ARM_ARCH_7EM__ 1
+#endif
+#define __FPU_USED 1U
+
+typedef struct {
+    __IM  uint32_t CPUID;
+    __IOM uint32_t ICSR, VTOR, AIRCR, SCR, CCR;
+    __IOM uint8_t  SHP[12];
+    __IOM uint32_t SHCSR, CFSR, HFSR, DFSR, MMFAR, BFAR, AFSR;
+} SCB_Type;
+
+typedef struct {
+    __IM  uint32_t ICTR;
+    __IOM uint32_t ACTLR;
+} SCnSCB_Type;
+
+typedef struct {
+    __IOM uint32_t CTRL, CYCCNT;
+} DWT_Type;
+
+typedef struct {
+    __IOM uint32_t DEMCR;
+} CoreDebug_Type;
+
+extern SCB_Type       *SCB;
+extern SCnSCB_Type    *SCnSCB;
+extern DWT_Type       *DWT;
+extern CoreDebug_Type *CoreDebug;
+
+#define SCB_SHCSR_MEMFAULTENA_Msk   (1u << 16)
+#define SCB_SHCSR_BUSFAULTENA_Msk   (1u << 17)
+#define SCB_SHCSR_USGFAULTENA_Msk   (1u << 18)
+#define SCB_CCR_UNALIGN_TRP_Msk     (1u << 3)
+#define SCB_CCR_DIV_0_TRP_Msk       (1u << 4)
+#define SCnSCB_ACTLR_DISDEFWBUF_Msk (1u << 1)
+#define CoreDebug_DEMCR_TRCENA_Msk  (1u << 24)
+#define DWT_CTRL_CYCCNTENA_Msk      (1u << 0)
+
+/* Core registers the library reads; the test sets them. */
+extern uint32_t host_msp, host_psp, host_fpscr, host_ipsr, host_control;
+
+static inline uint32_t __get_MSP(void)          { return host_msp; }
+static inline uint32_t __get_PSP(void)          { return host_psp; }
+static inline uint32_t __get_FPSCR(void)        { return host_fpscr; }
+static inline void     __set_FPSCR(uint32_t v)  { host_fpscr = v; }
+static inline uint32_t __get_IPSR(void)         { return host_ipsr; }
+static inline uint32_t __get_CONTROL(void)      { return host_control; }
+static inline uint32_t __get_PRIMASK(void)      { return 0u; }
+static inline void     __set_PRIMASK(uint32_t v) { (void)v; }
+static inline void     __disable_irq(void)      {}
+static inline void     __enable_irq(void)       {}
+static inline void     __DSB(void)              {}
+static inline void     __ISB(void)              {}
+static inline void     __DMB(void)              {}
+static inline void     NVIC_SystemReset(void)   {}
+
+extern uint32_t SystemCoreClock;
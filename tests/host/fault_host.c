@@ -0,0 +1,101 @@
+/*
+ * hardfault_dump.c built for the host, driven by tests/test_fault_capture.py.
+ *
+ * The core's part of a fault (stacking the frame, setting CFSR, taking the
+ * vector) is done by hand; from prvGetRegistersFromStack() on, the capture
+ * path is the firmware's own. RAM is mapped at the target's addresses so
+ * the 32-bit pointers in the dump stay valid:
+ *
+ *   fault_host MODE MAILBOX.bin
+ *
+ * MODE is div0 (SDIV by zero under HF_FAULT_STRICT) or fputrap
+ * (HardFault_FpuCheck()'s UDF under HF_FAULT_DIAGNOSTIC). Link with
+ * --defsym for _estack, __hf_dump_start and __hf_dump_end.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "hardfault_dump.h"
+#include "cmsis_host.h"
+#include "hf_arch.h"
+
+/* The naked entry only picks MSP or PSP; here it is never taken. */
+#undef HF_ARCH_HANDLER_ASM
+#define HF_ARCH_HANDLER_ASM "ret\n"
+
+#include "hardfault_dump.c"
+
+#define RAM_BASE 0x20000000u
+#define RAM_SIZE 0x00040000u
+#define FRAME    0x2003F000u       /* MSP at the fault */
+#define CODE     0x2003E000u       /* the faulting instruction */
+
+static SCB_Type       scb;
+static SCnSCB_Type    scnscb;
+static DWT_Type       dwt;
+static CoreDebug_Type coredebug;
+
+SCB_Type       *SCB       = &scb;
+SCnSCB_Type    *SCnSCB    = &scnscb;
+DWT_Type       *DWT       = &dwt;
+CoreDebug_Type *CoreDebug = &coredebug;
+uint32_t host_msp, host_psp, host_fpscr, host_ipsr, host_control;
+uint32_t SystemCoreClock = 170000000u;
+
+static uint8_t *ram(uint32_t addr)
+{
+    return (uint8_t *)(uintptr_t)addr;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 3) {
+        fprintf(stderr, "usage: %s div0|fputrap MAILBOX.bin\n", argv[0]);
+        return 2;
+    }
+    if (mmap(ram(RAM_BASE), RAM_SIZE, PROT_READ | PROT_WRITE,
+             MAP_FIXED | MAP_PRIVATE | MAP_ANONYMOUS, -1, 0) == MAP_FAILED) {
+        perror("mmap");
+        return 2;
+    }
+    const bool div0 = strcmp(argv[1], "div0") == 0;
+
+    HardFaultDumps_Init();
+    if (!HardFault_SetFaultProfile(div0 ? HF_FAULT_STRICT : HF_FAULT_DIAGNOSTIC)) {
+        return 3;
+    }
+    printf("shcsr 0x%08" PRIX32 " ccr 0x%08" PRIX32 "\n", SCB->SHCSR, SCB->CCR);
+    printf("routed %d %d %d\n", MemManage_Handler == HardFault_Handler,
+           BusFault_Handler == HardFault_Handler,
+           UsageFault_Handler == HardFault_Handler);
+
+    /* sdiv r0, r1, r2 / udf #0x46, as the core would see them. */
+    const uint16_t insn[2] = { div0 ? 0xFB91u : (0xDE00u | HF_FPU_TRAP_IMM), 0xF0F2u };
+    memcpy(ram(CODE), insn, sizeof insn);
+
+    uint32_t *frame = (uint32_t *)(uintptr_t)FRAME;
+    for (uint32_t i = 0; i < 64u; i++) {
+        frame[i] = 0x20000000u + 4u * i;
+    }
+    frame[0] = div0 ? 0x00000064u : HF_FPSCR_DZC;    /* r0: dividend, FPSCR flags */
+    frame[1] = 0x00000064u;
+    frame[2] = 0u;                                   /* r2: divisor */
+    frame[3] = 0u;
+    frame[4] = 0u;                                   /* r12 */
+    frame[5] = 0x08000F01u;                          /* lr */
+    frame[6] = CODE;                                 /* pc */
+    frame[7] = 0x01000000u;                          /* xpsr: Thumb */
+    host_msp = FRAME;
+    SCB->CFSR = div0 ? (1u << 25) : (1u << 16);      /* DIVBYZERO / UNDEFINSTR */
+
+    prvGetRegistersFromStack(frame, 0xFFFFFFF9u);
+
+    FILE *f = fopen(argv[2], "wb");
+    if (f == NULL || fwrite(__hf_dump_start, 1, HF_DUMP_AREA_SIZE, f) != HF_DUMP_AREA_SIZE) {
+        perror(argv[2]);
+        return 2;
+    }
+    fclose(f);
+    return 0;
+}
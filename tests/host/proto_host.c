@@ -0,0 +1,119 @@
+/*
+ * hf_proto.c on the host, behind a pty, for tests/test_hf_fetch.py:
+ *
+ *   proto_host DUMP0|- DUMP1|-
+ *
+ * Serves the dump files ("-" = empty slot) through the target's own
+ * protocol code and prints the pty's path, like `hf_fetch.py sim`. Runs
+ * until stdin closes.
+ */
+#define _DEFAULT_SOURCE
+#define _XOPEN_SOURCE 600
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "hardfault_dump.h"
+#include "hf_proto.h"
+
+static uint8_t *s_dump[HF_DUMP_COUNT];
+static uint32_t s_size[HF_DUMP_COUNT];
+
+/* ---- The hardfault_dump.c calls hf_proto.c makes ---- */
+
+const uint8_t *HardFault_DumpData(uint8_t id, uint32_t *size)
+{
+    *size = (id < HF_DUMP_COUNT) ? s_size[id] : 0u;
+    return (*size != 0u) ? s_dump[id] : NULL;
+}
+
+void HardFault_ClearDumpId(uint8_t id)
+{
+    if (id < HF_DUMP_COUNT) {
+        s_size[id] = 0u;
+    }
+}
+
+/* ---- Transport over the pty master ---- */
+
+static int pty_getc(void *ctx)
+{
+    uint8_t b;
+    return (read(*(int *)ctx, &b, 1) == 1) ? b : -1;
+}
+
+static void pty_write(void *ctx, const uint8_t *p, uint32_t n)
+{
+    while (n > 0u) {
+        const ssize_t w = write(*(int *)ctx, p, n);
+        if (w > 0) {
+            p += w;
+            n -= (uint32_t)w;
+        }
+    }
+}
+
+static bool load(uint8_t id, const char *path)
+{
+    if (strcmp(path, "-") == 0) {
+        return true;
+    }
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        perror(path);
+        return false;
+    }
+    fseek(f, 0, SEEK_END);
+    s_size[id] = (uint32_t)ftell(f);
+    rewind(f);
+    s_dump[id] = malloc(s_size[id] ? s_size[id] : 1u);
+    const bool ok = fread(s_dump[id], 1, s_size[id], f) == s_size[id];
+    fclose(f);
+    return ok;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 1 + HF_DUMP_COUNT) {
+        fprintf(stderr, "usage: %s DUMP0|- DUMP1|-\n", argv[0]);
+        return 2;
+    }
+    for (uint8_t id = 0; id < HF_DUMP_COUNT; id++) {
+        if (!load(id, argv[1 + id])) {
+            return 2;
+        }
+    }
+
+    int fd = posix_openpt(O_RDWR | O_NOCTTY);
+    struct termios t;
+    if (fd < 0 || grantpt(fd) != 0 || unlockpt(fd) != 0 || tcgetattr(fd, &t) != 0) {
+        perror("pty");
+        return 2;
+    }
+    cfmakeraw(&t);
+    tcsetattr(fd, TCSANOW, &t);
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    /* Hold the slave open too, or the master reports a hangup whenever
+     * the client closes it to reconnect. */
+    const char *path = ptsname(fd);
+    const int keep = open(path, O_RDWR | O_NOCTTY);
+    printf("%s\n", path);
+    fflush(stdout);
+
+    const hf_transport_t tp = { pty_getc, pty_write, &fd };
+    HardFaultProto_Init(&tp);
+
+    struct pollfd fds[2] = { { fd, POLLIN, 0 }, { STDIN_FILENO, POLLIN, 0 } };
+    for (;;) {
+        poll(fds, 2, 100);
+        if (fds[1].revents) {
+            close(keep);
+            return 0;                                  /* stdin closed: done */
+        }
+        HardFaultProto_Poll();
+    }
+}
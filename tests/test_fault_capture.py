@@ -0,0 +1,57 @@
+"""The firmware's capture path on the host (tests/host/fault_host.c): the
+configurable faults reach it, and the traps of the strict and diagnostic
+profiles come out classified."""
+import os
+import platform
+import shutil
+import subprocess
+
+import pytest
+
+from conftest import ROOT
+
+HOST = os.path.join(ROOT, 'tests', 'host')
+LINK = ('-Wl,--defsym=_estack=0x20040000,--defsym=__hf_dump_start=0x20020000,'
+        '--defsym=__hf_dump_end=0x20020400')
+
+
+@pytest.fixture(scope='module')
+def fault_host(tmp_path_factory):
+    cc = os.environ.get('CC', 'gcc')
+    if platform.system() != 'Linux' or platform.machine() != 'x86_64' or not shutil.which(cc):
+        pytest.skip('needs gcc on x86-64 Linux (fixed mappings at the target addresses)')
+    exe = tmp_path_factory.mktemp('fault_host') / 'fault_host'
+    subprocess.run([cc, '-O1', '-Wall', '-Wextra', '-Werror',
+                    '-Wno-pointer-to-int-cast', '-Wno-int-to-pointer-cast',
+                    '-I', HOST, '-I', ROOT, '-DHF_DEVICE_HEADER="cmsis_host.h"',
+                    '-no-pie', LINK, '-o', str(exe), os.path.join(HOST, 'fault_host.c')],
+                   check=True)
+    return exe
+
+
+def _fault(exe, mode, tmp_path, hfdump):
+    area = tmp_path / 'mailbox.bin'
+    out = subprocess.run([str(exe), mode, str(area)], check=True,
+                         capture_output=True, text=True).stdout
+    dumps = hfdump.parse_mailbox(area.read_bytes())
+    assert len(dumps) == 1
+    return out, dumps[0]
+
+
+def test_divide_by_zero(fault_host, tmp_path, hfdump_lib):
+    out, d = _fault(fault_host, 'div0', tmp_path, hfdump_lib)
+    assert 'routed 1 1 1' in out
+    shcsr, ccr = (int(w, 16) for w in out.split()[1:4:2])
+    assert shcsr & (1 << 18)                           # USGFAULTENA
+    assert ccr & (1 << 4) and ccr & (1 << 3)           # DIV_0_TRP, UNALIGN_TRP
+    assert d['class'] == 'UsageFault:DIVBYZERO'
+    assert 'DIVBYZERO' in d['cfsr_bits']
+    assert d['pc'] == '0x2003E000' and d['regs']['r2'] == '0x00000000'
+    assert d['checksum'] == 'ok'
+
+
+def test_fpu_trap(fault_host, tmp_path, hfdump_lib):
+    out, d = _fault(fault_host, 'fputrap', tmp_path, hfdump_lib)
+    assert 'routed 1 1 1' in out
+    assert d['class'] == 'FpuTrap:DZC'
+    assert d['fpu_trap'] == ['DZC']
@@ -0,0 +1,109 @@
+"""hf_addr2line.py's multi-image map: symbol files, image specs, map files,
+dispatch by address, and the HF_ADDR fallback without libhfdump."""
+import stat
+import sys
+
+import pytest
+
+import hf_addr2line
+import hfdump
+from hf_addr2line import Image, ImageMap, image_spec, load_map, symbolize_dumps
+from test_hf_locals import TEXT, _elf
+
+STUB = '''import sys
+with open(sys.argv[0] + '.log', 'a') as log:
+    log.write(' '.join(sys.argv[1:]) + '\\n')
+for a in sys.argv[sys.argv.index('-e') + 2:]:
+    print('f_' + a.lower(), 'fw.c:' + str(int(a, 16) & 0xFF), sep='\\n')
+'''
+
+
+@pytest.fixture
+def files(tmp_path, monkeypatch):
+    """An ELF (addr2line stubbed), an nm symbol file and a linker script."""
+    stub = tmp_path / 'addr2line'
+    stub.write_text(f'#!{sys.executable}\n' + STUB)
+    stub.chmod(stub.stat().st_mode | stat.S_IXUSR)
+    monkeypatch.setenv('HF_ADDR2LINE', str(stub))
+    monkeypatch.delenv('HF_SYMD_SOCKET', raising=False)
+    _elf(tmp_path / 'app.elf')
+    (tmp_path / 'boot.sym').write_text('00001000 00000100 T Reset_Handler\n'
+                                       '00001100 T boot_main\n'
+                                       'not a symbol line\n')
+    (tmp_path / 'rom.ld').write_text('rom_memcpy = 0x1FFF0000;\n'
+                                     'PROVIDE(rom_crc = 0x1FFF0100);\n')
+    return tmp_path
+
+
+def test_symbol_files(files):
+    boot = Image('boot', files / 'boot.sym')
+    assert boot.ranges == [(0x1000, 0x1101)]
+    assert boot.resolve([0x1004, 0x1100, 0x1180, 0xFFF]) == {
+        0x1004: ('Reset_Handler+0x4', '??:0'), 0x1100: ('boot_main', '??:0'),
+        0x1180: ('boot_main+0x80', '??:0'),           # no size: runs to the next symbol
+        0xFFF: ('??', '??:0')}
+    rom = Image('rom', files / 'rom.ld')
+    assert rom.ranges == [(0x1FFF0000, 0x1FFF0101)]
+    assert rom.resolve([0x1FFF0102])[0x1FFF0102][0] == 'rom_crc+0x2'
+    (files / 'empty.txt').write_text('hello\n')
+    with pytest.raises(ValueError, match='neither an ELF nor a symbol file'):
+        Image('x', files / 'empty.txt')
+
+
+def test_image_spec(files):
+    app = image_spec(f'app={files}/app.elf@0x08000000-0x08000200')
+    assert (app.name, app.ranges) == ('app', [(0x08000000, 0x08000200)])
+    app = image_spec(f'{files}/app.elf')
+    assert (app.name, app.ranges) == ('app', [(TEXT, TEXT + 0x400)])   # its code sections
+    with pytest.raises(ValueError, match='empty range'):
+        image_spec(f'{files}/app.elf@0x2000-0x1000')
+
+
+def test_load_map(files):
+    (files / 'images.map').write_text('# name file [range]\n'
+                                      'boot boot.sym\n'
+                                      'app  app.elf 0x08000000-0x08000200  # relative path\n'
+                                      '\n'
+                                      f'rom  {files}/rom.ld\n')
+    images = load_map(files / 'images.map')
+    assert [(i.name, i.path, i.ranges) for i in images] == [
+        ('boot', files / 'boot.sym', [(0x1000, 0x1101)]),
+        ('app', files / 'app.elf', [(0x08000000, 0x08000200)]),
+        ('rom', files / 'rom.ld', [(0x1FFF0000, 0x1FFF0101)])]
+    (files / 'bad.map').write_text('boot boot.sym\napp\n')
+    with pytest.raises(ValueError, match='bad.map:2: expected NAME FILE'):
+        load_map(files / 'bad.map')
+
+
+def test_image_map(files):
+    boot, app = Image('boot', files / 'boot.sym'), image_spec(f'app={files}/app.elf')
+    imap = ImageMap([app, boot])
+    assert [imap.image_for(a) for a in (0x1000, 0x1100, 0x1101, TEXT + 0x3FF, TEXT + 0x400)] \
+        == [boot, boot, None, app, None]
+    assert ImageMap([app], catch_all=app).image_for(0) is app
+    with pytest.raises(ValueError, match='boot 0x00001000-0x00001101 overlaps app2'):
+        ImageMap([boot, image_spec(f'app2={files}/app.elf@0x1100-0x1200')])
+
+
+def test_resolve_one_batch_per_image(files):
+    boot, app = Image('boot', files / 'boot.sym'), image_spec(f'app={files}/app.elf')
+    got = ImageMap([app, boot]).resolve([TEXT + 0x10, 0x1004, TEXT + 0x22, 0x30000000])
+    assert got == {TEXT + 0x10: ('f_0x08000010', 'fw.c:16', 'app'),
+                   0x1004: ('Reset_Handler+0x4', '??:0', 'boot'),
+                   TEXT + 0x22: ('f_0x08000022', 'fw.c:34', 'app'),
+                   0x30000000: None}
+    assert len((files / 'addr2line.log').read_text().splitlines()) == 1
+
+
+def test_hf_addr_fallback_keeps_byte_offsets(files, monkeypatch):
+    """Without libhfdump the HF_ADDR lines are found in the raw bytes: the
+    offsets are those of the log file, invalid UTF-8 and all."""
+    monkeypatch.setenv('HFDUMP_LIB', str(files / 'missing.so'))
+    monkeypatch.setattr(hfdump, '_lib', None)
+    monkeypatch.setattr(hf_addr2line, '_noted', True)
+    log = b'\xff\xfe\x00boot\r\nHF_ADDR PC=0x00001100 LR=0x08000011\n'
+    imap = ImageMap([Image('boot', files / 'boot.sym'), image_spec(f'app={files}/app.elf')])
+    (dumps,), _ = symbolize_dumps([log], imap)
+    assert [d['offset'] for d in dumps] == [log.index(b'HF_ADDR')]
+    assert dumps[0]['symbols'] == {'pc': ('boot_main', '??:0', 'boot'),
+                                   'lr': ('f_0x08000010', 'fw.c:16', 'app')}
@@ -0,0 +1,40 @@
+"""hf_capd.py selftest, shortened: simulated boards on ptys, every dump out
+on the right port (symbolized through a stub addr2line when given an ELF)."""
+import argparse
+import asyncio
+import os
+import stat
+import sys
+
+import pytest
+
+import hf_capd
+from test_hf_locals import CALLER, LEAF, MAIN, _elf
+from test_hf_symd import STUB
+
+pytestmark = pytest.mark.skipif(not hasattr(os, 'openpty'), reason='needs ptys')
+
+
+def _selftest(elf=None):
+    args = argparse.Namespace(ports=3, dumps=4, baud=1000000, elf=elf, queue=64)
+    return asyncio.run(hf_capd.selftest(args))
+
+
+def test_selftest_without_elf(hfdump_lib, capsys):
+    assert _selftest() == 0
+    out = capsys.readouterr().out
+    assert 'records: 12  ports with missing/misordered dumps: 0' in out
+
+
+def test_selftest_symbolizes_by_build_id(hfdump_lib, tmp_path, monkeypatch, capsys):
+    stub = tmp_path / 'addr2line'
+    stub.write_text(f'#!{sys.executable}\n' + STUB)
+    stub.chmod(stub.stat().st_mode | stat.S_IXUSR)
+    monkeypatch.setenv('HF_ADDR2LINE', str(stub))
+    elf = tmp_path / 'fw.elf'
+    _elf(elf, build_id=bytes(range(20)),
+         symbols=[('fault', LEAF, 0x10, 0x12), ('work', CALLER, 0x40, 0x12),
+                  ('main', MAIN, 0x40, 0x12)])
+    assert _selftest(str(elf)) == 0
+    out = capsys.readouterr().out
+    assert 'records: 12  ports with missing/misordered dumps: 0  unsymbolized: 0' in out
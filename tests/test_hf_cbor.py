@@ -0,0 +1,106 @@
+"""hf_cbor.py's encoder against the target's own hf_cbor.c, built for the
+host (tests/host/cbor_host.c): both must produce the same bytes."""
+import os
+import random
+import shutil
+import struct
+import subprocess
+
+import pytest
+
+import hf_cbor
+from conftest import ROOT
+from dumps import dump, mailbox
+
+
+def _stack(n, seed=3):
+    """Words of every varint length: zeros, small values, pointers near each
+    other, return addresses, and the odd far jump."""
+    rnd = random.Random(seed)
+    pick = (lambda: 0, lambda: rnd.randint(1, 300), lambda: 0x20001E00 + 4 * rnd.randint(0, 64),
+            lambda: 0x08000000 + rnd.randint(0, 0x8000) | 1, lambda: rnd.getrandbits(32))
+    return struct.pack(f'<{n}I', *(rnd.choice(pick)() for _ in range(n)))
+
+
+DUMPS = {
+    'bare': dump(),
+    'v4': dump(_stack(8), version=4, cfsr=0x00000082, mmfar=0x20000010),
+    'task': dump(_stack(32), rtos=1, priority=3, min_free=412, stack_base=0x20001800,
+                 task_name=b'net_rx', cfsr=0x00008200, bfar=0x40011C04, flags=0x0003,
+                 sp_limit=0x20001000, msp_limit=0x20007C00, msp_max_used=604),
+    'long_name': dump(_stack(300, seed=9), rtos=2, task_name=b'sixteen_chars_ok',
+                      r0=0xFFFFFFFF, psr=0x21000000, has_fp=1),
+}
+
+POLICIES = [
+    (hf_cbor.ESSENTIALS, 0, 1 << 16),
+    (hf_cbor.FULL, 0, 1 << 16),
+    (hf_cbor.FULL, 64, 1 << 16),                  # --max-stack
+    (hf_cbor.F_REGS | hf_cbor.F_SCB, 0, 1 << 16),
+    (hf_cbor.F_STACK | hf_cbor.F_RTOS, 0, 120),         # stack cut at the buffer end
+    (hf_cbor.FULL, 0, 24),                        # essentials do not fit
+]
+
+
+@pytest.fixture(scope='module')
+def cbor_host(tmp_path_factory):
+    cc = os.environ.get('CC', 'gcc')
+    if not shutil.which(cc):
+        pytest.skip('needs a C compiler')
+    exe = tmp_path_factory.mktemp('cbor_host') / 'cbor_host'
+    subprocess.run([cc, '-std=c11', '-O1', '-Wall', '-Wextra', '-Werror', '-I', ROOT,
+                    '-o', str(exe), os.path.join(ROOT, 'tests', 'host', 'cbor_host.c'),
+                    os.path.join(ROOT, 'hf_cbor.c')], check=True)
+    return exe
+
+
+def _target(exe, tmp_path, data, dump_id, count, fields, max_stack, cap):
+    """The record hf_cbor.c makes, or None for HF_CBOR_ERR_SPACE."""
+    f = tmp_path / 'dump.bin'
+    f.write_bytes(data)
+    r = subprocess.run([str(exe), str(dump_id), str(count), str(fields), str(max_stack),
+                        str(cap), str(f)], capture_output=True)
+    if r.returncode == 1:
+        assert r.stderr.strip() == b'-2'
+        return None
+    assert r.returncode == 0, r.stderr
+    return r.stdout
+
+
+def _host(h, stack, dump_id, count, fields, max_stack, cap):
+    try:
+        return hf_cbor.encode(h, stack, dump_id, count, fields, max_stack, cap)
+    except ValueError:
+        return None
+
+
+@pytest.mark.parametrize('name', DUMPS)
+@pytest.mark.parametrize('fields,max_stack,cap', POLICIES)
+def test_same_bytes(hfdump_lib, cbor_host, tmp_path, name, fields, max_stack, cap):
+    data = DUMPS[name]
+    [(dump_id, count, h, stack)] = hf_cbor.find_dumps(data)
+    host = _host(h, stack, dump_id, count, fields, max_stack, cap)
+    assert host == _target(cbor_host, tmp_path, data, dump_id, count, fields, max_stack, cap)
+    if host is not None and cap == 1 << 16:
+        _, rstack, rfields = hf_cbor.record_dump(hf_cbor.loads(host)[0])
+        assert rfields == (fields if h['rtos'] else fields & ~hf_cbor.F_RTOS)
+        n = len(stack) if not max_stack else min(len(stack), max_stack)
+        assert rstack == (stack[:n] if fields & hf_cbor.F_STACK else b'')
+
+
+def test_mailbox_slots(hfdump_lib, cbor_host, tmp_path):
+    """Slot id and fault count come from the mailbox, the dump from each slot."""
+    data = mailbox([DUMPS['task'], DUMPS['v4']], slot_size=0x200, faults=(2, 5))
+    found = hf_cbor.find_dumps(data)
+    assert [(i, c, h['task_name']) for i, c, h, _ in found] == [(0, 2, 'net_rx'), (1, 5, '')]
+    for dump_id, count, h, stack in found:
+        slot = data[32 + dump_id * 0x200:][:0x200]
+        assert hf_cbor.encode(h, stack, dump_id, count) == \
+            _target(cbor_host, tmp_path, slot, dump_id, count, hf_cbor.FULL, 0, 1 << 16)
+
+
+def test_bad_dumps_not_encoded(hfdump_lib):
+    good = DUMPS['task']
+    assert hf_cbor.find_dumps(good[:-1]) == []                       # payload cut
+    assert hf_cbor.find_dumps(dump(checksum=1)) == []                # checksum
+    assert hf_cbor.find_dumps(dump(version=3)) == []                 # before HF_VERSION_MIN
@@ -0,0 +1,91 @@
+"""hf_crashdb.py ingestion: dump times, builds, binary dumps in text logs
+and unterminated dump blocks."""
+import datetime
+import os
+import time
+
+import pytest
+
+import hf_crashdb
+from dumps import dump
+
+ADDR = 'HF_ADDR PC=0x08001234 LR=0x08000F01\n'
+BEGIN = '===== HARD FAULT DUMP =====\n'
+
+
+@pytest.fixture
+def ingest(tmp_path, hfdump_lib):
+    db = hf_crashdb.open_db(str(tmp_path / 'crash.db'))
+    ing = hf_crashdb.Ingestor(db, [])
+
+    def ingest(path):
+        ing.ingest_file(path)
+        offset, = db.execute('SELECT offset FROM files WHERE path = ?', (str(path),)).fetchone()
+        return [ts for ts, in db.execute('SELECT ts FROM dumps ORDER BY id')], offset
+    ingest.db = db
+    yield ingest
+    db.close()
+
+
+def test_time_from_line(tmp_path, ingest):
+    log = tmp_path / 'a.log'
+    log.write_text('boot\n'
+                   f'[2026-10-18 12:34:56.250] {ADDR}'
+                   f'2026-10-18T10:00:00Z {ADDR}'
+                   f'2026-10-18T12:00:00+0200 {ADDR}')
+    local = datetime.datetime(2026, 10, 18, 12, 34, 56, 250000).timestamp()
+    utc = datetime.datetime(2026, 10, 18, 10, tzinfo=datetime.timezone.utc).timestamp()
+    assert ingest(log)[0] == [local, utc, utc]
+
+
+def test_time_from_mtime(tmp_path, ingest):
+    log = tmp_path / 'a.log'
+    log.write_text(ADDR)
+    os.utime(log, (1_700_000_000, 1_700_000_000))
+    assert ingest(log)[0] == [1_700_000_000]
+
+
+def test_partial_block_held_while_written(tmp_path, ingest):
+    log = tmp_path / 'a.log'
+    head = ADDR + 'boot\n'
+    log.write_text(head + BEGIN + 'PC : 0x08001234\n')
+    dumps, offset = ingest(log)
+    assert len(dumps) == 1 and offset == len(head)
+
+
+def test_partial_block_given_up_when_idle(tmp_path, ingest):
+    log = tmp_path / 'a.log'
+    log.write_text(ADDR + BEGIN + 'PC : 0x08001234\n')
+    old = time.time() - hf_crashdb.PARTIAL_IDLE - 5
+    os.utime(log, (old, old))
+    dumps, offset = ingest(log)
+    assert len(dumps) == 2 and offset == log.stat().st_size
+
+
+def test_partial_block_given_up_when_long(tmp_path, ingest):
+    log = tmp_path / 'a.log'
+    log.write_text(BEGIN + 'noise\n' * (hf_crashdb.PARTIAL_MAX // 6 + 1))
+    dumps, offset = ingest(log)
+    assert len(dumps) == 1 and offset == log.stat().st_size
+
+
+def test_binary_dump_in_non_utf8_log(tmp_path, ingest):
+    log = tmp_path / 'a.log'
+    head = b'boot \xff\xfe\n'
+    bin_ = dump(stack=bytes(range(0x80, 0xC0)), pc=0x08002000)
+    mid = b'\x80\x81 noise\n'
+    log.write_bytes(head + bin_ + mid + ADDR.encode())
+    ingest(log)
+    rows = ingest.db.execute('SELECT pc, file_off FROM dumps ORDER BY file_off').fetchall()
+    assert rows == [(0x08002000, len(head)), (0x08001234, len(head + bin_ + mid))]
+
+
+def test_build_follows_banners(tmp_path, ingest):
+    log = tmp_path / 'a.log'
+    log.write_text(f'HF_BUILD_ID=aaaaaaaa\n{ADDR}HF_BUILD_ID=bbbbbbbb\n{ADDR}')
+    ingest(log)
+    with open(log, 'a') as f:
+        f.write(ADDR)                    # next pass: still the reflashed build
+    ingest(log)
+    builds = [b for b, in ingest.db.execute('SELECT build_id FROM dumps ORDER BY id')]
+    assert builds == ['aaaaaaaa', 'bbbbbbbb', 'bbbbbbbb']
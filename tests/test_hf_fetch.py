@@ -0,0 +1,114 @@
+"""hf_fetch.py's client against the target's own hf_proto.c, built for the
+host behind a pty (tests/host/proto_host.c), and against the Python
+simulator, which must behave the same."""
+import os
+import shutil
+import subprocess
+import threading
+
+import pytest
+
+import hf_fetch
+from conftest import ROOT
+
+DUMP = bytes((i * 7 + 3) & 0xFF for i in range(700))      # three READs of 256
+
+
+@pytest.fixture(scope='module')
+def proto_host(tmp_path_factory):
+    cc = os.environ.get('CC', 'gcc')
+    if not shutil.which(cc) or not hasattr(os, 'openpty'):
+        pytest.skip('needs a C compiler and ptys')
+    exe = tmp_path_factory.mktemp('proto_host') / 'proto_host'
+    subprocess.run([cc, '-std=c11', '-O1', '-Wall', '-Wextra', '-Werror', '-I', ROOT,
+                    '-o', str(exe), os.path.join(ROOT, 'tests', 'host', 'proto_host.c'),
+                    os.path.join(ROOT, 'hf_proto.c')], check=True)
+    return exe
+
+
+@pytest.fixture(params=['hf_proto.c', 'TargetSim'])
+def target(request, tmp_path):
+    """serve(dumps) -> pty path of a target holding them (None = empty slot)."""
+    stop = []
+
+    def serve(dumps):
+        if request.param == 'TargetSim':
+            master, slave, path = hf_fetch.open_pty_pair()
+            sim = hf_fetch.TargetSim(master, dumps, 2000000)
+            th = threading.Thread(target=sim.run, daemon=True)
+            th.start()
+            stop.append(lambda: (sim.stop.set(), th.join(), os.close(slave), os.close(master)))
+            return path
+        files = []
+        for i, d in enumerate(dumps):
+            if d is None:
+                files.append('-')
+            else:
+                (tmp_path / f'slot{i}.bin').write_bytes(d)
+                files.append(str(tmp_path / f'slot{i}.bin'))
+        proc = subprocess.Popen([str(request.getfixturevalue('proto_host'))] + files,
+                                stdin=subprocess.PIPE, stdout=subprocess.PIPE, text=True)
+        stop.append(lambda: (proc.stdin.close(), proc.wait(5)))
+        return proc.stdout.readline().strip()
+
+    yield serve
+    for s in stop:
+        s()
+
+
+def _client(path):
+    return hf_fetch.Client(path, 115200, timeout=0.5, reconnect_wait=0.05, max_reconnects=2)
+
+
+def test_list_and_fetch(target, tmp_path):
+    client = _client(target([None, DUMP]))
+    try:
+        max_chunk, dumps = client.list()
+        assert max_chunk == 256
+        assert [(d['id'], d['valid'], d['size']) for d in dumps] == [(0, False, 0), (1, True, 700)]
+        assert dumps[1]['crc'] == hf_fetch.crc32(DUMP)
+        got = hf_fetch.fetch(client, tmp_path / 'out', log=lambda *_: None)
+    finally:
+        client.close()
+    assert [p.read_bytes() for p in got] == [DUMP]
+
+
+def test_resume(target, tmp_path):
+    out = tmp_path / 'out'
+    out.mkdir()
+    name = hf_fetch.dump_name({'id': 1, 'crc': hf_fetch.crc32(DUMP)})
+    (out / name).with_suffix('.part').write_bytes(DUMP[:300])
+    log = []
+    client = _client(target([None, DUMP]))
+    try:
+        got = hf_fetch.fetch(client, out, log=log.append)
+    finally:
+        client.close()
+    assert got[0].read_bytes() == DUMP
+    assert 'dump 1: resuming at 300/700 bytes' in log
+
+
+def test_clear(target, tmp_path):
+    client = _client(target([DUMP, DUMP[:40]]))
+    try:
+        assert len(hf_fetch.fetch(client, tmp_path / 'out', clear=True, log=lambda *_: None)) == 2
+        assert not any(d['valid'] for d in client.list()[1])
+    finally:
+        client.close()
+
+
+def test_errors_and_resync(target):
+    client = _client(target([DUMP, None]))
+    try:
+        client.connect()
+        hf_fetch.write_all(client.fd, b'HF\xff\xff' + b'\x00noise' * 8)   # oversized, then junk
+        assert client.read(0, 0, 16) == DUMP[:16]
+        assert client.read(0, 690, 256) == DUMP[690:]
+        with pytest.raises(hf_fetch.LinkError, match='no dump'):
+            client.read(1, 0, 16)
+        with pytest.raises(hf_fetch.LinkError, match='bad argument'):
+            client.read(0, 701, 16)
+        with pytest.raises(hf_fetch.LinkError, match='bad command'):
+            client.request(0x55)
+    finally:
+        client.close()
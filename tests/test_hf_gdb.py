@@ -0,0 +1,148 @@
+"""hf_gdb.py against a stub `gdb` module: mailbox bounds, slot numbers, the
+printout and the registers --frame writes. No real gdb or target."""
+import importlib
+import shlex
+import sys
+import types
+
+import pytest
+
+from dumps import dump, mailbox
+
+AREA_LO, AREA_HI = 0x20020000, 0x20020400
+CODE = range(0x08000000, 0x08100000)
+SAVED = ('r0', 'r1', 'r2', 'r3', 'r4', 'r5', 'r6', 'r7', 'r8', 'r9', 'r10', 'r11',
+         'r12', 'sp', 'lr', 'pc', 'xpsr')
+
+
+def _stub(area, symbols=True):
+    gdb = types.ModuleType('gdb')
+    gdb.COMMAND_DATA = 1
+    gdb.error = type('error', (RuntimeError,), {})
+    gdb.GdbError = type('GdbError', (Exception,), {})
+    gdb.MemoryError = type('MemoryError', (gdb.error,), {})
+    gdb.commands = {}
+    gdb.regs = {n: 0x100 + i for i, n in enumerate(SAVED)}
+
+    class Command:
+        def __init__(self, name, _cls):
+            gdb.commands[name] = self
+    gdb.Command = Command
+    gdb.string_to_argv = shlex.split
+
+    def parse_and_eval(expr):
+        if symbols and '__hf_dump_start' in expr:
+            return AREA_LO
+        if symbols and '__hf_dump_end' in expr:
+            return AREA_HI
+        raise gdb.error('No symbol')
+    gdb.parse_and_eval = parse_and_eval
+
+    class Inferior:
+        def read_memory(self, lo, n):
+            return memoryview(area[lo - AREA_LO:lo - AREA_LO + n])
+    gdb.selected_inferior = Inferior
+
+    class Block:
+        superblock = None
+        function = types.SimpleNamespace(print_name='HardFaultingFunction')
+    gdb.block_for_pc = lambda pc: Block() if pc in CODE else None
+    gdb.find_pc_line = lambda pc: types.SimpleNamespace(
+        symtab=types.SimpleNamespace(filename='Src/app/foo.c') if pc in CODE else None,
+        line=123)
+
+    class Frame:
+        def read_register(self, name):
+            if name not in gdb.regs:
+                raise ValueError(f'bad register {name}')
+            return gdb.regs[name]
+    gdb.selected_frame = Frame
+
+    def execute(cmd, from_tty=False, to_string=False):
+        if cmd.startswith('set $'):
+            name, value = cmd[5:].split(' = ')
+            gdb.regs[name] = int(value, 16)
+        elif cmd.startswith('info symbol'):
+            return 'No symbol matches.\n'
+        return ''
+    gdb.execute = execute
+    return gdb
+
+
+@pytest.fixture
+def load(monkeypatch, hfdump_lib):
+    def load(area, symbols=True):
+        gdb = _stub(area, symbols)
+        monkeypatch.setitem(sys.modules, 'gdb', gdb)
+        sys.modules.pop('hf_gdb', None)
+        mod = importlib.import_module('hf_gdb')
+        return gdb, mod, gdb.commands['hf-dump']
+    yield load
+    sys.modules.pop('hf_gdb', None)
+
+
+AREA = mailbox([dump(pc=0x08000A10, lr=0x08000A01),
+                dump(stack=b'\x5b\x0a\x00\x08' * 4, active_sp=0x20001F20, cfsr=0x00020000)])
+
+
+def test_find_area(load):
+    gdb, mod, _ = load(AREA)
+    assert mod.find_area(None) == (AREA_LO, AREA_HI)
+    assert mod.find_area('0x20000000-0x20000100') == (0x20000000, 0x20000100)
+    with pytest.raises(gdb.GdbError, match='bad mailbox bounds'):
+        mod.find_area('0x2000-0x1000')
+    with pytest.raises(gdb.GdbError, match='LO-HI'):
+        mod.find_area('0x2000')
+    gdb, mod, _ = load(AREA, symbols=False)
+    with pytest.raises(gdb.GdbError, match='--area'):
+        mod.find_area(None)
+
+
+def test_slot_of(load):
+    _, mod, _ = load(AREA)
+    assert mod.slot_of(AREA, 32) == 0
+    assert mod.slot_of(AREA, 32 + 0x1F0) == 1
+    assert mod.slot_of(b'\0' * 64, 32) is None
+
+
+def test_print_dump(load, capsys):
+    _, _, cmd = load(AREA)
+    cmd.invoke('1', False)
+    out = capsys.readouterr().out
+    assert out.startswith('===== HARD FAULT DUMP (slot 1) =====\n')
+    assert 'Checksum: ok' in out
+    assert 'PC 0x08001234 in HardFaultingFunction () at Src/app/foo.c:123' in out
+    assert 'Active SP: 0x20001F20' in out
+    assert out.count('===== END HARD FAULT DUMP =====') == 1
+
+    cmd.invoke('', False)
+    out = capsys.readouterr().out
+    assert '(slot 0)' in out and '(slot 1)' in out
+
+
+def test_no_slot(load, capsys):
+    _, _, cmd = load(mailbox([None, None]))
+    cmd.invoke('', False)
+    assert capsys.readouterr().out == 'hf-dump: no valid slot\n'
+
+
+@pytest.mark.parametrize('has_fp, psr, sp', [
+    (0, 0x01000000, 0x20001020),       # basic frame
+    (0, 0x01000200, 0x20001024),       # + alignment pad (xPSR bit 9)
+    (1, 0x01000000, 0x20001068),       # FP extension
+    (1, 0x01000200, 0x2000106C),       # both
+])
+def test_frame_sp(load, capsys, has_fp, psr, sp):
+    area = mailbox([dump(active_sp=0x20001000, has_fp=has_fp, psr=psr, r0=0xAA, lr=0x08000F01)])
+    gdb, _, cmd = load(area)
+    before = dict(gdb.regs)
+    cmd.invoke('--frame', False)
+    assert gdb.regs['sp'] == sp
+    assert gdb.regs['pc'] == 0x08001234 and gdb.regs['lr'] == 0x08000F01
+    assert gdb.regs['r0'] == 0xAA and gdb.regs['xpsr'] == psr
+    assert gdb.regs['r4'] == before['r4']
+    out = capsys.readouterr().out
+    assert 'resumes at the faulting PC' in out and 'hf-dump --restore' in out
+
+    cmd.invoke('--restore', False)
+    assert gdb.regs == before
@@ -0,0 +1,290 @@
+"""hf_locals.py unwinding and variables on a synthetic ARM ELF (no cross
+toolchain needed).
+
+The ELF holds only .text and hand-written DWARF: a .debug_frame whose CIE is
+what arm-none-eabi-gcc emits (code align 2, data align -4, RA in r14,
+CFA = r13 + 0), and either an empty compile unit or, for the variable tests,
+a DWARF 4 unit with .debug_loc lists and a DWARF 5 unit with .debug_loclists.
+"""
+import struct
+
+import pytest
+
+from hf_elf import ElfFile
+from hf_dwarf import Dwarf
+from hf_locals import ARM, Frame, Target, frame_scopes, show, unwind
+from hf_ramdump import Memory
+
+TEXT = 0x08000000
+LEAF, CALLER, MAIN = 0x08000100, 0x08000200, 0x08000300
+SP = 0x20001000
+
+
+def _uleb(v):
+    out = bytearray()
+    while True:
+        b, v = v & 0x7F, v >> 7
+        out.append(b | (0x80 if v else 0))
+        if not v:
+            return bytes(out)
+
+
+def _entry(body):
+    body += b'\0' * (-len(body) % 4)                 # DW_CFA_nop padding
+    return struct.pack('<I', len(body)) + body
+
+
+def _debug_frame():
+    cie = _entry(struct.pack('<IB', 0xFFFFFFFF, 1) + b'\0' + _uleb(2) + b'\x7c' +
+                 bytes([14, 0x0C, 13, 0]))             # def_cfa r13+0
+
+    def fde(lo, size, insns=b''):
+        return _entry(struct.pack('<III', 0, lo, size) + insns)
+
+    # push {r4, lr}: CFA = SP + 8, LR at CFA - 4, R4 at CFA - 8.
+    push = bytes([0x41, 0x0E, 8, 0x80 | 14, 1, 0x80 | 4, 2])
+    return cie + fde(LEAF, 0x10) + fde(CALLER, 0x40, push) + fde(MAIN, 0x40, push)
+
+
+def _elf(path, debug=None, symbols=(), build_id=None):
+    """debug: section name -> body, replacing the one childless CU;
+    symbols: (name, value, size, st_info) in .text, for a .symtab;
+    build_id: bytes of a GNU build-id note."""
+    info = struct.pack('<HIB', 4, 0, 4) + bytes([1])
+    info = struct.pack('<I', len(info)) + info
+    debug = debug or {'.debug_info': info, '.debug_abbrev': bytes([1, 0x11, 0, 0, 0, 0])}
+    secs = [('.text', 1, 6, TEXT, b'\0' * 0x400, 0)] + \
+        [(name, 1, 0, 0, body, 0) for name, body in debug.items()] + \
+        [('.debug_frame', 1, 0, 0, _debug_frame(), 0)]
+    if build_id:
+        note = struct.pack('<III', 4, len(build_id), 3) + b'GNU\0' + build_id
+        secs.append(('.note.gnu.build-id', 7, 2, 0, note + bytes(-len(note) % 4), 0))
+    if symbols:
+        strtab, symtab = bytearray(b'\0'), bytearray(16)
+        for name, value, size, st_info in symbols:
+            symtab += struct.pack('<IIIBBH', len(strtab), value, size, st_info, 0, 1)
+            strtab += name.encode() + b'\0'
+        secs += [('.symtab', 2, 0, 0, bytes(symtab), len(secs) + 2),
+                 ('.strtab', 3, 0, 0, bytes(strtab), 0)]
+    shstr = b'\0' + b''.join(name.encode() + b'\0' for name, *_ in secs) + b'.shstrtab\0'
+    secs.append(('.shstrtab', 3, 0, 0, shstr, 0))
+    data, hdrs = bytearray(52), [bytes(40)]
+    for name, type_, flags, addr, body, link in secs:
+        hdrs.append(struct.pack('<IIIIIIIIII', shstr.index(b'\0' + name.encode() + b'\0') + 1,
+                                type_, flags, addr, len(data), len(body), link, 0, 1, 0))
+        data += body
+    shoff = len(data)
+    data += b''.join(hdrs)
+    data[:52] = (b'\x7fELF\x01\x01\x01' + bytes(9) +
+                 struct.pack('<HHIIIIIHHHHHH', 2, 40, 1, TEXT, 0, shoff, 0,
+                             52, 0, 0, 40, len(hdrs), len(hdrs) - 1))
+    path.write_bytes(bytes(data))
+    return ElfFile(path)
+
+
+def _unwind(tmp_path, lr):
+    elf = _elf(tmp_path / 'fw.elf')
+    # The leaf saved nothing; the caller's and main's push {r4, lr}.
+    stack = struct.pack('<IIII', 0x1234, MAIN + 0x11, 0x5678, 0)
+    tgt = Target(elf, SP, stack, Memory([]))
+    regs = {0: 1, 1: 2, 2: 3, 3: 4, 12: 5, ARM.sp: SP, 14: lr, ARM.pc: LEAF + 4}
+    return unwind(Dwarf(elf), ARM, tgt, regs, 16)
+
+
+def test_frameless_leaf_unwinds(tmp_path):
+    frames, why = _unwind(tmp_path, CALLER + 0x11)
+    assert [f.pc for f in frames] == [LEAF + 4, CALLER + 0x10, MAIN + 0x10]
+    assert [f.regs[ARM.sp] for f in frames] == [SP, SP, SP + 8]
+    assert frames[2].regs[4] == 0x1234
+    assert why == 'end of the call chain'
+
+
+def test_leaf_returning_to_itself_stops(tmp_path):
+    frames, why = _unwind(tmp_path, LEAF + 5)
+    assert len(frames) == 1
+    assert why == 'stack does not unwind'
+
+
+# ---- Variables: a v4 unit for LEAF/CALLER, a v5 unit for MAIN ----
+
+RAM = 0x20000000
+
+# code -> (tag, children, [(attribute, form)])
+_NAME, _TYPE, _LOC, _SIZE = (0x03, 0x08), (0x49, 0x13), (0x02, 0x18), (0x0b, 0x0b)
+_PC = [(0x11, 0x01), (0x12, 0x06)]
+ABBREVS = {
+    1: (0x11, 1, [_NAME] + _PC),                                  # compile_unit
+    2: (0x2e, 1, [_NAME] + _PC + [(0x40, 0x18)]),                 # subprogram
+    3: (0x24, 0, [_NAME, _SIZE, (0x3e, 0x0b)]),                   # base_type
+    4: (0x34, 0, [_NAME, _TYPE, _LOC]),                           # variable
+    5: (0x34, 0, [_NAME, _TYPE, (0x02, 0x17)]),                   # variable, location list
+    6: (0x05, 0, [_NAME, _TYPE, _LOC]),                           # formal_parameter
+    7: (0x0f, 0, [_SIZE, _TYPE]),                                 # pointer_type
+    8: (0x13, 1, [_NAME, _SIZE]),                                 # structure_type
+    9: (0x0d, 0, [_NAME, _TYPE, (0x38, 0x0b)]),                   # member
+    10: (0x01, 1, [_TYPE]),                                       # array_type
+    11: (0x21, 0, [(0x2f, 0x0b)]),                                # subrange_type
+    12: (0x34, 0, [_NAME, _TYPE, (0x1c, 0x0b)]),                  # variable, const_value
+    13: (0x04, 1, [_NAME, _SIZE]),                                # enumeration_type
+    14: (0x28, 0, [_NAME, (0x1c, 0x0d)]),                         # enumerator
+    15: (0x0b, 1, _PC),                                           # lexical_block
+    16: (0x34, 0, [_NAME, _TYPE]),                                # variable, no location
+}
+
+
+def _abbrev():
+    out = bytearray()
+    for code, (tag, children, specs) in ABBREVS.items():
+        out += _uleb(code) + _uleb(tag) + bytes([children])
+        for at, form in specs:
+            out += _uleb(at) + _uleb(form)
+        out += b'\0\0'
+    return bytes(out + b'\0')
+
+
+def _unit(version, dies):
+    """A compile unit from (code, [values], [children], label) trees; a value
+    is an int (sized by its form), str, bytes (an exprloc) or 'ref:<label>'.
+    A DIE without a label is labelled by its name, if it has one."""
+    hdr = 12 if version >= 5 else 11
+    body, labels, fixups = bytearray(), {}, []
+
+    def emit(code, values, children=(), label=None):
+        _, has_children, specs = ABBREVS[code]
+        if label is None and values and isinstance(values[0], str):
+            label = values[0]
+        labels[label] = hdr + len(body)
+        body.extend(_uleb(code))
+        for (_, form), v in zip(specs, values, strict=True):
+            if isinstance(v, str) and v.startswith('ref:'):
+                fixups.append((len(body), v[4:]))
+                body.extend(bytes(4))
+            elif isinstance(v, str):
+                body.extend(v.encode() + b'\0')
+            elif isinstance(v, bytes):
+                body.extend(_uleb(len(v)) + v)
+            elif form == 0x0d:
+                body.extend(bytes([v & 0x7F]))                  # small sdata only
+            else:
+                body.extend(v.to_bytes({0x01: 4, 0x06: 4, 0x17: 4, 0x0b: 1}[form], 'little'))
+        if has_children:
+            for c in children:
+                emit(*c)
+            body.append(0)
+
+    for d in dies:
+        emit(*d)
+    for at, label in fixups:
+        body[at:at + 4] = struct.pack('<I', labels[label])
+    head = struct.pack('<HBBI', 5, 1, 4, 0) if version >= 5 else struct.pack('<HIB', 4, 0, 4)
+    return struct.pack('<I', len(head) + len(body)) + head + bytes(body)
+
+
+def _sleb1(v):
+    return bytes([v & 0x7F])                                   # -64 <= v < 64
+
+
+CFA = b'\x9c'                                                  # DW_OP_call_frame_cfa
+TYPES = [(3, ['int', 4, 0x05]), (3, ['char', 1, 0x06]), (3, ['float', 4, 0x04]),
+         (3, ['_Bool', 1, 0x02]), (3, ['unsigned long long', 8, 0x07])]
+
+
+def _debug_info():
+    work = [
+        (6, ['n', 'ref:int', b'\x50']),                                   # r0
+        (6, ['name', 'ref:char*', b'\x51']),                              # r1
+        (4, ['count', 'ref:int', b'\x91' + _sleb1(-8)]),                  # fbreg -8
+        (4, ['pt', 'ref:point', b'\x7d\x04']),                            # breg13 +4
+        (4, ['buf', 'ref:char[8]', b'\x03' + struct.pack('<I', RAM + 0x40)]),
+        (4, ['how', 'ref:mode', b'\x35\x9f']),                           # lit5, stack_value
+        (4, ['ready', 'ref:_Bool', b'\x31\x9f']),
+        (4, ['wide', 'ref:unsigned long long', b'\x52\x93\x04\x53\x93\x04']),
+        (4, ['ratio', 'ref:float', b'\x9e\x04' + struct.pack('<f', 1.5)]),
+        (12, ['limit', 'ref:int', 42]),
+        (16, ['gone', 'ref:int']),
+        (4, ['start', 'ref:int', b'\xa3\x01\x50\x9f']),                   # entry_value(r0)
+        (4, ['far', 'ref:int', b'\x03' + struct.pack('<I', 0x30000000)]),
+        (5, ['state', 'ref:int', 0]),                                     # .debug_loc+0
+        (15, [CALLER + 0x0C, 0x14], [(4, ['inner', 'ref:int', b'\x54'])]),
+    ]
+    a = _unit(4, [(1, ['a.c', TEXT, MAIN - TEXT], TYPES + [
+        (7, [4, 'ref:char'], (), 'char*'),
+        (8, ['point', 8], [(9, ['x', 'ref:int', 0]), (9, ['y', 'ref:int', 4])]),
+        (10, ['ref:char'], [(11, [7])], 'char[8]'),
+        (13, ['mode', 4], [(14, ['IDLE', 0]), (14, ['RUN', 5])]),
+        (2, ['work', CALLER, 0x40, CFA], work)])])
+    b = _unit(5, [(1, ['b.c', MAIN, 0x40], [
+        (3, ['int', 4, 0x05]),
+        (2, ['main', MAIN, 0x40, CFA], [(5, ['tries', 'ref:int', 12])])])])
+    return a + b
+
+
+def _debug_loc():
+    """state in work(): r4, then a stack slot, then (after a base address
+    entry) a constant."""
+    def entry(lo, hi, expr):
+        return struct.pack('<IIH', lo, hi, len(expr)) + expr
+    off = CALLER - TEXT
+    return (entry(off, off + 8, b'\x54') + entry(off + 8, off + 0x20, b'\x7d\x0c') +
+            struct.pack('<II', 0xFFFFFFFF, CALLER) + entry(0x20, 0x28, b'\x39\x9f') +
+            bytes(8))
+
+
+def _debug_loclists():
+    """tries in main(): r5 by offset pair, 3 by start/length, else 7."""
+    body = (bytes([4, 0, 8, 1, 0x55]) +
+            bytes([8]) + struct.pack('<I', MAIN + 8) + bytes([4, 2, 0x33, 0x9f]) +
+            bytes([5, 2, 0x37, 0x9f, 0]))
+    return struct.pack('<IHBBI', 8 + len(body), 5, 4, 0, 0) + body
+
+
+STACK = struct.pack('<iiii', -3, 10, -20, 77)
+REGS = {0: 7, 1: RAM, 2: 0x89ABCDEF, 3: 0x01234567, 4: 0x44, 5: 0x55, ARM.sp: SP}
+
+
+def _frame(tmp_path, pc):
+    elf = _elf(tmp_path / 'fw.elf', {'.debug_info': _debug_info(),
+                                      '.debug_abbrev': _abbrev(),
+                                      '.debug_loc': _debug_loc(),
+                                      '.debug_loclists': _debug_loclists()})
+    ram = b'hello'.ljust(0x40, b'\0') + b'hi'.ljust(0x40, b'\0')
+    tgt = Target(elf, SP, STACK, Memory([(RAM, ram)]))
+    dw = Dwarf(elf)
+    return frame_scopes(dw, Frame(dw, ARM, tgt, {**REGS, ARM.pc: pc}, pc, True))
+
+
+def _shown(scopes):
+    return {v['name']: show(v) for s in scopes for v in s['args'] + s['locals']}
+
+
+def test_variable_locations_and_values(tmp_path):
+    [work] = _frame(tmp_path, CALLER + 0x10)
+    assert work['function'] == 'work'
+    assert [(v['name'], v['type']) for v in work['args']] == [('n', 'int'), ('name', 'char *')]
+    assert {v['name']: v['type'] for v in work['locals']}['buf'] == 'char[8]'
+    assert _shown([work]) == {
+        'n': '7', 'name': '0x20000000 "hello"',
+        'count': '-3',                                 # frame base (CFA = SP + 8) - 8
+        'pt': '{x = 10, y = -20}', 'buf': '"hi"', 'how': 'RUN', 'ready': 'true',
+        'wide': str(0x0123456789ABCDEF), 'ratio': '1.5', 'limit': '42',
+        'gone': '<optimized out>',
+        'start': '<unavailable: value at function entry (not captured)>',
+        'far': '<unavailable: 0x30000000 not captured>',
+        'state': '77', 'inner': '68'}
+
+
+@pytest.mark.parametrize('pc,name,want', [
+    (CALLER + 4, 'state', '68'),                       # .debug_loc: r4
+    (CALLER + 0x10, 'state', '77'),                    # a stack slot
+    (CALLER + 0x24, 'state', '9'),                     # after a base address entry
+    (CALLER + 0x30, 'state', '<optimized out>'),       # no entry covers pc
+    (MAIN + 4, 'tries', '85'),                         # .debug_loclists: offset pair
+    (MAIN + 8, 'tries', '3'),                          # start, length
+    (MAIN + 0x10, 'tries', '7'),                       # default location
+])
+def test_location_lists(tmp_path, pc, name, want):
+    assert _shown(_frame(tmp_path, pc))[name] == want
+
+
+def test_lexical_block_only_inside(tmp_path):
+    assert 'inner' not in _shown(_frame(tmp_path, CALLER + 4))
@@ -0,0 +1,104 @@
+"""hf_ramdump.py: the three image formats it loads, and the slots it
+reports as rejected."""
+import struct
+from pathlib import Path
+
+import pytest
+
+from hf_ramdump import expand, load_ihex, load_memory, rejected_slots
+from dumps import dump, mailbox
+
+RAM = 0x2001E000
+AREA = (0x2001F000, 0x2001F000 + 32 + 2 * 0x200)
+MBOX = mailbox([dump(b'\x11' * 16, rtos=1, task_name=b'idle'), None], slot_size=0x200, faults=(3, 0))
+
+
+def _ram():
+    """8 KiB of RAM from RAM with the mailbox at AREA."""
+    ram = bytearray(b'\xA5' * 0x2000)
+    ram[AREA[0] - RAM:AREA[1] - RAM] = MBOX
+    return bytes(ram)
+
+
+def _ihex(base, data):
+    def rec(addr, rtype, body):
+        r = bytes([len(body), addr >> 8 & 0xFF, addr & 0xFF, rtype]) + body
+        return ':' + (r + bytes([-sum(r) & 0xFF])).hex().upper()
+    out = [rec(0, 0x04, struct.pack('>H', base >> 16))]
+    for i in range(0, len(data), 16):
+        out.append(rec((base + i) & 0xFFFF, 0x00, data[i:i + 16]))
+    return '\n'.join(out + [rec(0, 0x01, b'')]) + '\n'
+
+
+def _core(runs):
+    """ELF32 core file with one PT_LOAD per (vaddr, bytes), no sections."""
+    phoff = 52
+    data = bytearray(phoff + 32 * len(runs))
+    for i, (addr, body) in enumerate(runs):
+        struct.pack_into('<IIIIIIII', data, phoff + 32 * i, 1, len(data), addr, addr,
+                         len(body), len(body), 6, 4)
+        data += body
+    data[:52] = (b'\x7fELF\x01\x01\x01' + bytes(9) +
+                 struct.pack('<HHIIIIIHHHHHH', 4, 40, 1, 0, phoff, 0, 0,
+                             52, 32, len(runs), 40, 0, 0))
+    return bytes(data)
+
+
+@pytest.mark.parametrize('name,make,base', [
+    ('ram.bin', _ram, RAM),                                    # FILE@BASE
+    ('hf.bin', lambda: MBOX, None),                            # mailbox extract
+    ('ram.hex', lambda: _ihex(RAM, _ram()).encode(), None),
+    ('dump', lambda: _ihex(RAM, _ram()).encode(), None),       # HEX by content
+    ('ram.core', lambda: _core([(0x08000000, b'\0' * 64), (RAM, _ram())]), None),
+])
+def test_images_load_alike(hfdump_lib, tmp_path, name, make, base):
+    f = tmp_path / name
+    f.write_bytes(make())
+    mem = load_memory(f, base, AREA)
+    blob = mem.read(AREA[0], AREA[1] - AREA[0])
+    assert blob == MBOX
+    [d] = hfdump_lib.parse_mailbox(blob)
+    assert (d['fault_count'], d['task']['name']) == (3, 'idle')
+
+
+def test_raw_image_needs_a_base(tmp_path):
+    f = tmp_path / 'ram.bin'
+    f.write_bytes(_ram())
+    with pytest.raises(ValueError, match='not a mailbox extract'):
+        load_memory(f, None, AREA)
+    with pytest.raises(ValueError, match='without load address'):
+        load_memory(f, None, None)
+
+
+def test_ihex_records():
+    text = _ihex(0x08000000, bytes(range(40)))
+    assert b''.join(d for _, d in load_ihex(text)) == bytes(range(40))
+    assert [a for a, _ in load_ihex(text)] == [0x08000000, 0x08000010, 0x08000020]
+    seg = ':020000021000EC\n:0400100001020304E2\n'          # segment 0x1000 -> 0x10010
+    assert load_ihex(seg) == [(0x10010, b'\x01\x02\x03\x04')]
+    with pytest.raises(ValueError, match='line 2'):
+        load_ihex(text.replace(text.splitlines()[1][-2:] + '\n', '00\n', 1))
+
+
+def test_rejected_slots(hfdump_lib):
+    torn = dump(b'\x22' * 8, checksum=1)
+    blob = mailbox([dump(), torn], slot_size=0x200)
+    assert rejected_slots(blob, hfdump_lib.parse_mailbox(blob)) == [1]
+    # Only the slots the header declares count.
+    one = bytearray(blob)
+    struct.pack_into('<H', one, 16, 1)
+    assert rejected_slots(bytes(one), hfdump_lib.parse_mailbox(bytes(one))) == []
+    assert rejected_slots(b'\xA5' * 64, []) == []
+    # More slots than the decoder accepts: every header is reported.
+    many = mailbox([dump()] * 9, slot_size=0xA0)
+    assert hfdump_lib.parse_mailbox(many) == []
+    assert rejected_slots(many, []) == list(range(9))
+
+
+def test_expand_finds_images(tmp_path):
+    for name in ('a.bin', 'sub/b.HEX', 'sub/c.core', 'notes.txt'):
+        (tmp_path / name).parent.mkdir(exist_ok=True)
+        (tmp_path / name).write_bytes(b'')
+    got = [(p.relative_to(tmp_path).as_posix(), b) for p, b in expand([str(tmp_path)], 5)]
+    assert got == [('a.bin', 5), ('sub/b.HEX', 5), ('sub/c.core', 5)]
+    assert list(expand(['x.bin@0x20000000'], None)) == [(Path('x.bin'), 0x20000000)]
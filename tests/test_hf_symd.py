@@ -0,0 +1,139 @@
+"""hf_symd.BuildCache eviction, with a stub addr2line (HF_ADDR2LINE)."""
+import asyncio
+import stat
+import sys
+
+import hf_symd
+from test_hf_locals import CALLER, LEAF, MAIN, _elf
+
+STUB = '''import sys
+for line in sys.stdin:
+    print('f_' + line.strip().lower(), 'fw.c:1', sep='\\n', flush=True)
+'''
+
+
+def _elfs(tmp_path, monkeypatch, n):
+    stub = tmp_path / 'addr2line'
+    stub.write_text(f'#!{sys.executable}\n' + STUB)
+    stub.chmod(stub.stat().st_mode | stat.S_IXUSR)
+    monkeypatch.setenv('HF_ADDR2LINE', str(stub))
+    paths = []
+    for i in range(n):
+        p = tmp_path / f'fw{i}.elf'
+        _elf(p)
+        with open(p, 'ab') as f:
+            f.write(bytes([i]))          # another content hash, another build
+        paths.append(p)
+    return paths
+
+
+async def _close(cache, builds):
+    cache.close()
+    for b in builds:
+        b.close()
+        if b.proc is not None:
+            await b.proc.wait()
+
+
+def test_pinned_build_survives_eviction(tmp_path, monkeypatch):
+    a, b, c = _elfs(tmp_path, monkeypatch, 3)
+
+    async def run():
+        cache, seen = hf_symd.BuildCache(1), []
+        try:
+            async with cache.use(a) as ba:
+                async with cache.use(b) as bb:
+                    seen += [ba, bb]
+                    assert list(cache.builds.values()) == [ba, bb]   # over the cap
+                    assert await ba.lookup([0x100]) == [['f_0x00000100', 'fw.c', 1]]
+                assert list(cache.builds.values()) == [ba]           # b dropped, a pinned
+                assert ba.proc.returncode is None
+            async with cache.use(c) as bc:
+                seen.append(bc)
+                assert list(cache.builds.values()) == [bc]
+            assert cache.evictions == 2
+        finally:
+            await _close(cache, seen)
+
+    asyncio.run(run())
+
+
+def test_identity_map_is_bounded(tmp_path, monkeypatch):
+    paths = _elfs(tmp_path, monkeypatch, 12)
+
+    async def run():
+        cache, seen = hf_symd.BuildCache(2), []
+        try:
+            for p in paths + paths[-1:]:
+                async with cache.use(p) as b:
+                    seen.append(b)
+            assert len(cache.ids) == cache.max_ids == 8
+            assert next(reversed(cache.ids))[0] == str(paths[-1])
+            async with cache.use(build_id=cache.ids[next(reversed(cache.ids))]) as b:
+                assert b.elf == paths[-1]
+        finally:
+            await _close(cache, seen)
+
+    asyncio.run(run())
+
+
+def test_concurrent_cold_requests_share_one_process(tmp_path, monkeypatch):
+    a, = _elfs(tmp_path, monkeypatch, 1)
+    started = []
+    start = hf_symd.Build.start
+
+    async def counting_start(self):
+        started.append(self)
+        await start(self)
+
+    monkeypatch.setattr(hf_symd.Build, 'start', counting_start)
+
+    async def one(cache, addr):
+        async with cache.use(a) as b:
+            return b, await b.lookup([addr])
+
+    async def run():
+        cache = hf_symd.BuildCache(1)
+        try:
+            res = await asyncio.gather(*(one(cache, 0x100 + 2 * i) for i in range(16)))
+            assert len({id(b) for b, _ in res}) == 1
+            assert [s for _, s in res] == [[[f'f_0x{0x100 + 2 * i:08x}', 'fw.c', 1]]
+                                           for i in range(16)]
+            assert len(started) == 1 and len(cache.ids) == 1 and not cache.hashing
+        finally:
+            await _close(cache, started)
+
+    asyncio.run(run())
+
+
+def test_address_cache_is_bounded(tmp_path, monkeypatch):
+    a, = _elfs(tmp_path, monkeypatch, 1)
+    monkeypatch.setattr(hf_symd.Build, 'MAX_CACHED', 4)
+
+    async def run():
+        cache = hf_symd.BuildCache(1)
+        async with cache.use(a) as b:
+            try:
+                syms = await b.lookup(list(range(0x100, 0x10C, 2)) + [0x100])
+                assert syms[0] == syms[-1] == ['f_0x00000100', 'fw.c', 1]
+                assert list(b.cache) == [0x104, 0x106, 0x108, 0x10A]
+                assert await b.lookup([0x104, 0x100]) and (b.hits, b.misses) == (2, 7)
+                assert list(b.cache) == [0x108, 0x10A, 0x104, 0x100]
+            finally:
+                await _close(cache, [b])
+
+    asyncio.run(run())
+
+
+def test_same_name_statics_all_kept(tmp_path):
+    """Static functions of one name in two files are both in symbols() and
+    both sampled by the bench; symbol() is the global definition."""
+    p = tmp_path / 'fw.elf'
+    elf = _elf(p, symbols=[('tick', MAIN, 0x20, 0x02),            # STB_LOCAL, STT_FUNC
+                           ('helper', CALLER, 0x20, 0x02),
+                           ('helper', MAIN + 0x20, 0x20, 0x02),
+                           ('tick', LEAF, 0x10, 0x12)])           # STB_GLOBAL
+    assert elf.symbols()['helper'] == [(CALLER, 0x20, 2), (MAIN + 0x20, 0x20, 2)]
+    assert elf.symbol('tick') == LEAF
+    funcs = {a & ~7 for a in hf_symd.code_addresses(p, 200)}
+    assert funcs == {LEAF, CALLER, MAIN, MAIN + 0x20}
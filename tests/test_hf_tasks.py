@@ -0,0 +1,93 @@
+"""hf_tasks.py: walking synthetic FreeRTOS task lists in every layout."""
+import struct
+
+import pytest
+
+from hf_ramdump import Memory
+from hf_tasks import Kernel, Layout, dump_for, saved_context
+
+BASE = 0x20000000
+END = 0xFFFFFFFF                                   # portMAX_DELAY, xListEnd.xItemValue
+
+
+class Elf:
+    def __init__(self, syms):
+        self.syms, self.path = syms, 'fw.elf'
+
+    def symbols(self):
+        return self.syms
+
+
+def _kernel(lay, tasks, current):
+    """tasks: (name, priority, list symbol); TCBs 0x100 apart from BASE+0x1000."""
+    ram = bytearray(0x4000)
+
+    def put(addr, *words):
+        struct.pack_into(f'<{len(words)}I', ram, addr - BASE, *words)
+
+    lists = {'pxReadyTasksLists': (BASE + 0x100, 2 * lay.list),
+             'xDelayedTaskList1': (BASE + 0x200, lay.list),
+             'xSuspendedTaskList': (BASE + 0x300, lay.list)}
+    syms = {k: [(a, size, 1)] for k, (a, size) in lists.items()}
+    syms['pxCurrentTCB'] = [(BASE, 4, 1)]
+    members = {}
+    for i, (name, prio, where) in enumerate(tasks):
+        tcb = BASE + 0x1000 + 0x100 * i
+        put(tcb, BASE + 0x3000 + 0x100 * i)                     # pxTopOfStack
+        put(tcb + lay.priority, prio, BASE + 0x2000 + 0x100 * i)  # uxPriority, pxStack
+        off = tcb + lay.name - BASE
+        ram[off:off + len(name)] = name.encode()
+        addr = lists[where][0] + (lay.list * prio if where == 'pxReadyTasksLists' else 0)
+        members.setdefault(addr, []).append(tcb)
+    for addr in [a for a, _ in lists.values()] + [lists['pxReadyTasksLists'][0] + lay.list]:
+        end = addr + lay.list_end
+        tcbs = members.get(addr, [])
+        items = [t + lay.priority - 2 * lay.list_item for t in tcbs]   # xStateListItem
+        put(end + lay.item_next - 4, END)
+        chain = [end] + items + [end]
+        for prev, item, nxt in zip(chain, chain[1:], chain[2:]):
+            put(item + lay.item_next, nxt, prev)
+            put(item + lay.item_owner, tcbs[items.index(item)])
+        put(end + lay.item_next, chain[1], chain[-2])
+    put(BASE, BASE + 0x1000 + 0x100 * current)
+    return Kernel(Elf(syms), Memory([(BASE, ram)]), lay)
+
+
+@pytest.mark.parametrize('lay', [
+    Layout(),
+    Layout(integrity=True),
+    Layout(integrity=True, mpu_settings=72, mini_list_item=False, name_len=12),
+], ids=['stock', 'integrity', 'mpu'])
+def test_walks_every_list(lay):
+    tasks = [('IDLE', 0, 'pxReadyTasksLists'), ('net', 1, 'pxReadyTasksLists'),
+             ('ui', 1, 'pxReadyTasksLists'), ('log', 1, 'xDelayedTaskList1'),
+             ('shell', 0, 'xSuspendedTaskList')]
+    k = _kernel(lay, tasks, current=1)
+    got = [(k.tcb(tcb)['name'], k.tcb(tcb)['priority'], state) for tcb, state in k.tasks()]
+    assert got == [('net', 1, 'running'), ('IDLE', 0, 'ready'), ('ui', 1, 'ready'),
+                   ('log', 1, 'blocked'), ('shell', 0, 'suspended')]
+
+
+def test_layout_offsets():
+    assert (Layout().list, Layout().priority, Layout().name) == (20, 44, 52)
+    lay = Layout(integrity=True, mpu_settings=72)
+    assert (lay.item_next, lay.item_owner, lay.list_item) == (8, 16, 28)
+    assert (lay.list_end, lay.list, lay.priority) == (12, 32, 4 + 72 + 56)
+
+
+def test_saved_context():
+    top = BASE + 0x100
+    sw = list(range(4, 12)) + [0xFFFFFFFD]             # R4-R11, EXC_RETURN
+    hw = [0, 1, 2, 3, 12, 0x08000F01, 0x08001234, 0x01000200]  # xPSR bit 9: padded
+    mem = Memory([(top, struct.pack('<17I', *(sw + hw)))])
+    regs = saved_context(mem, top, fpu_port=True)
+    assert (regs['r4'], regs['r11'], regs['pc']) == (4, 11, 0x08001234)
+    assert regs['sp'] == top + 4 * 17 + 4
+
+
+def test_dump_matches_name_and_stack():
+    t = {'name': 'net', 'stack': 0x20002100}
+    other = {'task': {'name': 'net', 'stack_base': '0x20009000'}}
+    mine = {'task': {'name': 'net', 'stack_base': '0x20002100'}}
+    assert dump_for([other, mine], t) is mine
+    assert dump_for([other, {'pc': '0x0'}], t) is None
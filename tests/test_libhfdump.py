@@ -0,0 +1,171 @@
+"""libhfdump through hfdump.py: text and mailbox decoding, and the raw
+scanner, whose scalar, SSE2 and AVX2 marker searches must find exactly the
+same dumps."""
+import pytest
+
+from dumps import HF_MAGIC, dump, mailbox
+
+TEXT = b'''[boot] clocks 170 MHz
+===== HARD FAULT DUMP =====
+Magic: 0x48464450, Ver: 6
+EXC_RETURN: 0xFFFFFFFD  MSP: 0x20017F80  PSP: 0x20004A10
+ R0 : 0x00000000  R1 : 0x20000010
+ R12: 0x00000000  LR : 0x08000F01
+ PC : 0x08001234  PSR: 0x21000000
+CFSR: 0x00008200 (MMFSR=0x00 BFSR=0x82 UFSR=0x0000)
+HF_ADDR PC=0x08001234 LR=0x08000F01
+===== END HARD FAULT DUMP =====
+HF_ADDR PC=0x08002000 LR=0x08002101
+'''
+TRUNCATED_TEXT = b'===== HARD FAULT DUMP =====\n PC : 0x08003000  PSR: 0x21000000\n'
+GOOD = dump(b'\x01\x02\x03\x04' * 8, pc=0x08004000, cfsr=1 << 25)
+CORRUPT = bytearray(dump(b'\x55' * 32, pc=0x08005000))
+CORRUPT[-1] ^= 0xFF                                    # payload no longer matches
+
+
+def _capture(pad):
+    """Every kind of span, at an alignment that moves with pad, plus decoys."""
+    noise = bytes((i * 37 + pad) & 0x7F for i in range(300)).replace(b'=', b'-')
+    return b''.join([
+        b'x' * pad, noise, TEXT, noise,
+        b'===== HARD FAULT', b'HF_ADD', b'PDFH',           # marker fragments
+        GOOD, noise, bytes(CORRUPT), noise,
+        mailbox([GOOD, bytes(CORRUPT)]), noise,
+        TRUNCATED_TEXT, noise,
+        GOOD[:100],                                      # cut off by the end of the capture
+    ])
+
+
+def _impls(hfdump):
+    lib = hfdump._load()
+    have = [i for i, n in hfdump.SCAN_IMPLS.items() if lib.hfd_scan_impl(n).decode() == i]
+    assert 'scalar' in have
+    return have
+
+
+@pytest.mark.parametrize('pad', [0, 1, 7, 15, 16, 31, 33, 63])
+def test_scan_impls_agree(hfdump_lib, pad):
+    data = _capture(pad)
+    want = hfdump_lib.scan(data, impl='scalar')
+    for impl in _impls(hfdump_lib):
+        assert hfdump_lib.scan(data, impl=impl) == want, impl
+        assert hfdump_lib.scan_count(data, impl) == hfdump_lib.scan_count(data, 'scalar')
+    assert hfdump_lib.scan(data) == want                 # auto
+
+
+def test_scan_finds_every_kind(hfdump_lib):
+    found = [(d['source'], d['pc'], d['checksum']) for d in hfdump_lib.scan(_capture(0))]
+    assert found == [
+        ('text', '0x08001234', 'none'),
+        ('hf_addr', '0x08002000', 'none'),
+        ('binary', '0x08004000', 'ok'),
+        ('binary', '0x08005000', 'bad'),                 # loose dump: shown, flagged
+        ('binary', '0x08004000', 'ok'),                  # mailbox: the corrupt slot is dropped
+        ('text', '0x08003000', 'none'),                  # block cut by a reset
+    ]                                                    # the cut-off dump at the end: nothing
+
+
+def _cut(prefix):
+    """A block cut by a reset, the boot log, and a lone HF_ADDR line."""
+    lines = ['===== HARD FAULT DUMP =====', 'Magic: 0x48464450, Ver: 6',
+             ' PC : 0x08003000  PSR: 0x21000000', 'MSP worst ever: 12 of 2048 bytes',
+             '[boot] reset cause: watchdog', 'HF_ADDR PC=0x08006000 LR=0x08006101']
+    return ''.join(f'{prefix}{line}\r\n' for line in lines).encode()
+
+
+@pytest.mark.parametrize('prefix', ['', 'I (123) hf: '])
+@pytest.mark.parametrize('tail', [b'', TEXT], ids=['end', 'block'])
+def test_truncated_block_ends_with_its_lines(hfdump_lib, prefix, tail):
+    """Lines after a block cut short are not the block's: a lone HF_ADDR
+    among them is a dump of its own, whether or not a later block has an
+    END line."""
+    data = _cut(prefix) + tail
+    want = [('text', '0x08003000'), ('hf_addr', '0x08006000')]
+    if tail:
+        want += [('text', '0x08001234'), ('hf_addr', '0x08002000')]
+    assert [(d['source'], d['pc']) for d in hfdump_lib.parse_text(data)] == want
+    for impl in _impls(hfdump_lib):
+        assert [(d['source'], d['pc']) for d in hfdump_lib.scan(data, impl=impl)] == want
+
+
+def test_scan_edges(hfdump_lib):
+    for impl in _impls(hfdump_lib):
+        assert hfdump_lib.scan(b'', impl=impl) == []
+        assert hfdump_lib.scan(b'HF_ADDR', impl=impl) == []
+        tail = b'y' * 40 + b'HF_ADDR PC=0x08001234 LR=0x08000F01'
+        assert [d['pc'] for d in hfdump_lib.scan(tail, impl=impl)] == ['0x08001234']
+
+
+def test_parse_mailbox(hfdump_lib):
+    area = mailbox([bytes(CORRUPT), GOOD], faults=(4, 7))
+    got = hfdump_lib.parse_mailbox(area)
+    assert [(d['pc'], d['fault_count'], d['checksum']) for d in got] == [('0x08004000', 7, 'ok')]
+    assert got[0]['class'] == 'UsageFault:DIVBYZERO'
+    assert got[0]['stack_bytes'] == 32
+
+    assert hfdump_lib.parse_mailbox(area[:200]) == []    # area_size past the end
+    assert hfdump_lib.parse_mailbox(b'\0' * 64) == []
+    bad_abi = area[:4] + b'\x02\x00' + area[6:]
+    assert hfdump_lib.parse_mailbox(bad_abi) == []
+
+
+def test_parse_binary(hfdump_lib):
+    assert hfdump_lib.parse_binary(GOOD)[0]['checksum'] == 'ok'
+    assert hfdump_lib.parse_binary(GOOD[:-1]) == []      # payload cut
+    assert hfdump_lib.parse_binary(GOOD[:100]) == []     # header cut
+    for version in (2, 3):                                # v3: task name length varied
+        old = dump(version=version)
+        assert int.from_bytes(old[:4], 'little') == HF_MAGIC
+        assert hfdump_lib.parse_binary(old) == []
+        assert hfdump_lib.scan(old) == []
+
+
+FULL_TEXT = '''===== HARD FAULT DUMP =====
+Magic: 0x48464450, Ver: 6
+Image: bootloader  Faults recorded: 3
+Soft capture: no fault, the system kept running
+Integrity: heap link at 0x20001000 found 0xDEADBEEF region 0x20000800 task 'net'
+EXC_RETURN: 0xFFFFFFED  MSP: 0x20017F80  PSP: 0x20004A10
+Active SP: 0x20004A10  Used: PSP  FP ctx: YES
+ R0 : 0x00000001  R1 : 0x00000002
+ R12: 0x0000000C  LR : 0x08000F01
+ PC : 0x08001234  PSR: 0x21000000
+CFSR: 0x00008200 (MMFSR=0x00 BFSR=0x82 UFSR=0x0000)
+MMFAR: 0x00000000  BFAR: 0x40011C04
+SP limit: 0x20004000  STACK OVERFLOW  State: Secure
+MSP bottom: 0x20017C00  Max used: 604 bytes  NEAR LIMIT
+ThreadX:
+ Task : 'rx thread'
+ Prio : 3
+ Stack base : 0x20004000
+ Min free   : 12 bytes
+ 'rx thread' min: 12 of 1024  last: 40  lows: 12 (b3 t100)
+Stack dump bytes: 256
+Shadow stack: depth 1  thread 0x20004B00  handler
+ Called from: 0x08002001
+Heap ops: 1 logged, newest first
+ Heap free: 0x20001008 from 0x08003001 ctx 0x20004B00
+HF_ADDR PC=0x08001234 LR=0x08000F01
+===== END HARD FAULT DUMP =====
+'''
+
+
+@pytest.mark.parametrize('prefix', ['', '[   12.345] '])
+def test_parse_text_every_line(hfdump_lib, prefix):
+    """Each label of HardFault_DecodeAndPrint() lands in its field, also with
+    a logger's prefix on every line and CRLF endings."""
+    text = ''.join(f'{prefix}{line}\r\n' for line in FULL_TEXT.splitlines())
+    [d] = hfdump_lib.parse_text(text)
+    assert (d['version'], d['image'], d['fault_count'], d['soft']) == (6, 'bootloader', 3, True)
+    assert d['regs']['exc_return'] == '0xFFFFFFED' and d['regs']['r12'] == '0x0000000C'
+    assert (d['stack'], d['fp_context'], d['fault_address']) == ('PSP', True, '0x40011C04')
+    assert (d['sp_limit'], d['stack_overflow'], d['secure']) == ('0x20004000', True, True)
+    assert d['main_stack'] == {'bottom': '0x20017C00', 'max_used': 604, 'near_limit': True}
+    assert d['task'] == {'rtos': 'ThreadX', 'name': 'rx thread', 'priority': 3,
+                         'stack_base': '0x20004000', 'min_free': 12}
+    assert d['stack_bytes'] == 256
+    if not prefix:                      # table rows are told apart by their leading " '"
+        assert d['task_stacks'][0]['min_free'] == 12
+    assert d['integrity']['kind'] == 'HEAP_LINK' and d['integrity']['task'] == 'net'
+    assert d['shadow_stack']['calls'] == [{'addr': '0x08002001'}]
+    assert d['heap']['ops'][0]['op'] == 'free'